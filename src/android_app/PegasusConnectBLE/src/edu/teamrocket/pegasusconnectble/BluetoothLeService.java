@@ -65,6 +65,7 @@ public class BluetoothLeService extends Service {
     public final static String ACTION_DATA_AVAILABLE = "edu.teamrocket.pegasusconnectble.ACTION_DATA_AVAILABLE";
     public final static String ACTION_DATA_WRITTEN = "edu.teamrocket.pegasusconnectble.ACTION_DATA_WRITTEN";
     public final static String EXTRA_DATA = "edu.teamrocket.pegasusconnectble.EXTRA_DATA";
+    public final static String EXTRA_BYTES = "edu.teamrocket.pegasusconnectble.EXTRA_BYTES";
 
     public final static UUID UUID_MLDP_DATA_PRIVATE_CHARACTERISTIC = UUID.fromString(MainActivity.MLDP_DATA_PRIVATE_CHAR);
     public final static UUID UUID_CHARACTERISTIC_NOTIFICATION_CONFIG = UUID.fromString(MainActivity.CHARACTERISTIC_NOTIFICATION_CONFIG);
@@ -164,6 +165,7 @@ public class BluetoothLeService extends Service {
             if (UUID_MLDP_DATA_PRIVATE_CHARACTERISTIC.equals(characteristic.getUuid())) { //See if this is the correct characteristic 
                 String dataValue = characteristic.getStringValue(0);                    //Get the data (in this case it is a string)
                 intent.putExtra(EXTRA_DATA, dataValue);                                 //Add the data string to the intent
+                intent.putExtra(EXTRA_BYTES, characteristic.getValue());                //And the raw bytes, for binary replies
             }
         }
         else {                                                                          //Did not get an action string we expect 
@@ -42,6 +42,7 @@ public interface Constants {
     public static final int BLUETOOTH_IN = 12;
     
     public static final int START_MESSAGE_READ = 13;
+    public static final int MESSAGE_WRITE_RPC = 14;
 
     // Key names received from the BluetoothService Handler
     public static final String DEVICE_NAME = "device_name";
@@ -0,0 +1,164 @@
+package edu.teamrocket.pegasusconnectble;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Binary ground commands to the flight computer. Request IDs and reply layouts
+ * are documented in thinman_V2/example/src/tasks/rpc.h, and the frames around
+ * them in tasks/frame.h: sync, type, u16 length, u32 arg, payload, CRC-16,
+ * all little-endian.
+ */
+public class GroundRpc {
+
+	public static final int STATUS = 0x01;
+	public static final int FLIGHT = 0x02;
+	public static final int SUBSCRIBE = 0x06;
+	public static final int REPLY = 0x80;
+	public static final int PUSH = 0xc0;
+	// RPC_VERSION the layouts below follow
+	public static final int VERSION = 2;
+
+	private static final int SYNC = 0xd5;
+	private static final int HEADER_SIZE = 8;
+	private static final int MAX_PAYLOAD = 512;
+
+	public static class Frame {
+		public int type;
+		public long arg;			// 0, or the error code of a reply
+		public byte[] payload;
+	}
+
+	public static class Status {
+		public int version;
+		public boolean gps, firingBoard, baro, imu, highg;
+		public int phase;
+		public long uptimeMs;
+
+		public static Status parse(byte[] p) {
+			if (p.length < 7) {
+				return null;
+			}
+			Status s = new Status();
+			s.version = p[0] & 0xff;
+			s.gps = (p[1] & 0x01) != 0;
+			s.firingBoard = (p[1] & 0x02) != 0;
+			s.baro = (p[1] & 0x04) != 0;
+			s.imu = (p[1] & 0x08) != 0;
+			s.highg = (p[1] & 0x10) != 0;
+			s.phase = p[2] & 0xff;
+			s.uptimeMs = getU32(p, 3);
+			return s;
+		}
+	}
+
+	public static class FlightData {
+		public float durationS;
+		public float altitudeM, maxAltitudeM;
+		public float maxAccelerationG;
+		public float speedMs, maxSpeedMs, descentRateMs;
+		public int phase;
+
+		public static FlightData parse(byte[] p) {
+			if (p.length < 23) {
+				return null;
+			}
+			FlightData f = new FlightData();
+			f.durationS = getU32(p, 0) / 1000.0f;
+			f.altitudeM = (int) getU32(p, 4) / 1000.0f;
+			f.maxAltitudeM = (int) getU32(p, 8) / 1000.0f;
+			f.maxAccelerationG = (int) getU32(p, 12) / 1000.0f;
+			f.speedMs = (short) getU16(p, 16) / 10.0f;
+			f.maxSpeedMs = (short) getU16(p, 18) / 10.0f;
+			f.descentRateMs = getU16(p, 20) / 10.0f;
+			f.phase = p[22] & 0xff;
+			return f;
+		}
+	}
+
+	/** Reassembles frames from the MLDP notifications. Text around them is skipped, and a bad frame resyncs on the next sync byte. */
+	public static class Decoder {
+		private byte[] buffer = new byte[HEADER_SIZE + MAX_PAYLOAD + 2];
+		private int count = 0;
+
+		public List<Frame> feed(byte[] data) {
+			List<Frame> frames = new ArrayList<Frame>();
+			if (data == null) {
+				return frames;
+			}
+			for (byte b : data) {
+				if (count == 0 && (b & 0xff) != SYNC) {
+					continue;
+				}
+				buffer[count++] = b;
+				if (count < HEADER_SIZE) {
+					continue;
+				}
+				int length = getU16(buffer, 2);
+				if (length > MAX_PAYLOAD) {
+					count = 0;
+					continue;
+				}
+				if (count < HEADER_SIZE + length + 2) {
+					continue;
+				}
+				count = 0;
+				if (crc16(buffer, 1, HEADER_SIZE - 1 + length) != getU16(buffer, HEADER_SIZE + length)) {
+					continue;
+				}
+				Frame f = new Frame();
+				f.type = buffer[1] & 0xff;
+				f.arg = getU32(buffer, 4);
+				f.payload = new byte[length];
+				System.arraycopy(buffer, HEADER_SIZE, f.payload, 0, length);
+				frames.add(f);
+			}
+			return frames;
+		}
+	}
+
+	public static byte[] request(int command) {
+		return request(command, 0, new byte[0]);
+	}
+
+	public static byte[] request(int command, long arg) {
+		return request(command, arg, new byte[0]);
+	}
+
+	public static byte[] request(int command, long arg, byte[] payload) {
+		byte[] frame = new byte[HEADER_SIZE + payload.length + 2];
+		frame[0] = (byte) SYNC;
+		frame[1] = (byte) command;
+		putU16(frame, 2, payload.length);
+		putU16(frame, 4, (int) arg);
+		putU16(frame, 6, (int) (arg >> 16));
+		System.arraycopy(payload, 0, frame, HEADER_SIZE, payload.length);
+		putU16(frame, HEADER_SIZE + payload.length, crc16(frame, 1, HEADER_SIZE - 1 + payload.length));
+		return frame;
+	}
+
+	// CRC-16/XMODEM, as crc_crc16 on the board
+	static int crc16(byte[] data, int offset, int length) {
+		int crc = 0;
+		for (int i = offset; i < offset + length; i++) {
+			crc ^= (data[i] & 0xff) << 8;
+			for (int bit = 0; bit < 8; bit++) {
+				crc = ((crc & 0x8000) != 0 ? (crc << 1) ^ 0x1021 : crc << 1) & 0xffff;
+			}
+		}
+		return crc;
+	}
+
+	static int getU16(byte[] p, int offset) {
+		return (p[offset] & 0xff) | ((p[offset + 1] & 0xff) << 8);
+	}
+
+	static long getU32(byte[] p, int offset) {
+		return getU16(p, offset) | ((long) getU16(p, offset + 2) << 16);
+	}
+
+	static void putU16(byte[] p, int offset, int value) {
+		p[offset] = (byte) value;
+		p[offset + 1] = (byte) (value >> 8);
+	}
+}
@@ -83,6 +83,8 @@ public class MainActivity extends ActionBarActivity implements
 	public static final int SELECT_DEVICE_BT = 3;
 	
 	public static final int SCAN_PERIOD = 4000;
+	// How often the board pushes flight data while that screen is up
+	public static final int FLIGHT_DATA_PERIOD_MS = 250;
 	private Handler mHandler  = new Handler();
 
 	private BluetoothLeService bService;
@@ -100,6 +102,8 @@ public class MainActivity extends ActionBarActivity implements
 	String input_additive_buffer;
 	String secondary_additive_buffer;
 	boolean complete_message;
+	GroundRpc.Decoder rpcDecoder = new GroundRpc.Decoder();
+	boolean rpcVersionOk;		// The last status reply had GroundRpc.VERSION; flight data waits for it
 	boolean mConnected;
 	public static int current_fragment;
 
@@ -283,6 +287,15 @@ public class MainActivity extends ActionBarActivity implements
 		Message writeMsg = handler.obtainMessage(Constants.MESSAGE_WRITE);
 		Bundle writeBnd = new Bundle();
 		
+		if (current_fragment == Constants.FLIGHT && position != 2 && paired_device != null) {
+			// Leaving flight data; stop the updates
+			Message stopMsg = handler.obtainMessage(Constants.MESSAGE_WRITE_RPC);
+			Bundle stopBnd = new Bundle();
+			stopBnd.putByteArray("data", GroundRpc.request(GroundRpc.SUBSCRIBE, 0));
+			stopMsg.setData(stopBnd);
+			handler.sendMessage(stopMsg);
+		}
+
 		switch (position) {
 		case 0:
 			fm.beginTransaction()
@@ -296,16 +309,17 @@ public class MainActivity extends ActionBarActivity implements
 					.replace(R.id.container, StatusFragment.newInstance(),
 							"Status").commit();
 			if(paired_device != null ) {
-				writeBnd.putString("data", "stat");
-				writeMsg.setData(writeBnd);
-				handler.sendMessage(writeMsg);
+				Message rpcMsg = handler.obtainMessage(Constants.MESSAGE_WRITE_RPC);
+				writeBnd.putByteArray("data", GroundRpc.request(GroundRpc.STATUS));
+				rpcMsg.setData(writeBnd);
+				handler.sendMessage(rpcMsg);
 				
 				handler.postDelayed( new Runnable() {
 					public void run() {
-						Message writeMsg = handler.obtainMessage(Constants.MESSAGE_WRITE);
+						Message writeMsg = handler.obtainMessage(Constants.MESSAGE_WRITE_RPC);
 						Bundle writeBnd = new Bundle();
 						if(paired_device != null ) {
-							writeBnd.putString("data", "stat");
+							writeBnd.putByteArray("data", GroundRpc.request(GroundRpc.STATUS));
 							writeMsg.setData(writeBnd);
 							handler.sendMessage(writeMsg);
 							
@@ -327,31 +341,20 @@ public class MainActivity extends ActionBarActivity implements
 
 			if(paired_device != null ) {
 				current_fragment = Constants.FLIGHT;
-				new Thread( new Runnable() {
-					public void run() {
-						while( current_fragment == Constants.FLIGHT ) {
-							Message writeMsg = handler.obtainMessage(Constants.MESSAGE_WRITE);
-							Bundle writeBnd = new Bundle();
-							writeBnd.putString("data", "fld");
-							writeMsg.setData(writeBnd);
-							handler.sendMessage(writeMsg);
-							try {
-								TimeUnit.MILLISECONDS.sleep(500);
-							}
-							catch(InterruptedException e) {
-								Log.d(TAG, "sleep interrupted");
-							}
-							handler.sendEmptyMessage(Constants.START_MESSAGE_READ);
-							try {
-								TimeUnit.MILLISECONDS.sleep(500);
-							}
-							catch(InterruptedException e) {
-								Log.d(TAG, "sleep interrupted");
-							}
-						}
-					}
-				}).start();
-				
+				// Status first, so the reply layout is checked before any flight data is shown
+				Message statusMsg = handler.obtainMessage(Constants.MESSAGE_WRITE_RPC);
+				Bundle statusBnd = new Bundle();
+				statusBnd.putByteArray("data", GroundRpc.request(GroundRpc.STATUS));
+				statusMsg.setData(statusBnd);
+				handler.sendMessage(statusMsg);
+
+				// The board pushes flight data from here on instead of being polled
+				Message rpcMsg = handler.obtainMessage(Constants.MESSAGE_WRITE_RPC);
+				writeBnd.putByteArray("data", GroundRpc.request(GroundRpc.SUBSCRIBE, FLIGHT_DATA_PERIOD_MS));
+				rpcMsg.setData(writeBnd);
+				handler.sendMessage(rpcMsg);
+
+				handler.sendEmptyMessage(Constants.START_MESSAGE_READ);
 			}
 			
 			break;
@@ -874,6 +877,12 @@ public class MainActivity extends ActionBarActivity implements
 				bService.writeCharacteristic(mDataMLDP);
 				break;
 
+			case Constants.MESSAGE_WRITE_RPC:
+				// A binary request frame, see GroundRpc
+				mDataMLDP.setValue(msg.getData().getByteArray("data"));
+				bService.writeCharacteristic(mDataMLDP);
+				break;
+
 			case Constants.MESSAGE_TOAST:
 				(Toast.makeText(context,
 						"Msg: " + msg.getData().getString(Constants.TOAST),
@@ -908,93 +917,92 @@ public class MainActivity extends ActionBarActivity implements
 		String[] parts = input.split(" ");
 
 		if (parts[0].equals("=F") && parts.length == 8 ) {
-			if (Units == METRIC_UNITS) {
-				Message tmpmsg = currentHandler
-						.obtainMessage(Constants.MESSAGE_FLIGHT_DATA);
-				Bundle bundle = new Bundle();
-				bundle.putString(Constants.MAXALT, parts[1].substring(0, parts[1].indexOf(".") + 3));
-				bundle.putString(Constants.MAXACC, parts[2].substring(0, parts[2].indexOf(".") + 3));
-				bundle.putString(Constants.DESCENT, parts[3].substring(0, parts[3].indexOf(".") + 3));
-				bundle.putString(Constants.DURATION, parts[4].substring(0, parts[4].indexOf(".") + 3));
-				bundle.putString(Constants.MAXSPD, parts[5].substring(0, parts[5].indexOf(".") + 3));
-				bundle.putString(Constants.CURSPD, parts[6].substring(0, parts[6].indexOf(".") + 3));
-				bundle.putString(Constants.CURALT, parts[7].substring(0, parts[7].indexOf(".") + 3));
-				bundle.putInt("units", Units);
-				tmpmsg.setData(bundle);
-
-				currentHandler.sendMessage(tmpmsg);
-			} else {
-				DecimalFormat df = new DecimalFormat("#0.00");
-				Message tmpmsg = currentHandler
-						.obtainMessage(Constants.MESSAGE_FLIGHT_DATA);
-				Bundle bundle = new Bundle();
-				// Convert Meters to Feet
-				bundle.putString(Constants.MAXALT,
-						String.valueOf(df.format(Float.parseFloat(parts[1]) / .3048)));
-				// Already in G's
-				bundle.putString(Constants.MAXACC, parts[2].substring(0, parts[2].indexOf(".") + 3));
-				// Already in G's
-//				bundle.putString(Constants.AVGACC, parts[3].substring(0, parts[3].indexOf(".") + 3));
-				// Convert m/s to fps
-				bundle.putString(Constants.DESCENT, String.valueOf(df.format(Float
-						.parseFloat(parts[3]) * 3.28083989501312)));
-				// Seconds are metric and imperial
-				bundle.putString(Constants.DURATION, parts[4].substring(0, parts[4].indexOf(".") + 3));
-				// Convert m/s to fps
-				bundle.putString(Constants.MAXSPD, String.valueOf(df.format(Float
-						.parseFloat(parts[5]) * 3.28083989501312)));
-				bundle.putString(Constants.CURSPD, String.valueOf(df.format(Float
-						.parseFloat(parts[6]) * 3.28083989501312)));
-				bundle.putString(Constants.CURALT, 
-						String.valueOf(df.format(Float.parseFloat(parts[7]) / .3048)));
-				
-				tmpmsg.setData(bundle);
-
-				currentHandler.sendMessage(tmpmsg);
-			}
+			showFlightData(Float.parseFloat(parts[1]), Float.parseFloat(parts[2]), Float.parseFloat(parts[3]),
+					Float.parseFloat(parts[4]), Float.parseFloat(parts[5]), Float.parseFloat(parts[6]),
+					Float.parseFloat(parts[7]));
 		} else if (parts[0].equals("=P")) {
 			// TODO fill out
 		} else if (parts[0].equals("=S") && parts.length == 6) {
-			Log.i(TAG,  "Handling Status");
-			Message tmp = currentHandler.obtainMessage(Constants.MESSAGE_STATUS_DATA);
-			Bundle bnd = new Bundle();
-			//gps firing baro imu highg
-			if( paired_device_name != null ) {
-				bnd.putChar(Constants.CONNECTED, 'y');
-			}
-			if(parts[1].equals("1")) {
-				bnd.putChar(Constants.GPS_CONNECTED, 'y');
-			}
-			else {
-				bnd.putChar(Constants.GPS_CONNECTED, 'n');
-			}
-			if(parts[2].equals("1")) {
-				bnd.putChar(Constants.FIRING_BOARD_CONNECTED, 'y');
-			}
-			else {
-				bnd.putChar(Constants.FIRING_BOARD_CONNECTED, 'n');
-			}			
-			if(parts[3].equals("1")) {
-				bnd.putChar(Constants.BARO_CONNECTED, 'y');
-			}
-			else {
-				bnd.putChar(Constants.BARO_CONNECTED, 'n');
-			}			
-			if(parts[4].equals("1")) {
-				bnd.putChar(Constants.IMU_CONNECTED, 'y');
+			showStatus(parts[1].equals("1"), parts[2].equals("1"), parts[3].equals("1"), parts[4].equals("1"),
+					parts[5].equals("1"));
+		}
+	}
+
+	// Binary replies to the GroundRpc requests; same displays as the text ones
+	public void processReply(GroundRpc.Frame frame) {
+		if (frame.arg != 0) {
+			Log.e(TAG, "Request " + (frame.type & ~GroundRpc.REPLY) + " failed with error " + frame.arg);
+		} else if (frame.type == (GroundRpc.FLIGHT | GroundRpc.REPLY) || frame.type == (GroundRpc.FLIGHT | GroundRpc.PUSH)) {
+			GroundRpc.FlightData f = GroundRpc.FlightData.parse(frame.payload);
+			if (f != null && rpcVersionOk) {
+				showFlightData(f.maxAltitudeM, f.maxAccelerationG, f.descentRateMs, f.durationS, f.maxSpeedMs,
+						f.speedMs, f.altitudeM);
 			}
-			else {
-				bnd.putChar(Constants.IMU_CONNECTED, 'n');
-			}			
-			if(parts[5].equals("1")) {
-				bnd.putChar(Constants.HIGHG_CONNECTED, 'y');
+		} else if (frame.type == (GroundRpc.STATUS | GroundRpc.REPLY)) {
+			GroundRpc.Status s = GroundRpc.Status.parse(frame.payload);
+			if (s == null) {
+				return;
 			}
-			else {
-				bnd.putChar(Constants.HIGHG_CONNECTED, 'n');
+			rpcVersionOk = s.version == GroundRpc.VERSION;
+			if (!rpcVersionOk) {
+				Log.e(TAG, "Board speaks RPC version " + s.version + ", the app " + GroundRpc.VERSION);
+				Toast.makeText(this, "Flight computer firmware does not match the app (RPC version " + s.version
+						+ ", expected " + GroundRpc.VERSION + ")", Toast.LENGTH_LONG).show();
 			}
-			tmp.setData(bnd);
-			currentHandler.sendMessage(tmp);
+			showStatus(s.gps, s.firingBoard, s.baro, s.imu, s.highg);
+		}
+	}
+
+	// Meters, g, m/s and seconds
+	private void showFlightData(float maxAlt, float maxAcc, float descent, float duration, float maxSpd,
+			float curSpd, float curAlt) {
+		DecimalFormat df = new DecimalFormat("#0.00");
+		Message tmpmsg = currentHandler
+				.obtainMessage(Constants.MESSAGE_FLIGHT_DATA);
+		Bundle bundle = new Bundle();
+		if (Units == METRIC_UNITS) {
+			bundle.putString(Constants.MAXALT, df.format(maxAlt));
+			bundle.putString(Constants.MAXACC, df.format(maxAcc));
+			bundle.putString(Constants.DESCENT, df.format(descent));
+			bundle.putString(Constants.DURATION, df.format(duration));
+			bundle.putString(Constants.MAXSPD, df.format(maxSpd));
+			bundle.putString(Constants.CURSPD, df.format(curSpd));
+			bundle.putString(Constants.CURALT, df.format(curAlt));
+			bundle.putInt("units", Units);
+		} else {
+			// Convert Meters to Feet
+			bundle.putString(Constants.MAXALT, df.format(maxAlt / .3048));
+			// Already in G's
+			bundle.putString(Constants.MAXACC, df.format(maxAcc));
+			// Convert m/s to fps
+			bundle.putString(Constants.DESCENT, df.format(descent * 3.28083989501312));
+			// Seconds are metric and imperial
+			bundle.putString(Constants.DURATION, df.format(duration));
+			// Convert m/s to fps
+			bundle.putString(Constants.MAXSPD, df.format(maxSpd * 3.28083989501312));
+			bundle.putString(Constants.CURSPD, df.format(curSpd * 3.28083989501312));
+			bundle.putString(Constants.CURALT, df.format(curAlt / .3048));
+		}
+		tmpmsg.setData(bundle);
+
+		currentHandler.sendMessage(tmpmsg);
+	}
+
+	private void showStatus(boolean gps, boolean firingBoard, boolean baro, boolean imu, boolean highg) {
+		Log.i(TAG,  "Handling Status");
+		Message tmp = currentHandler.obtainMessage(Constants.MESSAGE_STATUS_DATA);
+		Bundle bnd = new Bundle();
+		//gps firing baro imu highg
+		if( paired_device_name != null ) {
+			bnd.putChar(Constants.CONNECTED, 'y');
 		}
+		bnd.putChar(Constants.GPS_CONNECTED, gps ? 'y' : 'n');
+		bnd.putChar(Constants.FIRING_BOARD_CONNECTED, firingBoard ? 'y' : 'n');
+		bnd.putChar(Constants.BARO_CONNECTED, baro ? 'y' : 'n');
+		bnd.putChar(Constants.IMU_CONNECTED, imu ? 'y' : 'n');
+		bnd.putChar(Constants.HIGHG_CONNECTED, highg ? 'y' : 'n');
+		tmp.setData(bnd);
+		currentHandler.sendMessage(tmp);
 	}
 
 	public void sendMessage(String output) {
@@ -1117,6 +1125,9 @@ public class MainActivity extends ActionBarActivity implements
             
             else if (BluetoothLeService.ACTION_DATA_AVAILABLE.equals(action)) {         //Service has found new data available on BLE device
             	String dataValue = intent.getStringExtra(BluetoothLeService.EXTRA_DATA); //Get the value of the characteristic
+            	for (GroundRpc.Frame frame : rpcDecoder.feed(intent.getByteArrayExtra(BluetoothLeService.EXTRA_BYTES))) {
+            		processReply(frame);                                                    //Binary replies are handled here, text below
+            	}
                 Message msg = handler.obtainMessage(Constants.MESSAGE_READ);
                 Bundle bundle = new Bundle();
                 bundle.putString("data", dataValue);
@@ -0,0 +1,54 @@
+/*
+ * timebase.c
+ *
+ * Safe to call from interrupt handlers; the USI handler stamps fire
+ * requests with timebase_us().
+ */ 
+
+#include "../hardware_config.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "timebase.h"
+
+#define TIMEBASE_PRESCALE 64
+#define TIMEBASE_TOP ((F_CPU / TIMEBASE_PRESCALE / 1000) - 1)
+#define TIMEBASE_US_PER_COUNT (TIMEBASE_PRESCALE * 1000000UL / F_CPU)
+
+static volatile uint32_t timebase_ms_count;
+
+void timebase_init(void) {
+	TCCR0A = _BV(CTC0);
+	OCR0A = TIMEBASE_TOP;
+	TCNT0L = 0;
+	TIMSK |= _BV(OCIE0A);
+	TCCR0B = _BV(CS01) | _BV(CS00); // clk/64
+}
+
+ISR(TIMER0_COMPA_vect) {
+	timebase_ms_count++;
+	timebase_tick(timebase_ms_count);
+}
+
+uint32_t timebase_ms(void) {
+	uint32_t ms;
+	uint8_t sreg = SREG;
+	cli();
+	ms = timebase_ms_count;
+	SREG = sreg;
+	return ms;
+}
+
+uint32_t timebase_us(void) {
+	uint32_t ms;
+	uint8_t count;
+	uint8_t sreg = SREG;
+	cli();
+	ms = timebase_ms_count;
+	count = TCNT0L;
+	// A match that has not been serviced yet (we may be inside another handler) already wrapped the count
+	if ((TIFR & _BV(OCF0A)) && count < (TIMEBASE_TOP / 2)) {
+		ms++;
+	}
+	SREG = sreg;
+	return ms * 1000 + count * TIMEBASE_US_PER_COUNT;
+}
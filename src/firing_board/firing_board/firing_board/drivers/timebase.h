@@ -0,0 +1,21 @@
+/*
+ * timebase.h
+ *
+ * 1 ms tick from Timer0 in 8-bit CTC mode at clk/64. Microsecond
+ * timestamps have the 8 us resolution of the timer count.
+ */ 
+
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#include <stdint.h>
+
+void timebase_init(void);
+uint32_t timebase_ms(void);
+uint32_t timebase_us(void);
+
+// Called from the tick interrupt with the new millisecond count. Defined by the application.
+void timebase_tick(uint32_t ms);
+
+#endif /* TIMEBASE_H_ */
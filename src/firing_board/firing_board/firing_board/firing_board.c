@@ -12,9 +12,11 @@
 #include <util/delay.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/crc16.h>
 #include "error_codes.h"
 #include "drivers/neopixel.h"
 #include "drivers/USI_TWI_Slave.h"
+#include "drivers/timebase.h"
 #include "morse.h"
 
 typedef enum {
@@ -75,25 +77,82 @@ void set_channel_color(uint8_t channel, defined_colors_t color) {
 	update_channel_colors();
 }
 
-void adc_init(void) {
-	ADMUX = 0 | _BV(REFS1); // Enable 2.56V ref
-	ADCSRB = _BV(REFS2);
-	ADCSRA = _BV(ADPS1) | _BV(ADPS0) | _BV(ADPS2);
-	ADCSRA |= _BV(ADEN);
-}
+// Every input is converted in turn from the ADC interrupt. Each result is the sum of
+// ADC_OVERSAMPLE conversions shifted down to 12 bits, two more than a single conversion.
+typedef enum {
+	ADC_INPUT_EXT_BAT,
+	ADC_INPUT_BUS,
+	ADC_INPUT_CHANNEL_1,	// Channels 2-4 follow
+	ADC_INPUT_COUNT = ADC_INPUT_CHANNEL_1 + CHANNELS,
+} adc_input_t;
+
+#define ADC_OVERSAMPLE 16
+#define ADC_OVERSAMPLE_SHIFT 2
+
+static const uint8_t adc_mux[ADC_INPUT_COUNT] = {8, 7, 6, 4, 0, 2};
+// Readers use adc_tables[adc_front]; the interrupt fills the other table and flips
+// adc_front once a whole round is in, so a snapshot never mixes two rounds.
+static volatile uint16_t adc_tables[2][ADC_INPUT_COUNT];
+static volatile uint8_t adc_front;
+static uint8_t adc_input;
+static uint8_t adc_samples;
+static uint16_t adc_sum;
+static bool adc_settling;
 
-uint16_t adc_convert(uint8_t admux) {
+static void adc_select(uint8_t admux) {
 	ADMUX &= ~0b11111;
 	ADCSRB &= ~_BV(MUX5);
 	ADMUX |= admux & 0b11111;
 	if (admux & 0b100000) {
 		ADCSRB |= _BV(MUX5);
 	}
+}
+
+void adc_init(void) {
+	ADMUX = 0 | _BV(REFS1); // Enable 2.56V ref
+	ADCSRB = _BV(REFS2);
+	ADCSRA = _BV(ADPS1) | _BV(ADPS0) | _BV(ADPS2);
+	ADCSRA |= _BV(ADEN) | _BV(ADIE);
+	adc_input = 0;
+	adc_select(adc_mux[adc_input]);
+	adc_settling = true;
 	ADCSRA |= _BV(ADSC);
-	while (!(ADCSRA & _BV(ADIF)));
-	uint16_t result = ADC;
-	ADCSRA |= _BV(ADIF);
-	return result;
+}
+
+// Restarts the next conversion itself rather than free-running, so a mux change
+// applies to exactly the next conversion. That first conversion is discarded.
+ISR(ADC_vect) {
+	uint16_t value = ADC;
+	if (adc_settling) {
+		adc_settling = false;
+	} else {
+		adc_sum += value;
+		adc_samples++;
+	}
+	if (adc_samples == ADC_OVERSAMPLE) {
+		uint8_t back = adc_front ^ 1;
+		adc_tables[back][adc_input] = adc_sum >> ADC_OVERSAMPLE_SHIFT;
+		adc_sum = 0;
+		adc_samples = 0;
+		adc_input++;
+		if (adc_input == ADC_INPUT_COUNT) {
+			adc_input = 0;
+			adc_front = back;
+		}
+		adc_select(adc_mux[adc_input]);
+		adc_settling = true;
+	}
+	ADCSRA |= _BV(ADSC);
+}
+
+// Copy of the latest complete round
+static void adc_snapshot(uint16_t* results) {
+	uint8_t i;
+	cli();
+	for (i = 0; i < ADC_INPUT_COUNT; i++) {
+		results[i] = adc_tables[adc_front][i];
+	}
+	sei();
 }
 
 void init_channels(void) {
@@ -113,26 +172,93 @@ typedef enum {
 	SYSTEM_MODE_FIRING
 } system_mode_t;
 
-#define EXT_BAT_THRES 40 // ~ 1.0V
+// Fire sequence, driven from the 1 ms tick so the arm-to-fire delay does not depend on the main loop
+typedef enum {
+	FIRE_STATE_IDLE,
+	FIRE_STATE_ARMED,	// Waiting out the requested delay
+	FIRE_STATE_PULSE,	// Channel pin asserted
+	FIRE_STATE_DONE,	// Pulse finished; fire_done_us is valid
+} fire_state_t;
+
+#define EXT_BAT_THRES 160 // ~ 1.0V in 12-bit ADC counts
 #define IS_ANY_CHARGE(channel_v, ext_v) (channel_v > (ext_v / 2))
 // Approximately < 10KOhm
 #define IS_UNFIRED_CHARGE(channel_v, ext_v) (channel_v > (ext_v * 9 / 10))
+// Delay for fire requests that carry none, such as the ground test command. Leaves time to see the warning blink.
+#define FIRE_DEFAULT_DELAY_MS 2000
+#define FIRE_MAX_DELAY_MS 10000
+#define FIRE_PULSE_MS 10
 system_mode_t system_mode;
-uint16_t external_bat_volt;
-uint16_t bus_volt;
 uint8_t system_mode;
-uint8_t fire_channel = 0;
+static const uint8_t channel_pins[] = {6, 4, 1, 3};
+static volatile uint8_t fire_state = FIRE_STATE_IDLE;
+static volatile uint8_t fire_channel = 0;
+static volatile uint32_t fire_deadline_ms;
+static volatile uint32_t fire_pulse_end_ms;
+static volatile uint32_t fire_request_us;
+static volatile uint32_t fire_done_us;
+static volatile uint8_t fire_count;	// Pulses since power up; wraps
+
+// Interrupts are disabled in both of these
+static void fire_assert(void) {
+	// Master Arm
+	PORTB &= ~_BV(1);
+	// Channel ARM
+	PORTA |= _BV(channel_pins[fire_channel - 1]);
+	fire_done_us = timebase_us();
+	fire_count++;
+	fire_pulse_end_ms = timebase_ms() + FIRE_PULSE_MS;
+	fire_state = FIRE_STATE_PULSE;
+}
+
+static void fire_release(void) {
+	// Disarm
+	PORTA &= ~_BV(channel_pins[fire_channel - 1]);
+	PORTB |= _BV(1);
+	fire_state = FIRE_STATE_DONE;
+}
+
+void timebase_tick(uint32_t ms) {
+	if (fire_state == FIRE_STATE_ARMED && (int32_t)(ms - fire_deadline_ms) >= 0) {
+		fire_assert();
+	} else if (fire_state == FIRE_STATE_PULSE && (int32_t)(ms - fire_pulse_end_ms) >= 0) {
+		fire_release();
+	}
+}
+
+// Called from the USI interrupt. A zero delay asserts the channel before the reply goes out.
+static bool fire_request(uint8_t channel, uint16_t delay_ms) {
+	if (channel == 0 || channel > CHANNELS || delay_ms > FIRE_MAX_DELAY_MS) return false;
+	if (system_mode != SYSTEM_MODE_READY) return false;
+	if (fire_state == FIRE_STATE_ARMED || fire_state == FIRE_STATE_PULSE) return false;
+	fire_channel = channel;
+	fire_request_us = timebase_us();
+	if (delay_ms == 0) {
+		fire_assert();
+	} else {
+		fire_deadline_ms = timebase_ms() + delay_ms;
+		fire_state = FIRE_STATE_ARMED;
+	}
+	return true;
+}
+
 static void main_loop(void) {
-	static uint8_t channel_mux[] = {6, 4, 0, 2};
-	const static uint8_t channel_pins[] = {6, 4, 1, 3};
+	static uint16_t volts[ADC_INPUT_COUNT];
 	system_mode = SYSTEM_MODE_NO_POWER;
-	static uint16_t counter = 0;
 	for(;;) {
 		uint8_t i;
-		external_bat_volt = adc_convert(8);
-		bus_volt = adc_convert(7);
-		if (external_bat_volt < EXT_BAT_THRES) {
+		uint8_t state = fire_state;
+		uint16_t external_bat_volt;
+		adc_snapshot(volts);
+		external_bat_volt = volts[ADC_INPUT_EXT_BAT];
+		if (external_bat_volt < EXT_BAT_THRES && state != FIRE_STATE_PULSE) {
 			system_mode = SYSTEM_MODE_NO_POWER;
+			// Drop a pending request; the tick interrupt still ends a pulse in progress
+			cli();
+			if (fire_state == FIRE_STATE_ARMED) {
+				fire_state = FIRE_STATE_IDLE;
+			}
+			sei();
 			set_channel_color(CHANNELS, COLOR_DISCONNECTED);
 			_delay_ms(100);
 			set_channel_color(CHANNELS, COLOR_OFF);
@@ -140,69 +266,31 @@ static void main_loop(void) {
 			continue;
 		}
 		
-		if (system_mode == SYSTEM_MODE_NO_POWER) {
+		if (state == FIRE_STATE_ARMED) {
+			system_mode = SYSTEM_MODE_FIRE_READY;
+			if (((timebase_ms() / 100) % 2) == 1) {
+				set_channel_color(fire_channel - 1, COLOR_FIRE_READY_1);
+			} else {
+				set_channel_color(fire_channel - 1, COLOR_FIRE_READY_2);
+			}
+		} else if (state == FIRE_STATE_PULSE) {
+			system_mode = SYSTEM_MODE_FIRING;
+			set_channel_color(fire_channel - 1, COLOR_FIRING);
+		} else {
 			system_mode = SYSTEM_MODE_READY;
-			fire_channel = 0;
-		}
-		
-		if (system_mode != SYSTEM_MODE_FIRING) {			
-			if (system_mode == SYSTEM_MODE_READY) {
-				for (i = 0; i < CHANNELS; i++) {
-					uint16_t result = adc_convert(channel_mux[i]);
-
-					if (IS_UNFIRED_CHARGE(result, external_bat_volt)) {
-						set_channel_color(i, COLOR_CONNECTED_READY);
-					} else if (IS_ANY_CHARGE(result, external_bat_volt)) {
-						set_channel_color(i, COLOR_FIRED);
-					} else {
-						set_channel_color(i, COLOR_DISCONNECTED);
-					}
-				}
+			for (i = 0; i < CHANNELS; i++) {
+				uint16_t result = volts[ADC_INPUT_CHANNEL_1 + i];
 
-				if (fire_channel > 0 && fire_channel <= CHANNELS) {
-					system_mode = SYSTEM_MODE_FIRE_READY;
-					counter = 0;
+				if (IS_UNFIRED_CHARGE(result, external_bat_volt)) {
+					set_channel_color(i, COLOR_CONNECTED_READY);
+				} else if (IS_ANY_CHARGE(result, external_bat_volt)) {
+					set_channel_color(i, COLOR_FIRED);
 				} else {
-					fire_channel = 0;
+					set_channel_color(i, COLOR_DISCONNECTED);
 				}
-			} else if (system_mode == SYSTEM_MODE_FIRE_READY) {
-				if (fire_channel == 0 || fire_channel > CHANNELS) {
-					system_mode = SYSTEM_MODE_READY;
-					fire_channel = 0;
-				} else {
-					if (((counter / 100) % 2) == 1) {
-						set_channel_color(fire_channel - 1, COLOR_FIRE_READY_1);
-					} else {
-						set_channel_color(fire_channel - 1, COLOR_FIRE_READY_2);
-					}
-					if (counter >= 2000) {
-						system_mode = SYSTEM_MODE_FIRING;
-					}
-				}
-			}
-			
-			_delay_ms(1);
-		} else if (system_mode == SYSTEM_MODE_FIRING) {
-			uint8_t temp_chan = fire_channel;
-			set_channel_color(fire_channel - 1, COLOR_FIRING);
-			fire_channel = 0;
-			if (temp_chan > 0 && temp_chan <= CHANNELS) {
-				temp_chan -= 1;
-				// Master Arm
-				PORTB &= ~_BV(1);
-			
-				// Channel ARM
-				PORTA |= _BV(channel_pins[temp_chan]);
-				_delay_ms(10);
-				
-				// Disarm
-				PORTA &= ~_BV(channel_pins[temp_chan]);
-			
-				PORTB |= _BV(1);
 			}
-			system_mode = SYSTEM_MODE_READY;
 		}
-		counter ++;
+		_delay_ms(1);
 	}
 }
 
@@ -213,8 +301,42 @@ typedef enum {
 	I2C_COMMAND_READ_VOLTS,
 	I2C_COMMAND_READ_SYSTEM_MODE,
 	I2C_COMMAND_FIRE,
+	I2C_COMMAND_READ_FIRE_STATUS,
+	I2C_COMMAND_READ_STATUS_BLOCK,
 } i2c_command_t;
 
+static void usi_twi_tranmit_uint32_nb(uint32_t value) {
+	usi_twi_tranmit_uint16_nb(value);
+	usi_twi_tranmit_uint16_nb(value >> 16);
+}
+
+// Sends b and folds it into the status block CRC
+static void status_block_transmit(uint8_t b, uint16_t* crc) {
+	usi_twi_tranmit_byte_non_blocking(b);
+	*crc = _crc_xmodem_update(*crc, b);
+}
+
+// Everything the flight computer polls, in 13 bytes so it fits the TX ring with the result byte:
+// the ADC_INPUT_COUNT 12-bit values packed two per three bytes (low value first, little endian),
+// system_mode, fire_count, then CRC-16/XMODEM of the preceding bytes, little endian.
+static void transmit_status_block(void) {
+	uint8_t i;
+	uint16_t crc = 0;
+	// Interrupts do not nest, so adc_front cannot flip here
+	const volatile uint16_t* volts = adc_tables[adc_front];
+	usi_twi_tranmit_byte_non_blocking(0x00);
+	for (i = 0; i < ADC_INPUT_COUNT; i += 2) {
+		uint16_t first = volts[i];
+		uint16_t second = volts[i + 1];
+		status_block_transmit(first, &crc);
+		status_block_transmit(((first >> 8) & 0x0f) | (second << 4), &crc);
+		status_block_transmit(second >> 4, &crc);
+	}
+	status_block_transmit(system_mode, &crc);
+	status_block_transmit(fire_count, &crc);
+	usi_twi_tranmit_uint16_nb(crc);
+}
+
 void handle_i2c_command_non_blocking(void) {
 	// This method should be as fast as possible, must not hold for too long or I2C read to this address will block the SCK clock line extremely long
 	int16_t command = usi_twi_receive_byte_non_blocking();
@@ -222,13 +344,14 @@ void handle_i2c_command_non_blocking(void) {
 		usi_twi_tranmit_byte_non_blocking(0x00);
 		usi_twi_tranmit_byte_non_blocking(DEVICE_ID);
 	} else if (command == I2C_COMMAND_READ_VOLTS) {
+		// 12-bit oversampled counts from the last complete ADC round; interrupts do not nest, so the table cannot flip here
 		uint16_t result_value = 0;
 		switch(usi_twi_receive_byte_non_blocking()) {
 			case 0:
-				result_value = external_bat_volt;
+				result_value = adc_tables[adc_front][ADC_INPUT_EXT_BAT];
 				break;
 			case 1:
-				result_value = bus_volt;
+				result_value = adc_tables[adc_front][ADC_INPUT_BUS];
 				break;
 			default:
 				usi_twi_tranmit_byte_non_blocking(0x01);
@@ -240,18 +363,37 @@ void handle_i2c_command_non_blocking(void) {
 		usi_twi_tranmit_byte_non_blocking(0x00);
 		usi_twi_tranmit_byte_non_blocking(system_mode);
 	} else if (command == I2C_COMMAND_FIRE) {
+		// Arguments: channel, then an optional little-endian arm-to-fire delay in ms
 		int16_t channel = usi_twi_receive_byte_non_blocking();
-		fire_channel = channel;
-		if (channel > 0 && channel <= CHANNELS) {
+		int16_t delay_low = usi_twi_receive_byte_non_blocking();
+		int16_t delay_high = usi_twi_receive_byte_non_blocking();
+		uint16_t delay_ms = FIRE_DEFAULT_DELAY_MS;
+		if (delay_low >= 0 && delay_high >= 0) {
+			delay_ms = delay_low | (delay_high << 8);
+		}
+		if (channel > 0 && fire_request(channel, delay_ms)) {
 			usi_twi_tranmit_byte_non_blocking(0x00);
 		} else {
 			usi_twi_tranmit_byte_non_blocking(0x01);
 		}
+	} else if (command == I2C_COMMAND_READ_FIRE_STATUS) {
+		// 14 bytes: channel, fire_state_t, request time, pin assert time, current time; all in us
+		usi_twi_tranmit_byte_non_blocking(0x00);
+		usi_twi_tranmit_byte_non_blocking(fire_channel);
+		usi_twi_tranmit_byte_non_blocking(fire_state);
+		usi_twi_tranmit_uint32_nb(fire_request_us);
+		usi_twi_tranmit_uint32_nb(fire_done_us);
+		usi_twi_tranmit_uint32_nb(timebase_us());
+	} else if (command == I2C_COMMAND_READ_STATUS_BLOCK) {
+		transmit_status_block();
 	} else {
 		usi_twi_tranmit_byte_non_blocking(0x01);
 	}
 }
 
+// Built with FIRING_BOARD_HOST, the rest of this file runs on the host under
+// fire_check.py (src/thinman_V2), which plays the I2C master and the tick
+#ifndef FIRING_BOARD_HOST
 int main(void)
 {
 	system_mode = SYSTEM_MODE_BOOTING;
@@ -273,10 +415,12 @@ int main(void)
 
 	update_channel_colors();
 	adc_init();
+	timebase_init();
 	USI_TWI_Slave_Initialise(12);
 	
 	sei();
 
 	main_loop();	
 	blink_error_code(ERROR_CODE_MAINLOOP_FALL_THRU);
-}
\ No newline at end of file
+}
+#endif
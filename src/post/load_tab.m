@@ -0,0 +1,59 @@
+function data = load_tab(filename)
+% Load a TAB log written by the flight computer. Newer firmware logs raw
+% sensor counts with the scale in a '%' header line; those are converted
+% back to the columns calc_stats expects (t in ms):
+%   baro:  [t temp_C alt_m]
+%   imu:   [t ax ay az (g) gx gy gz (dps) mx my mz (gauss)], followed by
+%          q0 q1 q2 q3 in files from firmware that logged the attitude
+%   highg: [t ax ay az (g)]
+% Files without a header are returned as loaded.
+
+data = load(filename);
+
+fid = fopen(filename);
+header = fgetl(fid);
+fclose(fid);
+if ~ischar(header) || isempty(header) || header(1) ~= '%'
+    return;
+end
+
+scale = struct();
+tokens = regexp(header, '(\w+)=([\w.\-]+)', 'tokens');
+for k = 1:numel(tokens)
+    value = str2double(tokens{k}{2});
+    if isnan(value)
+        value = tokens{k}{2};
+    end
+    scale.(tokens{k}{1}) = value;
+end
+
+% Timestamps logged in microseconds from the 32-bit CT32B0 timebase wrap
+% every ~71.6 minutes; unwrap and convert to ms to match older files.
+% Rows flushed from the pre-trigger ring at launch follow the pad-rate rows
+% they overlap, so only large backwards steps are wraps, and rows are
+% sorted afterwards.
+if isfield(scale, 't_unit') && strcmp(scale.t_unit, 'us')
+    dt = diff(data(:,1));
+    dt(dt < -2^31) = dt(dt < -2^31) + 2^32;
+    data(:,1) = cumsum([data(1,1); dt]) / 1000;
+end
+data = sortrows(data, 1);
+
+switch scale.kind
+    case 'baro'
+        temp = scale.temp_offset_mdegc / 1000 + data(:,2) / scale.temp_counts_per_degc;
+        p = data(:,3) / scale.pressure_counts_per_mbar;
+        alt = (1 - (p / 1013.25).^0.190263) * 44330.8;
+        data = [data(:,1) temp alt];
+    case 'imu'
+        data(:,2:4) = data(:,2:4) * scale.a_fs_mg / 1000 / scale.full_scale_counts;
+        data(:,5:7) = data(:,5:7) * scale.g_fs_mdps / 1000 / scale.full_scale_counts;
+        data(:,8:10) = data(:,8:10) * scale.m_fs_mgauss / 1000 / scale.full_scale_counts;
+        if isfield(scale, 'q_one')
+            data(:,11:14) = data(:,11:14) / scale.q_one;
+        end
+    case 'highg'
+        data(:,2:4) = data(:,2:4) * scale.a_fs_mg / 1000 / scale.full_scale_counts;
+end
+
+end
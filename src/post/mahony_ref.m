@@ -0,0 +1,78 @@
+function q = mahony_ref(imu)
+% Floating point reference for the on-board fixed-point attitude filter
+% (thinman_V2 flight/attitude.c). Same gains, accelerometer gate and
+% magnetometer axis remap, so the two should agree to a fraction of a
+% degree apart from samples sitting right on the 1g +/- 15% gate.
+%   imu: [t_ms ax ay az (g) gx gy gz (dps) mx my mz (gauss)], as from load_tab
+%   q:   N x 4 quaternion [q0 q1 q2 q3] after each sample
+
+% Parameters (match attitude.c)
+two_kp = 1.0;
+two_ki = 0.0;
+two_kp_init = 10.0;
+init_time = 2.0;
+max_dt = 0.1;
+accel_gate = 0.15;
+max_half_step = 0.5;
+
+n = size(imu,1);
+q = zeros(n,4);
+qe = [1 0 0 0];
+integral = [0 0 0];
+init_remaining = init_time;
+
+for i = 1:n
+    if i == 1
+        dt = 0;
+    else
+        dt = min((imu(i,1) - imu(i-1,1)) / 1000, max_dt);
+    end
+    if init_remaining > dt
+        init_remaining = init_remaining - dt;
+        kp = two_kp_init;
+    else
+        init_remaining = 0;
+        kp = two_kp;
+    end
+
+    a = imu(i,2:4);
+    g = imu(i,5:7) * pi / 180;
+    % LSM9DS1 magnetometer axes are rotated against the accel/gyro axes
+    m = [-imu(i,9) -imu(i,8) imu(i,10)];
+    q0 = qe(1); q1 = qe(2); q2 = qe(3); q3 = qe(4);
+    halfe = [0 0 0];
+
+    if abs(norm(a) - 1) <= accel_gate
+        a = a / norm(a);
+        halfv = [q1*q3 - q0*q2, q0*q1 + q2*q3, q0*q0 - 0.5 + q3*q3];
+        halfe = halfe + cross(a, halfv);
+    end
+
+    if norm(m) > 0
+        m = m / norm(m);
+        hx = 2 * (m(1)*(0.5 - q2*q2 - q3*q3) + m(2)*(q1*q2 - q0*q3) + m(3)*(q1*q3 + q0*q2));
+        hy = 2 * (m(1)*(q1*q2 + q0*q3) + m(2)*(0.5 - q1*q1 - q3*q3) + m(3)*(q2*q3 - q0*q1));
+        bz = 2 * (m(1)*(q1*q3 - q0*q2) + m(2)*(q2*q3 + q0*q1) + m(3)*(0.5 - q1*q1 - q2*q2));
+        bx = sqrt(hx*hx + hy*hy);
+        halfw = [bx*(0.5 - q2*q2 - q3*q3) + bz*(q1*q3 - q0*q2), ...
+                 bx*(q1*q2 - q0*q3) + bz*(q0*q1 + q2*q3), ...
+                 bx*(q0*q2 + q1*q3) + bz*(0.5 - q1*q1 - q2*q2)];
+        halfe = halfe + cross(m, halfw);
+    end
+
+    if two_ki > 0
+        integral = integral + two_ki * halfe * dt;
+        g = g + integral;
+    end
+    g = g + kp * halfe;
+
+    h = min(max(g * 0.5 * dt, -max_half_step), max_half_step);
+    qe = qe + [-q1*h(1) - q2*h(2) - q3*h(3), ...
+                q0*h(1) + q2*h(3) - q3*h(2), ...
+                q0*h(2) - q1*h(3) + q3*h(1), ...
+                q0*h(3) + q1*h(2) - q2*h(1)];
+    qe = qe / norm(qe);
+    q(i,:) = qe;
+end
+
+end
@@ -0,0 +1,42 @@
+function err_deg = replay_attitude(filename, tolerance_deg)
+% Replays an IMU TAB file through mahony_ref. Files logged with the
+% on-board quaternion (q0..q3 columns) are compared sample by sample and
+% the replay fails if any sample is off by more than tolerance_deg.
+% Older files (e.g. testing/flights/flight3/IMU10.TAB) only have the
+% reference attitude plotted; thinman_V2/attitude_replay.py runs any IMU
+% file through the compiled attitude.c and checks it against this filter.
+
+if nargin < 2
+    tolerance_deg = 1;
+end
+
+imu = load_tab(filename);
+q_ref = mahony_ref(imu(:,1:10));
+t = (imu(:,1) - imu(1,1)) / 1000;
+
+% Tilt of board +x ("this side up") from vertical
+tilt = acosd(max(min(2 * (q_ref(:,2).*q_ref(:,4) - q_ref(:,1).*q_ref(:,3)), 1), -1));
+
+if size(imu,2) < 14
+    err_deg = [];
+    plot(t, tilt);
+    xlabel('time (s)');
+    ylabel('tilt from vertical (deg)');
+    title(filename);
+    return;
+end
+
+q_fw = imu(:,11:14);
+err_deg = 2 * acosd(min(abs(sum(q_ref .* q_fw, 2)), 1));
+fprintf('%s: max %.3f deg, mean %.3f deg over %d samples\n', filename, max(err_deg), mean(err_deg), numel(err_deg));
+
+plot(t, err_deg);
+xlabel('time (s)');
+ylabel('on-board vs reference (deg)');
+title(filename);
+
+if max(err_deg) > tolerance_deg
+    error('replay_attitude: on-board attitude differs from reference by %.3f deg', max(err_deg));
+end
+
+end
@@ -0,0 +1,223 @@
+# Replays an IMU TAB file through the attitude filter that flies
+# (example/src/flight/attitude.c), compiled for the host with host_build
+# and driven through ctypes, and through a floating point port of
+# post/mahony_ref.m, and compares the two sample by sample.
+#
+#   python attitude_replay.py [TAB] [--tolerance DEG] [--a-fs-mg N] [--g-fs-mdps N] [--m-fs-mgauss N]
+#
+# TAB defaults to testing/flights/flight3/IMU10.TAB. Files with a '%' header
+# are raw counts with the full scales in the header, as tasks/storage.c
+# writes them. Older files are in g, dps and gauss; they are turned back
+# into the counts the LSM gave, taking for each sensor the largest full
+# scale that makes every reading a whole count, unless it is given.
+#
+# Both filters see the same counts and time steps. The reference gates the
+# accelerometer on the same integer bounds attitude_init works out, so a
+# sample right on 1 g +/- 15% is not taken by one and refused by the other;
+# what is left is the fixed point rounding. Fails, exiting non-zero, if the
+# two are more than tolerance degrees apart at any sample.
+import argparse
+import ctypes
+import math
+import os
+import sys
+import host_build
+
+FULL_SCALE_COUNTS = 32768
+Q_ONE = float(1 << 30)      # ATTITUDE_Q_ONE
+DEFAULT_TAB = os.path.join(host_build.HERE, '..', '..', 'testing', 'flights', 'flight3', 'IMU10.TAB')
+
+# Full scales the LSM has been run at, per sensor, in the header's units
+SCALES = [('a_fs_mg', [2000, 4000, 8000, 16000, 24000]),
+          ('g_fs_mdps', [245000, 500000, 2000000]),
+          ('m_fs_mgauss', [4000, 8000, 12000, 16000])]
+
+# attitude.c's parameters, as in mahony_ref.m
+TWO_KP = 1.0
+TWO_KP_INIT = 10.0
+INIT_S = 2.0
+MAX_DT_S = 0.1
+GATE_PCT = 15
+MAX_HALF_STEP = 0.5
+
+
+class Quat(ctypes.Structure):
+    _fields_ = [('q0', ctypes.c_int32), ('q1', ctypes.c_int32), ('q2', ctypes.c_int32), ('q3', ctypes.c_int32)]
+
+
+lib = host_build.load(['flight/attitude.c', 'host/host.c'], defines=['CYCLES_HOST'])
+Vector = ctypes.c_int16 * 3
+
+
+def counts(value, fs):
+    return value * FULL_SCALE_COUNTS * 1000.0 / fs
+
+
+def infer_scale(rows, columns, candidates):
+    """Largest full scale that turns every reading into whole counts, or None."""
+    for fs in sorted(candidates, reverse=True):
+        if all(abs(counts(row[c], fs) - round(counts(row[c], fs))) < 0.05 for row in rows for c in columns):
+            return fs
+    return None
+
+
+def load(filename, given):
+    """Rows of [t_us, ax, ay, az, gx, gy, gz, mx, my, mz] in counts, the scales, and whether any was inferred."""
+    header = None
+    rows = []
+    for line in open(filename):
+        if line.startswith('%'):
+            header = dict(token.split('=', 1) for token in line.split() if '=' in token)
+        elif line.strip():
+            rows.append([float(v) for v in line.split()[:10]])
+    scales = {}
+    inferred = False
+    if header is not None:
+        if int(header.get('full_scale_counts', FULL_SCALE_COUNTS)) != FULL_SCALE_COUNTS:
+            sys.exit('%s: full_scale_counts %s, expected %d' % (filename, header['full_scale_counts'],
+                                                                FULL_SCALE_COUNTS))
+        for name, candidates in SCALES:
+            scales[name] = given[name] or int(header[name])
+        # 32-bit microsecond time stamps; unwrap, then put the flushed pre-trigger rows in place
+        last, base = None, 0
+        for row in rows:
+            if last is not None and row[0] - last < -2 ** 31:
+                base += 2 ** 32
+            last = row[0]
+            row[0] += base
+        rows.sort(key=lambda row: row[0])
+        return [[int(v) for v in row] for row in rows], scales, inferred
+    for column, (name, candidates) in zip((1, 4, 7), SCALES):
+        scales[name] = given[name]
+        if not scales[name]:
+            scales[name] = infer_scale(rows, range(column, column + 3), candidates)
+            inferred = True
+            if scales[name] is None:
+                sys.exit('%s: no %s of %s gives whole counts; give it' % (filename, name, candidates))
+    out = []
+    for row in rows:
+        out.append([int(round(row[0] * 1000))] +
+                   [int(round(counts(v, scales['a_fs_mg']))) for v in row[1:4]] +
+                   [int(round(counts(v, scales['g_fs_mdps']))) for v in row[4:7]] +
+                   [int(round(counts(v, scales['m_fs_mgauss']))) for v in row[7:10]])
+    return out, scales, inferred
+
+
+def clamp16(values):
+    return Vector(*[max(-32768, min(32767, v)) for v in values])
+
+
+def replay_fixed(rows, scales):
+    """The on-board filter's quaternion after each row."""
+    lib.attitude_init(scales['g_fs_mdps'], scales['a_fs_mg'])
+    out = []
+    q = Quat()
+    last = None
+    for row in rows:
+        dt_us = 0 if last is None else row[0] - last
+        last = row[0]
+        lib.attitude_update(clamp16(row[4:7]), clamp16(row[1:4]), clamp16(row[7:10]), dt_us)
+        lib.attitude_get(ctypes.byref(q))
+        out.append((q.q0 / Q_ONE, q.q1 / Q_ONE, q.q2 / Q_ONE, q.q3 / Q_ONE))
+    return out
+
+
+def cross(a, b):
+    return [a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]]
+
+
+def unit(v):
+    n = math.sqrt(sum(x * x for x in v))
+    return [x / n for x in v] if n > 0 else None
+
+
+def replay_reference(rows, scales):
+    """mahony_ref.m's quaternion after each row, and how many rows passed the accelerometer gate."""
+    counts_per_g = FULL_SCALE_COUNTS * 1000 // scales['a_fs_mg']
+    low = counts_per_g * (100 - GATE_PCT) // 100
+    high = counts_per_g * (100 + GATE_PCT) // 100
+    rad_per_count = scales['g_fs_mdps'] / 1000.0 / FULL_SCALE_COUNTS * math.pi / 180
+    qe = [1.0, 0.0, 0.0, 0.0]
+    init_remaining = INIT_S
+    out = []
+    gated = 0
+    last = None
+    for row in rows:
+        dt = 0.0 if last is None else min((row[0] - last) / 1e6, MAX_DT_S)
+        last = row[0]
+        if init_remaining > dt:
+            init_remaining -= dt
+            kp = TWO_KP_INIT
+        else:
+            init_remaining = 0
+            kp = TWO_KP
+        q0, q1, q2, q3 = qe
+        halfe = [0.0, 0.0, 0.0]
+        if low * low <= sum(v * v for v in row[1:4]) <= high * high:
+            gated += 1
+            a = unit(row[1:4])
+            halfv = [q1 * q3 - q0 * q2, q0 * q1 + q2 * q3, q0 * q0 - 0.5 + q3 * q3]
+            halfe = [e + c for e, c in zip(halfe, cross(a, halfv))]
+        # LSM9DS1 magnetometer axes are rotated against the accel/gyro axes
+        m = unit([-row[8], -row[7], row[9]])
+        if m is not None:
+            hx = 2 * (m[0] * (0.5 - q2 * q2 - q3 * q3) + m[1] * (q1 * q2 - q0 * q3) + m[2] * (q1 * q3 + q0 * q2))
+            hy = 2 * (m[0] * (q1 * q2 + q0 * q3) + m[1] * (0.5 - q1 * q1 - q3 * q3) + m[2] * (q2 * q3 - q0 * q1))
+            bz = 2 * (m[0] * (q1 * q3 - q0 * q2) + m[1] * (q2 * q3 + q0 * q1) + m[2] * (0.5 - q1 * q1 - q2 * q2))
+            bx = math.sqrt(hx * hx + hy * hy)
+            halfw = [bx * (0.5 - q2 * q2 - q3 * q3) + bz * (q1 * q3 - q0 * q2),
+                     bx * (q1 * q2 - q0 * q3) + bz * (q0 * q1 + q2 * q3),
+                     bx * (q0 * q2 + q1 * q3) + bz * (0.5 - q1 * q1 - q2 * q2)]
+            halfe = [e + c for e, c in zip(halfe, cross(m, halfw))]
+        g = [v * rad_per_count + kp * e for v, e in zip(row[4:7], halfe)]
+        h = [min(max(v * 0.5 * dt, -MAX_HALF_STEP), MAX_HALF_STEP) for v in g]
+        qe = [q0 - q1 * h[0] - q2 * h[1] - q3 * h[2],
+              q1 + q0 * h[0] + q2 * h[2] - q3 * h[1],
+              q2 + q0 * h[1] - q1 * h[2] + q3 * h[0],
+              q3 + q0 * h[2] + q1 * h[1] - q2 * h[0]]
+        qe = unit(qe)
+        out.append(tuple(qe))
+    return out, gated
+
+
+def angle_deg(a, b):
+    return 2 * math.degrees(math.acos(min(abs(sum(x * y for x, y in zip(a, b))), 1.0)))
+
+
+def tilt_deg(q):
+    """Angle of board +x from vertical, as attitude_vertical_cos gives it."""
+    return math.degrees(math.acos(max(min(2 * (q[1] * q[3] - q[0] * q[2]), 1.0), -1.0)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Replay an IMU log through the on-board attitude filter')
+    parser.add_argument('tab', nargs='?', default=DEFAULT_TAB)
+    parser.add_argument('--tolerance', type=float, default=1.0, help='most degrees the two may differ by')
+    for name, candidates in SCALES:
+        parser.add_argument('--' + name.replace('_', '-'), dest=name, type=int, default=0,
+                            help='full scale for a file without a header')
+    opts = parser.parse_args()
+    rows, scales, inferred = load(opts.tab, vars(opts))
+    if len(rows) < 2:
+        sys.exit('%s: no samples' % opts.tab)
+    fixed = replay_fixed(rows, scales)
+    reference, gated = replay_reference(rows, scales)
+
+    errors = [angle_deg(a, b) for a, b in zip(fixed, reference)]
+    worst = max(range(len(errors)), key=lambda i: errors[i])
+    tilts = [tilt_deg(q) for q in fixed]
+    print '%s: %d samples over %.1f s' % (os.path.basename(opts.tab), len(rows), (rows[-1][0] - rows[0][0]) / 1e6)
+    print 'full scales%s: accel %d mg, gyro %d mdps, mag %d mgauss' % (
+        ' (inferred)' if inferred else '', scales['a_fs_mg'], scales['g_fs_mdps'], scales['m_fs_mgauss'])
+    print 'accelerometer within 1 g +/- %d%%: %.1f%% of samples' % (GATE_PCT, 100.0 * gated / len(rows))
+    print 'tilt from vertical: %.1f to %.1f deg' % (min(tilts), max(tilts))
+    print 'on-board vs reference: max %.3f deg at %.2f s, mean %.3f deg' % (
+        errors[worst], (rows[worst][0] - rows[0][0]) / 1e6, sum(errors) / len(errors))
+    ok = errors[worst] <= opts.tolerance
+    print 'result: ' + ('ok' if ok else 'BAD, over %.3f deg' % opts.tolerance)
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,212 @@
+# Checks the integer decimators (example/src/flight/decimate.c) against a
+# floating point reference. decimate.c is compiled for the host with
+# host_build and driven through ctypes; the reference is the same CIC and
+# half-band cascade with unquantized taps and no rounding.
+#
+#   python decimate_check.py [--factor N ...] [--points N]
+#
+# For each factor it checks:
+#   - the reference keeps the passband, to 0.35 of the output rate, within
+#     PASSBAND_DROOP_DB, and puts every input that would alias into it at
+#     least ALIAS_REJECTION_DB down
+#   - tones swept from DC to the input Nyquist come out of the C with the
+#     gain and phase of the reference, within GAIN_TOLERANCE_DB, or below
+#     the alias limit where the reference is
+#   - a constant comes through exactly from the first output after a change
+#     of factor, and a full-scale square wave does not wrap
+#   - outputs lag the input by decimate_delay_us
+# Exits non-zero on any failure.
+import argparse
+import cmath
+import ctypes
+import math
+import sys
+import host_build
+
+CIC_ORDER = 4
+HB_TAPS = 15
+HB_RING = 16
+HB_CENTRE = HB_TAPS // 2
+# The equiripple design the Q15 taps were rounded from, stopband from 0.325
+HB_FLOAT = [0.3114067602, -0.0843004128, 0.0339465977, -0.0110530770]
+
+PASSBAND = 0.35             # Of the output rate
+PASSBAND_DROOP_DB = 1.8
+ALIAS_REJECTION_DB = 44.0
+GAIN_TOLERANCE_DB = 0.05
+AMPLITUDE = 20000
+
+
+class Channel(ctypes.Structure):
+    _fields_ = [('integrator', ctypes.c_uint32 * CIC_ORDER),
+                ('comb', ctypes.c_uint32 * CIC_ORDER),
+                ('ring', ctypes.c_int16 * HB_RING)]
+
+
+class DecimatorT(ctypes.Structure):
+    _fields_ = [('channels', ctypes.c_uint8), ('factor', ctypes.c_uint8),
+                ('cic_shift', ctypes.c_uint8), ('cic_count', ctypes.c_uint8),
+                ('head', ctypes.c_uint8), ('odd', ctypes.c_bool), ('primed', ctypes.c_bool),
+                ('cycles_max', ctypes.c_uint32), ('cycles_budget', ctypes.c_uint32),
+                ('channel', ctypes.POINTER(Channel))]
+
+
+lib = host_build.load(['flight/decimate.c'], defines=['CYCLES_HOST'])
+lib.decimate_push.restype = ctypes.c_bool
+lib.decimate_delay_us.restype = ctypes.c_uint32
+
+
+class Decimator(object):
+    """decimator_t and its functions, for one or more channels."""
+    def __init__(self, channels, factor):
+        self.channels = channels
+        self.d = DecimatorT()
+        self.state = (Channel * channels)()
+        self.x = (ctypes.c_int16 * channels)()
+        self.y = (ctypes.c_int16 * channels)()
+        lib.decimate_init(ctypes.byref(self.d), channels, self.state, factor)
+
+    def set_factor(self, factor):
+        lib.decimate_set_factor(ctypes.byref(self.d), factor)
+
+    def push(self, x):
+        """Returns the outputs, or None."""
+        self.x[:] = x
+        if lib.decimate_push(ctypes.byref(self.d), self.x, self.y):
+            return list(self.y)
+        return None
+
+    def delay_us(self, period_us):
+        return lib.decimate_delay_us(ctypes.byref(self.d), period_us)
+
+
+def reference_response(factor, f):
+    """Complex gain of the float cascade at f cycles per input sample."""
+    if factor <= 1:
+        return 1.0
+    rate = max(factor // 2, 1)
+    cic = 1.0
+    if rate > 1:
+        if abs(math.sin(math.pi * f)) < 1e-12:
+            cic = 1.0 if abs(round(f) - f) < 1e-12 else 0.0
+        else:
+            cic = (cmath.exp(-1j * math.pi * f * (rate - 1)) * math.sin(math.pi * f * rate) /
+                   (rate * math.sin(math.pi * f))) ** CIC_ORDER
+    g = f * rate
+    hb = 0.5 + 2 * sum(tap * math.cos(2 * math.pi * g * (2 * k + 1)) for k, tap in enumerate(HB_FLOAT))
+    return cic * hb * cmath.exp(-2j * math.pi * g * HB_CENTRE)
+
+
+def db(x):
+    return 20 * math.log10(max(abs(x), 1e-12))
+
+
+def check_design(factor, points):
+    """Passband droop and alias rejection of the reference."""
+    out_rate = 1.0 / factor
+    edge = PASSBAND * out_rate
+    droop = min(db(reference_response(factor, edge * i / points)) for i in range(points + 1))
+    worst = -200.0
+    k = 1
+    while k * out_rate - edge < 0.5:
+        for i in range(points + 1):
+            f = k * out_rate - edge + 2 * edge * i / points
+            if 0 < f <= 0.5:
+                worst = max(worst, db(reference_response(factor, f)))
+        k += 1
+    return -droop, -worst
+
+
+def measure(factor, f, length):
+    """Complex gain of the C for a tone at f, against the newest input at each output."""
+    # A cosine and a sine on two channels make up exp(j 2 pi f n), so the
+    # tone's mirror image at -f, which aliases elsewhere, drops out
+    d = Decimator(2, factor)
+    outputs = []
+    for n in range(length):
+        x = cmath.exp(2j * math.pi * f * n) * AMPLITUDE
+        y = d.push([int(round(x.real)), int(round(x.imag))])
+        if y is not None:
+            outputs.append((n, complex(y[0], y[1])))
+    # Skip the outputs that still see the priming constant
+    outputs = outputs[len(outputs) // 4:]
+    acc = sum(y * cmath.exp(-2j * math.pi * f * n) for n, y in outputs)
+    return acc / len(outputs) / AMPLITUDE
+
+
+def check_tones(factor, points):
+    worst = 0.0
+    failures = []
+    for i in range(1, points):
+        f = 0.5 * i / points
+        expected = reference_response(factor, f)
+        got = measure(factor, f, 64 * factor * 8)
+        if db(expected) > -20:
+            error = abs(db(got) - db(expected))
+            phase = abs(cmath.phase(got / expected))
+            worst = max(worst, error)
+            if error > GAIN_TOLERANCE_DB or phase > 0.01:
+                failures.append('%.4f: %.3f dB, %.4f rad off' % (f, db(got) - db(expected), phase))
+        elif db(got) > max(db(expected) + 1, -ALIAS_REJECTION_DB) and abs(got - expected) > 1e-3:
+            failures.append('%.4f: %.1f dB against %.1f dB' % (f, db(got), db(expected)))
+    return worst, failures
+
+
+def check_constant(factor):
+    d = Decimator(3, factor)
+    values = [[-32768, 0, 32767], [1234, -5, 7], [-1, 1, 0]]
+    for value in values:
+        d.set_factor(factor)
+        for n in range(4 * factor):
+            y = d.push(value)
+            if y is not None and y != value:
+                return 'constant %s came out as %s' % (value, y)
+    square = [32767 if (n // (factor * 3)) % 2 else -32768 for n in range(64 * factor)]
+    d = Decimator(1, factor)
+    for x in square:
+        y = d.push([x])
+        if y is not None and abs(y[0]) > 32768:
+            return 'square wave came out as %d' % y[0]
+    return None
+
+
+def check_delay(factor):
+    """A slow tone lined up by decimate_delay_us against the reference's group delay at DC."""
+    period_us = 5000
+    delay = Decimator(1, factor).delay_us(period_us) / float(period_us)
+    f = 1e-4
+    group = -cmath.phase(reference_response(factor, f)) / (2 * math.pi * f)
+    return delay, group
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Integer decimators against a float reference')
+    parser.add_argument('--factor', type=int, action='append', help='1, 2, 4 or 8; all by default')
+    parser.add_argument('--points', type=int, default=100, help='frequencies per sweep')
+    opts = parser.parse_args()
+    ok = True
+    print '%6s %9s %9s %9s %9s %9s %s' % ('factor', 'droop dB', 'alias dB', 'error dB', 'delay', 'group', 'result')
+    for factor in opts.factor or [2, 4, 8]:
+        droop, rejection = check_design(factor, opts.points)
+        worst, failures = check_tones(factor, opts.points)
+        constant = check_constant(factor)
+        delay, group = check_delay(factor)
+        if droop > PASSBAND_DROOP_DB:
+            failures.append('passband droops %.2f dB' % droop)
+        if rejection < ALIAS_REJECTION_DB:
+            failures.append('aliases only %.1f dB down' % rejection)
+        if constant:
+            failures.append(constant)
+        if abs(delay - group) > 1e-3:
+            failures.append('delay %.3f periods, group delay %.3f' % (delay, group))
+        ok = ok and not failures
+        print '%6d %9.2f %9.1f %9.3f %9.1f %9.1f %s' % (factor, droop, rejection, worst, delay, group,
+                                                          'ok' if not failures else 'BAD')
+        for failure in failures[:5]:
+            print '       ' + failure
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
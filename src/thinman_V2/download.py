@@ -0,0 +1,216 @@
+# Pulls files off the card over USB download mode. Send "usb" on the command
+# link first; the board resets and comes up as a CDC serial port.
+# Requests are documented in example/src/tasks/download.h.
+#
+#   python download.py list
+#   python download.py get BARO1.TAB IMU1.TAB
+#   python download.py session [N]    Every <name>N.TAB/.BIN, the newest session by default
+#   python download.py mirror [N]     The flash mirror, and session N checked against it
+#   python download.py quit           Reset back to flight mode
+#
+# A file that already exists in the output directory with fewer bytes is
+# resumed from where it ends. mirror writes the ring to MIRROR.BIN and, for
+# each TAB file of the session it rebuilds, fetches the card copy and says
+# where the two differ; a card copy with gaps the mirror fills is rewritten
+# whole under mirror/.
+import argparse
+import binascii
+import os
+import re
+import struct
+import sys
+import time
+import mirror_log
+from frame_link import FrameLink, FrameError, ABANDONED, error_text
+
+# Log and trace files outside the numbered TAB/BIN sets come along with every session
+SESSION_NAME = re.compile(r'^([A-Z]+?)(\d*)\.(TAB|BIN)$')
+SESSION_EXTRAS = ['EVRYTHNG.LOG']
+MIRROR_FILE = 'MIRROR.BIN'
+REQUEST_TIMEOUT = 2.0
+REQUEST_RETRIES = 5
+
+
+def request(link, kind, arg=0, payload='', expect=''):
+    """Sends a request until a frame of one of the expected types, or an error, answers it."""
+    missed = 0
+    while missed < REQUEST_RETRIES:
+        link.send(kind, arg, payload)
+        deadline = time.time() + REQUEST_TIMEOUT
+        abandoned = False
+        while time.time() < deadline:
+            frame = link.receive(deadline - time.time())
+            if frame is None:
+                break
+            if frame[0] == 'x':
+                if frame[1] == ABANDONED:
+                    # We missed the answer to the last request and the board dropped this one
+                    # giving up on it; send it again. The board heard us, so this is no miss.
+                    abandoned = True
+                    break
+                raise FrameError(error_text(frame[1]))
+            if frame[0] in expect:
+                return frame
+        if not abandoned:
+            missed += 1
+    raise FrameError('no answer to %s' % kind)
+
+
+def list_files(link):
+    """The card's root directory as (name, size). A frame of it lost is asked for again, from there on."""
+    files = []
+    stuck = 0
+    while stuck < REQUEST_RETRIES:
+        had = len(files)
+        frame = request(link, 'L', had, expect='le')
+        while frame is not None and frame[0] == 'l' and frame[1] == len(files):
+            size, = struct.unpack_from('<I', frame[2])
+            files.append((frame[2][4:], size))
+            frame = link.receive(REQUEST_TIMEOUT)
+        if frame is not None and frame[0] == 'e' and frame[1] == len(files):
+            return files
+        stuck = 0 if len(files) > had else stuck + 1
+        # Let the rest of this listing go by
+        while link.receive(0.2) is not None:
+            pass
+    raise FrameError('listing cut short')
+
+
+def get_file(link, name, out_dir, kind='G'):
+    """Fetches a card file, or with kind 'M' the flash mirror into name."""
+    path = os.path.join(out_dir, name)
+    start = os.path.getsize(path) if os.path.exists(path) else 0
+    payload = name if kind == 'G' else ''
+    _, size, _ = request(link, kind, start, payload, expect='g')
+    if start > size:
+        start = 0
+        _, size, _ = request(link, kind, 0, payload, expect='g')
+    f = open(path, 'r+b' if start else 'wb')
+    f.seek(start)
+    f.truncate()
+    began = time.time()
+    for attempt in range(REQUEST_RETRIES):
+        try:
+            crc = link.receive_range(f, f.tell(), size, REQUEST_TIMEOUT)
+            break
+        except FrameError:
+            if attempt == REQUEST_RETRIES - 1:
+                f.close()
+                raise
+            # Carry on from what came through, as a rerun would; from the end this only
+            # fetches the 'c' frame. A board still sending gives the rest up for this.
+            request(link, kind, f.tell(), payload, expect='g')
+    f.close()
+
+    data = open(path, 'rb').read()
+    if len(data) != size:
+        raise FrameError('%s is %d bytes, expected %d' % (name, len(data), size))
+    if binascii.crc32(data) & 0xffffffff != crc:
+        os.remove(path)
+        raise FrameError('%s CRC mismatch, removed' % name)
+    elapsed = time.time() - began
+    print '%-12s %8d bytes  %6.1f kB/s' % (name, size, (size - start) / 1024.0 / max(elapsed, 1e-3))
+
+
+def sessions(files):
+    numbers = {}
+    for name, size in files:
+        match = SESSION_NAME.match(name)
+        if match:
+            numbers.setdefault(int(match.group(2) or 0), []).append(name)
+    return numbers
+
+
+def span_text(ranges):
+    shown = ', '.join('%d-%d' % r for r in ranges[:3])
+    return shown + (' and %d more' % (len(ranges) - 3) if len(ranges) > 3 else '')
+
+
+def check_mirror(link, files, number, out_dir):
+    # The ring moves on between flights, so it is always fetched whole
+    path = os.path.join(out_dir, MIRROR_FILE)
+    if os.path.exists(path):
+        os.remove(path)
+    get_file(link, MIRROR_FILE, out_dir, 'M')
+    mirrored, torn = mirror_log.rebuild(open(path, 'rb').read())
+    if torn:
+        print '%d torn pages in the mirror' % torn
+    numbers = sessions([(name, 0) for name in mirrored])
+    if not numbers:
+        sys.exit('nothing in the mirror')
+    if number is None:
+        number = max(numbers)
+    if number not in numbers:
+        sys.exit('no session %d in the mirror' % number)
+    on_card = [name for name, size in files]
+    for name in sorted(numbers[number]):
+        mirror = mirrored[name]
+        card = ''
+        if name in on_card:
+            get_file(link, name, out_dir)
+            card = open(os.path.join(out_dir, name), 'rb').read()
+        merged, repaired, lost = mirror_log.merge(card, mirror)
+        if not repaired and not lost:
+            print '%-12s card and mirror agree' % name
+            continue
+        if repaired:
+            print '%-12s card differs at %s; %d bytes taken from the mirror' % (
+                name, span_text(repaired), sum(b - a for a, b in repaired))
+            fixed_dir = os.path.join(out_dir, 'mirror')
+            if not os.path.isdir(fixed_dir):
+                os.makedirs(fixed_dir)
+            open(os.path.join(fixed_dir, name), 'wb').write(merged)
+        if lost:
+            print '%-12s %d bytes in neither copy: %s' % (name, sum(b - a for a, b in lost), span_text(lost))
+
+
+def parse_args(argv=None):
+    parser = argparse.ArgumentParser(description='Flight data download over USB')
+    parser.add_argument('-p', '--port', default='/dev/ttyACM0')
+    parser.add_argument('-o', '--out', default='.', help='output directory')
+    parser.add_argument('command', choices=['list', 'get', 'session', 'mirror', 'quit'])
+    parser.add_argument('args', nargs='*')
+    return parser.parse_args(argv)
+
+
+def run(link, opts):
+    """Carries out opts.command over link; download_check.py calls it over a pseudo terminal."""
+    if opts.command == 'quit':
+        link.send('Q')
+        return
+    files = list_files(link)
+    if opts.command == 'list':
+        for name, size in files:
+            print '%-12s %8d' % (name, size)
+        return
+    if not os.path.isdir(opts.out):
+        os.makedirs(opts.out)
+    if opts.command == 'mirror':
+        check_mirror(link, files, int(opts.args[0]) if opts.args else None, opts.out)
+        return
+    if opts.command == 'get':
+        names = opts.args
+    else:
+        numbers = sessions(files)
+        if not numbers:
+            sys.exit('no sessions on the card')
+        number = int(opts.args[0]) if opts.args else max(numbers)
+        if number not in numbers:
+            sys.exit('no session %d' % number)
+        present = [name for name, size in files]
+        names = sorted(numbers[number]) + [name for name in SESSION_EXTRAS if name in present]
+    for name in names:
+        get_file(link, name, opts.out)
+
+
+def main():
+    import serial
+    opts = parse_args()
+    run(FrameLink(serial.Serial(opts.port, 115200, timeout=0.05)), opts)
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except FrameError as e:
+        sys.exit(str(e))
@@ -0,0 +1,234 @@
+# Pulls files through download mode (example/src/tasks/download.c and
+# frame.c) with download.py, over a pseudo terminal standing in for the USB
+# VCOM link. host/download_host.c runs task_download in a thread on the
+# master side, serves a card directory of made-up session files and a flash
+# mirror buffer, and drops or corrupts frames on the way.
+#
+#   python download_check.py [--seed N]
+#
+# Each run fetches session 2 with download.py's own session command and
+# checks every file comes out byte for byte, under:
+#   - a clean link
+#   - 1 in 3, then 1 in 7, of the data frames dropped
+#   - a byte flipped in 1 in 5 frames of any kind, listing, 'g' and 'c'
+#     included
+#   - a byte flipped in 1 in 4 reads by the board, losing acks and requests
+# Then it checks:
+#   - a truncated copy is resumed from where it ends, sending only the rest
+#   - a resumed copy whose first part is damaged fails the whole-file CRC and
+#     is removed
+#   - a get for a file not on the card fails with FR_NO_FILE
+#   - the flash mirror comes out byte for byte
+#   - quit leaves download mode
+# Exits non-zero on any failure.
+import argparse
+import ctypes
+import os
+import random
+import select
+import shutil
+import sys
+import tempfile
+import time
+import tty
+import download
+import host_build
+from frame_link import FrameLink, FrameError
+
+# Session 2 is the newest, so the one session fetches. Sizes straddle the
+# 512-byte data frames.
+CARD = [('BARO1.TAB', 20000), ('IMU1.TAB', 70001),
+        ('BARO2.TAB', 30000), ('IMU2.TAB', 200000), ('HIGHG2.TAB', 4096), ('GPS2.TAB', 513),
+        ('VOLTS2.TAB', 1), ('KTRACE2.BIN', 0), ('EVRYTHNG.LOG', 511)]
+SESSION = ['BARO2.TAB', 'EVRYTHNG.LOG', 'GPS2.TAB', 'HIGHG2.TAB', 'IMU2.TAB', 'KTRACE2.BIN', 'VOLTS2.TAB']
+MIRROR_SIZE = 100000
+FR_NO_FILE = 4
+# Faults as chances of 1 in N of (data frames dropped, frames corrupted, reads corrupted); 0 for none
+RUNS = [('clean', (0, 0, 0)), ('drop 1 in 3', (3, 0, 0)), ('drop 1 in 7', (7, 0, 0)),
+        ('corrupt 1 in 5', (0, 5, 0)), ('lose acks 1 in 4', (0, 0, 4))]
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint32) for name in
+                ('frames', 'data_frames', 'dropped', 'corrupted', 'reads', 'reads_corrupted')]
+
+
+class PtyPort(object):
+    """The read and write a serial.Serial with timeout=0.05 gives FrameLink."""
+    def __init__(self, path):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+
+    def read(self, size):
+        if not select.select([self.fd], [], [], 0.05)[0]:
+            return ''
+        return os.read(self.fd, size)
+
+    def write(self, data):
+        while data:
+            data = data[os.write(self.fd, data):]
+
+
+class Quiet(object):
+    """Keeps download.py's line per file out of the results."""
+    def __enter__(self):
+        self.stdout = sys.stdout
+        sys.stdout = open(os.devnull, 'w')
+
+    def __exit__(self, *exc):
+        sys.stdout.close()
+        sys.stdout = self.stdout
+
+
+lib = host_build.load(['host/download_host.c', 'tasks/download.c', 'tasks/frame.c', 'drivers/crc.c',
+                       'host/host.c'],
+                      includes=[os.path.join(host_build.HERE, 'example', 'inc'),
+                                os.path.join(host_build.HERE, 'fatfs')],
+                      extra=['-pthread'])
+lib.download_host_open.restype = ctypes.c_char_p
+lib.download_host_start.restype = ctypes.c_bool
+lib.download_host_stop.restype = ctypes.c_bool
+
+
+def stats():
+    s = Stats()
+    lib.download_host_stats(ctypes.byref(s))
+    return s
+
+
+def compare(card, out, names):
+    """Failures for each of names not in out byte for byte as on the card."""
+    failures = []
+    for name in names:
+        path = os.path.join(out, name)
+        if not os.path.exists(path):
+            failures.append('%s not fetched' % name)
+        elif open(path, 'rb').read() != open(os.path.join(card, name), 'rb').read():
+            failures.append('%s differs from the card' % name)
+    extra = set(os.listdir(out)) - set(names)
+    if extra:
+        failures.append('fetched %s as well' % ', '.join(sorted(extra)))
+    return failures
+
+
+def fetch_session(link, card, out, faults, seed):
+    """Failures, seconds taken and the link counts for one session fetch."""
+    lib.download_host_faults(*(faults + (seed,)))
+    before = stats()
+    began = time.time()
+    try:
+        with Quiet():
+            download.run(link, download.parse_args(['-o', out, 'session']))
+        failures = compare(card, out, SESSION)
+    except FrameError as e:
+        failures = ['download.py: %s' % e]
+    elapsed = time.time() - began
+    lib.download_host_faults(0, 0, 0, 1)
+    after = stats()
+    counts = dict((name, getattr(after, name) - getattr(before, name)) for name, kind in Stats._fields_)
+    return failures, elapsed, counts
+
+
+def check_resume(link, card, out):
+    failures = []
+    name, size = 'IMU2.TAB', 200000
+    os.makedirs(out)
+    whole = open(os.path.join(card, name), 'rb').read()
+    partial = 150000
+    open(os.path.join(out, name), 'wb').write(whole[:partial])
+    before = stats().data_frames
+    download.get_file(link, name, out)
+    sent = stats().data_frames - before
+    if open(os.path.join(out, name), 'rb').read() != whole:
+        failures.append('resumed %s differs from the card' % name)
+    if sent != (size - partial + 511) // 512:
+        failures.append('resuming %s from %d sent %d data frames' % (name, partial, sent))
+
+    damaged = bytearray(whole[:partial])
+    damaged[1000] ^= 1
+    open(os.path.join(out, name), 'wb').write(damaged)
+    try:
+        download.get_file(link, name, out)
+        failures.append('resuming over a damaged copy of %s passed the CRC' % name)
+    except FrameError:
+        if os.path.exists(os.path.join(out, name)):
+            failures.append('damaged copy of %s not removed' % name)
+
+    try:
+        download.get_file(link, 'NOPE.TAB', out)
+        failures.append('a get for a file not on the card succeeded')
+    except FrameError as e:
+        if str(e) != download.error_text(FR_NO_FILE):
+            failures.append('a get for a file not on the card failed with "%s"' % e)
+    return failures
+
+
+def check_mirror(link, rng, out):
+    data = ''.join(chr(rng.getrandbits(8)) for i in range(MIRROR_SIZE))
+    lib.download_host_mirror(data, len(data))
+    os.makedirs(out)
+    download.get_file(link, download.MIRROR_FILE, out, 'M')
+    if open(os.path.join(out, download.MIRROR_FILE), 'rb').read() != data:
+        return ['the flash mirror differs']
+    return []
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Download mode over a loopback link')
+    parser.add_argument('--seed', type=int, default=1)
+    opts = parser.parse_args()
+    rng = random.Random(opts.seed)
+    top = tempfile.mkdtemp(prefix='download_check')
+    try:
+        card = os.path.join(top, 'card')
+        os.makedirs(card)
+        for name, size in CARD:
+            open(os.path.join(card, name), 'wb').write(''.join(chr(rng.getrandbits(8)) for i in range(size)))
+        path = lib.download_host_open(card)
+        if path is None:
+            sys.exit('could not open a pseudo terminal')
+        for name, size in CARD:
+            lib.download_host_file(name)
+        if not lib.download_host_start():
+            sys.exit('could not start the download task')
+        link = FrameLink(PtyPort(path))
+
+        ok = True
+        print '%-18s %6s %8s %8s %9s %9s %7s %s' % ('link', 'frames', 'data', 'dropped', 'corrupted',
+                                                  'bad reads', 'kB/s', 'result')
+        total = sum(size for name, size in CARD if name in SESSION)
+        for n, (what, faults) in enumerate(RUNS):
+            failures, elapsed, c = fetch_session(link, card, os.path.join(top, 'out%d' % n), faults,
+                                                    rng.getrandbits(32))
+            ok = ok and not failures
+            print '%-18s %6d %8d %8d %9d %9d %7.1f %s' % (
+                what, c['frames'], c['data_frames'], c['dropped'], c['corrupted'], c['reads_corrupted'],
+                total / 1024.0 / elapsed, 'ok' if not failures else 'BAD')
+            for failure in failures[:5]:
+                print '        ' + failure
+
+        checks = [('resume', lambda: check_resume(link, card, os.path.join(top, 'resume'))),
+                  ('flash mirror', lambda: check_mirror(link, rng, os.path.join(top, 'mirror')))]
+        for what, check in checks:
+            try:
+                with Quiet():
+                    failures = check()
+            except FrameError as e:
+                failures = ['download.py: %s' % e]
+            ok = ok and not failures
+            print '%-18s %s' % (what, 'ok' if not failures else 'BAD')
+            for failure in failures[:5]:
+                print '        ' + failure
+
+        link.send('Q')
+        left = lib.download_host_stop(2000)
+        ok = ok and left
+        print '%-18s %s' % ('quit', 'ok' if left else 'BAD, still in download mode')
+    finally:
+        shutil.rmtree(top)
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -79,7 +79,19 @@
 #define configTICK_RATE_HZ				( ( portTickType ) 1000 )
 #define configMAX_PRIORITIES			( ( unsigned portBASE_TYPE ) 8 )
 #define configMINIMAL_STACK_SIZE		( ( unsigned short ) 64 )
+/* Task stacks are .bss arrays passed to xTaskGenericCreate, so they show up in the
+ * linker map (see memory_report.py). TCBs, mutexes and queues still come from the heap;
+ * FreeRTOS 8.0.0 has no static variant for them. */
+#define configSTATIC_TASK_STACKS		1
+#if configSTATIC_TASK_STACKS
+/* At 88 bytes a TCB and 96 a mutex or semaphore with heap_2's header, flight takes
+ * about 4.3 kB: ten TCBs, the Boot and idle stacks, 17 driver locks, the trace FIL
+ * and a file command's FIL. Download mode peaks near 5.2 kB with its transfer state
+ * and the USB locks. "perf" logs the low-water mark. */
+#define configTOTAL_HEAP_SIZE			( ( size_t ) ( 6 * 1024 ) )
+#else
 #define configTOTAL_HEAP_SIZE			( ( size_t ) ( 20 * 1024 ) )
+#endif
 #define configMAX_TASK_NAME_LEN			( 10 )
 #define configUSE_TRACE_FACILITY		1
 #define configUSE_16_BIT_TICKS			0
@@ -91,8 +103,9 @@
 #define configUSE_MALLOC_FAILED_HOOK	1
 #define configUSE_APPLICATION_TASK_TAG	0
 #define configUSE_COUNTING_SEMAPHORES	1
-#define configGENERATE_RUN_TIME_STATS	0
+#define configGENERATE_RUN_TIME_STATS	1
 #define configUSE_TICKLESS_IDLE 1 
+#define configUSE_KERNEL_TRACE			1
 
 
 /* Co-routine definitions. */
@@ -145,6 +158,12 @@ to all Cortex-M ports, and do not rely on any particular library functions. */
 #define configKERNEL_INTERRUPT_PRIORITY 		( configLIBRARY_LOWEST_INTERRUPT_PRIORITY << (8 - configPRIO_BITS) )
 #define configMAX_SYSCALL_INTERRUPT_PRIORITY 	( configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY << (8 - configPRIO_BITS) )
 
+/* Run time stats count the CT32B0 microsecond timebase, which timebase_init()
+starts in hardware_init() before the scheduler. */
+uint32_t perf_run_time_counter(void);
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE() perf_run_time_counter()
+
 /* Normal assert() semantics without relying on the provision of an assert.h
 header file. */
 void logging_config_assert_failed(const char* file, uint32_t line);
@@ -153,6 +172,9 @@ void exit_error(int);
 
 #define configUSE_CUSTOM_TICK 0
 
+/* Kernel event trace hooks, recorded to TRACE.BIN */
+#include "kernel_trace.h"
+
 /* Definitions that map the FreeRTOS port interrupt handlers to their CMSIS
 standard names - or at least those used in the unmodified vector table. */
 #define vPortSVCHandler SVC_Handler
@@ -0,0 +1,40 @@
+/*
+ * boot_profile.h
+ *
+ *  Timestamps boot stages on the microsecond timebase and logs one report
+ *  once the first sample reaches the card. Times count from timebase_init at
+ *  the top of main; reset handling and clock setup before it are not seen.
+ *  Stages are marked from several tasks and only the first mark counts.
+ */
+
+#ifndef BOOT_PROFILE_H_
+#define BOOT_PROFILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+	BOOT_STAGE_HARDWARE,		// hardware_init done
+	BOOT_STAGE_SCHEDULER,		// Boot task running
+	BOOT_STAGE_IMU,				// Sensor init done
+	BOOT_STAGE_HIGHG,
+	BOOT_STAGE_BARO,
+	BOOT_STAGE_FIRING_BOARD,
+	BOOT_STAGE_TELEMETRY,
+	BOOT_STAGE_SD_MOUNTED,
+	BOOT_STAGE_LOG_OPEN,		// Persistent log open; the storage writer may use the card
+	BOOT_STAGE_FIRST_SAMPLE,	// First record pushed by the acquisition task
+	BOOT_STAGE_FIRST_WRITE,		// First record written to a TAB file
+	BOOT_STAGE_COUNT,
+} boot_stage_t;
+
+// The report is logged without the missing stages if the first write has not happened by then
+#define BOOT_PROFILE_TIMEOUT_MS 10000
+
+void boot_profile_mark(boot_stage_t stage);
+// Returns the stage time in us since timebase_init, or false when it was not reached
+bool boot_profile_get(boot_stage_t stage, uint32_t* t_us);
+// Logs the report once it is due. Called periodically from the perf task.
+void boot_profile_poll(void);
+
+#endif /* BOOT_PROFILE_H_ */
@@ -0,0 +1,83 @@
+/*
+ * kernel_trace.h
+ *
+ *  FreeRTOS trace hooks that record compact timestamped kernel events into a
+ *  ring in the USB SRAM bank. The storage writer drains the ring into TRACE.BIN, which
+ *  trace_to_json.py turns into a Chrome trace / Perfetto timeline.
+ *  Included from FreeRTOSConfig.h, so the hook macros expand inside tasks.c
+ *  and queue.c. They are only defined when configUSE_KERNEL_TRACE is 1.
+ */
+
+#ifndef KERNEL_TRACE_H_
+#define KERNEL_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Also record entry and exit of the I2C and SSP interrupt handlers. The I2C
+// handlers run once per byte, so this fills the ring quickly.
+#ifndef KERNEL_TRACE_ISRS
+#define KERNEL_TRACE_ISRS 0
+#endif
+
+typedef enum {
+	KERNEL_TRACE_SWITCH_IN = 1,		// arg: task number, object: priority
+	KERNEL_TRACE_TASK_CREATE,		// arg: task number, object: priority
+	KERNEL_TRACE_TASK_DELETE,		// arg: task number
+	KERNEL_TRACE_QUEUE_BLOCK,		// arg: queue type, object: queue. Current task blocks to receive/take.
+	KERNEL_TRACE_QUEUE_RECEIVE,		// Received from, or took, the queue
+	KERNEL_TRACE_QUEUE_TIMEOUT,		// Receive or take failed
+	KERNEL_TRACE_QUEUE_SEND,		// Sent to, or gave, the queue
+	KERNEL_TRACE_QUEUE_SEND_ISR,
+	KERNEL_TRACE_PRIORITY_INHERIT,	// arg: mutex holder task number, object: inherited priority
+	KERNEL_TRACE_PRIORITY_DISINHERIT,	// arg: task number, object: restored priority
+	KERNEL_TRACE_ISR_ENTER,			// arg: IRQ number
+	KERNEL_TRACE_ISR_EXIT,
+} kernel_trace_type_t;
+
+// Bytes of the event ring, a power of two. The rest of the USB SRAM bank holds
+// the high-g pretrigger ring (tasks/storage.c).
+#define KERNEL_TRACE_RING_SIZE	0x400
+
+// Queues are identified by the low 16 bits of their address, unique within the 32kB main SRAM
+#define KERNEL_TRACE_OBJECT(p) ((uint16_t)(uint32_t)(p))
+
+// Start recording. Call after timebase_init(); events before that are discarded.
+// Not in download mode, where USB takes the bank the ring is in.
+void kernel_trace_start(void);
+
+void kernel_trace_event(uint8_t type, uint8_t arg, uint16_t object);
+void kernel_trace_name_task(uint8_t number, const char* name);
+void kernel_trace_name_queue(void* queue, const char* name);
+
+// Writes pending events to TRACE.BIN, opening it on first use. Called from the storage writer;
+// returns quickly when there is little to write.
+void kernel_trace_flush(void);
+
+#if configUSE_KERNEL_TRACE
+#define traceTASK_SWITCHED_IN() kernel_trace_event(KERNEL_TRACE_SWITCH_IN, pxCurrentTCB->uxTCBNumber, pxCurrentTCB->uxPriority)
+#define traceTASK_CREATE(pxNewTCB) { \
+	kernel_trace_name_task((pxNewTCB)->uxTCBNumber, (const char*) (pxNewTCB)->pcTaskName); \
+	kernel_trace_event(KERNEL_TRACE_TASK_CREATE, (pxNewTCB)->uxTCBNumber, (pxNewTCB)->uxPriority); \
+}
+#define traceTASK_DELETE(pxTCB) kernel_trace_event(KERNEL_TRACE_TASK_DELETE, (pxTCB)->uxTCBNumber, 0)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue) kernel_trace_event(KERNEL_TRACE_QUEUE_BLOCK, (pxQueue)->ucQueueType, KERNEL_TRACE_OBJECT(pxQueue))
+#define traceQUEUE_RECEIVE(pxQueue) kernel_trace_event(KERNEL_TRACE_QUEUE_RECEIVE, (pxQueue)->ucQueueType, KERNEL_TRACE_OBJECT(pxQueue))
+#define traceQUEUE_RECEIVE_FAILED(pxQueue) kernel_trace_event(KERNEL_TRACE_QUEUE_TIMEOUT, (pxQueue)->ucQueueType, KERNEL_TRACE_OBJECT(pxQueue))
+#define traceQUEUE_SEND(pxQueue) kernel_trace_event(KERNEL_TRACE_QUEUE_SEND, (pxQueue)->ucQueueType, KERNEL_TRACE_OBJECT(pxQueue))
+#define traceQUEUE_SEND_FROM_ISR(pxQueue) kernel_trace_event(KERNEL_TRACE_QUEUE_SEND_ISR, (pxQueue)->ucQueueType, KERNEL_TRACE_OBJECT(pxQueue))
+#define traceTASK_PRIORITY_INHERIT(pxTCB, uxPriority) kernel_trace_event(KERNEL_TRACE_PRIORITY_INHERIT, (pxTCB)->uxTCBNumber, (uxPriority))
+#define traceTASK_PRIORITY_DISINHERIT(pxTCB, uxPriority) kernel_trace_event(KERNEL_TRACE_PRIORITY_DISINHERIT, (pxTCB)->uxTCBNumber, (uxPriority))
+#define traceQUEUE_REGISTRY_ADD(xQueue, pcQueueName) kernel_trace_name_queue((xQueue), (pcQueueName))
+
+#endif
+
+#if configUSE_KERNEL_TRACE && KERNEL_TRACE_ISRS
+#define KERNEL_TRACE_ISR_ENTER(irq) kernel_trace_event(KERNEL_TRACE_ISR_ENTER, (irq), 0)
+#define KERNEL_TRACE_ISR_EXIT(irq) kernel_trace_event(KERNEL_TRACE_ISR_EXIT, (irq), 0)
+#else
+#define KERNEL_TRACE_ISR_ENTER(irq)
+#define KERNEL_TRACE_ISR_EXIT(irq)
+#endif
+
+#endif /* KERNEL_TRACE_H_ */
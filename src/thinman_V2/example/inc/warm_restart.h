@@ -0,0 +1,45 @@
+/*
+ * warm_restart.h
+ *
+ *  State that survives a reset in flight. A block in no-init RAM carries the
+ *  flight phase and, for each storage stream, the TAB file number and the
+ *  offset of its last f_sync. The file numbers identify the session. After a
+ *  reset the block is accepted only if its magic and CRC check out, the reset
+ *  was not a power-on and the saved phase is between launch and landing. The
+ *  firmware then resumes that phase and appends to the same files instead of
+ *  starting new ones.
+ */
+
+#ifndef WARM_RESTART_H_
+#define WARM_RESTART_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "flight/flight_phase.h"
+#include "tasks/storage.h"
+
+// Stream has no file in this session yet
+#define WARM_RESTART_NO_FILE 0xffff
+
+// Validates or clears the block. Call first thing in main, before anything updates it.
+void warm_restart_init(void);
+
+// True when this boot resumes a flight
+bool warm_restart_is_warm(void);
+flight_phase_t warm_restart_phase(void);
+// Reset source bits (SYSCTL_RST_*) and the number of warm restarts in this session
+uint32_t warm_restart_reset_cause(void);
+uint32_t warm_restart_count(void);
+// exit_error code that caused the reset, or 0
+int warm_restart_last_error(void);
+
+void warm_restart_save_phase(flight_phase_t phase);
+// number is the N of <name>N.TAB, 0 for <name>.TAB. offset is the synced file size.
+void warm_restart_save_file(storage_stream_t stream, uint16_t number, uint32_t offset);
+bool warm_restart_get_file(storage_stream_t stream, uint16_t* number, uint32_t* offset);
+
+// Called from exit_error with interrupts disabled. Resets the chip when in flight,
+// so logging resumes instead of halting; returns otherwise.
+void warm_restart_on_fatal(int error_code);
+
+#endif /* WARM_RESTART_H_ */
@@ -0,0 +1,56 @@
+/*
+ * boot_profile.c
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging.h"
+#include "boot_profile.h"
+#include "drivers/timebase.h"
+
+static const char* const boot_stage_names[BOOT_STAGE_COUNT] = {
+	"hardware", "scheduler", "imu", "highg", "baro", "firing", "telemetry", "sd_mount", "log_open",
+	"sample", "write",
+};
+
+static uint32_t boot_stage_us[BOOT_STAGE_COUNT];
+static volatile uint32_t boot_stage_marked;
+static bool boot_report_logged;
+
+void boot_profile_mark(boot_stage_t stage) {
+	uint32_t now = timebase_us();
+	uint32_t bit = 1UL << stage;
+	// Cheap early out; the acquisition and storage tasks mark on every record
+	if (boot_stage_marked & bit) return;
+	taskENTER_CRITICAL();
+	if (!(boot_stage_marked & bit)) {
+		boot_stage_us[stage] = now;
+		boot_stage_marked |= bit;
+	}
+	taskEXIT_CRITICAL();
+}
+
+bool boot_profile_get(boot_stage_t stage, uint32_t* t_us) {
+	if (!(boot_stage_marked & (1UL << stage))) return false;
+	*t_us = boot_stage_us[stage];
+	return true;
+}
+
+void boot_profile_poll(void) {
+	int i;
+	uint32_t t_us;
+	if (boot_report_logged) return;
+	if (!(boot_stage_marked & (1UL << BOOT_STAGE_FIRST_WRITE)) && timebase_us() < BOOT_PROFILE_TIMEOUT_MS * 1000UL) return;
+	boot_report_logged = true;
+
+	for (i = 0; i < BOOT_STAGE_COUNT; i++) {
+		if (boot_profile_get(i, &t_us)) {
+			LOG_INFO("Boot %s at %uus", boot_stage_names[i], t_us);
+		} else {
+			LOG_WARN("Boot %s not reached", boot_stage_names[i]);
+		}
+	}
+	if (boot_profile_get(BOOT_STAGE_FIRST_WRITE, &t_us)) {
+		LOG_INFO("Boot to first logged sample %ums", t_us / 1000);
+	}
+}
@@ -17,11 +17,14 @@ size_t S25FL_erase_sector_count = 0;
 
 static void S25FL_write_wait();
 
-inline void flash_enter() {
+static inline void flash_enter() {
 	xSemaphoreTake(mutex_flash, portMAX_DELAY);
+	// The SD card shares the bus
+	spi_lock(S25FL_spi_device);
 }
 
-inline void flash_exit() {
+static inline void flash_exit() {
+	spi_unlock(S25FL_spi_device);
 	xSemaphoreGive(mutex_flash);
 }
 
@@ -114,6 +117,27 @@ void S25FL_reset() {
 	flash_exit();
 }
 
+uint32_t S25FL_read_id(void) {
+	uint8_t buf[4];
+	buf[0] = S25FL_RDID;
+
+	flash_enter();
+	S25FL_ss_set();
+	spi_transceive(S25FL_spi_device, buf, 4);
+	S25FL_ss_clear();
+	flash_exit();
+
+	return ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+}
+
+bool S25FL_busy(void) {
+	bool busy;
+	flash_enter();
+	busy = (S25FL_read_register(S25FL_RDSR1) & 0x01) != 0;
+	flash_exit();
+	return busy;
+}
+
 void S25FL_ss_set() {
 	Chip_GPIO_SetPinState(LPC_GPIO, S25FL_SS_PORT, S25FL_SS_PIN, 0);
 }
@@ -236,6 +260,41 @@ void S25FL_erase_sector(uint32_t address) {
 	flash_exit();
 }
 
+void S25FL_erase_sector_start(uint32_t address) {
+	uint8_t tx_buf[4];
+	tx_buf[0] = S25FL_SE;
+	tx_buf[1] = (address >> 16) & 0xFF;
+	tx_buf[2] = (address >> 8) & 0xFF;
+	tx_buf[3] = address & 0xFF;
+
+	S25FL_erase_sector_count ++;
+
+	flash_enter();
+	S25FL_write_enable();
+	S25FL_ss_set();
+	spi_send(S25FL_spi_device, tx_buf, 4);
+	S25FL_ss_clear();
+	flash_exit();
+}
+
+void S25FL_erase_suspend(void) {
+	flash_enter();
+	S25FL_ss_set();
+	spi_transceive_byte(S25FL_spi_device, S25FL_ERSP);
+	S25FL_ss_clear();
+	// WIP clears within 45 us once the erase has stopped
+	S25FL_write_wait();
+	flash_exit();
+}
+
+void S25FL_erase_resume(void) {
+	flash_enter();
+	S25FL_ss_set();
+	spi_transceive_byte(S25FL_spi_device, S25FL_ERRS);
+	S25FL_ss_clear();
+	flash_exit();
+}
+
 void S25FL_erase_bulk() {
 	// Setup params
 
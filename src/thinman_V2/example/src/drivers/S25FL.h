@@ -83,8 +83,11 @@ extern size_t S25FL_erase_sector_count;
 #define S25FL_DUMMY_CYCLES	5000	// mentioned, but # not defined by spec
 
 // === SPI
-#define S25FL_SS_PORT	1
-#define S25FL_SS_PIN	23
+// Shares SPI1 with the SD card, which selects on PIO1_23
+#define S25FL_SS_PORT	0
+#define S25FL_SS_PIN	2
+// S25FL_read_id manufacturer byte
+#define S25FL_MANUFACTURER_SPANSION	0x01
 
 // Number of bytes for each block write operation
 #define S25FL_SECTOR_SIZE 4096
@@ -128,6 +131,13 @@ void S25FL_set_erase_size(enum Erase_Size erase_size);
 // bit and the PPB Lock bit
 void S25FL_reset();
 
+// Reads the manufacturer ID into bits 23-16 and the device ID into bits 15-0.
+// Reads 0xffffff or 0 when no device answers.
+uint32_t S25FL_read_id(void);
+
+// Returns whether a program or erase is still in progress
+bool S25FL_busy(void);
+
 // =======================================================================
 // === Write functions
 // =======================================================================
@@ -182,6 +192,16 @@ void S25FL_erase_4k(uint32_t address);
 // configuration) at address (3-bytes)
 void S25FL_erase_sector(uint32_t address);
 
+// Starts the same erase and returns without waiting for it. Nothing else may
+// be programmed until S25FL_busy() clears, or the erase is suspended.
+void S25FL_erase_sector_start(uint32_t address);
+
+// Pauses an erase so that pages outside its sector can be programmed, and
+// continues it. Leave 100 us after a resume before suspending again, or the
+// erase makes no progress.
+void S25FL_erase_suspend(void);
+void S25FL_erase_resume(void);
+
 // Erases (sets all bits to 1) the entire flash memory array
 void S25FL_erase_bulk();
 
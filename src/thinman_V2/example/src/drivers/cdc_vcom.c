@@ -53,6 +53,8 @@ VCOM_DATA_T g_vCOM;
 static xSemaphoreHandle mutex_g_vCOM;
 static xSemaphoreHandle sem_read_complete;
 static xSemaphoreHandle sem_write_complete;
+// Packets that arrive while rx_buff has no room for another are read here and dropped
+static uint8_t rx_discard[USB_FS_MAX_BULK_PACKET];
 
 /*****************************************************************************
  * Private functions
@@ -79,8 +81,12 @@ static ErrorCode_t VCOM_bulk_out_hdlr(USBD_HANDLE_T hUsb, void *data, uint32_t e
 
 	switch (event) {
 	case USB_EVT_OUT:
-		// XXX: this is crazy.  The buffer may very easily overflow.
-		pVcom->rx_count += USBD_API->hw->ReadEP(hUsb, USB_CDC_OUT_EP, pVcom->rx_buff + pVcom->rx_count);
+		if (pVcom->rx_count > VCOM_RX_BUF_SZ - USB_FS_MAX_BULK_PACKET) {
+			USBD_API->hw->ReadEP(hUsb, USB_CDC_OUT_EP, rx_discard);
+			pVcom->rx_dropped++;
+		} else {
+			pVcom->rx_count += USBD_API->hw->ReadEP(hUsb, USB_CDC_OUT_EP, pVcom->rx_buff + pVcom->rx_count);
+		}
 		if (pVcom->rx_flags & VCOM_RX_BUF_QUEUED) {
 			pVcom->rx_flags &= ~VCOM_RX_BUF_QUEUED;
 			if (pVcom->rx_count != 0) {
@@ -98,7 +104,6 @@ static ErrorCode_t VCOM_bulk_out_hdlr(USBD_HANDLE_T hUsb, void *data, uint32_t e
 		break;
 
 	case USB_EVT_OUT_NAK:
-		exit_error(42);
 		/* queue free buffer for RX */
 		if ((pVcom->rx_flags & (VCOM_RX_BUF_FULL | VCOM_RX_BUF_QUEUED)) == 0) {
 			USBD_API->hw->ReadReqEP(hUsb, USB_CDC_OUT_EP, pVcom->rx_buff, VCOM_RX_BUF_SZ);
@@ -196,6 +201,12 @@ ErrorCode_t vcom_init(USBD_HANDLE_T hUsb, USB_CORE_DESCS_T *pDesc, USBD_API_INIT
 
 /* Virtual com port buffered read routine */
 uint32_t vcom_bread(uint8_t *pBuf, uint32_t buf_len)
+{
+	return vcom_bread_timeout(pBuf, buf_len, portMAX_DELAY);
+}
+
+/* Buffered read that gives up after timeout ticks */
+uint32_t vcom_bread_timeout(uint8_t *pBuf, uint32_t buf_len, uint32_t timeout)
 {
 	VCOM_DATA_T *pVcom = &g_vCOM;
 	uint16_t cnt = 0;
@@ -204,15 +215,19 @@ uint32_t vcom_bread(uint8_t *pBuf, uint32_t buf_len)
 	vcom_enter();
 	while (!pVcom->rx_count) {
 		if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+			bool received;
 			vcom_exit();
-			xSemaphoreTake(sem_read_complete, portMAX_DELAY);
+			received = xSemaphoreTake(sem_read_complete, timeout) == pdTRUE;
 			vcom_enter();
+			if (!received) break;
 		}
 	}
 
 	if (pVcom->rx_count) {
-		cnt = (pVcom->rx_count < buf_len) ? pVcom->rx_count : buf_len;
-		memcpy(pBuf, pVcom->rx_buff, cnt);
+		/* a short read leaves the rest of rx_buff for the next call */
+		cnt = pVcom->rx_count - pVcom->rx_rd_count;
+		if (cnt > buf_len) cnt = buf_len;
+		memcpy(pBuf, pVcom->rx_buff + pVcom->rx_rd_count, cnt);
 		pVcom->rx_rd_count += cnt;
 
 		/* enter critical section */
@@ -300,3 +315,17 @@ uint32_t vcom_write(uint8_t *pBuf, uint32_t len)
 
 	return ret;
 }
+
+/* Write any length, one bulk packet at a time */
+bool vcom_write_all(const uint8_t *pBuf, uint32_t len)
+{
+	while (len > 0) {
+		uint32_t chunk = len < USB_FS_MAX_BULK_PACKET ? len : USB_FS_MAX_BULK_PACKET;
+		if (vcom_write((uint8_t *) pBuf, chunk) != chunk) {
+			return false;
+		}
+		pBuf += chunk;
+		len -= chunk;
+	}
+	return true;
+}
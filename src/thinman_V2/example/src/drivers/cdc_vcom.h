@@ -62,6 +62,7 @@ typedef struct VCOM_DATA {
 	uint16_t rx_count;
 	volatile uint16_t tx_flags;
 	volatile uint16_t rx_flags;
+	uint32_t rx_dropped;	/* OUT packets dropped because rx_buff was full */
 } VCOM_DATA_T;
 
 /**
@@ -88,6 +89,15 @@ ErrorCode_t vcom_init (USBD_HANDLE_T hUsb, USB_CORE_DESCS_T *pDesc, USBD_API_INI
  */
 uint32_t vcom_bread (uint8_t *pBuf, uint32_t buf_len);
 
+/**
+ * @brief	Virtual com port buffered read routine with a timeout
+ * @param	pBuf	: Pointer to buffer where read data should be copied
+ * @param	buf_len	: Length of the buffer passed
+ * @param	timeout	: Ticks to wait for data to arrive
+ * @return	Return number of bytes read, 0 on timeout.
+ */
+uint32_t vcom_bread_timeout (uint8_t *pBuf, uint32_t buf_len, uint32_t timeout);
+
 /**
  * @brief	Virtual com port read routine
  * @param	pBuf	: Pointer to buffer where read data should be copied
@@ -118,6 +128,14 @@ static INLINE uint32_t vcom_connected(void) {
  */
 uint32_t vcom_write (uint8_t *pBuf, uint32_t buf_len);
 
+/**
+ * @brief	Write a buffer of any length, one bulk packet at a time
+ * @param	pBuf	: Pointer to buffer to be written
+ * @param	buf_len	: Length of the buffer passed
+ * @return	false if the host went away part way through
+ */
+bool vcom_write_all (const uint8_t *pBuf, uint32_t buf_len);
+
 /**
  * @}
  */
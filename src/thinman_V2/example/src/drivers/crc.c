@@ -69,3 +69,20 @@ crc_crc16(const void *buffer, size_t size) {
 
 	return crc;
 }
+
+// CRC-32 as used by zlib and Ethernet, one nibble at a time to keep the table small
+static const uint32_t crc32_nibble_table[16] = {
+	0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t crc_crc32_update(uint32_t crc, const void* buffer, size_t length) {
+	const uint8_t* data = (const uint8_t*) buffer;
+	crc = ~crc;
+	while (length--) {
+		crc ^= *data++;
+		crc = crc32_nibble_table[crc & 0x0f] ^ (crc >> 4);
+		crc = crc32_nibble_table[crc & 0x0f] ^ (crc >> 4);
+	}
+	return ~crc;
+}
@@ -12,5 +12,7 @@
 #include <stddef.h>
 uint8_t crc_crc7(const void* buffer, size_t length);
 uint16_t crc_crc16(const void* buffer, size_t length);
+// Continue a CRC-32 (zlib.crc32 compatible); start from 0
+uint32_t crc_crc32_update(uint32_t crc, const void* buffer, size_t length);
 
 #endif /* CRC_H_ */
@@ -0,0 +1,37 @@
+/*
+ * cycles.h
+ *
+ *  Core clock cycle counts from the down-counting SysTick, for costing
+ *  short stretches of code against a budget. Build with CYCLES_HOST to count
+ *  host time stamp counter ticks instead.
+ */
+
+#ifndef CYCLES_H_
+#define CYCLES_H_
+
+#include <stdint.h>
+
+#ifdef CYCLES_HOST
+static inline uint32_t cycles_now(void) {
+	return (uint32_t) __builtin_ia32_rdtsc();
+}
+
+static inline uint32_t cycles_since(uint32_t start) {
+	return (uint32_t) __builtin_ia32_rdtsc() - start;
+}
+#else
+#include "chip.h"
+
+static inline uint32_t cycles_now(void) {
+	return SysTick->VAL;
+}
+
+// Cycles since start. Valid for spans shorter than one tick.
+static inline uint32_t cycles_since(uint32_t start) {
+	uint32_t now = SysTick->VAL;
+	if (now <= start) return start - now;
+	return start + (SysTick->LOAD + 1) - now;
+}
+#endif
+
+#endif /* CYCLES_H_ */
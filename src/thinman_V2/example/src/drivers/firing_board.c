@@ -12,6 +12,7 @@
 #include <math.h>
 #include <string.h>
 #include "./firing_board.h"
+#include "./crc.h"
 #include "logging.h"
 
 static I2C_ID_T firing_board_i2c_device;
@@ -37,18 +38,71 @@ bool firing_board_setup(I2C_ID_T i2c_device) {
 
 	return true;
 }
+static float firing_board_volts(uint16_t raw) {
+	// 12-bit counts: the firing board sums 16 conversions of its 10-bit ADC and drops 2 bits
+	return raw * (2.56f / 4092 * ((82+10) / 10));
+}
+
 float firing_board_read_volt(firing_board_volt_channel_t vchan) {
 	uint16_t raw_output;
 	if (firing_board_transceive_command(0x01, &vchan, 1, &raw_output, sizeof(raw_output)) != 0) {
 		return INFINITY;
 	}
-	return raw_output * (2.56f / 1023 * ((82+10) / 10));
+	return firing_board_volts(raw_output);
 }
 
 bool firing_board_fire_channel(uint8_t channel) {
 	return firing_board_transceive_command(0x03, &channel, 1, NULL, 0) == 0;
 }
 
+bool firing_board_fire_channel_after(uint8_t channel, uint16_t delay_ms) {
+	uint8_t args[3] = {channel, delay_ms, delay_ms >> 8};
+	return firing_board_transceive_command(0x03, args, sizeof(args), NULL, 0) == 0;
+}
+
+static uint32_t firing_board_get_u32(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+bool firing_board_read_fire_status(firing_board_fire_status_t* status) {
+	uint8_t raw[14];
+	if (firing_board_transceive_command(0x04, NULL, 0, raw, sizeof(raw)) != 0) {
+		return false;
+	}
+	status->channel = raw[0];
+	status->state = raw[1];
+	status->request_us = firing_board_get_u32(raw + 2);
+	status->fire_us = firing_board_get_u32(raw + 6);
+	status->now_us = firing_board_get_u32(raw + 10);
+	return true;
+}
+
+bool firing_board_read_status(firing_board_status_t* status) {
+	// External battery, bus, then channels 1-4 as 12-bit values packed two per three bytes,
+	// mode, fire count and a CRC-16 of everything before it
+	uint8_t raw[13];
+	uint16_t values[2 + FIRING_BOARD_CHANNELS];
+	int i;
+	if (firing_board_transceive_command(0x05, NULL, 0, raw, sizeof(raw)) != 0) {
+		return false;
+	}
+	if (crc_crc16(raw, 11) != (raw[11] | (raw[12] << 8))) {
+		LOG_WARN("Firing board status CRC mismatch");
+		return false;
+	}
+	for (i = 0; i < 2 + FIRING_BOARD_CHANNELS; i += 2) {
+		const uint8_t* p = raw + i / 2 * 3;
+		values[i] = p[0] | ((p[1] & 0x0f) << 8);
+		values[i + 1] = (p[1] >> 4) | (p[2] << 4);
+	}
+	status->vext = firing_board_volts(values[0]);
+	status->vbus = firing_board_volts(values[1]);
+	memcpy(status->channel_raw, values + 2, sizeof(status->channel_raw));
+	status->mode = raw[9];
+	status->fire_count = raw[10];
+	return true;
+}
+
 uint8_t firing_board_transceive_command(uint8_t command, const void* arguments, size_t arg_size, void* output, size_t output_size) {
 	static uint8_t buf[16];
 	if (arg_size + 1 > sizeof(buf)) {
@@ -17,6 +17,47 @@ typedef enum {
 	VOLTAGE_BUS,
 } firing_board_volt_channel_t;
 
+// Progress of the firing board's last fire request
+typedef enum {
+	FIRING_BOARD_FIRE_IDLE,
+	FIRING_BOARD_FIRE_ARMED,		// Waiting out the arm-to-fire delay
+	FIRING_BOARD_FIRE_PULSE,		// Channel asserted
+	FIRING_BOARD_FIRE_DONE,
+} firing_board_fire_state_t;
+
+// Mirrors system_mode_t on the firing board
+typedef enum {
+	FIRING_BOARD_MODE_BOOTING,
+	FIRING_BOARD_MODE_NO_POWER,
+	FIRING_BOARD_MODE_READY,
+	FIRING_BOARD_MODE_FIRE_READY,
+	FIRING_BOARD_MODE_FIRING,
+} firing_board_mode_t;
+
+#define FIRING_BOARD_CHANNELS 4
+
+// Everything the board reports, read in a single transaction
+typedef struct {
+	float vext;
+	float vbus;
+	uint16_t channel_raw[FIRING_BOARD_CHANNELS];	// 12-bit counts on the same scale as vext
+	firing_board_mode_t mode;
+	uint8_t fire_count;		// Channel pulses since the board powered up; wraps
+} firing_board_status_t;
+
+// Times are on the firing board's own microsecond clock (8 us resolution)
+typedef struct {
+	uint8_t channel;
+	firing_board_fire_state_t state;
+	uint32_t request_us;	// When the board handled the fire command
+	uint32_t fire_us;		// When the channel pin was asserted
+	uint32_t now_us;		// When the board answered this read
+} firing_board_fire_status_t;
+
+// Arm-to-fire delay the board applies to firing_board_fire_channel requests
+#define FIRING_BOARD_DEFAULT_DELAY_MS 2000
+#define FIRING_BOARD_MAX_DELAY_MS 10000
+
 // Flag indicating whether last communication failed with NACK
 extern bool firing_board_transmit_error;
 
@@ -28,6 +69,11 @@ bool firing_board_setup(I2C_ID_T i2c_device);
 float firing_board_read_volt(firing_board_volt_channel_t vchan);
 // Command the firing board to start firing one channel
 bool firing_board_fire_channel(uint8_t channel);
+// Fire one channel delay_ms after the board handles the request. 0 asserts the channel before the board replies.
+bool firing_board_fire_channel_after(uint8_t channel, uint16_t delay_ms);
+bool firing_board_read_fire_status(firing_board_fire_status_t* status);
+// Read voltages, channel levels, mode and fire count in one burst. Returns false on a bus error or bad CRC.
+bool firing_board_read_status(firing_board_status_t* status);
 // Send a command to the firing board, and read the output.  Returns 0 if successful. Non-zero error code otherwise.
 uint8_t firing_board_transceive_command(uint8_t command, const void* arguments, size_t arg_size, void* output, size_t output_size);
 
@@ -0,0 +1,410 @@
+/*
+ * ftl.c
+ *
+ *  Blocks fill one at a time and sequence numbers only grow, so replaying
+ *  the blocks in order of their first tag replays the writes in order.
+ *  Slots are numbered block * FTL_SLOTS + slot.
+ */
+
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging.h"
+#include "drivers/S25FL.h"
+#include "drivers/crc.h"
+#include "./ftl.h"
+
+#define FTL_UNMAPPED	0xffff
+#define FTL_NONE		0xff
+#define FTL_COPY_SIZE	256			// A page, S25FL_P_256
+
+typedef enum {
+	FTL_TAG_BLANK,
+	FTL_TAG_GOOD,
+	FTL_TAG_TORN,		// Power failed while it was programmed
+} ftl_tag_t;
+
+typedef struct {
+	uint16_t erases;
+	uint8_t live;		// Slots the map points at
+	bool free;			// Erased, with a header and no tags
+} ftl_block_t;
+
+typedef struct {
+	uint16_t* map;		// Sector to slot
+	ftl_block_t block[FTL_BLOCKS];
+	uint8_t current;	// Block being filled
+	uint8_t slot;		// Next slot in it, FTL_SLOTS when full
+	uint8_t free_blocks;
+	uint32_t sequence;	// Of the next write
+	uint8_t copy[FTL_COPY_SIZE];
+	bool ready;
+	ftl_stats_t stats;
+} ftl_state_t;
+
+static ftl_state_t ftl;
+
+static uint32_t ftl_block_address(uint8_t block) {
+	return (uint32_t) block * FTL_BLOCK_SIZE;
+}
+
+static uint32_t ftl_tag_address(uint8_t block, uint8_t slot) {
+	return ftl_block_address(block) + FTL_HEADER_SIZE + (uint32_t) slot * FTL_TAG_SIZE;
+}
+
+static uint32_t ftl_data_address(uint16_t slot) {
+	return ftl_block_address(slot / FTL_SLOTS) + (uint32_t) (FTL_TAG_SLOTS + slot % FTL_SLOTS) * FTL_SECTOR_SIZE;
+}
+
+static void ftl_put_u16(uint8_t* p, uint16_t value) {
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+static void ftl_put_u32(uint8_t* p, uint32_t value) {
+	ftl_put_u16(p, value);
+	ftl_put_u16(p + 2, value >> 16);
+}
+
+static uint16_t ftl_get_u16(const uint8_t* p) {
+	return p[0] | ((uint16_t) p[1] << 8);
+}
+
+static uint32_t ftl_get_u32(const uint8_t* p) {
+	return ftl_get_u16(p) | ((uint32_t) ftl_get_u16(p + 2) << 16);
+}
+
+// An erase-ahead of the flash mirror may still be running
+static void ftl_wait(void) {
+	while (S25FL_busy()) {
+		vTaskDelay(1);
+	}
+}
+
+static bool ftl_read_header(uint8_t block, uint16_t* erases) {
+	uint8_t header[10];
+	S25FL_read(ftl_block_address(block), header, sizeof(header));
+	if (ftl_get_u32(header) != FTL_MAGIC || ftl_get_u16(header + 8) != crc_crc16(header, 8)) {
+		return false;
+	}
+	*erases = ftl_get_u32(header + 4);
+	return true;
+}
+
+static ftl_tag_t ftl_read_tag(uint8_t block, uint8_t slot, uint16_t* sector, uint32_t* sequence) {
+	uint8_t tag[8];
+	S25FL_read(ftl_tag_address(block, slot), tag, sizeof(tag));
+	*sector = ftl_get_u16(tag);
+	*sequence = ftl_get_u32(tag + 2);
+	if (*sector == FTL_UNMAPPED && *sequence == 0xffffffff && ftl_get_u16(tag + 6) == 0xffff) {
+		return FTL_TAG_BLANK;
+	}
+	return ftl_get_u16(tag + 6) == crc_crc16(tag, 6) ? FTL_TAG_GOOD : FTL_TAG_TORN;
+}
+
+static bool ftl_slot_blank(uint16_t slot) {
+	uint16_t i, n;
+	for (i = 0; i < FTL_SECTOR_SIZE; i += FTL_COPY_SIZE) {
+		S25FL_read(ftl_data_address(slot) + i, ftl.copy, FTL_COPY_SIZE);
+		for (n = 0; n < FTL_COPY_SIZE; n++) {
+			if (ftl.copy[n] != 0xff) return false;
+		}
+	}
+	return true;
+}
+
+static void ftl_erase(uint8_t block) {
+	uint8_t header[10];
+	ftl_block_t* b = &ftl.block[block];
+
+	// Clear the magic first, so a block the erase did not finish is never replayed
+	memset(header, 0, sizeof(header));
+	S25FL_write(ftl_block_address(block), header, 4);
+	S25FL_erase_sector(ftl_block_address(block));
+	b->erases++;
+	ftl_put_u32(header, FTL_MAGIC);
+	ftl_put_u32(header + 4, b->erases);
+	ftl_put_u16(header + 8, crc_crc16(header, 8));
+	S25FL_write(ftl_block_address(block), header, sizeof(header));
+	b->live = 0;
+	b->free = true;
+	ftl.free_blocks++;
+	ftl.stats.erases++;
+	if (b->erases > ftl.stats.max_erases) {
+		ftl.stats.max_erases = b->erases;
+	}
+}
+
+// Programs the sector into the next slot, from RAM, or from the slot it is in when data is NULL
+static void ftl_program(uint16_t sector, const uint8_t* data, uint16_t from) {
+	uint16_t slot = ftl.current * FTL_SLOTS + ftl.slot;
+	uint32_t address = ftl_data_address(slot);
+	uint16_t old = ftl.map[sector];
+	uint8_t tag[8];
+	uint16_t i;
+
+	for (i = 0; i < FTL_SECTOR_SIZE; i += FTL_COPY_SIZE) {
+		if (data != NULL) {
+			memcpy(ftl.copy, data + i, FTL_COPY_SIZE);
+		} else {
+			S25FL_read(ftl_data_address(from) + i, ftl.copy, FTL_COPY_SIZE);
+		}
+		S25FL_write(address + i, ftl.copy, FTL_COPY_SIZE);
+	}
+	ftl_put_u16(tag, sector);
+	ftl_put_u32(tag + 2, ftl.sequence++);
+	ftl_put_u16(tag + 6, crc_crc16(tag, 6));
+	S25FL_write(ftl_tag_address(ftl.current, ftl.slot), tag, sizeof(tag));
+
+	if (old != FTL_UNMAPPED) {
+		ftl.block[old / FTL_SLOTS].live--;
+	}
+	ftl.map[sector] = slot;
+	ftl.block[ftl.current].live++;
+	ftl.slot++;
+}
+
+static void ftl_open_block(void) {
+	uint8_t b, best = FTL_NONE;
+	for (b = 0; b < FTL_BLOCKS; b++) {
+		if (ftl.block[b].free && (best == FTL_NONE || ftl.block[b].erases < ftl.block[best].erases)) {
+			best = b;
+		}
+	}
+	ftl.block[best].free = false;
+	ftl.free_blocks--;
+	ftl.current = best;
+	ftl.slot = 0;
+}
+
+// The block to collect: the one with fewest live slots, or for wear, the least
+// erased once it lags by FTL_WEAR_SPREAD. Only blocks whose live slots fit in
+// the space left are considered.
+static uint8_t ftl_victim(bool wear) {
+	uint16_t room = ftl.free_blocks * FTL_SLOTS + (FTL_SLOTS - ftl.slot);
+	uint8_t b, victim = FTL_NONE;
+
+	for (b = 0; b < FTL_BLOCKS; b++) {
+		const ftl_block_t* block = &ftl.block[b];
+		if (block->free || (b == ftl.current && ftl.slot < FTL_SLOTS) || block->live > room) {
+			continue;
+		}
+		if (victim == FTL_NONE) {
+			victim = b;
+		} else if (wear) {
+			if (block->erases < ftl.block[victim].erases) {
+				victim = b;
+			}
+		} else if (block->live < ftl.block[victim].live ||
+				(block->live == ftl.block[victim].live && block->erases < ftl.block[victim].erases)) {
+			victim = b;
+		}
+	}
+	if (wear && victim != FTL_NONE && ftl.stats.max_erases - ftl.block[victim].erases < FTL_WEAR_SPREAD) {
+		return FTL_NONE;
+	}
+	return victim;
+}
+
+// Copies the live slots of victim forward and erases it
+static bool ftl_collect(uint8_t victim) {
+	uint8_t slot;
+	uint16_t sector;
+	uint32_t sequence;
+
+	if (victim == FTL_NONE) {
+		LOG_ERROR("FTL has no block to collect");
+		return false;
+	}
+	for (slot = 0; slot < FTL_SLOTS && ftl.block[victim].live > 0; slot++) {
+		uint16_t from = victim * FTL_SLOTS + slot;
+		if (ftl_read_tag(victim, slot, &sector, &sequence) != FTL_TAG_GOOD ||
+				sector >= FTL_SECTOR_COUNT || ftl.map[sector] != from) {
+			continue;
+		}
+		if (ftl.slot == FTL_SLOTS) {
+			ftl_open_block();
+		}
+		ftl_program(sector, NULL, from);
+		ftl.stats.copies++;
+	}
+	ftl_erase(victim);
+	return true;
+}
+
+// Leaves a free slot to write to, and a free block besides. There is no free
+// block only after power failed in a collection, whose victim still fits.
+static bool ftl_reserve(void) {
+	bool levelled = false;
+	while (ftl.slot == FTL_SLOTS || ftl.free_blocks == 0) {
+		if (ftl.free_blocks < (ftl.slot == FTL_SLOTS ? 2 : 1)) {
+			if (!ftl_collect(ftl_victim(false))) return false;
+			continue;
+		}
+		ftl_open_block();
+		if (!levelled) {
+			uint8_t victim = ftl_victim(true);
+			levelled = true;
+			if (victim != FTL_NONE) {
+				ftl_collect(victim);
+			}
+		}
+	}
+	return true;
+}
+
+bool ftl_init(void) {
+	uint32_t first[FTL_BLOCKS];
+	uint8_t order[FTL_BLOCKS];
+	uint8_t used = 0, b, i, slot;
+	uint16_t sector, erases;
+	uint32_t sequence;
+	ftl_tag_t tag;
+	bool formatted[FTL_BLOCKS];
+
+	ftl.ready = false;
+	if ((S25FL_read_id() >> 16) != S25FL_MANUFACTURER_SPANSION) {
+		return false;
+	}
+	if (ftl.map == NULL) {
+		ftl.map = pvPortMalloc(FTL_SECTOR_COUNT * sizeof(uint16_t));
+		if (ftl.map == NULL) {
+			LOG_ERROR("No memory for the FTL map");
+			return false;
+		}
+	}
+	memset(ftl.map, 0xff, FTL_SECTOR_COUNT * sizeof(uint16_t));
+	memset(&ftl.stats, 0, sizeof(ftl.stats));
+	ftl.free_blocks = 0;
+	ftl.sequence = 0;
+	ftl.slot = FTL_SLOTS;
+	ftl_wait();
+
+	// Blocks in use, by the sequence of their first tag
+	for (b = 0; b < FTL_BLOCKS; b++) {
+		ftl_block_t* block = &ftl.block[b];
+		block->live = 0;
+		block->free = false;
+		formatted[b] = ftl_read_header(b, &erases);
+		if (!formatted[b]) continue;
+		block->erases = erases;
+		if (erases > ftl.stats.max_erases) {
+			ftl.stats.max_erases = erases;
+		}
+		switch (ftl_read_tag(b, 0, &sector, &sequence)) {
+		case FTL_TAG_BLANK:
+			block->free = true;
+			ftl.free_blocks++;
+			continue;
+		case FTL_TAG_TORN:
+			// Writes resume after a torn tag, so the block is as old as its
+			// first good one. With none it was the last opened, so the newest.
+			for (slot = 1; slot < FTL_SLOTS; slot++) {
+				tag = ftl_read_tag(b, slot, &sector, &sequence);
+				if (tag != FTL_TAG_TORN) break;
+			}
+			if (tag != FTL_TAG_GOOD) {
+				sequence = 0xffffffff;
+			}
+			break;
+		case FTL_TAG_GOOD:
+			break;
+		}
+		for (i = used++; i > 0 && first[i - 1] > sequence; i--) {
+			first[i] = first[i - 1];
+			order[i] = order[i - 1];
+		}
+		first[i] = sequence;
+		order[i] = b;
+	}
+
+	for (i = 0; i < used; i++) {
+		b = order[i];
+		for (slot = 0; slot < FTL_SLOTS; slot++) {
+			tag = ftl_read_tag(b, slot, &sector, &sequence);
+			if (tag == FTL_TAG_BLANK) break;
+			if (tag == FTL_TAG_GOOD && sector < FTL_SECTOR_COUNT) {
+				ftl.map[sector] = b * FTL_SLOTS + slot;
+				if (sequence >= ftl.sequence) {
+					ftl.sequence = sequence + 1;
+				}
+			}
+		}
+		ftl.current = b;
+		ftl.slot = slot;
+	}
+	// Writes resume after the last tag. A sector whose tag never made it gets a
+	// tag of zeros without its CRC, which reads as torn, so the next mount does
+	// not stop there.
+	while (ftl.slot < FTL_SLOTS && !ftl_slot_blank(ftl.current * FTL_SLOTS + ftl.slot)) {
+		memset(ftl.copy, 0, 6);
+		S25FL_write(ftl_tag_address(ftl.current, ftl.slot), ftl.copy, 6);
+		ftl.slot++;
+	}
+	for (sector = 0; sector < FTL_SECTOR_COUNT; sector++) {
+		if (ftl.map[sector] != FTL_UNMAPPED) {
+			ftl.block[ftl.map[sector] / FTL_SLOTS].live++;
+		}
+	}
+
+	// Erase counts of blocks that lost their header are taken as the highest
+	erases = ftl.stats.max_erases;
+	for (b = 0; b < FTL_BLOCKS; b++) {
+		if (!formatted[b]) {
+			ftl.block[b].erases = erases;
+			ftl_erase(b);
+		}
+	}
+	ftl.ready = true;
+	LOG_INFO("FTL at sequence %u, %u free blocks", ftl.sequence, ftl.free_blocks);
+	return true;
+}
+
+bool ftl_ready(void) {
+	return ftl.ready;
+}
+
+bool ftl_read(uint8_t* buffer, uint32_t sector, uint32_t count) {
+	if (!ftl.ready || sector + count > FTL_SECTOR_COUNT) return false;
+	ftl_wait();
+	for (; count > 0; count--, sector++, buffer += FTL_SECTOR_SIZE) {
+		if (ftl.map[sector] == FTL_UNMAPPED) {
+			memset(buffer, 0, FTL_SECTOR_SIZE);
+		} else {
+			S25FL_read(ftl_data_address(ftl.map[sector]), buffer, FTL_SECTOR_SIZE);
+		}
+	}
+	return true;
+}
+
+bool ftl_write(const uint8_t* buffer, uint32_t sector, uint32_t count) {
+	if (!ftl.ready || sector + count > FTL_SECTOR_COUNT) return false;
+	ftl_wait();
+	for (; count > 0; count--, sector++, buffer += FTL_SECTOR_SIZE) {
+		if (!ftl_reserve()) return false;
+		ftl_program(sector, buffer, 0);
+		ftl.stats.writes++;
+	}
+	return true;
+}
+
+void ftl_trim(uint32_t first, uint32_t last) {
+	if (!ftl.ready) return;
+	for (; first <= last && first < FTL_SECTOR_COUNT; first++) {
+		if (ftl.map[first] != FTL_UNMAPPED) {
+			ftl.block[ftl.map[first] / FTL_SLOTS].live--;
+			ftl.map[first] = FTL_UNMAPPED;
+		}
+	}
+}
+
+void ftl_get_stats(ftl_stats_t* stats) {
+	uint8_t b;
+	*stats = ftl.stats;
+	stats->min_erases = stats->max_erases;
+	for (b = 0; b < FTL_BLOCKS; b++) {
+		if (ftl.block[b].erases < stats->min_erases) {
+			stats->min_erases = ftl.block[b].erases;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/*
+ * ftl.h
+ *
+ *  Flash translation layer under FatFs drive 1 (fatfs/diskio.c), so the
+ *  S25FL can hold a FAT volume without erasing a block for every sector
+ *  FatFs rewrites. Sectors are never written in place: each write goes to
+ *  the next free slot of the block being filled, with a tag naming the
+ *  sector, and a RAM map points every sector at its newest slot. Once free
+ *  blocks run short, the block with fewest live slots is copied forward
+ *  and erased.
+ *
+ *  The FTL owns the bottom FTL_BLOCKS of the flash; the mirror ring in
+ *  tasks/flash_log.h has the rest. ftl_sim.py compiles this code for the
+ *  host and runs it against a model of the flash under the TAB writer's
+ *  workload.
+ */
+
+#ifndef FTL_H_
+#define FTL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Block, little-endian:
+ *   u32 FTL_MAGIC
+ *   u32 erase_count
+ *   u16 crc_crc16 of the above, then 6 bytes 0xff
+ *   FTL_SLOTS tags, each FTL_TAG_SIZE bytes:
+ *     u16 sector		0xffff while the slot is free
+ *     u32 sequence		Count of writes before this one, across the volume
+ *     u16 crc_crc16 of the above, then 8 bytes 0xff
+ *   FTL_SLOTS sectors, from FTL_TAG_SLOTS * FTL_SECTOR_SIZE
+ *
+ * The header is written after the erase and a tag after its sector, so a
+ * tag that checks out always has its data. The magic is cleared before an
+ * erase, so a block without a header may have been part erased, and is
+ * erased again on mount. Each tag is one 16 byte ECC unit of the S25FL-S and
+ * is programmed once. The newest tag for a sector wins on mount.
+ */
+#define FTL_MAGIC			0x314c5446		// "FTL1"
+#define FTL_SECTOR_SIZE		512
+#define FTL_BLOCK_SIZE		0x10000			// S25FL_erase_sector with S25FL_E_64
+#ifndef FTL_BLOCKS
+#define FTL_BLOCKS			16				// 1 MB
+#endif
+#define FTL_HEADER_SIZE		16
+#define FTL_TAG_SIZE		16
+#define FTL_TAG_SLOTS		4				// Sectors' worth of header and tags
+#define FTL_SLOTS			(FTL_BLOCK_SIZE / FTL_SECTOR_SIZE - FTL_TAG_SLOTS)
+
+// Blocks' worth of slots kept back from the volume: one stays erased for
+// garbage collection to copy into, and the other keeps the live fraction of
+// the rest below 1, so collecting a block always gains space
+#define FTL_SPARE_BLOCKS	2
+#define FTL_SECTOR_COUNT	((FTL_BLOCKS - FTL_SPARE_BLOCKS) * FTL_SLOTS)
+
+// Once erase counts differ by this much, the least-erased block is collected
+// whatever it holds, so data that never changes does not pin it
+#define FTL_WEAR_SPREAD		64
+
+typedef struct {
+	uint32_t writes;		// Sectors written by FatFs
+	uint32_t copies;		// Sectors moved by garbage collection
+	uint32_t erases;
+	uint16_t min_erases;	// Over the blocks, including those before boot
+	uint16_t max_erases;
+} ftl_stats_t;
+
+// Rebuilds the map from the tags, erasing blocks left without a header, which
+// formats a blank partition. Takes 2 bytes a sector from the heap. Returns false
+// when there is no flash or no memory.
+bool ftl_init(void);
+bool ftl_ready(void);
+
+// Sectors never written, or trimmed, read as 0
+bool ftl_read(uint8_t* buffer, uint32_t sector, uint32_t count);
+bool ftl_write(const uint8_t* buffer, uint32_t sector, uint32_t count);
+
+// Forgets sectors first to last, so they are not copied again; for FatFs
+// CTRL_ERASE_SECTOR. Not recorded on the flash, so they come back after a
+// reboot until rewritten.
+void ftl_trim(uint32_t first, uint32_t last);
+
+void ftl_get_stats(ftl_stats_t* stats);
+
+#endif /* FTL_H_ */
@@ -17,6 +17,7 @@ void i2c_init(void) {
 
 	for (i = 0; i < I2C_NUM_INTERFACE; i++) {
 		i2c_devices[i].mutex = xSemaphoreCreateMutex();
+		vQueueAddToRegistry(i2c_devices[i].mutex, i == 0 ? "I2C0" : "I2C1");
 		vSemaphoreCreateBinary(i2c_devices[i].sem_ready);
 		xSemaphoreTake(i2c_devices[i].sem_ready, 0);
 	}
@@ -45,21 +46,25 @@ void i2c_setup_master(I2C_ID_T device) {
 
 void I2C0_IRQHandler(void)
 {
+	KERNEL_TRACE_ISR_ENTER(I2C0_IRQn);
 	if (Chip_I2C_IsMasterActive(I2C0)) {
 		Chip_I2C_MasterStateHandler(I2C0);
 	}
 	else {
 		Chip_I2C_SlaveStateHandler(I2C0);
 	}
+	KERNEL_TRACE_ISR_EXIT(I2C0_IRQn);
 }
 
 
 void I2C1_IRQHandler(void)
 {
+	KERNEL_TRACE_ISR_ENTER(I2C1_IRQn);
 	if (Chip_I2C_IsMasterActive(I2C1)) {
 		Chip_I2C_MasterStateHandler(I2C1);
 	}
 	else {
 		Chip_I2C_SlaveStateHandler(I2C1);
 	}
+	KERNEL_TRACE_ISR_EXIT(I2C1_IRQn);
 }
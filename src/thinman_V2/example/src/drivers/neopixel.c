@@ -4,15 +4,17 @@
  *  Created on: Nov 18, 2014
  *      Author: Max Zhao
  *
- * @remarks I'm giving up on using interrupts and/or DMA for neopixels on the LPC. For alternative chipsets it's possible to do
- * this unblocking using DMA and timers (PWM), but that requires a good (working) system and a decent PWM timer that can at least
- * control the output polarity, unlike the abomination that is TIM16B0.   See
- * https://github.com/ErichStyger/mcuoneclipse/tree/master/Examples/Eclipse/FRDM-KL25Z/FRDM-KL25Z_NeoPixel, more specifically
- * https://github.com/ErichStyger/mcuoneclipse/blob/master/Examples/Eclipse/FRDM-KL25Z/FRDM-KL25Z_NeoPixel/Sources/NeoPixel.c
- * for what non-blocking code might look like.  We might have better luck with SCT0/1
+ * The WS2812 data line is PIO0_10, which has no SSP MOSI or SCT output function, so the waveform is written to the
+ * pin's GPIO byte register by DMA. Every WS2812 bit becomes three slots of 1/3 bit time each: high, the data bit, low.
+ * SCT0 runs as a plain 32-bit timer whose limit event raises DMA request 0 once per slot, and that request paces a
+ * single-byte transfer per slot. Interrupts stay enabled the whole time; the CPU only encodes the slots and starts
+ * the channel.
  *
- * Current solution is to use stop-the-world blocking code that disables all interrupts (with sufficiently low priority that
- * portDISABLE_INTERRUPTS) works on them, and activate the updates asynchronously when the system is in idle (idle hook)
+ * Set NEOPIXEL_USE_DMA to 0 for the old ws2812_sendarray path, which bit-bangs with interrupts disabled: 60 cycles a
+ * bit at 48 MHz, ~460 a byte with the loop, so ~58 us for both pixels, on every idle pass. That was the worst the
+ * latency probe could see. With DMA the longest masked stretches left are estimated at ~15 us for a tick waking
+ * every blocked task at once and ~13 us for warm_restart_save_file's CRC; not yet checked on a board.
+ * timebase_take_irq_latency_max (see the perf report) shows the difference.
  */
 
 #include <string.h>
@@ -21,6 +23,7 @@
 #include <task.h>
 #include "./neopixel.h"
 #include "./light_ws2812_cortex.h"
+#include "./timebase.h"
 
 #define NEOPIXEL_FREQ ((uint32_t) (1/1.25e-6))
 #define NEOPIXEL_0_HIGH_FREQ ((uint32_t) (1/0.4e-6))
@@ -28,12 +31,106 @@
 #define NEOPIXEL_UPDATE_DATA_FREQ NEOPIXEL_1_HIGH_FREQ
 #define NEOPIXEL_RESET_FREQ ((uint32_t) (1/51e-6))
 
+#define NEOPIXEL_PORT 0
+#define NEOPIXEL_PIN 10
+#define NEOPIXEL_DMA_CHANNEL DMA_CH14		// No peripheral request of its own
+// A third of the 1.25 us bit time: 0 is high for 0.42 us, 1 for 0.83 us
+#define NEOPIXEL_SLOTS_PER_BIT 3
+#define NEOPIXEL_SLOT_FREQ (NEOPIXEL_FREQ * NEOPIXEL_SLOTS_PER_BIT)
+// A low slot first absorbs a request left pending from the last frame, one last holds the line low
+#define NEOPIXEL_SLOT_COUNT (1 + NEOPIXEL_COUNT * 24 * NEOPIXEL_SLOTS_PER_BIT + 1)
+// Frame plus the > 50 us reset gap before the next one may start
+#define NEOPIXEL_FRAME_US (NEOPIXEL_SLOT_COUNT * 1000000 / NEOPIXEL_SLOT_FREQ + 1000000 / NEOPIXEL_RESET_FREQ + 1)
+
 static uint32_t pixel_colors[NEOPIXEL_COUNT];
 static uint8_t output_array[NEOPIXEL_COUNT * 3];
 static uint8_t last_output_array[NEOPIXEL_COUNT * 3];
 
+#if NEOPIXEL_USE_DMA
+static uint8_t neopixel_slots[NEOPIXEL_SLOT_COUNT];
+static uint32_t neopixel_frame_start_us;
+static bool neopixel_sending;
+
+static void neopixel_dma_init(void) {
+	Chip_DMA_Init(LPC_DMA);
+	Chip_DMA_Enable(LPC_DMA);
+	Chip_DMA_SetSRAMBase(LPC_DMA, DMA_ADDR(Chip_DMA_Table));
+	Chip_DMA_EnableChannel(LPC_DMA, NEOPIXEL_DMA_CHANNEL);
+	Chip_DMA_SetupChannelConfig(LPC_DMA, NEOPIXEL_DMA_CHANNEL, DMA_CFG_HWTRIGEN | DMA_CFG_TRIGPOL_HIGH |
+			DMA_CFG_TRIGTYPE_EDGE | DMA_CFG_TRIGBURST_SNGL | DMA_CFG_CHPRIORITY(0));
+	Chip_DMA_SetHWTrigger(LPC_DMATRIGMUX, NEOPIXEL_DMA_CHANNEL, DMATRIG_SCT0_DMA0);
+
+	Chip_SCT_Init(LPC_SCT0);
+	Chip_SCT_Config(LPC_SCT0, SCT_CONFIG_32BIT_COUNTER | SCT_CONFIG_CLKMODE_BUSCLK);
+	Chip_SCT_SetControl(LPC_SCT0, SCT_CTRL_HALT_L | SCT_CTRL_CLRCTR_L);
+	LPC_SCT0->REGMODE_L = 0;
+	Chip_SCT_SetMatchCount(LPC_SCT0, SCT_MATCH_0, SystemCoreClock / NEOPIXEL_SLOT_FREQ - 1);
+	Chip_SCT_SetMatchReload(LPC_SCT0, SCT_MATCH_0, SystemCoreClock / NEOPIXEL_SLOT_FREQ - 1);
+	// Event 0: match 0 in state 0. It restarts the count and requests one slot transfer.
+	LPC_SCT0->EVENT[0].STATE = 1;
+	LPC_SCT0->EVENT[0].CTRL = SCT_MATCH_0 | (1 << 12);
+	LPC_SCT0->LIMIT_L = SCT_EVT_0;
+	LPC_SCT0->DMA0REQUEST = SCT_EVT_0;
+}
+
+static void neopixel_encode(void) {
+	uint8_t* slot = neopixel_slots;
+	int i, bit;
+	*slot++ = 0;
+	for (i = 0; i < sizeof(output_array); i++) {
+		for (bit = 7; bit >= 0; bit--) {
+			*slot++ = 1;
+			*slot++ = (output_array[i] >> bit) & 1;
+			*slot++ = 0;
+		}
+	}
+	*slot = 0;
+}
+
+// True while a frame or its reset gap is still going out. Stops the pacing timer once it is over.
+static bool neopixel_busy(void) {
+	if (!neopixel_sending) return false;
+	if ((Chip_DMA_GetActiveChannels(LPC_DMA) & (1 << NEOPIXEL_DMA_CHANNEL)) ||
+			timebase_us() - neopixel_frame_start_us < NEOPIXEL_FRAME_US) {
+		return true;
+	}
+	Chip_SCT_SetControl(LPC_SCT0, SCT_CTRL_HALT_L | SCT_CTRL_CLRCTR_L);
+	neopixel_sending = false;
+	return false;
+}
+
+static void neopixel_send_data(void) {
+	DMA_CHDESC_T desc;
+	neopixel_encode();
+	desc.xfercfg = 0;
+	desc.source = DMA_ADDR(&neopixel_slots[NEOPIXEL_SLOT_COUNT - 1]);
+	desc.dest = DMA_ADDR(&LPC_GPIO->B[NEOPIXEL_PORT][NEOPIXEL_PIN]);
+	desc.next = 0;
+	Chip_DMA_SetupTranChannel(LPC_DMA, NEOPIXEL_DMA_CHANNEL, &desc);
+	Chip_DMA_SetupChannelTransfer(LPC_DMA, NEOPIXEL_DMA_CHANNEL, DMA_XFERCFG_CFGVALID | DMA_XFERCFG_WIDTH_8 |
+			DMA_XFERCFG_SRCINC_1 | DMA_XFERCFG_DSTINC_0 | DMA_XFERCFG_XFERCOUNT(NEOPIXEL_SLOT_COUNT));
+	neopixel_frame_start_us = timebase_us();
+	neopixel_sending = true;
+	Chip_SCT_ClearControl(LPC_SCT0, SCT_CTRL_HALT_L);
+}
+#else
+static void neopixel_dma_init(void) {
+}
+
+static bool neopixel_busy(void) {
+	return false;
+}
+
+static void neopixel_send_data(void) {
+	portDISABLE_INTERRUPTS();
+	ws2812_sendarray(output_array, sizeof(output_array));
+	portENABLE_INTERRUPTS();
+}
+#endif
+
 void neopixel_init(void) {
 	memset(pixel_colors, 0, sizeof(pixel_colors));
+	neopixel_dma_init();
 	neopixel_refresh_now();
 }
 
@@ -50,19 +147,15 @@ static bool check_update_output_array(void) {
 	return changed;
 }
 
-static void neopixel_send_data(void) {
-	portDISABLE_INTERRUPTS();
-	ws2812_sendarray(output_array, sizeof(output_array));
-	portENABLE_INTERRUPTS();
-}
-
 void neopixel_refresh_now(void) {
+	while (neopixel_busy());
 	check_update_output_array();
 	neopixel_send_data();
 }
 
 void neopixel_refresh_idle(void) {
-	if (check_update_output_array()) {
+	// Leave the change pending until the frame in flight is done
+	if (!neopixel_busy() && check_update_output_array()) {
 		neopixel_send_data();
 	}
 }
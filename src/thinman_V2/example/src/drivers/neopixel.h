@@ -11,6 +11,8 @@
 
 // The number of Neopixels to be controlled
 #define NEOPIXEL_COUNT 2
+// Clock frames out with SCT-paced DMA, leaving interrupts enabled. 0 bit-bangs them with interrupts disabled.
+#define NEOPIXEL_USE_DMA 1
 // Convert a 24-bit color from 0xRRGGBB format to 0xGGRRBB format (used by WS2812B)
 #define NEOPIXEL_COLOR_FROM_RGB(rgb)  (((rgb >> 16) << 8) | (((rgb >> 8) & 0xff) << 16) | (rgb & 0xff))
 
@@ -18,9 +20,9 @@
 void neopixel_init(void);
 // Update the color of a neopixel.  Does not actually change color until next refresh
 void neopixel_set_color(uint32_t index, uint32_t color);
-// Force a neopixel update now
+// Force a neopixel update now, waiting out a frame still in flight
 void neopixel_refresh_now(void);
-// Update neopixels iff at least one pixel's color had been changed.  Intended to be used in vApplicationIdleHook
+// Update neopixels iff at least one pixel's color had been changed and no frame is going out.  Intended to be used in vApplicationIdleHook
 void neopixel_refresh_idle(void);
 
 
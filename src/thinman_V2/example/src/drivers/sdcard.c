@@ -4,6 +4,7 @@
 #include "crc.h"
 #include "spi.h"
 #include "logging.h"
+#include "timebase.h"
 #include "./sdcard.h"
 
 #include "chip.h"
@@ -45,6 +46,32 @@ void SDCardDumpLogs(void) {
 
 #endif
 
+#ifdef SDCARD_WRITE_TIMING
+
+static sdcard_write_stats_t sdcard_write_stats;
+
+static void SDCardTimeWrite(uint32_t elapsed_us, size_t count) {
+	uint32_t ms = elapsed_us / 1000;
+	int bucket = 0;
+	while (ms > 0 && bucket < SDCARD_WRITE_BUCKETS - 1) {
+		ms >>= 1;
+		bucket++;
+	}
+	sdcard_write_stats.writes++;
+	sdcard_write_stats.sectors += count;
+	sdcard_write_stats.histogram[bucket]++;
+	if (elapsed_us > sdcard_write_stats.max_us) {
+		sdcard_write_stats.max_us = elapsed_us;
+	}
+}
+
+void SDCardGetWriteStats(sdcard_write_stats_t* stats) {
+	// Only the storage task writes, so a copy taken from the same task is consistent
+	*stats = sdcard_write_stats;
+}
+
+#endif
+
 static void SDCardSlowMode() {
 	spi_set_bit_rate(SDCARD_SPI_DEVICE, 100000);
 }
@@ -81,9 +108,10 @@ void SDCardWaitIdle() {
 }
 
 int SDCardSendCommand(uint8_t command, uint32_t param, uint8_t crc, void* buffer, size_t recvSize) {
-	Chip_GPIO_SetPinState(LPC_GPIO, 0, 2, !Chip_GPIO_GetPinState(LPC_GPIO, 0, 2));
 	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
 		xSemaphoreTake(xMutexSDCard, portMAX_DELAY);
+	// The S25FL shares the bus
+	spi_lock(SDCARD_SPI_DEVICE);
 	int result = SDCARD_ERROR_GENERIC;
 	int wait = SDCARD_SPI_MAX_WAIT;
 	int i;
@@ -175,6 +203,7 @@ int SDCardSendCommand(uint8_t command, uint32_t param, uint8_t crc, void* buffer
 	}
  finish:
 	SDCardClearSS();
+	spi_unlock(SDCARD_SPI_DEVICE);
 	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
 		xSemaphoreGive(xMutexSDCard);
 	return result;
@@ -192,6 +221,7 @@ void SDCardInit() {
 	Chip_GPIO_SetPinDIROutput(LPC_GPIO, SDCARD_SPI_SLAVE_PORT, SDCARD_SPI_SLAVE_PIN);
 	SDCardClearSS();
 	xMutexSDCard = xSemaphoreCreateMutex();
+	vQueueAddToRegistry(xMutexSDCard, "SDCard");
 }
 
 int SDCardStartup() {
@@ -371,6 +401,7 @@ static int SDCardWriteSectorInternal(const uint8_t* buffer, uint32_t sector) {
 
 	uint16_t sendCRC = crc_crc16(buffer, 512);
 	// Send actual data blocks now
+	spi_lock(SDCARD_SPI_DEVICE);
 	SDCardSetSS();
 
 	spi_transceive_byte(SDCARD_SPI_DEVICE, 0xfe);
@@ -381,6 +412,8 @@ static int SDCardWriteSectorInternal(const uint8_t* buffer, uint32_t sector) {
 	result = spi_transceive_byte(SDCARD_SPI_DEVICE, 0xff) & 0x1f;
 
 	while (spi_transceive_byte(SDCARD_SPI_DEVICE, 0xff) == 0);
+	SDCardClearSS();
+	spi_unlock(SDCARD_SPI_DEVICE);
 
 	if (result == 5) return 0;
 
@@ -405,6 +438,11 @@ int SDCardWriteSector(const uint8_t* buffer, uint32_t sector) {
 
 int SDCardDiskWrite(const uint8_t* buffer, uint32_t sector, size_t count) {
 	int result = 0;
+#ifdef SDCARD_WRITE_TIMING
+	// Includes waiting for the card to finish programming, which is where it stalls
+	uint32_t start_us = timebase_us();
+	size_t sectors = count;
+#endif
 	while (count > 0) {
 		result = SDCardWriteSector(buffer, sector);
 		if (result != 0) return result;
@@ -412,6 +450,9 @@ int SDCardDiskWrite(const uint8_t* buffer, uint32_t sector, size_t count) {
 		sector ++;
 		count --;
 	}
+#ifdef SDCARD_WRITE_TIMING
+	SDCardTimeWrite(timebase_us() - start_us, sectors);
+#endif
 	Chip_GPIO_SetPinOutLow(LPC_GPIO, 0, 20);
 	return result;
 }
@@ -42,6 +42,19 @@
 // Number of buffered entries in the SD card error log
 #define SDCARD_ERROR_LOG_SIZE 0x20
 
+// Enable timing every SDCardDiskWrite into a latency histogram
+#define SDCARD_WRITE_TIMING
+// Bucket 0 counts writes under 1 ms, bucket n those from 2^(n-1) up to 2^n ms,
+// and the last everything from 512 ms, which covers a card's garbage collection
+#define SDCARD_WRITE_BUCKETS 11
+
+typedef struct {
+	uint32_t writes;		// SDCardDiskWrite calls, whatever the sector count
+	uint32_t sectors;
+	uint32_t max_us;		// Longest call
+	uint32_t histogram[SDCARD_WRITE_BUCKETS];
+} sdcard_write_stats_t;
+
 // Initialize SD card resources (mutexes, semaphores)
 void SDCardInit();
 // Startup SD card. Returns 0 if successful, an error code otherwise
@@ -69,4 +82,9 @@ int SDCardDiskWrite(const uint8_t* buffer, uint32_t sector, size_t count);
 void SDCardDumpLogs(void);
 #endif
 
+#ifdef SDCARD_WRITE_TIMING
+// Copy the latency counts since boot
+void SDCardGetWriteStats(sdcard_write_stats_t* stats);
+#endif
+
 #endif /* SDCARD_H_ */
@@ -17,7 +17,8 @@ void spi_init() {
 	spi_devices[0].ssp_device = LPC_SSP0;
 	spi_devices[1].ssp_device = LPC_SSP1;
 	for (i = 0; i < sizeof(spi_devices) / sizeof(spi_devices[0]); i++) {
-		spi_devices[i].mutex = xSemaphoreCreateMutex();
+		spi_devices[i].mutex = xSemaphoreCreateRecursiveMutex();
+		vQueueAddToRegistry(spi_devices[i].mutex, i == 0 ? "SPI0" : "SPI1");
 		vSemaphoreCreateBinary(spi_devices[i].sem_ready);
 		xSemaphoreTake(spi_devices[i].sem_ready, 0);
 	}
@@ -60,16 +61,20 @@ static void spi_interrupt_transceive(spi_device_t* device) {
 }
 
 void SSP0_IRQHandler(void) {
-	 spi_interrupt_transceive(&spi_devices[0]);
+	KERNEL_TRACE_ISR_ENTER(SSP0_IRQn);
+	spi_interrupt_transceive(&spi_devices[0]);
+	KERNEL_TRACE_ISR_EXIT(SSP0_IRQn);
 }
 
 void SSP1_IRQHandler(void) {
-	 spi_interrupt_transceive(&spi_devices[1]);
+	KERNEL_TRACE_ISR_ENTER(SSP1_IRQn);
+	spi_interrupt_transceive(&spi_devices[1]);
+	KERNEL_TRACE_ISR_EXIT(SSP1_IRQn);
 }
 
 static void spi_transceive_internal(spi_device_t* device, uint8_t* read_buffer, const uint8_t* write_buffer, size_t size) {
 	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
-		xSemaphoreTake(device->mutex, portMAX_DELAY);
+		xSemaphoreTakeRecursive(device->mutex, portMAX_DELAY);
 	device->xf_setup.rx_data = read_buffer;
 	device->xf_setup.tx_data = (void*) write_buffer;
 	device->xf_setup.length = size;
@@ -93,7 +98,7 @@ static void spi_transceive_internal(spi_device_t* device, uint8_t* read_buffer,
 	}
 
 	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
-		xSemaphoreGive(device->mutex);
+		xSemaphoreGiveRecursive(device->mutex);
 }
 
 void spi_transceive(spi_device_t* device, uint8_t* buffer, size_t size) {
@@ -114,3 +119,13 @@ uint8_t spi_transceive_byte(spi_device_t* device, uint8_t b) {
 void spi_receive(spi_device_t* device, uint8_t* buffer, size_t size) {
 	spi_transceive_internal(device, buffer, NULL, size);
 }
+
+void spi_lock(spi_device_t* device) {
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		xSemaphoreTakeRecursive(device->mutex, portMAX_DELAY);
+}
+
+void spi_unlock(spi_device_t* device) {
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		xSemaphoreGiveRecursive(device->mutex);
+}
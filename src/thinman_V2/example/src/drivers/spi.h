@@ -49,6 +49,10 @@ uint8_t spi_transceive_byte(spi_device_t* device, uint8_t b);
 void spi_receive(spi_device_t* device, uint8_t* buffer, size_t size);
 // Send data to the SPI device, and discard any received data (buffer will not be overwritten)
 void spi_send(spi_device_t* device, const uint8_t* buffer, size_t size);
+// Hold the bus from slave select to deselect, for slaves that share it (the SD card and the S25FL).
+// Transfers inside nest on the same mutex.
+void spi_lock(spi_device_t* device);
+void spi_unlock(spi_device_t* device);
 
 
 #endif /* SPI_H_ */
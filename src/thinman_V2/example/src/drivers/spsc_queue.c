@@ -0,0 +1,52 @@
+/*
+ * spsc_queue.c
+ */
+
+#include <string.h>
+#include "./spsc_queue.h"
+
+#ifdef SPSC_HOST
+#define SPSC_BARRIER() __sync_synchronize()
+#else
+#include <chip.h>
+#define SPSC_BARRIER() __DMB()
+#endif
+
+void spsc_queue_init(spsc_queue_t* queue, void* buffer, uint16_t record_size, uint32_t capacity) {
+	queue->buffer = (uint8_t*) buffer;
+	queue->record_size = record_size;
+	queue->mask = capacity - 1;
+	queue->head = 0;
+	queue->tail = 0;
+	queue->high_water = 0;
+	queue->dropped = 0;
+}
+
+bool spsc_queue_push(spsc_queue_t* queue, const void* record) {
+	uint32_t head = queue->head;
+	uint32_t count = head - queue->tail;
+	if (count > queue->mask) {
+		queue->dropped++;
+		return false;
+	}
+	memcpy(&queue->buffer[(head & queue->mask) * queue->record_size], record, queue->record_size);
+	// The record must land before the index that publishes it
+	SPSC_BARRIER();
+	queue->head = head + 1;
+	if (count + 1 > queue->high_water) {
+		queue->high_water = count + 1;
+	}
+	return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t* queue, void* record) {
+	uint32_t tail = queue->tail;
+	if (queue->head == tail) return false;
+	// Read the record only after seeing the index that published it
+	SPSC_BARRIER();
+	memcpy(record, &queue->buffer[(tail & queue->mask) * queue->record_size], queue->record_size);
+	// Finish the copy before handing the slot back to the producer
+	SPSC_BARRIER();
+	queue->tail = tail + 1;
+	return true;
+}
@@ -0,0 +1,46 @@
+/*
+ * spsc_queue.h
+ *
+ *  Lock-free single-producer/single-consumer queue of fixed-size records.
+ *  The Cortex-M0+ has no LDREX/STREX, so the design is index-only: the
+ *  producer alone writes head and the consumer alone writes tail, and both
+ *  are free-running 32-bit counters read and written in one access.
+ *  Either side may be an interrupt handler. Build with SPSC_HOST to use the
+ *  compiler's full barrier instead of the CMSIS one.
+ */
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	uint8_t* buffer;
+	uint16_t record_size;
+	uint16_t mask;				// capacity - 1
+	volatile uint32_t head;		// Records pushed; written only by the producer
+	volatile uint32_t tail;		// Records popped; written only by the consumer
+	uint32_t high_water;		// Largest occupancy seen by the producer
+	uint32_t dropped;			// Pushes refused because the queue was full
+} spsc_queue_t;
+
+// buffer must hold capacity records of record_size bytes; capacity must be a power of two
+void spsc_queue_init(spsc_queue_t* queue, void* buffer, uint16_t record_size, uint32_t capacity);
+
+// Producer: copies record in. Returns false, and counts a drop, when full.
+bool spsc_queue_push(spsc_queue_t* queue, const void* record);
+
+// Consumer: copies out and removes the oldest record. Returns false when empty.
+bool spsc_queue_pop(spsc_queue_t* queue, void* record);
+
+// Records waiting. Exact on either side, a snapshot anywhere else.
+static inline uint32_t spsc_queue_count(const spsc_queue_t* queue) {
+	return queue->head - queue->tail;
+}
+
+static inline uint32_t spsc_queue_capacity(const spsc_queue_t* queue) {
+	return (uint32_t)queue->mask + 1;
+}
+
+#endif /* SPSC_QUEUE_H_ */
@@ -0,0 +1,63 @@
+/*
+ * timebase.c
+ */
+
+#include "./timebase.h"
+
+#ifdef TIMEBASE_HOST
+#include <time.h>
+
+static struct timespec timebase_start;
+
+void timebase_init(void) {
+	clock_gettime(CLOCK_MONOTONIC, &timebase_start);
+}
+
+uint32_t timebase_take_irq_latency_max(void) {
+	return 0;
+}
+
+uint32_t timebase_us(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)((now.tv_sec - timebase_start.tv_sec) * 1000000LL + (now.tv_nsec - timebase_start.tv_nsec) / 1000);
+}
+#else
+#include "FreeRTOS.h"
+#include "task.h"
+
+static volatile uint32_t timebase_irq_latency_max;
+
+void timebase_init(void) {
+	Chip_TIMER_Init(LPC_TIMER32_0);
+	Chip_TIMER_Reset(LPC_TIMER32_0);
+	// Count the core clock down to 1 MHz; match 0 only drives the latency probe
+	Chip_TIMER_PrescaleSet(LPC_TIMER32_0, SystemCoreClock / 1000000 - 1);
+	Chip_TIMER_SetMatch(LPC_TIMER32_0, 0, TIMEBASE_PROBE_PERIOD_US);
+	Chip_TIMER_MatchEnableInt(LPC_TIMER32_0, 0);
+	// Highest priority. The peripheral interrupts are left at 0 too, so the probe waits behind
+	// their handlers as well as masked sections, as they do behind each other.
+	NVIC_SetPriority(TIMER_32_0_IRQn, 0);
+	NVIC_EnableIRQ(TIMER_32_0_IRQn);
+	Chip_TIMER_Enable(LPC_TIMER32_0);
+}
+
+void TIMER32_0_IRQHandler(void) {
+	uint32_t match = LPC_TIMER32_0->MR[0];
+	uint32_t latency = Chip_TIMER_ReadCount(LPC_TIMER32_0) - match;
+	Chip_TIMER_ClearMatch(LPC_TIMER32_0, 0);
+	if (latency > timebase_irq_latency_max) {
+		timebase_irq_latency_max = latency;
+	}
+	Chip_TIMER_SetMatch(LPC_TIMER32_0, 0, match + TIMEBASE_PROBE_PERIOD_US);
+}
+
+uint32_t timebase_take_irq_latency_max(void) {
+	uint32_t latency;
+	taskENTER_CRITICAL();
+	latency = timebase_irq_latency_max;
+	timebase_irq_latency_max = 0;
+	taskEXIT_CRITICAL();
+	return latency;
+}
+#endif
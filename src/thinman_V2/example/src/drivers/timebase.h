@@ -0,0 +1,36 @@
+/*
+ * timebase.h
+ *
+ *  Free-running 1 MHz microsecond counter on CT32B0. Wraps every ~71.6 minutes;
+ *  differences of two readings are valid across one wrap when taken as uint32_t.
+ *  Build with TIMEBASE_HOST to replace the timer with the host monotonic clock.
+ */
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#include <stdint.h>
+
+// Start the counter. Call once before any sensor task runs.
+void timebase_init(void);
+
+// Interrupt latency probe: match 0 fires every TIMEBASE_PROBE_PERIOD_US (not a divisor of
+// the tick, so it samples every phase of it) and its handler records how late it ran.
+// That is the longest stretch interrupts were masked, or a priority 0 handler ran, at 1 us
+// resolution: what the UART, SSP, I2C and USB interrupts, also at priority 0, can be kept waiting.
+#define TIMEBASE_PROBE_PERIOD_US 997
+
+// Worst latency since the previous call, in us
+uint32_t timebase_take_irq_latency_max(void);
+
+#ifdef TIMEBASE_HOST
+uint32_t timebase_us(void);
+#else
+#include <Chip.h>
+// Current time in microseconds since timebase_init
+static inline uint32_t timebase_us(void) {
+	return Chip_TIMER_ReadCount(LPC_TIMER32_0);
+}
+#endif
+
+#endif /* TIMEBASE_H_ */
@@ -39,6 +39,7 @@ void uart0_init() {
 	vSemaphoreCreateBinary(sem_uart_ready);
 	vSemaphoreCreateBinary(sem_uart_read_ready);
 	mutex_uart_in_use = xSemaphoreCreateMutex();
+	vQueueAddToRegistry(mutex_uart_in_use, "UART0");
 	mutex_uart_read_in_use = xSemaphoreCreateMutex();
 
 	// FreeRTOS craziness!!!
@@ -95,6 +96,10 @@ static void uart0_write_internal(const uint8_t* data, size_t size, bool in_rtos)
  * Guarantees reading at least one byte. If none present, blocks until at least one byte is received.
  */
 size_t uart0_read(char* buf, size_t size) {
+	return uart0_read_timeout(buf, size, portMAX_DELAY);
+}
+
+size_t uart0_read_timeout(char* buf, size_t size, TickType_t timeout) {
 	xSemaphoreTake(mutex_uart_read_in_use, portMAX_DELAY);
 
 	uint32_t read = 0;
@@ -106,7 +111,9 @@ size_t uart0_read(char* buf, size_t size) {
 
 		// Nothing read, wait
 		if (RingBuffer_IsEmpty(&rxring) && xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
-			xSemaphoreTake(sem_uart_read_ready, portMAX_DELAY);
+			if (xSemaphoreTake(sem_uart_read_ready, timeout) != pdTRUE) {
+				break;
+			}
 		}
 	}
 
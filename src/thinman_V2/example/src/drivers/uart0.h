@@ -4,6 +4,7 @@
 #pragma once
 #include <stdint.h>
 #include "chip.h"
+#include "FreeRTOS.h"
 
 #define UART0_WRITE_RB_SIZE 128
 #define UART0_READ_RB_SIZE 64
@@ -23,5 +24,7 @@ void uart0_write_critical(const uint8_t* data, size_t size);
 void uart0_write_string_critical(const char* str);
 // Read a block from UART0 buffer.  Returns the amount of bytes actually read.  Guarantees at least one byte is read every invocation.  Blocks if non available.
 size_t uart0_read(char* buf, size_t size);
+// As uart0_read, but returns 0 once timeout ticks pass with nothing received
+size_t uart0_read_timeout(char* buf, size_t size, TickType_t timeout);
 // Read a single character from UART0.  Blocks if none available.
 int  uart0_readchar();
@@ -0,0 +1,248 @@
+/*
+ * attitude.c
+ *
+ *  Mahony complementary filter (Mahony et al. 2008, using the structure of
+ *  Madgwick's reference MahonyAHRS.c) in fixed point:
+ *    quaternion, unit vectors, errors	Q30
+ *    angular rates						Q20 rad/s
+ *    time steps						Q32 s
+ *  Q30 products go through a 64-bit multiply, which the M0+ does in software,
+ *  so the cost is measured with SysTick on every update.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "drivers/cycles.h"
+#include "./attitude.h"
+
+// 2 * proportional gain, Mahony's default of 2 * 0.5
+#define ATTITUDE_TWO_KP_Q16			(1L << 16)
+// 2 * integral gain; 0 leaves gyro bias untracked
+#define ATTITUDE_TWO_KI_Q16			0
+// Higher gain used while converging from the identity quaternion after init
+#define ATTITUDE_TWO_KP_INIT_Q16	(10L << 16)
+#define ATTITUDE_INIT_US			2000000
+// Longer gaps (task stalls) are integrated as this much
+#define ATTITUDE_MAX_DT_US			100000
+// Accelerometer is only trusted as "up" within this band around 1g, so thrust and drag
+// during flight do not pull the estimate. In percent of 1g.
+#define ATTITUDE_ACCEL_GATE_PCT		15
+// Per-axis half-angle step limit, keeps |q| below 2 before normalizing
+#define ATTITUDE_MAX_HALF_STEP		(ATTITUDE_Q_ONE / 2)
+
+#define Q_HALF			(ATTITUDE_Q_ONE / 2)
+#define Q_THREE_HALVES	(ATTITUDE_Q_ONE + ATTITUDE_Q_ONE / 2)
+// 2^32 / 10^6, converts microseconds to Q32 seconds
+#define US_TO_Q32		4295
+
+static attitude_quat_t attitude_q = {ATTITUDE_Q_ONE, 0, 0, 0};
+static attitude_stats_t attitude_stats;
+static int32_t integral[3];			// Q20 rad/s
+static int32_t gyro_scale_q40;		// rad/s per count, Q40
+static uint32_t accel_min_sq, accel_max_sq;
+static uint32_t init_remaining_us;
+
+static inline int32_t qmul(int32_t a, int32_t b) {
+	return (int32_t)(((int64_t)a * b) >> ATTITUDE_Q_SHIFT);
+}
+
+static uint32_t isqrt32(uint32_t x) {
+	uint32_t res = 0;
+	uint32_t bit = 1UL << 30;
+	while (bit > x) bit >>= 2;
+	while (bit) {
+		if (x >= res + bit) {
+			x -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+	return res;
+}
+
+// Scales raw counts to a Q30 unit vector. Returns the squared length in counts, 0 if degenerate.
+static uint32_t normalize3(const int16_t in[3], int32_t out[3]) {
+	// Each square fits in int32_t but three of them reach 3 * 2^30, so the sum is unsigned
+	uint32_t sumsq = (uint32_t)((int32_t)in[0] * in[0]) + (uint32_t)((int32_t)in[1] * in[1]) + (uint32_t)((int32_t)in[2] * in[2]);
+	uint32_t norm, inv;
+	if (sumsq == 0) return 0;
+	norm = isqrt32(sumsq);
+	if (norm == 0) return 0;
+	inv = (1UL << ATTITUDE_Q_SHIFT) / norm; // |in[i]| <= norm, so in[i] * inv stays within Q30
+	out[0] = in[0] * (int32_t)inv;
+	out[1] = in[1] * (int32_t)inv;
+	out[2] = in[2] * (int32_t)inv;
+	return sumsq;
+}
+
+void attitude_init(int32_t g_fs_mdps, int32_t a_fs_mg) {
+	// rad/s per count = mdps * pi / 180000 / 32768, times 2^40 = mdps * 585.6345
+	gyro_scale_q40 = (int32_t)((int64_t)g_fs_mdps * 5856345 / 10000);
+	{
+		uint32_t counts_per_g = 32768UL * 1000 / a_fs_mg;
+		uint32_t low = counts_per_g * (100 - ATTITUDE_ACCEL_GATE_PCT) / 100;
+		uint32_t high = counts_per_g * (100 + ATTITUDE_ACCEL_GATE_PCT) / 100;
+		accel_min_sq = low * low;
+		accel_max_sq = high * high;
+	}
+	integral[0] = integral[1] = integral[2] = 0;
+	init_remaining_us = ATTITUDE_INIT_US;
+
+	taskENTER_CRITICAL();
+	attitude_q.q0 = ATTITUDE_Q_ONE;
+	attitude_q.q1 = 0;
+	attitude_q.q2 = 0;
+	attitude_q.q3 = 0;
+	attitude_stats.updates = 0;
+	attitude_stats.cycles_last = 0;
+	attitude_stats.cycles_max = 0;
+	attitude_stats.cycles_budget = SystemCoreClock / ATTITUDE_RATE_HZ;
+	taskEXIT_CRITICAL();
+}
+
+void attitude_update(const int16_t gyro[3], const int16_t accel[3], const int16_t mag[3], uint32_t dt_us) {
+	uint32_t start = cycles_now();
+	int32_t q0 = attitude_q.q0, q1 = attitude_q.q1, q2 = attitude_q.q2, q3 = attitude_q.q3;
+	int32_t q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+	int32_t rate[3];
+	int32_t halfe[3] = {0, 0, 0};
+	int32_t a[3], m[3];
+	uint32_t dt_q32;
+	int32_t two_kp;
+	int i;
+
+	if (dt_us > ATTITUDE_MAX_DT_US) dt_us = ATTITUDE_MAX_DT_US;
+	dt_q32 = dt_us * US_TO_Q32;
+	if (init_remaining_us > dt_us) {
+		init_remaining_us -= dt_us;
+		two_kp = ATTITUDE_TWO_KP_INIT_Q16;
+	} else {
+		init_remaining_us = 0;
+		two_kp = ATTITUDE_TWO_KP_Q16;
+	}
+
+	for (i = 0; i < 3; i++) {
+		rate[i] = (int32_t)(((int64_t)gyro[i] * gyro_scale_q40) >> 20);
+	}
+
+	q0q0 = qmul(q0, q0);
+	q0q1 = qmul(q0, q1);
+	q0q2 = qmul(q0, q2);
+	q0q3 = qmul(q0, q3);
+	q1q1 = qmul(q1, q1);
+	q1q2 = qmul(q1, q2);
+	q1q3 = qmul(q1, q3);
+	q2q2 = qmul(q2, q2);
+	q2q3 = qmul(q2, q3);
+	q3q3 = qmul(q3, q3);
+
+	{
+		uint32_t a_sq = normalize3(accel, a);
+		if (a_sq >= accel_min_sq && a_sq <= accel_max_sq) {
+			// Half of the estimated up direction in the body frame
+			int32_t halfvx = q1q3 - q0q2;
+			int32_t halfvy = q0q1 + q2q3;
+			int32_t halfvz = q0q0 - Q_HALF + q3q3;
+			halfe[0] += qmul(a[1], halfvz) - qmul(a[2], halfvy);
+			halfe[1] += qmul(a[2], halfvx) - qmul(a[0], halfvz);
+			halfe[2] += qmul(a[0], halfvy) - qmul(a[1], halfvx);
+		}
+	}
+
+	if (mag != NULL) {
+		// LSM9DS1 magnetometer axes are rotated against the accel/gyro axes
+		int16_t m_body[3];
+		m_body[0] = -mag[1];
+		m_body[1] = -mag[0];
+		m_body[2] = mag[2];
+		if (normalize3(m_body, m)) {
+			int32_t hx, hy, bx, bz, halfwx, halfwy, halfwz;
+			// Earth's field in the earth frame, rotated so it has no east component
+			hx = 2 * (qmul(m[0], Q_HALF - q2q2 - q3q3) + qmul(m[1], q1q2 - q0q3) + qmul(m[2], q1q3 + q0q2));
+			hy = 2 * (qmul(m[0], q1q2 + q0q3) + qmul(m[1], Q_HALF - q1q1 - q3q3) + qmul(m[2], q2q3 - q0q1));
+			bz = 2 * (qmul(m[0], q1q3 - q0q2) + qmul(m[1], q2q3 + q0q1) + qmul(m[2], Q_HALF - q1q1 - q2q2));
+			// Horizontal magnitude at Q15 is plenty for a direction and keeps the sqrt in 32 bits
+			hx >>= 15;
+			hy >>= 15;
+			bx = (int32_t)isqrt32((uint32_t)(hx * hx) + (uint32_t)(hy * hy)) << 15;
+			// Half of the estimated field direction in the body frame
+			halfwx = qmul(bx, Q_HALF - q2q2 - q3q3) + qmul(bz, q1q3 - q0q2);
+			halfwy = qmul(bx, q1q2 - q0q3) + qmul(bz, q0q1 + q2q3);
+			halfwz = qmul(bx, q0q2 + q1q3) + qmul(bz, Q_HALF - q1q1 - q2q2);
+			halfe[0] += qmul(m[1], halfwz) - qmul(m[2], halfwy);
+			halfe[1] += qmul(m[2], halfwx) - qmul(m[0], halfwz);
+			halfe[2] += qmul(m[0], halfwy) - qmul(m[1], halfwx);
+		}
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (ATTITUDE_TWO_KI_Q16 > 0) {
+			int32_t ki_rate = (int32_t)(((int64_t)halfe[i] * ATTITUDE_TWO_KI_Q16) >> 26);
+			integral[i] += (int32_t)(((int64_t)ki_rate * dt_q32) >> 32);
+			rate[i] += integral[i];
+		}
+		rate[i] += (int32_t)(((int64_t)halfe[i] * two_kp) >> 26);
+	}
+
+	{
+		// Half-angle steps: Q20 rad/s * Q32 s -> Q52, halved into Q30
+		int32_t hs[3];
+		int32_t qa = q0, qb = q1, qc = q2;
+		int32_t n2, inv;
+		for (i = 0; i < 3; i++) {
+			int64_t step = ((int64_t)rate[i] * dt_q32) >> 23;
+			if (step > ATTITUDE_MAX_HALF_STEP) step = ATTITUDE_MAX_HALF_STEP;
+			if (step < -ATTITUDE_MAX_HALF_STEP) step = -ATTITUDE_MAX_HALF_STEP;
+			hs[i] = (int32_t)step;
+		}
+		q0 += -qmul(qb, hs[0]) - qmul(qc, hs[1]) - qmul(q3, hs[2]);
+		q1 += qmul(qa, hs[0]) + qmul(qc, hs[2]) - qmul(q3, hs[1]);
+		q2 += qmul(qa, hs[1]) - qmul(qb, hs[2]) + qmul(q3, hs[0]);
+		q3 += qmul(qa, hs[2]) + qmul(qb, hs[1]) - qmul(qc, hs[0]);
+
+		// 1/sqrt(n2) from the first-order guess plus two Newton steps; n2 stays near 1
+		n2 = qmul(q0, q0) + qmul(q1, q1) + qmul(q2, q2) + qmul(q3, q3);
+		inv = Q_THREE_HALVES - n2 / 2;
+		inv = qmul(inv, Q_THREE_HALVES - qmul(n2 / 2, qmul(inv, inv)));
+		inv = qmul(inv, Q_THREE_HALVES - qmul(n2 / 2, qmul(inv, inv)));
+		q0 = qmul(q0, inv);
+		q1 = qmul(q1, inv);
+		q2 = qmul(q2, inv);
+		q3 = qmul(q3, inv);
+	}
+
+	{
+		uint32_t cycles = cycles_since(start);
+		taskENTER_CRITICAL();
+		attitude_q.q0 = q0;
+		attitude_q.q1 = q1;
+		attitude_q.q2 = q2;
+		attitude_q.q3 = q3;
+		attitude_stats.updates++;
+		attitude_stats.cycles_last = cycles;
+		if (cycles > attitude_stats.cycles_max) {
+			attitude_stats.cycles_max = cycles;
+		}
+		taskEXIT_CRITICAL();
+	}
+}
+
+void attitude_get(attitude_quat_t* q) {
+	taskENTER_CRITICAL();
+	*q = attitude_q;
+	taskEXIT_CRITICAL();
+}
+
+int32_t attitude_vertical_cos(void) {
+	attitude_quat_t q;
+	attitude_get(&q);
+	return 2 * (qmul(q.q1, q.q3) - qmul(q.q0, q.q2));
+}
+
+void attitude_get_stats(attitude_stats_t* stats) {
+	taskENTER_CRITICAL();
+	*stats = attitude_stats;
+	taskEXIT_CRITICAL();
+}
@@ -0,0 +1,49 @@
+/*
+ * attitude.h
+ *
+ *  Fixed-point Mahony attitude filter fed from the LSM9DS1 raw counts.
+ *  No floating point is used after attitude_init().
+ */
+
+#ifndef ATTITUDE_H_
+#define ATTITUDE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Quaternion components are Q30, so ATTITUDE_Q_ONE represents 1.0
+#define ATTITUDE_Q_SHIFT	30
+#define ATTITUDE_Q_ONE		(1L << ATTITUDE_Q_SHIFT)
+
+// Rate the filter is budgeted for (LSM gyro ODR)
+#define ATTITUDE_RATE_HZ	952
+
+typedef struct {
+	int32_t q0, q1, q2, q3;
+} attitude_quat_t;
+
+typedef struct {
+	uint32_t updates;
+	uint32_t cycles_last;
+	uint32_t cycles_max;
+	// Core clock cycles available per update at ATTITUDE_RATE_HZ
+	uint32_t cycles_budget;
+} attitude_stats_t;
+
+// Resets to the identity quaternion. Pass the LSM full scales (LSM_g_fs_mdps, LSM_a_fs_mg)
+void attitude_init(int32_t g_fs_mdps, int32_t a_fs_mg);
+
+// Runs one filter step. Arrays are raw x, y, z counts in the accel/gyro frame order read from
+// the LSM; mag may be NULL when no new magnetometer sample is available.
+void attitude_update(const int16_t gyro[3], const int16_t accel[3], const int16_t mag[3], uint32_t dt_us);
+
+// Copies the latest estimate. Safe to call from any task.
+void attitude_get(attitude_quat_t* q);
+
+// Cosine of the angle between board +x ("this side up") and vertical, Q30
+int32_t attitude_vertical_cos(void);
+
+void attitude_get_stats(attitude_stats_t* stats);
+
+#endif /* ATTITUDE_H_ */
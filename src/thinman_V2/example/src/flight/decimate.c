@@ -0,0 +1,146 @@
+/*
+ * decimate.c
+ *
+ *  The CIC runs in wrapping 32-bit arithmetic, which is exact as long as
+ *  its gain of 2^(order * shift) fits, and divides the gain out with a
+ *  rounding shift. The half-band taps are Q15 with a Q30 accumulator; only
+ *  every other tap is non-zero, and the pairs either side of the centre are
+ *  added before the multiply, so an output costs four multiplies a channel.
+ */
+
+#include <string.h>
+#include "drivers/cycles.h"
+#include "./decimate.h"
+
+// Taps 1, 3, 5 and 7 away from the centre tap of 1/2, Q15. Equiripple with the
+// stopband from 0.325 of the half-band input rate; they sum to 1/4, so a
+// constant comes through exactly.
+static const int16_t decimate_hb_taps[(DECIMATE_HB_TAPS + 1) / 4] = {10204, -2762, 1112, -362};
+#define HB_CENTRE	(DECIMATE_HB_TAPS / 2)
+#define HB_MASK		(DECIMATE_HB_RING - 1)
+
+static void decimate_integrate(decimate_channel_t* c, int16_t x) {
+	uint32_t sum = (uint32_t)(int32_t) x;
+	int k;
+	for (k = 0; k < DECIMATE_CIC_ORDER; k++) {
+		sum += c->integrator[k];
+		c->integrator[k] = sum;
+	}
+}
+
+static int16_t decimate_comb(decimate_channel_t* c, uint8_t shift) {
+	uint32_t y = c->integrator[DECIMATE_CIC_ORDER - 1];
+	uint8_t gain_shift = DECIMATE_CIC_ORDER * shift;
+	int k;
+	for (k = 0; k < DECIMATE_CIC_ORDER; k++) {
+		uint32_t previous = c->comb[k];
+		c->comb[k] = y;
+		y -= previous;
+	}
+	return (int16_t)(((int32_t) y + (1L << (gain_shift - 1))) >> gain_shift);
+}
+
+static int16_t decimate_halfband(const decimate_channel_t* c, uint8_t head) {
+	uint8_t centre = (head - HB_CENTRE) & HB_MASK;
+	int32_t acc = (int32_t) c->ring[centre] << 14;
+	int k;
+	for (k = 0; k < (DECIMATE_HB_TAPS + 1) / 4; k++) {
+		uint8_t offset = 2 * k + 1;
+		acc += decimate_hb_taps[k] * ((int32_t) c->ring[(centre - offset) & HB_MASK] + c->ring[(centre + offset) & HB_MASK]);
+	}
+	acc = (acc + (1L << 14)) >> 15;
+	// The taps overshoot a full-scale step by a few percent
+	if (acc > INT16_MAX) return INT16_MAX;
+	if (acc < INT16_MIN) return INT16_MIN;
+	return (int16_t) acc;
+}
+
+// Settles every stage on in, as if it had been the input forever
+static void decimate_prime(decimator_t* d, const int16_t* in) {
+	int i, n, k;
+	for (i = 0; i < d->channels; i++) {
+		decimate_channel_t* c = &d->channel[i];
+		memset(c->integrator, 0, sizeof(c->integrator));
+		memset(c->comb, 0, sizeof(c->comb));
+		if (d->cic_shift) {
+			// Each comb stage needs one CIC output more than the last before it is exact
+			for (n = 0; n <= DECIMATE_CIC_ORDER; n++) {
+				for (k = 0; k < (1 << d->cic_shift); k++) {
+					decimate_integrate(c, in[i]);
+				}
+				decimate_comb(c, d->cic_shift);
+			}
+		}
+		for (k = 0; k < DECIMATE_HB_RING; k++) {
+			c->ring[k] = in[i];
+		}
+	}
+	d->cic_count = 0;
+	d->head = 0;
+	d->odd = false;
+	d->primed = true;
+}
+
+void decimate_init(decimator_t* d, uint8_t channels, decimate_channel_t* channel, uint8_t factor) {
+	memset(d, 0, sizeof(*d));
+	d->channels = channels;
+	d->channel = channel;
+	d->cycles_budget = channels * DECIMATE_CYCLES_PER_CHANNEL;
+	decimate_set_factor(d, factor);
+}
+
+void decimate_set_factor(decimator_t* d, uint8_t factor) {
+	d->factor = factor;
+	// The half-band takes the last factor of 2
+	d->cic_shift = 0;
+	while ((2 << d->cic_shift) < factor) {
+		d->cic_shift++;
+	}
+	d->primed = false;
+}
+
+bool decimate_push(decimator_t* d, const int16_t* in, int16_t* out) {
+	uint32_t start = cycles_now();
+	bool ready = false;
+	int i;
+	if (d->factor <= 1) {
+		memmove(out, in, d->channels * sizeof(int16_t));
+		return true;
+	}
+	if (!d->primed) {
+		decimate_prime(d, in);
+	}
+	if (d->cic_shift) {
+		for (i = 0; i < d->channels; i++) {
+			decimate_integrate(&d->channel[i], in[i]);
+		}
+		d->cic_count++;
+	}
+	if (d->cic_count == (1 << d->cic_shift) || !d->cic_shift) {
+		d->cic_count = 0;
+		d->head = (d->head + 1) & HB_MASK;
+		for (i = 0; i < d->channels; i++) {
+			decimate_channel_t* c = &d->channel[i];
+			c->ring[d->head] = d->cic_shift ? decimate_comb(c, d->cic_shift) : in[i];
+			if (d->odd) {
+				out[i] = decimate_halfband(c, d->head);
+			}
+		}
+		ready = d->odd;
+		d->odd = !d->odd;
+	}
+	{
+		uint32_t cycles = cycles_since(start);
+		if (cycles > d->cycles_max) {
+			d->cycles_max = cycles;
+		}
+	}
+	return ready;
+}
+
+uint32_t decimate_delay_us(const decimator_t* d, uint32_t period_us) {
+	uint32_t rate = 1UL << d->cic_shift;
+	if (d->factor <= 1) return 0;
+	// Half input periods: the CIC's order * (rate - 1) and the half-band's centre tap
+	return (DECIMATE_CIC_ORDER * (rate - 1) + 2 * HB_CENTRE * rate) * period_us / 2;
+}
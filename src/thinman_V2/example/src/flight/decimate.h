@@ -0,0 +1,65 @@
+/*
+ * decimate.h
+ *
+ *  Integer decimation for sensor channels logged below the rate they are
+ *  sampled at, so the rows kept are filtered rather than picked out of a
+ *  signal that would alias. A fourth-order CIC divides the rate by 1, 2 or
+ *  4 and a 15-tap half-band FIR by a further 2, giving factors of 2, 4 and
+ *  8; factor 1 passes samples straight through. Up to 0.35 of the output
+ *  rate the half-band is flat to 0.06 dB and the CIC droops by at most
+ *  1.8 dB; input that would alias below that is 44 dB down or more.
+ *  decimate_check.py compiles this code for the host and checks its response
+ *  against a floating point reference.
+ */
+
+#ifndef DECIMATE_H_
+#define DECIMATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DECIMATE_MAX_FACTOR		8
+#define DECIMATE_CIC_ORDER		4
+#define DECIMATE_HB_TAPS		15
+#define DECIMATE_HB_RING		16		// Power of two holding the taps
+
+// Cost of one decimate_push per channel, in core clock cycles, with the
+// worst case being a push that produces an output
+#define DECIMATE_CYCLES_PER_CHANNEL	300
+
+typedef struct {
+	uint32_t integrator[DECIMATE_CIC_ORDER];	// Wrap around; only differences count
+	uint32_t comb[DECIMATE_CIC_ORDER];
+	int16_t ring[DECIMATE_HB_RING];				// Half-band inputs, newest at head
+} decimate_channel_t;
+
+typedef struct {
+	uint8_t channels;
+	uint8_t factor;
+	uint8_t cic_shift;		// log2 of the CIC rate change
+	uint8_t cic_count;		// Inputs since the last CIC output
+	uint8_t head;
+	bool odd;				// The next half-band input completes an output
+	bool primed;
+	uint32_t cycles_max;	// Longest push
+	uint32_t cycles_budget;	// channels * DECIMATE_CYCLES_PER_CHANNEL
+	decimate_channel_t* channel;	// channels entries, 64 bytes each
+} decimator_t;
+
+// channel is the caller's state for channels channels, as spsc_queue and
+// pretrigger take their buffers
+void decimate_init(decimator_t* d, uint8_t channels, decimate_channel_t* channel, uint8_t factor);
+
+// factor is 1, 2, 4 or 8. A change restarts the filter as if every channel
+// had held its next input forever, so the output carries on without a gap.
+void decimate_set_factor(decimator_t* d, uint8_t factor);
+
+// Takes one sample of each channel. Returns true with out filled once every
+// factor inputs; out may be in.
+bool decimate_push(decimator_t* d, const int16_t* in, int16_t* out);
+
+// How far outputs lag the newest input, for inputs period_us apart; the
+// group delay of the CIC and half-band together
+uint32_t decimate_delay_us(const decimator_t* d, uint32_t period_us);
+
+#endif /* DECIMATE_H_ */
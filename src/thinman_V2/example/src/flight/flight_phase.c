@@ -0,0 +1,134 @@
+/*
+ * flight_phase.c
+ *
+ *  Thresholds follow post/find_flight_accel.m so on-board and ground
+ *  detection agree on the same logs.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging.h"
+#include "warm_restart.h"
+#include "./flight_phase.h"
+
+// Launch: +x acceleration above this for FLIGHT_LAUNCH_CONFIRM_MS
+#define FLIGHT_LAUNCH_ACCEL_MG		2500
+#define FLIGHT_LAUNCH_CONFIRM_MS	20
+// Burnout: +x acceleration below this for FLIGHT_BURNOUT_CONFIRM_MS
+#define FLIGHT_BURNOUT_ACCEL_MG		1300
+#define FLIGHT_BURNOUT_CONFIRM_MS	50
+// Apogee: altitude this far below the highest seen since launch
+#define FLIGHT_APOGEE_DROP_MM		3000
+// Landed: altitude stays within this band for FLIGHT_LANDED_STILL_MS
+#define FLIGHT_LANDED_BAND_MM		2000
+#define FLIGHT_LANDED_STILL_MS		10000
+
+static volatile flight_phase_t flight_phase = FLIGHT_PHASE_PAD;
+
+// Only touched by the accel feeder
+static bool accel_condition_active;
+static uint32_t accel_condition_start;
+// Only touched by the altitude feeder
+static int32_t alt_max_mm;
+static int32_t alt_still_ref_mm;
+static uint32_t alt_still_start;
+
+static const char* const flight_phase_names[] = {"PAD", "BOOST", "COAST", "DESCENT", "LANDED"};
+
+// Moves from -> to unless another task already changed phase
+static bool flight_phase_transition(flight_phase_t from, flight_phase_t to, uint32_t tick) {
+	bool changed = false;
+	taskENTER_CRITICAL();
+	if (flight_phase == from) {
+		flight_phase = to;
+		changed = true;
+	}
+	taskEXIT_CRITICAL();
+	if (changed) {
+		warm_restart_save_phase(to);
+		LOG_INFO("Flight phase %s -> %s at %u", flight_phase_names[from], flight_phase_names[to], tick);
+	}
+	return changed;
+}
+
+// True once cond has held continuously for confirm_ms
+static bool accel_confirmed(bool cond, uint32_t tick, uint32_t confirm_ms) {
+	if (!cond) {
+		accel_condition_active = false;
+		return false;
+	}
+	if (!accel_condition_active) {
+		accel_condition_active = true;
+		accel_condition_start = tick;
+	}
+	return (tick - accel_condition_start) >= confirm_ms;
+}
+
+void flight_phase_init(void) {
+	flight_phase = FLIGHT_PHASE_PAD;
+	accel_condition_active = false;
+	alt_max_mm = INT32_MIN;
+	alt_still_start = 0;
+}
+
+void flight_phase_resume(flight_phase_t phase) {
+	flight_phase_init();
+	flight_phase = phase;
+	LOG_INFO("Flight phase resumed at %s", flight_phase_names[phase]);
+}
+
+flight_phase_t flight_phase_get(void) {
+	return flight_phase;
+}
+
+const char* flight_phase_name(flight_phase_t phase) {
+	return flight_phase_names[phase];
+}
+
+bool flight_phase_is_full_rate(flight_phase_t phase) {
+	return phase == FLIGHT_PHASE_BOOST || phase == FLIGHT_PHASE_COAST || phase == FLIGHT_PHASE_DESCENT;
+}
+
+void flight_phase_update_accel(int32_t accel_x_mg, uint32_t tick) {
+	switch (flight_phase) {
+		case FLIGHT_PHASE_PAD:
+			if (accel_confirmed(accel_x_mg > FLIGHT_LAUNCH_ACCEL_MG, tick, FLIGHT_LAUNCH_CONFIRM_MS)) {
+				accel_condition_active = false;
+				flight_phase_transition(FLIGHT_PHASE_PAD, FLIGHT_PHASE_BOOST, tick);
+			}
+			break;
+		case FLIGHT_PHASE_BOOST:
+			if (accel_confirmed(accel_x_mg < FLIGHT_BURNOUT_ACCEL_MG, tick, FLIGHT_BURNOUT_CONFIRM_MS)) {
+				accel_condition_active = false;
+				flight_phase_transition(FLIGHT_PHASE_BOOST, FLIGHT_PHASE_COAST, tick);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+void flight_phase_update_altitude(int32_t alt_mm, uint32_t tick) {
+	flight_phase_t phase = flight_phase;
+	if (phase == FLIGHT_PHASE_PAD || phase == FLIGHT_PHASE_LANDED) return;
+
+	if (alt_mm > alt_max_mm) {
+		alt_max_mm = alt_mm;
+	}
+
+	if (phase == FLIGHT_PHASE_BOOST || phase == FLIGHT_PHASE_COAST) {
+		// Burnout can be missed if the accel saturates or drops out, so apogee is accepted from boost too
+		if (alt_mm < alt_max_mm - FLIGHT_APOGEE_DROP_MM) {
+			alt_still_ref_mm = alt_mm;
+			alt_still_start = tick;
+			flight_phase_transition(phase, FLIGHT_PHASE_DESCENT, tick);
+		}
+	} else if (phase == FLIGHT_PHASE_DESCENT) {
+		if (alt_mm > alt_still_ref_mm + FLIGHT_LANDED_BAND_MM || alt_mm < alt_still_ref_mm - FLIGHT_LANDED_BAND_MM) {
+			alt_still_ref_mm = alt_mm;
+			alt_still_start = tick;
+		} else if ((tick - alt_still_start) >= FLIGHT_LANDED_STILL_MS) {
+			flight_phase_transition(FLIGHT_PHASE_DESCENT, FLIGHT_PHASE_LANDED, tick);
+		}
+	}
+}
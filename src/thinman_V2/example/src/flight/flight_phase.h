@@ -0,0 +1,43 @@
+/*
+ * flight_phase.h
+ *
+ *  Launch, burnout, apogee and landing detection. Sensor tasks feed it and
+ *  pick their sample and log rates from the current phase.
+ */
+
+#ifndef FLIGHT_PHASE_H_
+#define FLIGHT_PHASE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+	FLIGHT_PHASE_PAD,
+	FLIGHT_PHASE_BOOST,
+	FLIGHT_PHASE_COAST,
+	FLIGHT_PHASE_DESCENT,
+	FLIGHT_PHASE_LANDED,
+} flight_phase_t;
+
+// Sample and log period while landed, and log period while sampling into the pre-trigger rings on the pad
+#define FLIGHT_LOW_RATE_PERIOD_MS	500
+
+void flight_phase_init(void);
+// Start in phase instead of on the pad, after a warm restart in flight. Apogee is
+// detected against the highest altitude seen after the restart.
+void flight_phase_resume(flight_phase_t phase);
+
+flight_phase_t flight_phase_get(void);
+
+const char* flight_phase_name(flight_phase_t phase);
+
+// True between launch and landing, when every sensor samples and logs at full rate
+bool flight_phase_is_full_rate(flight_phase_t phase);
+
+// Feed acceleration along board +x ("this side up") in mg. Detects launch and burnout.
+void flight_phase_update_accel(int32_t accel_x_mg, uint32_t tick);
+
+// Feed barometric altitude in mm. Detects apogee and landing.
+void flight_phase_update_altitude(int32_t alt_mm, uint32_t tick);
+
+#endif /* FLIGHT_PHASE_H_ */
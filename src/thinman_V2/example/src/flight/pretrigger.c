@@ -0,0 +1,34 @@
+/*
+ * pretrigger.c
+ */
+
+#include <string.h>
+#include "./pretrigger.h"
+
+void pretrigger_init(pretrigger_ring_t* ring, void* buffer, uint16_t record_size, uint16_t capacity) {
+	ring->buffer = (uint8_t*) buffer;
+	ring->record_size = record_size;
+	ring->capacity = capacity;
+	ring->head = 0;
+	ring->count = 0;
+}
+
+void pretrigger_push(pretrigger_ring_t* ring, const void* record) {
+	memcpy(&ring->buffer[(uint32_t)ring->head * ring->record_size], record, ring->record_size);
+	ring->head++;
+	if (ring->head == ring->capacity) {
+		ring->head = 0;
+	}
+	if (ring->count < ring->capacity) {
+		ring->count++;
+	}
+}
+
+bool pretrigger_pop(pretrigger_ring_t* ring, void* record) {
+	uint16_t tail;
+	if (ring->count == 0) return false;
+	tail = (ring->head + ring->capacity - ring->count) % ring->capacity;
+	memcpy(record, &ring->buffer[(uint32_t)tail * ring->record_size], ring->record_size);
+	ring->count--;
+	return true;
+}
@@ -0,0 +1,32 @@
+/*
+ * pretrigger.h
+ *
+ *  Fixed-size ring of the most recent sensor records, kept while waiting
+ *  on the pad and written out once launch is detected. Each ring belongs to
+ *  a single task, so there is no locking.
+ */
+
+#ifndef PRETRIGGER_H_
+#define PRETRIGGER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	uint8_t* buffer;
+	uint16_t record_size;
+	uint16_t capacity;
+	uint16_t head;		// Next slot to write
+	uint16_t count;
+} pretrigger_ring_t;
+
+// buffer must hold capacity records of record_size bytes
+void pretrigger_init(pretrigger_ring_t* ring, void* buffer, uint16_t record_size, uint16_t capacity);
+
+// Stores a copy of record, overwriting the oldest when full
+void pretrigger_push(pretrigger_ring_t* ring, const void* record);
+
+// Copies out and removes the oldest record. Returns false when empty.
+bool pretrigger_pop(pretrigger_ring_t* ring, void* record);
+
+#endif /* PRETRIGGER_H_ */
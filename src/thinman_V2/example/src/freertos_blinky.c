@@ -32,11 +32,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <cr_section_macros.h>
 #include "chip.h"
 #include "board.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "logging.h"
+#include "kernel_trace.h"
+#include "boot_profile.h"
+#include "warm_restart.h"
 #include "error_codes.h"
 #include "ff.h"
 #include "drivers/uart0.h"
@@ -49,13 +53,25 @@
 #include "drivers/i2c.h"
 #include "drivers/firing_board.h"
 #include "drivers/i2c_uart.h"
+#include "drivers/timebase.h"
 #include "sensors/LPS.h"
 #include "sensors/LSM.h"
 #include "sensors/H3L.h"
+#include "flight/flight_phase.h"
 #include "tasks/bluetooth_command.h"
-#include "tasks/volatile_flight_data.h"
-
-#define SDCARD_START_RETRY_LIMIT 10
+#include "tasks/acquisition.h"
+#include "tasks/storage.h"
+#include "tasks/perf.h"
+#include "tasks/flight_state.h"
+#include "tasks/pyro.h"
+#include "tasks/download.h"
+
+#define SDCARD_START_RETRY_LIMIT 30
+#define SDCARD_RETRY_DELAY_MS 100
+// One status block read per poll. Records are logged at 2 Hz on the pad, on every mode or
+// fire count change, and on every poll once the flight phase runs at full rate.
+#define VOLTS_POLL_MS 20
+#define VOLTS_PAD_LOG_POLLS 25
 
 /*****************************************************************************
  * Private types/enumerations/variables
@@ -111,7 +127,8 @@ static void debug_uart_init(void) {
 	uart0_init();
 	uart0_setup(115200, UART0_LCR_WLEN8 | UART0_LCR_SBS_1BIT | UART0_LCR_PARITY_DIS);
 
-	if (0) {
+	// USB needs the USB SRAM, which holds the high-g pretrigger ring in flight mode
+	if (download_mode_active()) {
 		usb_init_freertos();
 		vcom_init_freertos();
 		if (usb_init()) {
@@ -158,6 +175,9 @@ static void prvSetupHardware(void)
 {
 	SystemCoreClockUpdate();
 	Board_Init();
+	// Reset cleanly on a sagging supply; in flight the warm restart path picks up from there
+	Chip_SYSCTL_SetBODLevels(SYSCTL_BODRSTLVL_LEVEL2, SYSCTL_BODINTVAL_RESERVED1);
+	Chip_SYSCTL_EnableBODReset();
 }
 
 /* LED1 toggle thread */
@@ -220,260 +240,13 @@ static void vFlushLogs(void* pvParameters) {
 	}
 }
 
-static void vBaro(void* pvParameters) {
-	static FIL f_baro_log;
-	static char baro_str_buf[0x20];
-	int result;
-	int counter = 0;
-	if (LPS_init(ONBOARD_I2C)) {
-		LOG_INFO("LPS initialized");
-	} else {
-		LOG_ERROR("LPS failed to initialize");
-		vTaskSuspend(NULL);
-	}
-	LPS_enable();
-	strcpy(baro_str_buf, "BARO.TAB");
-	{
-		int rename_number = 1;
-		while(true) {
-			if (f_stat(baro_str_buf, NULL) == FR_OK) {
-				sprintf(baro_str_buf, "BARO%d.TAB", rename_number);
-				rename_number ++;
-				continue;
-			}
-			break;
-		}
-	}
-	LOG_INFO("Baro output is %s", baro_str_buf);
-	result = f_open(&f_baro_log, baro_str_buf, FA_WRITE 	| FA_CREATE_ALWAYS);
-
-	if (result != FR_OK) {
-		LOG_ERROR("Failed to open Baro log file %s with error code %d", baro_str_buf, result);
-		vTaskSuspend(NULL);
-	}
-
-	int out;
-	baro_running = true;
-	while (true) {
-		float temp, alt;
-		temp = LPS_read_data(LPS_TEMPERATURE);
-		alt = LPS_read_data(LPS_ALTITUDE);
-		if (result == FR_OK) {
-
-			// Update last 5 altitude measurements
-			alt_arr[4] = alt_arr[3];
-			alt_arr[3] = alt_arr[2];
-			alt_arr[2] = alt_arr[1];
-			alt_arr[1] = alt_arr[0];
-			alt_arr[0] = alt;
-
-			// Average last 5 measurements as **simple** filter
-			float avg_alt = (alt_arr[0] + alt_arr[1] + alt_arr[2] + alt_arr[3] + alt_arr[4]) / 5;
-
-			// Store max altitude if found
-			if(avg_alt > max_alt) {
-				max_alt = avg_alt;
-			}
-
-			//update last 5 times for calculating speed
-			time_arr[4] = time_arr[3];
-			time_arr[3] = time_arr[2];
-			time_arr[2] = time_arr[1];
-			time_arr[1] = time_arr[0];
-			time_arr[0] = xTaskGetTickCount() / 1000.0;
-
-			sprintf(baro_str_buf, "%d\t%f\t%f\n", xTaskGetTickCount(), temp, alt);
-			if ((out = f_puts(baro_str_buf, &f_baro_log)) != strlen(baro_str_buf)) {
-				LOG_ERROR("Baro log failed %d", out);
-			}
-			if ((counter % 50) == 0) {
-//				LOG_INFO("Syncing Baro");
-				out = f_sync(&f_baro_log);
-//				LOG_INFO("Sync Done");
-				if (result != FR_OK) {
-					LOG_ERROR("Baro sync failed %d", out);
-				}
-			}
-		}
-		vTaskDelay(50);
-		counter ++;
-	}
-}
-
-typedef struct {
-	float ax;
-	float ay;
-	float az;
-	float gx;
-	float gy;
-	float gz;
-	float mx;
-	float my;
-	float mz;
-} imu_measurements_t;
-
-
-static imu_measurements_t imu_measurements;
-static void vIMU(void* pvParameters) {
-	static FIL f_imu_log;
-	static char imu_str_buf[0x40];
-	LOG_INFO("Initializing IMU");
-	if (LSM_init(ONBOARD_I2C, G_SCALE_500DPS, A_SCALE_16G, M_SCALE_4GS, G_ODR_952, A_ODR_952, M_ODR_80)) {
-		LOG_INFO("IMU initialized");
-	} else {
-		LOG_ERROR("IMU failed to initialize");
-		vTaskSuspend(NULL);
-	}
-
-	int result;
-	int counter = 0;
-	strcpy(imu_str_buf, "IMU.TAB");
-	{
-		int rename_number = 1;
-		while(true) {
-			if (f_stat(imu_str_buf, NULL) == FR_OK) {
-				sprintf(imu_str_buf, "IMU%d.TAB", rename_number);
-				rename_number ++;
-				continue;
-			}
-			break;
-		}
-	}
-	LOG_INFO("Imu output is %s", imu_str_buf);
-	result = f_open(&f_imu_log, imu_str_buf, FA_WRITE | FA_CREATE_ALWAYS);
-	if (result != FR_OK) {
-		LOG_ERROR("Failed to open IMU log file");
-		vTaskSuspend(NULL);
-	}
-	imu_running = true;
-	for (;;) {
-		while (!(LSM_read_reg_xlg(LSM_STATUS_REG1_XL) & 1));
-		imu_measurements.ax = LSM_read_accel_g(LSM_ACCEL_X);
-		imu_measurements.ay = LSM_read_accel_g(LSM_ACCEL_Y);
-		imu_measurements.az = LSM_read_accel_g(LSM_ACCEL_Z);
-		while (!(LSM_read_reg_xlg(LSM_STATUS_REG1_XL) & 2));
-		imu_measurements.gx = LSM_read_gyro_dps(LSM_GYRO_X);
-		imu_measurements.gy = LSM_read_gyro_dps(LSM_GYRO_Y);
-		imu_measurements.gz = LSM_read_gyro_dps(LSM_GYRO_Z);
-		while (!(LSM_read_reg_mag(LSM_STATUS_REG_M) & 8));
-		imu_measurements.mx = LSM_read_mag_gs(LSM_MAG_X);
-		imu_measurements.my = LSM_read_mag_gs(LSM_MAG_Y);
-		imu_measurements.mz = LSM_read_mag_gs(LSM_MAG_Z);
-
-		if (result == FR_OK) {
-			//Find max acceleration in positive x direction.  "this side up" on board is +x
-			if(imu_measurements.ax > max_acc) {
-				max_acc = imu_measurements.ax;
-			}
-			sprintf(imu_str_buf, "%d\t%f\t%f\t%f\t%f\t", xTaskGetTickCount(), imu_measurements.ax, imu_measurements.ay, imu_measurements.az, imu_measurements.gx);
-			f_puts(imu_str_buf, &f_imu_log);
-			sprintf(imu_str_buf, "%f\t%f\t%f\t%f\t%f\n", imu_measurements.gy, imu_measurements.gz, imu_measurements.mx, imu_measurements.my, imu_measurements.mz);
-			f_puts(imu_str_buf, &f_imu_log);
-			if ((counter % 100) == 0) {
-				f_sync(&f_imu_log);
-			}
-		}
-
-		vTaskDelay(50);
-		counter += 1;
-	}
-}
-
-static void vHighG(void* pvParameters) {
-	static FIL f_highg_log;
-	static char highg_str_buf[0x40];
-	LOG_INFO("Initializing HighG");
-	if (H3L_init(ONBOARD_I2C, H3L_SCALE_100G, H3L_ODR_100)) {
-		LOG_INFO("HighG initialized");
-	} else {
-		LOG_ERROR("HighG failed to initialize");
-		vTaskSuspend(NULL);
-	}
-
-	int result;
-	int counter = 0;
-	strcpy(highg_str_buf, "HIGHG.TAB");
-	{
-		int rename_number = 1;
-		while(true) {
-			if (f_stat(highg_str_buf, NULL) == FR_OK) {
-				sprintf(highg_str_buf, "HIGHG%d.TAB", rename_number);
-				rename_number ++;
-				continue;
-			}
-			break;
-		}
-	}
-	LOG_INFO("HighG output is %s", highg_str_buf);
-	result = f_open(&f_highg_log, highg_str_buf, FA_WRITE | FA_CREATE_ALWAYS);
-	if (result != FR_OK) {
-		LOG_ERROR("Failed to open HighG log file");
-		vTaskSuspend(NULL);
-	}
-	highg_running = true;
-	for (;;) {
-		float ax, ay, az;
-		while (!(H3L_read_reg(H3L_STATUS_REG) & 1));
-		ax = H3L_read_accel_g(H3L_X);
-		while (!(H3L_read_reg(H3L_STATUS_REG) & 2));
-		ay = H3L_read_accel_g(H3L_Y);
-		while (!(H3L_read_reg(H3L_STATUS_REG) & 4));
-		az = H3L_read_accel_g(H3L_Z);
-
-		if (fabs(ay) > 5.0) {
-			if (!firing_board_fire_channel(2)) {
-				LOG_DEBUG("Failed to fire 2");
-			} else {
-				LOG_DEBUG("Firing 2");
-			}
-		}
-
-		if (result == FR_OK) {
-			//Find max acceleration in positive x direction.  "this side up" on board is +x
-			if( ax > max_acc ) {
-				max_acc = ax;
-			}
-			sprintf(highg_str_buf, "%d\t%f\t%f\t%f\n", xTaskGetTickCount(), ax, ay, az);
-			f_puts(highg_str_buf, &f_highg_log);
-			if ((counter % 50) == 0) {
-				f_sync(&f_highg_log);
-			}
-		}
-
-		vTaskDelay(50);
-		counter += 1;
-	}
-}
-
 static void vGPS(void* pv) {
-	static FIL f_volts;
-	static char highg_str_buf[0x40];
 	LOG_INFO("Initializing GPS board");
-
-	int result;
-	strcpy(highg_str_buf, "GPS.TAB");
-	{
-		int rename_number = 1;
-		while(true) {
-			if (f_stat(highg_str_buf, NULL) == FR_OK) {
-				sprintf(highg_str_buf, "GPS%d.TAB", rename_number);
-				rename_number ++;
-				continue;
-			}
-			break;
-		}
-	}
-	LOG_INFO("GPS output is %s", highg_str_buf);
-	result = f_open(&f_volts, highg_str_buf, FA_WRITE | FA_CREATE_ALWAYS);
-	if (result != FR_OK) {
-		LOG_ERROR("Failed to open gps log file");
-		vTaskSuspend(NULL);
-	}
+	storage_open(STORAGE_GPS);
 
 	TickType_t xLastWakeTime = xTaskGetTickCount();
 	bool line_broken = true;
 	uint32_t counter = 0;
-	uint32_t line_counter = 0;
 
     LOG_INFO("Initializing Telem wing");
 	for(;;) {
@@ -482,6 +255,7 @@ static void vGPS(void* pv) {
 			i2c_uart_set_gpio_direction(0xff); // Set all GPIO to output to reduce noise susceptibility
 			i2c_uart_write_gpio(1 << 3);
 			LOG_INFO("Telemetry wing initialized");
+			boot_profile_mark(BOOT_STAGE_TELEMETRY);
 			size_t line_position = 0;
             static char line_buffer[200];
             bool is_gpgga = false;
@@ -504,7 +278,10 @@ static void vGPS(void* pv) {
 					if (line_position < sizeof(line_buffer) - 1) {
 						line_buffer[line_position] = c;
 					}
-					f_putc(c, &f_volts);
+					{
+						char byte = c;
+						storage_push(STORAGE_GPS, &byte);
+					}
 					line_position ++;
 
 					if (line_position == 6) {
@@ -515,10 +292,6 @@ static void vGPS(void* pv) {
 					}
 
 					if (c == '\n') {
-						if ((line_counter % 20) == 0) {
-							f_sync(&f_volts);
-						}
-						line_counter ++;
 						if (is_gpgga) {
 							line_buffer[line_position] = 0;
 							i2c_uart_send_string(I2C_UART_CHANA, line_buffer);
@@ -541,7 +314,7 @@ static void vGPS(void* pv) {
 					if (is_firing) {
 						is_firing = false;
 						if (c >= '1' && c <= '4') {
-							if (firing_board_fire_channel(c - '0')) {
+							if (pyro_fire(c - '0', FIRING_BOARD_DEFAULT_DELAY_MS)) {
 								i2c_uart_send_string(I2C_UART_CHANA, "Firing\n");
 							} else {
 								i2c_uart_send_string(I2C_UART_CHANA, "Failed to fire\n");
@@ -556,7 +329,10 @@ static void vGPS(void* pv) {
 				}
 				if ((counter % 10) == 0) {
 					static char imu_out_buf[40];
-					sprintf(imu_out_buf, "S,IMUACC,%.2f,%.2f,%.2f\n", imu_measurements.ax, imu_measurements.ay, imu_measurements.az);
+					flight_state_t state;
+					flight_state_snapshot(&state);
+					sprintf(imu_out_buf, "S,IMUACC,%.2f,%.2f,%.2f\n", LSM_accel_raw_to_mg(state.imu_accel[0]) / 1000.0f,
+							LSM_accel_raw_to_mg(state.imu_accel[1]) / 1000.0f, LSM_accel_raw_to_mg(state.imu_accel[2]) / 1000.0f);
 					i2c_uart_send_string(I2C_UART_CHANA, imu_out_buf);
 				}
 				vTaskDelayUntil(&xLastWakeTime, 10);
@@ -568,40 +344,20 @@ static void vGPS(void* pv) {
 }
 
 static void vVolts(void* pv) {
-	static FIL f_volts;
-	static char highg_str_buf[0x40];
-
-	int result;
-	int counter = 0;
-	strcpy(highg_str_buf, "VOLTS.TAB");
-	{
-		int rename_number = 1;
-		while(true) {
-			if (f_stat(highg_str_buf, NULL) == FR_OK) {
-				sprintf(highg_str_buf, "VOLTS%d.TAB", rename_number);
-				rename_number ++;
-				continue;
-			}
-			break;
-		}
-	}
-	LOG_INFO("Volts output is %s", highg_str_buf);
-	result = f_open(&f_volts, highg_str_buf, FA_WRITE | FA_CREATE_ALWAYS);
-	if (result != FR_OK) {
-		LOG_ERROR("Failed to open volts log file");
-		vTaskSuspend(NULL);
-	}
-
+	storage_open(STORAGE_VOLTS);
 
 	LOG_INFO("Init Firing Board ");
 	for (;;) {
 		if (firing_board_setup(OFFBOARD_I2C)) {
 			LOG_INFO("Firing board initialized");
+			boot_profile_mark(BOOT_STAGE_FIRING_BOARD);
 
+			TickType_t last_wake = xTaskGetTickCount();
+			uint32_t polls = 0;
+			firing_board_status_t last = {0};
 			for (;;) {
-				float vext, vbus;
-				vext = firing_board_read_volt(VOLTAGE_EXTERNAL_BAT);
-				vbus = firing_board_read_volt(VOLTAGE_BUS);
+				firing_board_status_t status;
+				bool ok = firing_board_read_status(&status);
 
 				if (firing_board_transmit_error) {
 					LOG_ERROR("Firing board dropped out");
@@ -609,18 +365,27 @@ static void vVolts(void* pv) {
 					break;
 				}
 
-				if (result == FR_OK) {
-					sprintf(highg_str_buf, "%d\t%f\t%f\n", xTaskGetTickCount(), vext, vbus);
-					f_puts(highg_str_buf, &f_volts);
-					if ((counter % 5) == 0) {
-						f_sync(&f_volts);
+				// A CRC failure skips the poll
+				if (ok) {
+					bool changed = polls == 0 || status.mode != last.mode || status.fire_count != last.fire_count;
+					if (changed || polls % VOLTS_PAD_LOG_POLLS == 0 || flight_phase_is_full_rate(flight_phase_get())) {
+						volts_record_t record;
+						record.tick = xTaskGetTickCount();
+						record.vext = status.vext;
+						record.vbus = status.vbus;
+						memcpy(record.channel_raw, status.channel_raw, sizeof(record.channel_raw));
+						record.mode = status.mode;
+						record.fire_count = status.fire_count;
+						storage_push(STORAGE_VOLTS, &record);
 					}
+					last = status;
+					polls++;
 				}
+				pyro_poll();
 
 				volt_active = true;
 
-				vTaskDelay(500);
-				counter += 1;
+				vTaskDelayUntil(&last_wake, VOLTS_POLL_MS);
 			}
 		}
 		vTaskDelay(500); // Wait for firing board connect
@@ -630,25 +395,61 @@ static void vVolts(void* pv) {
 static TaskHandle_t monitor_tasks[10];
 static uint32_t monitor_task_write_ptr;
 
-void vTaskDepthRecorder(void* pv) {
-	int i;
-	for (;;) {
-		for (i = 0; i < sizeof(monitor_tasks) / sizeof(*monitor_tasks); i++) {
-			if (monitor_tasks[i]) {
-				LOG_DEBUG("Task %s: watermark %d", pcTaskGetTaskName(monitor_tasks[i]), uxTaskGetStackHighWaterMark(monitor_tasks[i]));
-			}
-		}
-		vTaskDelay(2000);
+/* Stacks of the tasks that run for the whole flight. In the static build they are
+ * fixed .bss arrays; otherwise the kernel allocates them from the heap. Boot deletes
+ * itself, and tasks.c hands a deleted task's stack to vPortFree, so it stays on the heap. */
+#if configSTATIC_TASK_STACKS
+#define TASK_STACK(name, words)	static StackType_t name[words]
+#define TASK_STACK_ARGS(name)	(sizeof(name) / sizeof(StackType_t)), (name)
+#else
+#define TASK_STACK(name, words)	enum { name##_words = (words) }
+#define TASK_STACK_ARGS(name)	name##_words, NULL
+#endif
+
+TASK_STACK(perf_stack, 256);
+TASK_STACK(flush_logs_stack, 150);
+TASK_STACK(led_stack, 128);
+TASK_STACK(bluetooth_stack, 256);
+TASK_STACK(storage_stack, 384);
+TASK_STACK(acquisition_stack, 384);
+TASK_STACK(volts_stack, 256);
+TASK_STACK(gps_stack, 256);
+
+static void start_task(TaskFunction_t code, const char* name, uint16_t stack_words, StackType_t* stack, UBaseType_t priority) {
+	if (xTaskGenericCreate(code, name, stack_words, NULL, priority, &monitor_tasks[monitor_task_write_ptr++], stack, NULL) != pdPASS) {
+		LOG_ERROR("Could not create task %s", name);
 	}
 }
 
 static FATFS root_fs;
 static void vBootSystem(void* pvParameters) {
 	int result;
-	LOG_INFO("Wait for voltage stabilization");
-	vTaskDelay(1000);
+	boot_profile_mark(BOOT_STAGE_SCHEDULER);
+
+	// Sensor, firing board and telemetry wing bring-up run on the I2C buses while this
+	// task mounts the card over SPI. The storage writer holds records in its queues
+	// until storage_volume_ready(). Download mode logs nothing but the text log.
+	if (warm_restart_is_warm()) {
+		flight_phase_resume(warm_restart_phase());
+	} else {
+		flight_phase_init();
+	}
+	// Needs the SPI interrupt, so not in hardware_init. The storage writer or the
+	// download task probes it before use.
+	S25FL_init(SPI_DEVICE_1, S25FL_P_256, S25FL_E_64);
+	if (!download_mode_active()) {
+		LOG_INFO("Starting sensor tasks");
+		storage_init();
+		start_task(task_storage, "Storage", TASK_STACK_ARGS(storage_stack), (tskIDLE_PRIORITY + 1UL));
+		start_task(task_acquisition, "Acq", TASK_STACK_ARGS(acquisition_stack), SENSOR_PRIORITY);
+		start_task(vVolts, "Volts", TASK_STACK_ARGS(volts_stack), (tskIDLE_PRIORITY + 1UL));
+		start_task(vGPS, "GPS", TASK_STACK_ARGS(gps_stack), (tskIDLE_PRIORITY + 1UL));
+	}
+	start_task(task_perf, "Perf", TASK_STACK_ARGS(perf_stack), (tskIDLE_PRIORITY + 1UL));
+	start_task(vLEDTask1, "vTaskLed1", TASK_STACK_ARGS(led_stack), (tskIDLE_PRIORITY + 1UL));
 
 	if (1){
+		// No fixed settle delay; a card that is still powering up fails the first attempts
 		int sdcard_retry_limit = SDCARD_START_RETRY_LIMIT;
 		while (sdcard_retry_limit > 0) {
 			LOG_INFO("Attempting to mount FAT on SDCARD");
@@ -657,7 +458,8 @@ static void vBootSystem(void* pvParameters) {
 				break;
 			}
 			LOG_WARN("SDCard Mount error code %d", result);
-			if (result == FR_NO_FILESYSTEM) {
+			// Never format the card under a resumed flight
+			if (result == FR_NO_FILESYSTEM && !warm_restart_is_warm()) {
 				LOG_WARN("No file system. Making new.");
 				result = f_mkfs("0:", 1, 0);
 				if (result != FR_OK) {
@@ -666,13 +468,14 @@ static void vBootSystem(void* pvParameters) {
 				}
 			}
 			Chip_GPIO_SetPinState(LPC_GPIO, 0, 20, !Chip_GPIO_GetPinState(LPC_GPIO, 0, 20));
-			vTaskDelay(200);
+			vTaskDelay(SDCARD_RETRY_DELAY_MS);
 			sdcard_retry_limit --;
 		}
 		if (sdcard_retry_limit == 0) {
 			LOG_ERROR("SDCard Mount failed");
 			exit_error(ERROR_CODE_SDCARD_MOUNT_FAILED);
 		}
+		boot_profile_mark(BOOT_STAGE_SD_MOUNTED);
 
 		Chip_GPIO_SetPinState(LPC_GPIO, 0, 20, false);
 
@@ -680,27 +483,22 @@ static void vBootSystem(void* pvParameters) {
 		if (result != 0) {
 			exit_error(ERROR_CODE_SDCARD_LOGGING_INIT_FAILED);
 		}
+		boot_profile_mark(BOOT_STAGE_LOG_OPEN);
+		if (warm_restart_is_warm()) {
+			LOG_WARN("Warm restart %u in %s, reset cause 0x%x, error %d", warm_restart_count(),
+					flight_phase_name(warm_restart_phase()), warm_restart_reset_cause(), warm_restart_last_error());
+		}
 	}
 
-	LOG_INFO("Starting real tasks");
-//	xTaskCreate(vTaskDepthRecorder, "DepthRec", 156, NULL, (tskIDLE_PRIORITY + 2), &monitor_tasks[monitor_task_write_ptr++]);
-
-	xTaskCreate(vFlushLogs, "vFlushLogs",
-				150, NULL, (tskIDLE_PRIORITY + 2), &monitor_tasks[monitor_task_write_ptr++]);
-
-	xTaskCreate(vLEDTask1, "vTaskLed1",
-				128, NULL, (tskIDLE_PRIORITY + 1UL),
-				&monitor_tasks[monitor_task_write_ptr++]);
-
-	xTaskCreate(task_bluetooth_commands, "USBUART", 256, NULL, (tskIDLE_PRIORITY + 1UL), &monitor_tasks[monitor_task_write_ptr++]);
-
-	xTaskCreate(vBaro, "Baro", 256, NULL, SENSOR_PRIORITY, &monitor_tasks[monitor_task_write_ptr++]);
-
-	xTaskCreate(vIMU, "IMU", 256, NULL, SENSOR_PRIORITY, &monitor_tasks[monitor_task_write_ptr++]);
-
-	xTaskCreate(vHighG, "HighG", 256, NULL, SENSOR_PRIORITY, &monitor_tasks[monitor_task_write_ptr++]);
-	xTaskCreate(vVolts, "Volts", 256, NULL, (tskIDLE_PRIORITY + 1UL), &monitor_tasks[monitor_task_write_ptr++]);
-	xTaskCreate(vGPS, "GPS", 256, NULL, (tskIDLE_PRIORITY + 1UL), &monitor_tasks[monitor_task_write_ptr++]);
+	LOG_INFO("Starting card tasks");
+	start_task(vFlushLogs, "vFlushLogs", TASK_STACK_ARGS(flush_logs_stack), (tskIDLE_PRIORITY + 2));
+	start_task(task_bluetooth_commands, "USBUART", TASK_STACK_ARGS(bluetooth_stack), (tskIDLE_PRIORITY + 1UL));
+	if (download_mode_active()) {
+		// Acquisition is not running, so its stack is free
+		start_task(task_download, "Download", TASK_STACK_ARGS(acquisition_stack), (tskIDLE_PRIORITY + 1UL));
+	} else {
+		storage_volume_ready();
+	}
 
 	LOG_INFO("Initialization Complete. Clock speed is %d", SystemCoreClock);
 	LOG_INFO("Free memory %d", xPortGetFreeHeapSize());
@@ -723,24 +521,16 @@ int main(void)
 {
 
 	/* Initialize Globals */
-	max_spd = 0;
-	max_acc = 0;
-	max_alt = 0;
-	descent_rate = 0;
-	
-	alt_arr[0] = 0;
-	alt_arr[1] = 0;
-	alt_arr[2] = 0;
-	alt_arr[3] = 0;
-	alt_arr[4] = 0;
-
-	time_arr[0] = 0;
-	time_arr[1] = 0;
-	time_arr[2] = 0;
-	time_arr[3] = 0;
-	time_arr[4] = 0;
+	warm_restart_init();
+	download_mode_init();
+	flight_state_init();
 
 	prvSetupHardware();
+	// Boot profile times count from here
+	timebase_init();
+	if (!download_mode_active()) {
+		kernel_trace_start();
+	}
 
 	Chip_GPIO_SetPinDIROutput(LPC_GPIO, 0, 20);
 	debug_uart_init();
@@ -748,6 +538,7 @@ int main(void)
 	Chip_GPIO_SetPinState(LPC_GPIO, 0, 20, true);
 	hardware_init();
 	Chip_GPIO_SetPinState(LPC_GPIO, 0, 20, true);
+	boot_profile_mark(BOOT_STAGE_HARDWARE);
 
 
 	/* LED1 toggle thread */
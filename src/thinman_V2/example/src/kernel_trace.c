@@ -0,0 +1,235 @@
+/*
+ * kernel_trace.c
+ *
+ *  TRACE.BIN is a sequence of blocks, little-endian:
+ *    u8 'K', u8 'T', u8 kind, u8 0, u16 count, u16 dropped
+ *  kind 1, task names:  count x { u8 number, char name[configMAX_TASK_NAME_LEN] }
+ *  kind 2, queue names: count x { u16 object, char name[configMAX_TASK_NAME_LEN] }
+ *  kind 3, events:      count x { u32 t_us, u8 type, u8 arg, u16 object }
+ *  dropped counts the events lost to a full ring since the previous event block.
+ *  Name blocks are rewritten whole whenever a name is added, so the last one wins.
+ */
+
+#include <string.h>
+#include <chip.h>
+#include <cr_section_macros.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "ff.h"
+#include "logging.h"
+#include "kernel_trace.h"
+#include "drivers/timebase.h"
+#include "tasks/storage.h"
+
+#define KERNEL_TRACE_EVENTS			(KERNEL_TRACE_RING_SIZE / sizeof(kernel_trace_record_t))
+#define KERNEL_TRACE_MAX_TASKS		12
+#define KERNEL_TRACE_MAX_QUEUES		8
+// Flush once this many events are waiting, or the oldest has waited KERNEL_TRACE_FLUSH_MS
+#define KERNEL_TRACE_FLUSH_EVENTS	(KERNEL_TRACE_EVENTS / 2)
+#define KERNEL_TRACE_FLUSH_MS		100
+#define KERNEL_TRACE_SYNC_MS		1000
+
+enum {
+	KERNEL_TRACE_BLOCK_TASK_NAMES = 1,
+	KERNEL_TRACE_BLOCK_QUEUE_NAMES,
+	KERNEL_TRACE_BLOCK_EVENTS_KIND,
+};
+
+typedef struct {
+	uint32_t t_us;
+	uint8_t type;
+	uint8_t arg;
+	uint16_t object;
+} kernel_trace_record_t;
+
+typedef struct {
+	uint8_t number;
+	char name[configMAX_TASK_NAME_LEN];
+} kernel_trace_task_name_t;
+
+typedef struct {
+	uint16_t object;
+	char name[configMAX_TASK_NAME_LEN];
+} kernel_trace_queue_name_t;
+
+// USB SRAM, shared with the high-g pretrigger ring. Download mode hands the bank
+// to USB, so the trace is never started there.
+__BSS(RAM3) static kernel_trace_record_t kernel_trace_ring[KERNEL_TRACE_EVENTS];
+static uint32_t kernel_trace_head;		// Written with interrupts masked
+static uint32_t kernel_trace_tail;		// Written only by kernel_trace_flush
+static uint16_t kernel_trace_dropped;
+static bool kernel_trace_running;
+
+static kernel_trace_task_name_t kernel_trace_tasks[KERNEL_TRACE_MAX_TASKS];
+static kernel_trace_queue_name_t kernel_trace_queues[KERNEL_TRACE_MAX_QUEUES];
+static uint8_t kernel_trace_task_count;
+static uint8_t kernel_trace_queue_count;
+static volatile bool kernel_trace_names_dirty;
+
+void kernel_trace_start(void) {
+	kernel_trace_running = true;
+}
+
+void kernel_trace_event(uint8_t type, uint8_t arg, uint16_t object) {
+	// Hooks run from tasks, the scheduler and interrupts alike
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (kernel_trace_running) {
+		if (kernel_trace_head - kernel_trace_tail < KERNEL_TRACE_EVENTS) {
+			kernel_trace_record_t* record = &kernel_trace_ring[kernel_trace_head & (KERNEL_TRACE_EVENTS - 1)];
+			record->t_us = timebase_us();
+			record->type = type;
+			record->arg = arg;
+			record->object = object;
+			kernel_trace_head++;
+		} else if (kernel_trace_dropped != 0xffff) {
+			kernel_trace_dropped++;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
+void kernel_trace_name_task(uint8_t number, const char* name) {
+	uint32_t primask = __get_PRIMASK();
+	int i;
+	__disable_irq();
+	for (i = 0; i < kernel_trace_task_count; i++) {
+		if (kernel_trace_tasks[i].number == number) break;
+	}
+	if (i < KERNEL_TRACE_MAX_TASKS) {
+		if (i == kernel_trace_task_count) {
+			kernel_trace_task_count++;
+		}
+		kernel_trace_tasks[i].number = number;
+		strncpy(kernel_trace_tasks[i].name, name, configMAX_TASK_NAME_LEN);
+		kernel_trace_names_dirty = true;
+	}
+	__set_PRIMASK(primask);
+}
+
+void kernel_trace_name_queue(void* queue, const char* name) {
+	int i;
+	uint16_t object = KERNEL_TRACE_OBJECT(queue);
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (i = 0; i < kernel_trace_queue_count; i++) {
+		if (kernel_trace_queues[i].object == object) break;
+	}
+	if (i < KERNEL_TRACE_MAX_QUEUES) {
+		if (i == kernel_trace_queue_count) {
+			kernel_trace_queue_count++;
+		}
+		kernel_trace_queues[i].object = object;
+		strncpy(kernel_trace_queues[i].name, name, configMAX_TASK_NAME_LEN);
+		kernel_trace_names_dirty = true;
+	}
+	__set_PRIMASK(primask);
+}
+
+static void kernel_trace_put_u16(uint8_t* p, uint16_t value) {
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+static bool kernel_trace_write(FIL* f, const void* data, size_t size) {
+	UINT written;
+	return f_write(f, data, size, &written) == FR_OK && written == size;
+}
+
+static bool kernel_trace_write_header(FIL* f, uint8_t kind, uint16_t count, uint16_t dropped) {
+	uint8_t header[8] = {'K', 'T', kind, 0};
+	kernel_trace_put_u16(&header[4], count);
+	kernel_trace_put_u16(&header[6], dropped);
+	return kernel_trace_write(f, header, sizeof(header));
+}
+
+// Entries go out one at a time, packed; the in-memory tables carry padding. FatFs
+// gathers them in the file's sector buffer.
+static bool kernel_trace_write_names(FIL* f) {
+	uint8_t entry[2 + configMAX_TASK_NAME_LEN];
+	int i, count;
+
+	kernel_trace_names_dirty = false;
+	count = kernel_trace_task_count;
+	if (!kernel_trace_write_header(f, KERNEL_TRACE_BLOCK_TASK_NAMES, count, 0)) return false;
+	for (i = 0; i < count; i++) {
+		taskENTER_CRITICAL();
+		entry[0] = kernel_trace_tasks[i].number;
+		memcpy(&entry[1], kernel_trace_tasks[i].name, configMAX_TASK_NAME_LEN);
+		taskEXIT_CRITICAL();
+		if (!kernel_trace_write(f, entry, 1 + configMAX_TASK_NAME_LEN)) return false;
+	}
+
+	count = kernel_trace_queue_count;
+	if (!kernel_trace_write_header(f, KERNEL_TRACE_BLOCK_QUEUE_NAMES, count, 0)) return false;
+	for (i = 0; i < count; i++) {
+		taskENTER_CRITICAL();
+		kernel_trace_put_u16(entry, kernel_trace_queues[i].object);
+		memcpy(&entry[2], kernel_trace_queues[i].name, configMAX_TASK_NAME_LEN);
+		taskEXIT_CRITICAL();
+		if (!kernel_trace_write(f, entry, 2 + configMAX_TASK_NAME_LEN)) return false;
+	}
+	return true;
+}
+
+void kernel_trace_flush(void) {
+	// Taken from the heap when the card first has something to write, so download
+	// mode, which never starts the trace, does not carry it
+	static FIL* f_trace;
+	static bool failed;
+	static portTickType last_flush, last_sync;
+	portTickType now = xTaskGetTickCount();
+	uint32_t pending;
+
+	if (failed) return;
+	pending = kernel_trace_head - kernel_trace_tail;
+	if (pending < KERNEL_TRACE_FLUSH_EVENTS && (now - last_flush) < KERNEL_TRACE_FLUSH_MS && !kernel_trace_names_dirty) return;
+	last_flush = now;
+
+	if (f_trace == NULL) {
+		int result;
+		f_trace = pvPortMalloc(sizeof(FIL));
+		if (f_trace == NULL) {
+			LOG_ERROR("No heap for the trace file");
+			failed = true;
+			return;
+		}
+		result = storage_open_next(f_trace, "TRACE", "BIN");
+		if (result != FR_OK) {
+			LOG_ERROR("Failed to open trace file with error code %d", result);
+			vPortFree(f_trace);
+			f_trace = NULL;
+			failed = true;
+			return;
+		}
+	}
+	if (kernel_trace_names_dirty && !kernel_trace_write_names(f_trace)) {
+		LOG_ERROR("Trace write failed");
+	}
+
+	while (pending > 0) {
+		// Events are written straight from the ring, up to where it wraps. The hooks
+		// only add at the head, so the slots stay put until the tail moves past them.
+		uint32_t start = kernel_trace_tail & (KERNEL_TRACE_EVENTS - 1);
+		uint16_t count = pending < KERNEL_TRACE_EVENTS - start ? pending : KERNEL_TRACE_EVENTS - start;
+		uint16_t dropped;
+		__disable_irq();
+		dropped = kernel_trace_dropped;
+		kernel_trace_dropped = 0;
+		__enable_irq();
+		// The record layout has no padding and the core is little-endian, so events go out as stored
+		if (!kernel_trace_write_header(f_trace, KERNEL_TRACE_BLOCK_EVENTS_KIND, count, dropped)
+				|| !kernel_trace_write(f_trace, &kernel_trace_ring[start], count * sizeof(kernel_trace_record_t))) {
+			LOG_ERROR("Trace write failed");
+			break;
+		}
+		// A single word store; kernel_trace_event reads it with interrupts masked
+		kernel_trace_tail += count;
+		pending -= count;
+	}
+
+	if ((now - last_sync) >= KERNEL_TRACE_SYNC_MS) {
+		last_sync = now;
+		f_sync(f_trace);
+	}
+}
@@ -12,6 +12,7 @@
 #include <task.h>
 #include "./morse.h"
 #include "logging.h"
+#include "warm_restart.h"
 #include "ff.h"
 
 static FIL log_file;
@@ -21,6 +22,8 @@ static xSemaphoreHandle logging_mutex;
 uint32_t logging_counter = 0;
 void exit_error(int error_code) {
 	taskDISABLE_INTERRUPTS();
+	// In flight, reset and resume logging rather than halt
+	warm_restart_on_fatal(error_code);
 	Board_LED_Set(0, false);
 	Board_LED_Set(1, false);
 	Board_LED_Set(2, false);
@@ -30,6 +33,7 @@ void exit_error(int error_code) {
 
 void exit_error_msg(int error_code, const char* message) {
 	taskDISABLE_INTERRUPTS();
+	warm_restart_on_fatal(error_code);
     morsePlay("SOS");
 	for(;;) {
 		morseInt(error_code);
@@ -40,6 +44,7 @@ void exit_error_msg(int error_code, const char* message) {
 
 void logging_init(void) {
 	logging_mutex = xSemaphoreCreateMutex();
+	vQueueAddToRegistry(logging_mutex, "Log");
 }
 
 int logging_init_persistent() {
@@ -49,6 +49,26 @@ float H3L_read_accel_g(uint8_t dimension) {
 	return H3L_a_res * (float)H3L_read_accel_raw(dimension);
 }
 
+int H3L_read_accel_raw_burst(int16_t out[3]) {
+	uint8_t buf[6];
+	if (!H3L_read_regs(H3L_OUT_X_L, buf, sizeof(buf))) return 0;
+	out[0] = (int16_t)(buf[1] << 8 | buf[0]);
+	out[1] = (int16_t)(buf[3] << 8 | buf[2]);
+	out[2] = (int16_t)(buf[5] << 8 | buf[4]);
+	return 1;
+}
+
+int16_t H3L_accel_mg_to_raw(int32_t mg) {
+	int32_t raw = mg * (H3L_FULL_SCALE_COUNTS / 8) / (H3L_a_fs_mg / 8); // keep 400g * 32768 within 32 bits
+	if (raw > INT16_MAX) return INT16_MAX;
+	if (raw < INT16_MIN) return INT16_MIN;
+	return (int16_t)raw;
+}
+
+int32_t H3L_accel_raw_to_mg(int16_t raw) {
+	return (int32_t)raw * (H3L_a_fs_mg / 8) / (H3L_FULL_SCALE_COUNTS / 8);
+}
+
 void H3L_set_accel_scale(enum H3L_accel_scale a_sc) {
 	// Get current reg value
 	uint8_t ctrl = H3L_read_reg(H3L_CTRL_REG4);
@@ -95,15 +115,19 @@ void H3L_calc_a_res() {
 	switch (H3L_a_scale) {
 		case H3L_SCALE_100G:
 			H3L_a_res = 100.0f / 32768.0f;
+			H3L_a_fs_mg = 100000;
 			break;
 		case H3L_SCALE_200G:
 			H3L_a_res = 200.0f / 32768.0f;
+			H3L_a_fs_mg = 200000;
 			break;
 		case H3L_SCALE_400G:
 			H3L_a_res = 400.0f / 32768.0f;
+			H3L_a_fs_mg = 400000;
 			break;
 		default:
 			H3L_a_res = 1.0f;
+			H3L_a_fs_mg = 32768000;
 	}
 }
 
@@ -133,3 +157,7 @@ void H3L_write_reg(uint8_t reg_addr, uint8_t data) {
 	// - Write the data
 	Chip_I2C_MasterSend(H3L_i2c_id, H3L_slave_address >> 1, tx_buf, tx_size);
 }
+
+int H3L_read_regs(uint8_t reg_addr, uint8_t* buf, uint8_t size) {
+	return Chip_I2C_MasterCmdRead(H3L_i2c_id, H3L_slave_address >> 1, reg_addr | 0x80, buf, size) == size;
+}
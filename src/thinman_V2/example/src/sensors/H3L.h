@@ -62,6 +62,9 @@ uint8_t H3L_slave_address;
 enum H3L_accel_scale H3L_a_scale;
 // Conversion factor (sensor scale) / (2^15)
 float H3L_a_res;
+// Integer full-scale range in mg, i.e. the acceleration of H3L_FULL_SCALE_COUNTS raw counts
+#define H3L_FULL_SCALE_COUNTS 32768
+int32_t H3L_a_fs_mg;
 
 int H3L_init(I2C_ID_T id_in, enum H3L_accel_scale a_sc, enum H3L_accel_odr a_odr);
 
@@ -69,6 +72,15 @@ int H3L_init(I2C_ID_T id_in, enum H3L_accel_scale a_sc, enum H3L_accel_odr a_odr
 // Possible dimensions are H3L_X, H3L_Y, H3L_Z for this device
 int16_t H3L_read_accel_raw(uint8_t dimension);
 float H3L_read_accel_g(uint8_t dimension);
+// Read x, y and z in one I2C transaction using register auto-increment, so all three axes come
+// from the same output sample. Returns 0 on bus error, leaving out unchanged.
+int H3L_read_accel_raw_burst(int16_t out[3]);
+
+// Convert an acceleration in mg to raw counts at the current scale, saturating at the int16 range.
+// Intended for precomputing thresholds at init, not for the sample path.
+int16_t H3L_accel_mg_to_raw(int32_t mg);
+// Convert raw counts to mg at the current scale. For display/telemetry only.
+int32_t H3L_accel_raw_to_mg(int16_t raw);
 
 // Set the full range scale to H3L_SCALE_100G, H3L_SCALE_200G, or H3L_SCALLE_400G
 void H3L_set_accel_scale(enum H3L_accel_scale a_sc);
@@ -90,7 +102,7 @@ void H3L_configure_int_2(uint8_t int2_cfg, uint8_t int2_ths, uint8_t duration);
 void H3L_init_accel();
 
 // Calculate the resolution of the accelerometer.
-// This function will set the value of the a_res variable. a_scale must
+// This function will set the value of the a_res and a_fs_mg variables. a_scale must
 // be set prior to calling this function.
 void H3L_calc_a_res();
 
@@ -100,4 +112,7 @@ uint8_t H3L_read_reg(uint8_t reg_addr);
 // Write to a register on the device
 void H3L_write_reg(uint8_t reg_addr, uint8_t data);
 
+// Read consecutive registers starting at reg_addr (MSB of the address enables auto-increment)
+int H3L_read_regs(uint8_t reg_addr, uint8_t* buf, uint8_t size);
+
 #endif /* H3L_H */
@@ -1,5 +1,40 @@
 #include "LPS.h"
 
+// Altitude (mm) of the standard atmosphere at every 4 mbar, starting at LPS_ALT_TABLE_FIRST * 4 mbar
+// Generated from LPS_pressure_to_altitude_m(i * 4.0f, 1013.25f) * 1000, rounded
+#define LPS_ALT_TABLE_SHIFT		14 // 4 mbar = 2^14 raw counts
+#define LPS_ALT_TABLE_FIRST		64 // 256 mbar
+#define LPS_ALT_TABLE_SIZE		209 // up to 1088 mbar
+static const int32_t LPS_alt_table_mm[LPS_ALT_TABLE_SIZE] = {
+	10209319, 10108517, 10008962, 9910621, 9813462, 9717453, 9622564, 9528767,
+	9436033, 9344336, 9253651, 9163953, 9075218, 8987424, 8900548, 8814569,
+	8729467, 8645222, 8561815, 8479228, 8397442, 8316442, 8236209, 8156728,
+	8077983, 7999960, 7922643, 7846019, 7770074, 7694794, 7620167, 7546180,
+	7472821, 7400078, 7327940, 7256395, 7185433, 7115044, 7045217, 6975941,
+	6907209, 6839009, 6771333, 6704172, 6637518, 6571362, 6505695, 6440510,
+	6375798, 6311553, 6247766, 6184431, 6121541, 6059087, 5997065, 5935467,
+	5874286, 5813517, 5753153, 5693189, 5633618, 5574435, 5515634, 5457209,
+	5399156, 5341469, 5284143, 5227173, 5170554, 5114282, 5058351, 5002756,
+	4947495, 4892561, 4837951, 4783661, 4729686, 4676022, 4622665, 4569612,
+	4516859, 4464401, 4412235, 4360358, 4308766, 4257456, 4206423, 4155665,
+	4105179, 4054961, 4005008, 3955317, 3905885, 3856709, 3807786, 3759113,
+	3710687, 3662505, 3614566, 3566865, 3519401, 3472170, 3425171, 3378401,
+	3331856, 3285536, 3239437, 3193556, 3147893, 3102444, 3057208, 3012181,
+	2967362, 2922749, 2878340, 2834132, 2790124, 2746313, 2702698, 2659276,
+	2616046, 2573006, 2530154, 2487488, 2445007, 2402708, 2360590, 2318651,
+	2276889, 2235303, 2193891, 2152652, 2111584, 2070685, 2029954, 1989388,
+	1948988, 1908751, 1868676, 1828761, 1789005, 1749406, 1709964, 1670676,
+	1631541, 1592559, 1553728, 1515045, 1476512, 1438124, 1399883, 1361786,
+	1323832, 1286021, 1248350, 1210818, 1173426, 1136170, 1099051, 1062067,
+	1025217, 988500, 951915, 915461, 879137, 842941, 806873, 770932,
+	735117, 699426, 663859, 628416, 593094, 557893, 522812, 487850,
+	453006, 418280, 383671, 349177, 314797, 280532, 246380, 212340,
+	178411, 144593, 110884, 77285, 43794, 10410, -22866, -56038,
+	-89103, -122065, -154923, -187677, -220330, -252881, -285331, -317681,
+	-349932, -382084, -414137, -446094, -477953, -509717, -541385, -572958,
+	-604437
+};
+
 int LPS_init(I2C_ID_T id_in) {
 	LPS_i2c_id = id_in;
 	LPS_slave_address = LPS_SA0_LOW_ADDRESS;
@@ -12,11 +47,9 @@ int LPS_init(I2C_ID_T id_in) {
 }
 
 float LPS_read_data(uint8_t dimension) {
-	float p_mbar = 0.0f;
 	switch (dimension) {
 		case LPS_ALTITUDE:
-			p_mbar = LPS_read_pressure_millibars();
-			return LPS_pressure_to_altitude_m(p_mbar, 1013.25f);
+			return LPS_pressure_raw_to_altitude_mm(LPS_read_pressure_raw()) / 1000.0f;
 		case LPS_TEMPERATURE:
 			return LPS_read_temperature_C();
 		default:
@@ -51,6 +84,15 @@ int16_t LPS_read_temperature_raw() {
 	return (int16_t)(t_h << 8 | t_l);
 }
 
+int LPS_read_raw_burst(int32_t* pressure_raw, int16_t* temp_raw) {
+	// OUT_PRESS_XL, _L, _H, OUT_TEMP_L, _H are consecutive
+	uint8_t buf[5];
+	if (!LPS_read_regs(LPS_OUT_PRESS_XL, buf, sizeof(buf))) return 0;
+	*pressure_raw = (int32_t)(buf[2] << 16 | (uint16_t)(buf[1] << 8 | buf[0]));
+	*temp_raw = (int16_t)(buf[4] << 8 | buf[3]);
+	return 1;
+}
+
 float LPS_read_temperature_C() {
 	// (t_max - temp(0)) / 2^15 = 0.00190734863f.....
 	// 42.5 = specified by data sheet
@@ -61,6 +103,21 @@ float LPS_pressure_to_altitude_m(float pressure_mbar, float altimeter_setting_mb
 	return (1 - pow(pressure_mbar / altimeter_setting_mbar, 0.190263f)) * 44330.8f;
 }
 
+int32_t LPS_pressure_raw_to_altitude_mm(int32_t pressure_raw) {
+	int32_t index = (pressure_raw >> LPS_ALT_TABLE_SHIFT) - LPS_ALT_TABLE_FIRST;
+	// Clamp to the table; anything outside is a sensor fault or well outside our flight envelope
+	if (index < 0) {
+		return LPS_alt_table_mm[0];
+	}
+	if (index >= LPS_ALT_TABLE_SIZE - 1) {
+		return LPS_alt_table_mm[LPS_ALT_TABLE_SIZE - 1];
+	}
+	// Slope is at most ~101 m per step, so 12 bits of fraction keep the product within 32 bits
+	int32_t fraction = (pressure_raw & ((1 << LPS_ALT_TABLE_SHIFT) - 1)) >> (LPS_ALT_TABLE_SHIFT - 12);
+	int32_t slope = LPS_alt_table_mm[index + 1] - LPS_alt_table_mm[index];
+	return LPS_alt_table_mm[index] + (slope * fraction) / (1 << 12);
+}
+
 // bool LPS_detect_device() {
 // 	slave_address = LPS_SA0_LOW_ADDRESS;
 // 	if (read_reg(LPS_WHO_AM_I) == LPS331AP_WHO_ID)
@@ -101,3 +158,7 @@ void LPS_write_reg(uint8_t reg_addr, uint8_t data) {
 	// - Write the data
 	Chip_I2C_MasterSend(LPS_i2c_id, LPS_slave_address >> 1, tx_buf, tx_size);
 }
+
+int LPS_read_regs(uint8_t reg_addr, uint8_t* buf, uint8_t size) {
+	return Chip_I2C_MasterCmdRead(LPS_i2c_id, LPS_slave_address >> 1, reg_addr | 0x80, buf, size) == size;
+}
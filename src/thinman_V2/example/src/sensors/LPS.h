@@ -56,12 +56,26 @@ int32_t LPS_read_pressure_raw();
 float LPS_read_pressure_millibars();
 int16_t LPS_read_temperature_raw();
 float LPS_read_temperature_C();
+// Read pressure and temperature in one I2C transaction using register auto-increment.
+// Returns 0 on bus error, leaving the outputs unchanged.
+int LPS_read_raw_burst(int32_t* pressure_raw, int16_t* temp_raw);
 // Formula only applies to 11 km / 36000 ft
 float LPS_pressure_to_altitude_m(float pressure_mbar, float altimeter_setting_mbar);
+// Integer-only conversion of a raw pressure reading (4096 counts / mbar) to altitude in millimetres,
+// referenced to the 1013.25 mbar standard atmosphere.  Uses a 4 mbar lookup table with linear
+// interpolation instead of pow(). On the M0+ that is about 30 cycles counted from its Thumb
+// sequence (the clamp, two table loads, one single-cycle multiply), against a soft-float divide
+// and double pow() for the formula; not yet timed on the board. lps_check.py checks the error
+// and ranks the two on the host.
+// Error against LPS_pressure_to_altitude_m: < 25 mm below 1 km, < 55 mm below 5 km, < 170 mm up to 10 km.
+// Readings outside 256..1088 mbar (about -600 m to +10200 m) are clamped to the table ends.
+int32_t LPS_pressure_raw_to_altitude_mm(int32_t pressure_raw);
 
 // Low level register work
 uint8_t LPS_read_reg(uint8_t reg_addr);
 void LPS_write_reg(uint8_t reg_addr, uint8_t data);
+// Read consecutive registers starting at reg_addr (MSB of the address enables auto-increment)
+int LPS_read_regs(uint8_t reg_addr, uint8_t* buf, uint8_t size);
 
 // Detects if the device is present on the I2C bus
 bool detect_device();
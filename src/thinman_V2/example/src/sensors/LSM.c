@@ -148,6 +148,44 @@ float LSM_read_temperature_C() {
 	return (float)LSM_read_temperature_raw();
 }
 
+static void LSM_unpack_axes(const uint8_t* buf, int16_t out[3]) {
+	out[0] = (int16_t)(buf[1] << 8 | buf[0]);
+	out[1] = (int16_t)(buf[3] << 8 | buf[2]);
+	out[2] = (int16_t)(buf[5] << 8 | buf[4]);
+}
+
+int LSM_read_accel_raw_burst(int16_t out[3]) {
+	uint8_t buf[6];
+	if (!LSM_read_regs_xlg(LSM_OUT_X_L_XL, buf, sizeof(buf))) return 0;
+	LSM_unpack_axes(buf, out);
+	return 1;
+}
+
+int LSM_read_gyro_raw_burst(int16_t out[3]) {
+	uint8_t buf[6];
+	if (!LSM_read_regs_xlg(LSM_OUT_X_L_G, buf, sizeof(buf))) return 0;
+	LSM_unpack_axes(buf, out);
+	return 1;
+}
+
+int LSM_read_mag_raw_burst(int16_t out[3]) {
+	uint8_t buf[6];
+	if (!LSM_read_regs_mag(LSM_OUT_X_L_M, buf, sizeof(buf))) return 0;
+	LSM_unpack_axes(buf, out);
+	return 1;
+}
+
+int16_t LSM_accel_mg_to_raw(int32_t mg) {
+	int32_t raw = mg * LSM_FULL_SCALE_COUNTS / LSM_a_fs_mg;
+	if (raw > INT16_MAX) return INT16_MAX;
+	if (raw < INT16_MIN) return INT16_MIN;
+	return (int16_t)raw;
+}
+
+int32_t LSM_accel_raw_to_mg(int16_t raw) {
+	return (int32_t)raw * LSM_a_fs_mg / LSM_FULL_SCALE_COUNTS;
+}
+
 void LSM_set_gyro_scale(enum LSM_gyro_scale g_sc) {
 	// Get current reg value
 	uint8_t ctrl = (uint8_t)LSM_read_reg_xlg(LSM_CTRL_REG1_G);
@@ -377,15 +415,19 @@ void LSM_calc_g_res() {
 	switch (LSM_g_scale) {
 		case G_SCALE_245DPS:
 			LSM_g_res = 245.0f / 32768.0f;
+			LSM_g_fs_mdps = 245000;
 			break;
 		case G_SCALE_500DPS:
 			LSM_g_res = 500.0f / 32768.0f;
+			LSM_g_fs_mdps = 500000;
 			break;
 		case G_SCALE_2000DPS:
 			LSM_g_res = 2000.0f / 32768.0f;
+			LSM_g_fs_mdps = 2000000;
 			break;
 		default:
 			LSM_g_res = 1.0f;
+			LSM_g_fs_mdps = 32768000;
 	}
 }
 
@@ -393,18 +435,23 @@ void LSM_calc_a_res() {
 	switch (LSM_a_scale) {
 		case A_SCALE_2G:
 			LSM_a_res = 2.0f / 32768.0f;
+			LSM_a_fs_mg = 2000;
 			break;
 		case A_SCALE_4G:
 			LSM_a_res = 4.0f / 32768.0f;
+			LSM_a_fs_mg = 4000;
 			break;
 		case A_SCALE_8G:
 			LSM_a_res = 8.0f / 32768.0f;
+			LSM_a_fs_mg = 8000;
 			break;
 		case A_SCALE_16G:
 			LSM_a_res = 24.0f / 32768.0f;
+			LSM_a_fs_mg = 24000;
 			break;
 		default:
 			LSM_a_res = 1.0f;
+			LSM_a_fs_mg = 32768000;
 	}
 }
 
@@ -412,18 +459,23 @@ void LSM_calc_m_res() {
 	switch (LSM_m_scale) {
 		case M_SCALE_4GS:
 			LSM_m_res = 4.0f / 32768.0f;
+			LSM_m_fs_mgauss = 4000;
 			break;
 		case M_SCALE_8GS:
 			LSM_m_res = 8.0f / 32768.0f;
+			LSM_m_fs_mgauss = 8000;
 			break;
 		case M_SCALE_12GS:
 			LSM_m_res = 12.0f / 32768.0f;
+			LSM_m_fs_mgauss = 12000;
 			break;
 		case M_SCALE_16GS:
 			LSM_m_res = 16.0f / 32768.0f;
+			LSM_m_fs_mgauss = 16000;
 			break;
 		default:
 			LSM_m_res = 1.0f;
+			LSM_m_fs_mgauss = 32768000;
 	}
 }
 
@@ -481,3 +533,11 @@ void LSM_write_reg_mag(uint8_t reg_addr, uint8_t data) {
 	// - Write the data
 	Chip_I2C_MasterSend(LSM_i2c_id, LSM_mag_address, tx_buf, tx_size);
 }
+
+int LSM_read_regs_xlg(uint8_t reg_addr, uint8_t* buf, uint8_t size) {
+	return Chip_I2C_MasterCmdRead(LSM_i2c_id, LSM_xlg_address, reg_addr, buf, size) == size;
+}
+
+int LSM_read_regs_mag(uint8_t reg_addr, uint8_t* buf, uint8_t size) {
+	return Chip_I2C_MasterCmdRead(LSM_i2c_id, LSM_mag_address, reg_addr | 0x80, buf, size) == size;
+}
@@ -175,6 +175,12 @@ enum LSM_mag_scale LSM_m_scale;
 // This value is calculated as (sensor scale) / (2^15).
 float LSM_g_res, LSM_a_res, LSM_m_res;
 
+// Integer full-scale range of each sensor, i.e. the physical value of LSM_FULL_SCALE_COUNTS raw counts.
+// Units are mdps, mg and mgauss. Lets the hot path stay in raw counts: thresholds are converted
+// to counts once at init, and counts are only converted to physical units on the host or for display.
+#define LSM_FULL_SCALE_COUNTS 32768
+int32_t LSM_g_fs_mdps, LSM_a_fs_mg, LSM_m_fs_mgauss;
+
 // Store the bias offsets for calibration
 //float a_bias[3];
 //float g_bias[3];
@@ -215,6 +221,18 @@ float LSM_read_mag_gs(uint8_t dimension);
 // Reads raw temperature output registers
 int16_t LSM_read_temperature_raw();
 
+// Read x, y and z in one I2C transaction using register auto-increment, so all three axes come
+// from the same output sample. Returns 0 on bus error, leaving out unchanged.
+int LSM_read_accel_raw_burst(int16_t out[3]);
+int LSM_read_gyro_raw_burst(int16_t out[3]);
+int LSM_read_mag_raw_burst(int16_t out[3]);
+
+// Convert an acceleration in mg to raw accel counts at the current scale, saturating at the int16 range.
+// Intended for precomputing thresholds at init, not for the sample path.
+int16_t LSM_accel_mg_to_raw(int32_t mg);
+// Convert raw accel counts to mg at the current scale. For display/telemetry only.
+int32_t LSM_accel_raw_to_mg(int16_t raw);
+
 // Reads C temperature output
 // NO CALIBRATION YET
 float LSM_read_temperature_C();
@@ -304,17 +322,17 @@ void LSM_init_accel();
 void LSM_init_mag();
 
 // Calculate the resolution of the gyroscope.
-// This function will set the value of the g_res variable. g_scale must
+// This function will set the value of the g_res and g_fs_mdps variables. g_scale must
 // be set prior to calling this function.
 void LSM_calc_g_res();
 
 // Calculate the resolution of the accelerometer.
-// This function will set the value of the a_res variable. a_scale must
+// This function will set the value of the a_res and a_fs_mg variables. a_scale must
 // be set prior to calling this function.
 void LSM_calc_a_res();
 
 // Calculate the resolution of the magnetometer.
-// This function will set the value of the m_res variable. m_scale must
+// This function will set the value of the m_res and m_fs_mgauss variables. m_scale must
 // be set prior to calling this function.
 void LSM_calc_m_res();
 
@@ -327,6 +345,11 @@ void LSM_write_reg_xlg(uint8_t reg_addr, uint8_t data);
 // Read a register on the magnetometer device
 uint8_t LSM_read_reg_mag(uint8_t reg_addr);
 
+// Multi-byte read starting at reg_addr. Accel/gyro auto-increment through CTRL_REG8 IF_ADD_INC
+// (on by default); the magnetometer needs the MSB of the register address set.
+int LSM_read_regs_xlg(uint8_t reg_addr, uint8_t* buf, uint8_t size);
+int LSM_read_regs_mag(uint8_t reg_addr, uint8_t* buf, uint8_t size);
+
 // Write a register on the magnetometer
 void LSM_write_reg_mag(uint8_t reg_addr, uint8_t data);
 
@@ -0,0 +1,414 @@
+/*
+ * acquisition.c
+ *
+ *  The table fixes each sensor's period and phase in minor frames, so samples
+ *  are evenly spaced and sensors never share a slot on the bus: the IMU runs
+ *  every frame, the high-g on odd frames and the baro on every other even one.
+ *  Sample functions never spin on data-ready; they check it once and report
+ *  whether a new sample was taken. Records go to the storage writer; nothing
+ *  here touches FatFs after start-up. In coast and descent the IMU and
+ *  high-g rows are filtered down to a lower rate before they are logged
+ *  (flight/decimate.h); everything else here keeps the full rate.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging.h"
+#include "boot_profile.h"
+#include "drivers/timebase.h"
+#include "sensors/LPS.h"
+#include "sensors/LSM.h"
+#include "sensors/H3L.h"
+#include "flight/attitude.h"
+#include "flight/decimate.h"
+#include "flight/flight_phase.h"
+#include "./acquisition.h"
+#include "./storage.h"
+#include "./flight_state.h"
+#include "./pyro.h"
+
+// Onboard sensor bus, ONBOARD_I2C in freertos_blinky.c
+#define ACQ_I2C I2C0
+// Lateral acceleration on the high-g axis that triggers channel 2
+#define HIGHG_FIRE_THRESHOLD_MG 5000
+#define HIGHG_FIRE_CHANNEL 2
+// Arm-to-fire delay on the firing board. The 2 s the old fire path always waited
+// stays the default, so the channel cannot fire within 2 s of the trigger. A bench
+// build timing the fire path may define it as 0, which fires while the request is
+// being answered.
+#ifndef HIGHG_FIRE_DELAY_MS
+#define HIGHG_FIRE_DELAY_MS 2000
+#endif
+// Table periods of the decimated sensors
+#define IMU_PERIOD_MS	5
+#define HIGHG_PERIOD_MS	10
+// Timing counters are logged this often
+#define ACQ_REPORT_PERIOD_MS 10000
+// Boot no longer waits for the rails to settle, so a sensor still in its power-on
+// boot gets a few more attempts before its entry is disabled
+#define ACQ_INIT_ATTEMPTS		5
+#define ACQ_INIT_RETRY_MS		20
+
+typedef struct {
+	const char* name;
+	uint16_t period_ms;		// Between launch and landing, and on the pad into the pre-trigger rings (tasks/storage.c)
+	uint16_t phase_ms;		// Offset of the first slot within the period
+	bool (*init)(void);
+	bool (*sample)(void);	// Returns true when a new sample was taken
+	boot_stage_t boot_stage;	// Marked when init succeeds
+} acq_entry_t;
+
+// Working copy of the flight record; every sample function publishes it after updating
+static flight_state_t acq_flight_state;
+
+// Samples per logged row in each flight phase. The pad logs every sample into
+// the pre-trigger rings and landed already samples slowly, so both keep 1.
+static const uint8_t imu_decimation[] = {
+	[FLIGHT_PHASE_PAD] = 1, [FLIGHT_PHASE_BOOST] = 1, [FLIGHT_PHASE_COAST] = 2,
+	[FLIGHT_PHASE_DESCENT] = 4, [FLIGHT_PHASE_LANDED] = 1,
+};
+static const uint8_t highg_decimation[] = {
+	[FLIGHT_PHASE_PAD] = 1, [FLIGHT_PHASE_BOOST] = 1, [FLIGHT_PHASE_COAST] = 2,
+	[FLIGHT_PHASE_DESCENT] = 4, [FLIGHT_PHASE_LANDED] = 1,
+};
+
+/*****************************************************************************
+ * Barometer
+ ****************************************************************************/
+
+static bool baro_init(void) {
+	if (LPS_init(ACQ_I2C)) {
+		LOG_INFO("LPS initialized");
+	} else {
+		LOG_ERROR("LPS failed to initialize");
+		return false;
+	}
+	LPS_enable();
+	storage_open(STORAGE_BARO);
+	baro_running = true;
+	return true;
+}
+
+static bool baro_sample(void) {
+	baro_record_t record;
+	int32_t alt_mm, avg_alt;
+	uint32_t tick;
+	int i;
+
+	// P_DA; the slot runs at twice the 25 Hz ODR so a new sample is never more than one slot old
+	if (!(LPS_read_reg(LPS_STATUS_REG) & 2)) return false;
+	record.t_us = timebase_us();
+	if (!LPS_read_raw_burst(&record.pressure_raw, &record.temp_raw)) {
+		LOG_ERROR("Baro read failed");
+		return false;
+	}
+	tick = xTaskGetTickCount();
+	alt_mm = LPS_pressure_raw_to_altitude_mm(record.pressure_raw);
+
+	// Update last 5 altitude measurements and their times for calculating speed
+	memmove(&acq_flight_state.alt_mm[1], &acq_flight_state.alt_mm[0], (FLIGHT_STATE_ALT_HISTORY - 1) * sizeof(int32_t));
+	memmove(&acq_flight_state.alt_tick[1], &acq_flight_state.alt_tick[0], (FLIGHT_STATE_ALT_HISTORY - 1) * sizeof(uint32_t));
+	acq_flight_state.alt_mm[0] = alt_mm;
+	acq_flight_state.alt_tick[0] = tick;
+
+	// Average last 5 measurements as **simple** filter
+	avg_alt = 0;
+	for (i = 0; i < FLIGHT_STATE_ALT_HISTORY; i++) {
+		avg_alt += acq_flight_state.alt_mm[i];
+	}
+	avg_alt /= FLIGHT_STATE_ALT_HISTORY;
+
+	// Store max altitude if found
+	if(avg_alt > acq_flight_state.max_alt_mm) {
+		acq_flight_state.max_alt_mm = avg_alt;
+	}
+	flight_state_publish(&acq_flight_state);
+
+	flight_phase_update_altitude(avg_alt, tick);
+	storage_push(STORAGE_BARO, &record);
+	return true;
+}
+
+/*****************************************************************************
+ * IMU
+ ****************************************************************************/
+
+static imu_record_t imu_measurements;
+static uint32_t imu_last_us;
+// Accel x, y, z then gyro x, y, z
+static decimator_t imu_decimator;
+static decimate_channel_t imu_channels[6];
+
+static bool imu_init(void) {
+	LOG_INFO("Initializing IMU");
+	if (LSM_init(ACQ_I2C, G_SCALE_500DPS, A_SCALE_16G, M_SCALE_4GS, G_ODR_952, A_ODR_952, M_ODR_80)) {
+		LOG_INFO("IMU initialized");
+	} else {
+		LOG_ERROR("IMU failed to initialize");
+		return false;
+	}
+	attitude_init(LSM_g_fs_mdps, LSM_a_fs_mg);
+	decimate_init(&imu_decimator, 6, imu_channels, 1);
+	storage_open(STORAGE_IMU);
+	imu_last_us = timebase_us();
+	imu_running = true;
+	return true;
+}
+
+// The row is stamped at the filter's centre so accel and gyro line up with the
+// other streams; mag is the newest, and leads by the filter delay
+static void imu_log(void) {
+	imu_record_t imu_row;
+	int16_t in[6], out[6];
+	uint8_t factor = imu_decimation[flight_phase_get()];
+	if (factor != imu_decimator.factor) {
+		decimate_set_factor(&imu_decimator, factor);
+	}
+	memcpy(&in[0], imu_measurements.accel, sizeof(imu_measurements.accel));
+	memcpy(&in[3], imu_measurements.gyro, sizeof(imu_measurements.gyro));
+	if (!decimate_push(&imu_decimator, in, out)) return;
+	imu_row = imu_measurements;
+	imu_row.t_us -= decimate_delay_us(&imu_decimator, IMU_PERIOD_MS * 1000UL);
+	memcpy(imu_row.accel, &out[0], sizeof(imu_row.accel));
+	memcpy(imu_row.gyro, &out[3], sizeof(imu_row.gyro));
+	storage_push(STORAGE_IMU, &imu_row);
+}
+
+static bool imu_sample(void) {
+	bool mag_new;
+
+	// Accel and gyro share the 952 Hz ODR, so accel data-ready marks the sample
+	if (!(LSM_read_reg_xlg(LSM_STATUS_REG1_XL) & 1)) return false;
+	imu_measurements.t_us = timebase_us();
+	if (!LSM_read_accel_raw_burst(imu_measurements.accel) || !LSM_read_gyro_raw_burst(imu_measurements.gyro)) {
+		LOG_ERROR("IMU read failed");
+		return false;
+	}
+	mag_new = (LSM_read_reg_mag(LSM_STATUS_REG_M) & 8) && LSM_read_mag_raw_burst(imu_measurements.mag);
+
+	attitude_update(imu_measurements.gyro, imu_measurements.accel, mag_new ? imu_measurements.mag : NULL,
+			imu_measurements.t_us - imu_last_us);
+	imu_last_us = imu_measurements.t_us;
+
+	flight_phase_update_accel(LSM_accel_raw_to_mg(imu_measurements.accel[0]), xTaskGetTickCount());
+
+	//Find max acceleration in positive x direction.  "this side up" on board is +x
+	if(imu_measurements.accel[0] > acq_flight_state.max_acc_imu) {
+		acq_flight_state.max_acc_imu = imu_measurements.accel[0];
+	}
+	memcpy(acq_flight_state.imu_accel, imu_measurements.accel, sizeof(acq_flight_state.imu_accel));
+	flight_state_publish(&acq_flight_state);
+	imu_log();
+	return true;
+}
+
+/*****************************************************************************
+ * High-g accelerometer
+ ****************************************************************************/
+
+static int16_t fire_threshold_raw;
+static bool highg_fired;
+static decimator_t highg_decimator;
+static decimate_channel_t highg_channels[3];
+
+static bool highg_init(void) {
+	LOG_INFO("Initializing HighG");
+	// ODR above the 100 Hz slot rate so every slot finds a fresh sample
+	if (H3L_init(ACQ_I2C, H3L_SCALE_100G, H3L_ODR_400)) {
+		LOG_INFO("HighG initialized");
+	} else {
+		LOG_ERROR("HighG failed to initialize");
+		return false;
+	}
+	// Compare raw counts in the loop; the threshold is converted once at the configured scale
+	fire_threshold_raw = H3L_accel_mg_to_raw(HIGHG_FIRE_THRESHOLD_MG);
+	decimate_init(&highg_decimator, 3, highg_channels, 1);
+	storage_open(STORAGE_HIGHG);
+	highg_running = true;
+	return true;
+}
+
+static void highg_log(highg_record_t* record) {
+	uint8_t factor = highg_decimation[flight_phase_get()];
+	if (factor != highg_decimator.factor) {
+		decimate_set_factor(&highg_decimator, factor);
+	}
+	if (!decimate_push(&highg_decimator, record->accel, record->accel)) return;
+	record->t_us -= decimate_delay_us(&highg_decimator, HIGHG_PERIOD_MS * 1000UL);
+	storage_push(STORAGE_HIGHG, record);
+}
+
+static bool highg_sample(void) {
+	highg_record_t record;
+
+	// ZYXDA: a new sample is ready on all three axes
+	if (!(H3L_read_reg(H3L_STATUS_REG) & 8)) return false;
+	record.t_us = timebase_us();
+	if (!H3L_read_accel_raw_burst(record.accel)) {
+		LOG_ERROR("HighG read failed");
+		return false;
+	}
+
+	// One request per boot; a failed request is retried on the next sample over the threshold
+	if (!highg_fired && abs(record.accel[1]) > fire_threshold_raw) {
+		highg_fired = pyro_fire(HIGHG_FIRE_CHANNEL, HIGHG_FIRE_DELAY_MS);
+		if (!highg_fired) {
+			LOG_DEBUG("Failed to fire %d", HIGHG_FIRE_CHANNEL);
+		} else {
+			LOG_DEBUG("Firing %d", HIGHG_FIRE_CHANNEL);
+		}
+	}
+
+	//Find max acceleration in positive x direction.  "this side up" on board is +x
+	if( record.accel[0] > acq_flight_state.max_acc_highg ) {
+		acq_flight_state.max_acc_highg = record.accel[0];
+		flight_state_publish(&acq_flight_state);
+	}
+	highg_log(&record);
+	return true;
+}
+
+/*****************************************************************************
+ * Executive
+ ****************************************************************************/
+
+static const acq_entry_t acq_table[] = {
+	// name		period	phase	init		sample			boot stage
+	{"IMU",		IMU_PERIOD_MS,	0,	imu_init,	imu_sample,		BOOT_STAGE_IMU},	// 200 Hz, bounded by the LSM bursts at 100 kHz; 0.3 s pre-trigger
+	{"HighG",	HIGHG_PERIOD_MS,	5,	highg_init,	highg_sample,	BOOT_STAGE_HIGHG},	// 100 Hz; 0.85 s pre-trigger
+	{"Baro",	20,		10,		baro_init,	baro_sample,	BOOT_STAGE_BARO},	// 2x the 25 Hz LPS ODR; 1.28 s pre-trigger
+};
+#define ACQ_ENTRY_COUNT (sizeof(acq_table) / sizeof(acq_table[0]))
+
+typedef struct {
+	bool enabled;
+	uint16_t last_period_ms;
+	uint32_t last_start_us;
+} acq_entry_state_t;
+
+static acq_entry_state_t acq_state[ACQ_ENTRY_COUNT];
+static acq_stats_t acq_stats[ACQ_ENTRY_COUNT];
+static acq_frame_stats_t acq_frame_stats;
+
+static void acquisition_report(void) {
+	int i;
+	attitude_stats_t att;
+	for (i = 0; i < ACQ_ENTRY_COUNT; i++) {
+		LOG_INFO("Acq %s runs %u samples %u jitter %uus misses %u exec %uus", acq_stats[i].name, acq_stats[i].runs,
+				acq_stats[i].samples, acq_stats[i].jitter_max_us, acq_stats[i].deadline_misses, acq_stats[i].exec_max_us);
+	}
+	LOG_INFO("Acq frames %u overruns %u busy %uus", acq_frame_stats.frames, acq_frame_stats.overruns, acq_frame_stats.busy_max_us);
+	attitude_get_stats(&att);
+	LOG_INFO("Attitude filter %d cycles, max %d, budget %d", att.cycles_last, att.cycles_max, att.cycles_budget);
+	LOG_INFO("Decimate IMU /%u max %u of %u cycles, HighG /%u max %u of %u cycles", imu_decimator.factor,
+			imu_decimator.cycles_max, imu_decimator.cycles_budget, highg_decimator.factor, highg_decimator.cycles_max,
+			highg_decimator.cycles_budget);
+}
+
+void task_acquisition(void* pvParameters) {
+	portTickType last_wake;
+	uint32_t frame = 0;
+	int i, attempt;
+
+	for (i = 0; i < ACQ_ENTRY_COUNT; i++) {
+		acq_stats[i].name = acq_table[i].name;
+	}
+	for (attempt = 0; attempt < ACQ_INIT_ATTEMPTS; attempt++) {
+		bool pending = false;
+		if (attempt > 0) {
+			vTaskDelay(ACQ_INIT_RETRY_MS);
+		}
+		for (i = 0; i < ACQ_ENTRY_COUNT; i++) {
+			if (acq_state[i].enabled) continue;
+			acq_state[i].enabled = acq_table[i].init();
+			if (acq_state[i].enabled) {
+				boot_profile_mark(acq_table[i].boot_stage);
+			} else {
+				pending = true;
+			}
+		}
+		if (!pending) break;
+	}
+
+	last_wake = xTaskGetTickCount();
+	for (;;) {
+		uint32_t frame_start_us, busy_us;
+		uint32_t frame_ms = frame * ACQ_MINOR_FRAME_MS;
+		bool landed;
+
+		// Releases on a fixed grid; an overrun frame returns at once and the next ones catch up
+		vTaskDelayUntil(&last_wake, ACQ_MINOR_FRAME_MS);
+		frame_start_us = timebase_us();
+		landed = flight_phase_get() == FLIGHT_PHASE_LANDED;
+
+		for (i = 0; i < ACQ_ENTRY_COUNT; i++) {
+			const acq_entry_t* entry = &acq_table[i];
+			acq_entry_state_t* state = &acq_state[i];
+			acq_stats_t* stats = &acq_stats[i];
+			uint16_t period_ms = landed ? FLIGHT_LOW_RATE_PERIOD_MS : entry->period_ms;
+			uint32_t start_us, end_us;
+
+			if (!state->enabled) continue;
+			if ((frame_ms % period_ms) != entry->phase_ms) continue;
+
+			start_us = timebase_us();
+			if (state->last_period_ms == period_ms) {
+				int32_t error_us = (int32_t)(start_us - state->last_start_us) - (int32_t)period_ms * 1000;
+				uint32_t jitter_us = error_us < 0 ? -error_us : error_us;
+				if (jitter_us > stats->jitter_max_us) {
+					stats->jitter_max_us = jitter_us;
+				}
+			}
+			state->last_period_ms = period_ms;
+			state->last_start_us = start_us;
+
+			if (entry->sample()) {
+				stats->samples++;
+				boot_profile_mark(BOOT_STAGE_FIRST_SAMPLE);
+			}
+			stats->runs++;
+
+			end_us = timebase_us();
+			if ((end_us - start_us) > stats->exec_max_us) {
+				stats->exec_max_us = end_us - start_us;
+			}
+			if ((end_us - frame_start_us) > ACQ_MINOR_FRAME_MS * 1000UL) {
+				stats->deadline_misses++;
+			}
+		}
+
+		busy_us = timebase_us() - frame_start_us;
+		if (busy_us > acq_frame_stats.busy_max_us) {
+			acq_frame_stats.busy_max_us = busy_us;
+		}
+		if (busy_us > ACQ_MINOR_FRAME_MS * 1000UL) {
+			acq_frame_stats.overruns++;
+		}
+		acq_frame_stats.frames++;
+
+		if ((frame_ms % ACQ_REPORT_PERIOD_MS) == 0) {
+			acquisition_report();
+		}
+		frame++;
+	}
+}
+
+int acquisition_entry_count(void) {
+	return ACQ_ENTRY_COUNT;
+}
+
+bool acquisition_get_stats(int index, acq_stats_t* stats) {
+	if (index < 0 || index >= ACQ_ENTRY_COUNT) return false;
+	taskENTER_CRITICAL();
+	*stats = acq_stats[index];
+	taskEXIT_CRITICAL();
+	return true;
+}
+
+void acquisition_get_frame_stats(acq_frame_stats_t* stats) {
+	taskENTER_CRITICAL();
+	*stats = acq_frame_stats;
+	taskEXIT_CRITICAL();
+}
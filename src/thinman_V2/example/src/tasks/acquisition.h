@@ -0,0 +1,41 @@
+/*
+ * acquisition.h
+ *
+ *  Time-triggered acquisition executive. One task samples every onboard
+ *  sensor from a static table on a fixed minor frame, replacing the
+ *  per-sensor vBaro/vIMU/vHighG loops.
+ */
+
+#ifndef ACQUISITION_H_
+#define ACQUISITION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Every table period and phase is a multiple of this
+#define ACQ_MINOR_FRAME_MS	5
+
+typedef struct {
+	const char* name;
+	uint32_t runs;				// Slots in which the entry was executed
+	uint32_t samples;			// Runs that found new data
+	uint32_t jitter_max_us;		// Largest |start-to-start interval - period|
+	uint32_t deadline_misses;	// Runs that ended after their minor frame
+	uint32_t exec_max_us;
+} acq_stats_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t overruns;			// Frames whose entries did not finish within ACQ_MINOR_FRAME_MS
+	uint32_t busy_max_us;
+} acq_frame_stats_t;
+
+void task_acquisition(void* pvParameters);
+
+// Number of entries in the acquisition table
+int acquisition_entry_count(void);
+// Copy the counters for one table entry. Returns false for an invalid index.
+bool acquisition_get_stats(int index, acq_stats_t* stats);
+void acquisition_get_frame_stats(acq_frame_stats_t* stats);
+
+#endif /* ACQUISITION_H_ */
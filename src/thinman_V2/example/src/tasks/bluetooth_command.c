@@ -9,13 +9,86 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <ff.h>
 #include "./bluetooth_command.h"
 #include "logging.h"
-#include "volatile_flight_data.h"
+#include "sensors/LSM.h"
+#include "sensors/H3L.h"
+#include "flight/attitude.h"
+#include "flight/flight_phase.h"
+#include "./storage.h"
+#include "./perf.h"
+#include "./flight_state.h"
+#include "./download.h"
+#include "./frame.h"
+#include "./rpc.h"
+#include "drivers/uart0.h"
+
+#define BT_BAUD					9600
+
+// "xfer" sends frames (tasks/frame.h) over the MLDP link, which runs at BT_BAUD:
+// short frames, a few in flight, and a timeout that covers a whole window
+#define BT_XFER_FRAME_BYTES		128
+#define BT_XFER_WINDOW_FRAMES	4
+#define BT_XFER_ACK_TIMEOUT_MS	1000
+#define BT_XFER_RETRY_LIMIT		5
+#if FRAME_SIZE(BT_XFER_FRAME_BYTES) > _MAX_SS
+#error "xfer frames go out of the command block buffer"
+#endif
+// Acks still arriving after a transfer are read and dropped until the link has been quiet this long
+#define BT_XFER_QUIET_MS		200
+// A request frame that stops arriving partway is dropped after this long
+#define BT_REQUEST_TIMEOUT_MS	500
+// Room for a reply in the command block buffer
+#define BT_REPLY_MAX			(_MAX_SS - FRAME_SIZE(0))
+// Handler return for a reply it has already sent itself
+#define BT_REPLY_SENT			0xffffffff
+// Subscription updates take at most half the link, leaving the rest for replies
+#define BT_STREAM_MIN_PERIOD_MS	(FRAME_SIZE(RPC_STREAM_SIZE) * 10 * 1000 * 2 / BT_BAUD)
+#define BT_STREAM_MAX_PERIOD_MS	60000
+
+typedef enum {
+	BT_INPUT_NONE,			// Timed out
+	BT_INPUT_LINE,			// Text line in line_buffer
+	BT_INPUT_REQUEST,		// Request frame in bt_link
+} bt_input_t;
+
+typedef struct {
+	uint32_t arg;
+	const char* payload;	// NUL terminated
+} bt_request_t;
+
+typedef struct {
+	uint8_t id;				// RPC_ command, 0 for text only
+	const char* name;		// Text command
+	// Fills in reply and *length. Returns 0, or the error for the reply arg.
+	uint32_t (*handler)(const bt_request_t* request, uint8_t* reply, uint16_t* length);
+	// Prints a good reply for the text command
+	void (*print)(const uint8_t* reply, uint16_t length);
+	// Text command with its own parsing and output, in place of handler and print
+	void (*text)(const char* command_line);
+} bt_command_t;
 
 static bool bluetooth_mldp_active = false;
+// Derived here from flight_state snapshots, so only this task touches them
+static int16_t max_speed_dm_s;
+// Flight state subscription; period 0 when there is none
+static uint32_t stream_period;
+static TickType_t stream_next;
+static uint32_t stream_count;
+static uint32_t stream_version;
 static char line_buffer[80];
+static size_t line_length;
+static TickType_t last_input;
+static char command[6];
+static char buff[20];
+// Outgoing frames and the file commands' scratch space
+static uint8_t command_block[_MAX_SS];
+// The file commands' FIL, taken from the heap only while their file is open
+static FIL* t_file;
+static uint8_t request_block[FRAME_SIZE(RPC_MAX_REQUEST) + 1];
+static uint8_t rx_block[16];
 
 typedef enum {
 	BT_EVENT_CONNECTED,
@@ -30,138 +103,525 @@ static void bluetooth_event(EVENT_TYPE_T event) {
 		LOG_INFO("Bluetooth Disconnected.");
 		// fprintf(stderr, "R,1\n");
 		bluetooth_mldp_active = false;
+		stream_period = 0;
 	}
 }
 
 
-static void bluetooth_handle_command(const char* command_line) {
-	static char command[6] = {0};
-	static char buff[20] = {0};
-	static uint8_t block[_MAX_SS];
-	static FIL t_file;
+static bool bt_write(const uint8_t* data, uint32_t size) {
+	uart0_write(data, size);
+	return true;
+}
+
+static uint32_t bt_read(uint8_t* buffer, uint32_t size, TickType_t timeout) {
+	return uart0_read_timeout((char*) buffer, size, timeout);
+}
+
+// Request frames, replies and "xfer" share the one link
+static frame_link_t bt_link = {
+	.write = bt_write,
+	.read = bt_read,
+	.frame = command_block,
+	.payload_max = BT_XFER_FRAME_BYTES,
+	.request = request_block,
+	.request_max = RPC_MAX_REQUEST,
+	.rx = rx_block,
+	.rx_size = sizeof(rx_block),
+	.window = BT_XFER_WINDOW_FRAMES,
+	.ack_timeout = BT_XFER_ACK_TIMEOUT_MS / portTICK_PERIOD_MS,
+	.retry_limit = BT_XFER_RETRY_LIMIT,
+};
+
+static FRESULT t_file_open(const char* name, BYTE mode) {
 	FRESULT res;
+	t_file = pvPortMalloc(sizeof(FIL));
+	if (t_file == NULL) return FR_NOT_ENOUGH_CORE;
+	res = f_open(t_file, name, mode);
+	if (res != FR_OK) {
+		vPortFree(t_file);
+		t_file = NULL;
+	}
+	return res;
+}
 
-	if (strlen(command_line) == 0) return;
-	if (sscanf(command_line, "%5s", command) == 0) return;
+static void t_file_close(void) {
+	f_close(t_file);
+	vPortFree(t_file);
+	t_file = NULL;
+}
 
-	if (strcmp(command, "ls") == 0) {
-		static FILINFO fno;
-	    static DIR dir;
-
-	    res = f_opendir(&dir, "/");
-	    if (res != FR_OK) {
-	    	fprintf(stderr, "root dir open failed with erro %d\n", res);
-	    	return;
-	    }
-
-	    for(;;) {
-	    	res = f_readdir(&dir, &fno);
-	    	if (res != FR_OK || fno.fname[0] == 0) break;
-	    	if (fno.fname[0] == '.') continue;
-	    	if (fno.fattrib & AM_DIR) {
-	    		fprintf(stderr, "D %d %s\n", fno.fsize, fno.fname);
-	    	} else {
-	    		fprintf(stderr, "F %d %s\n", fno.fsize, fno.fname);
-	    	}
-	    }
-	    fprintf(stderr, "END\n");
-	    if (res != FR_OK) {
-	    	fprintf(stderr, "readdir failed with error %d\n", res);
-	    }
-	} else if (strcmp(command, "cat") == 0) {
-		if (sscanf(command_line, "%5s %19s", command, buff) == 0) {
-			fprintf(stderr, "Need <filename>\n");
-			return;
-		}
-		res = f_open(&t_file, buff, FA_OPEN_EXISTING | FA_READ);
-		if (res != FR_OK) {
-			fprintf(stderr, "open file %s failed with error %d\n", buff, res);
-			return;
-		}
+static uint32_t command_status(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	reply[0] = RPC_VERSION;
+	reply[1] = (gps_activated ? RPC_STATUS_GPS : 0) | (volt_active ? RPC_STATUS_VOLT : 0) |
+			(baro_running ? RPC_STATUS_BARO : 0) | (imu_running ? RPC_STATUS_IMU : 0) |
+			(highg_running ? RPC_STATUS_HIGHG : 0);
+	reply[2] = flight_phase_get();
+	frame_put_u32(&reply[3], xTaskGetTickCount() * portTICK_PERIOD_MS);
+	*length = RPC_STATUS_SIZE;
+	return 0;
+}
 
-		for(;;) {
-			UINT read = 0;
-			res = f_read(&t_file, block, 40, &read);
-			if (res != FR_OK) {
-				break;
-			}
-			if (read == 0) break;
-			uart0_write(block, read);
-			// vcom_write(block, read);
+static void print_status(const uint8_t* reply, uint16_t length) {
+	uint8_t flags = reply[1];
+	fprintf(stderr, "=S %d %d %d %d %d \n", !!(flags & RPC_STATUS_GPS), !!(flags & RPC_STATUS_VOLT),
+			!!(flags & RPC_STATUS_BARO), !!(flags & RPC_STATUS_IMU), !!(flags & RPC_STATUS_HIGHG));
+}
 
-		}
+// The RPC_FLIGHT reply. Returns the flight_state version it came from.
+static uint32_t flight_encode(uint8_t* reply) {
+	flight_state_t state;
+	uint32_t version;
+	int32_t elapsed_ms, max_acc_mg;
+	int64_t vertical_change_mm, speed_dm_s = 0;
+	version = flight_state_snapshot(&state);
+	elapsed_ms = state.alt_tick[0] - state.alt_tick[FLIGHT_STATE_ALT_HISTORY - 1];
+	vertical_change_mm = (int64_t) state.alt_mm[0] - state.alt_mm[FLIGHT_STATE_ALT_HISTORY - 1];
+	max_acc_mg = LSM_accel_raw_to_mg(state.max_acc_imu);
+	if (H3L_accel_raw_to_mg(state.max_acc_highg) > max_acc_mg) {
+		max_acc_mg = H3L_accel_raw_to_mg(state.max_acc_highg);
+	}
+	if (elapsed_ms > 0) {
+		// Up is positive; mm per ms is m/s, so 10 mm per ms is 1 dm/s
+		speed_dm_s = vertical_change_mm * 10 / elapsed_ms;
+		if (speed_dm_s > INT16_MAX) speed_dm_s = INT16_MAX;
+		if (speed_dm_s < INT16_MIN) speed_dm_s = INT16_MIN;
+	}
+	if (speed_dm_s > max_speed_dm_s) {
+		max_speed_dm_s = speed_dm_s;
+	}
 
-		fprintf(stderr, "END\n");
-		if (res != FR_OK) {
-			fprintf(stderr, "f_read failed with error %d\n", res);
-		}
+	frame_put_u32(&reply[0], state.alt_tick[0]);
+	frame_put_u32(&reply[4], state.alt_mm[0]);
+	frame_put_u32(&reply[8], state.max_alt_mm);
+	frame_put_u32(&reply[12], max_acc_mg);
+	frame_put_u16(&reply[16], speed_dm_s);
+	frame_put_u16(&reply[18], max_speed_dm_s);
+	frame_put_u16(&reply[20], 0);
+	reply[22] = flight_phase_get();
+	return version;
+}
 
-		f_close(&t_file);
-	} else if (strcmp(command, "rm") == 0) {
-		if (sscanf(command_line, "%5s %19s", command, buff) == 0) {
-			fprintf(stderr, "Need <filename>\n");
-			return;
-		}
-		res = f_unlink(buff);
-		if (res != FR_OK) {
-			fprintf(stderr, "Failed to unlink file %s with error %d\n", buff, res);
-		}
-	} else if (strcmp(command, "appd") == 0) {
-		if (sscanf(command_line, "%5s %19s", command, buff) == 0) {
-			fprintf(stderr, "Need <filename>\n");
-			return;
+static uint32_t command_flight(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	flight_encode(reply);
+	*length = RPC_FLIGHT_SIZE;
+	return 0;
+}
+
+static void print_flight(const uint8_t* reply, uint16_t length) {
+	// max alt, max acc, descent rate, duration, max speed, speed, alt; m, g, m/s and s
+	fprintf(stderr, "=F %f %f %f %f %f %f %f \n", (int32_t) frame_get_u32(&reply[8]) / 1000.0f,
+			(int32_t) frame_get_u32(&reply[12]) / 1000.0f, frame_get_u16(&reply[20]) / 10.0f,
+			frame_get_u32(&reply[0]) / 1000.0f, (int16_t) frame_get_u16(&reply[18]) / 10.0f,
+			(int16_t) frame_get_u16(&reply[16]) / 10.0f, (int32_t) frame_get_u32(&reply[4]) / 1000.0f);
+}
+
+static uint32_t command_attitude(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	attitude_quat_t q;
+	attitude_stats_t stats;
+	attitude_get(&q);
+	attitude_get_stats(&stats);
+	frame_put_u32(&reply[0], q.q0);
+	frame_put_u32(&reply[4], q.q1);
+	frame_put_u32(&reply[8], q.q2);
+	frame_put_u32(&reply[12], q.q3);
+	frame_put_u32(&reply[16], attitude_vertical_cos());
+	frame_put_u32(&reply[20], stats.cycles_last);
+	frame_put_u32(&reply[24], stats.cycles_max);
+	frame_put_u32(&reply[28], stats.cycles_budget);
+	*length = RPC_ATTITUDE_SIZE;
+	return 0;
+}
+
+static void print_attitude(const uint8_t* reply, uint16_t length) {
+	// Quaternion and vertical cosine are Q30; cost is in core clock cycles
+	fprintf(stderr, "=A %ld %ld %ld %ld %ld %lu %lu %lu \n", (int32_t) frame_get_u32(&reply[0]),
+			(int32_t) frame_get_u32(&reply[4]), (int32_t) frame_get_u32(&reply[8]), (int32_t) frame_get_u32(&reply[12]),
+			(int32_t) frame_get_u32(&reply[16]), frame_get_u32(&reply[20]), frame_get_u32(&reply[24]),
+			frame_get_u32(&reply[28]));
+}
+
+static uint32_t command_subscribe(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	stream_period = request->arg;
+	if (stream_period != 0 && stream_period < BT_STREAM_MIN_PERIOD_MS) stream_period = BT_STREAM_MIN_PERIOD_MS;
+	if (stream_period > BT_STREAM_MAX_PERIOD_MS) stream_period = BT_STREAM_MAX_PERIOD_MS;
+	stream_next = xTaskGetTickCount();
+	stream_count = 0;
+	stream_version = 0;
+	frame_put_u16(&reply[0], stream_period);
+	*length = RPC_SUBSCRIBE_SIZE;
+	return 0;
+}
+
+static void print_subscribe(const uint8_t* reply, uint16_t length) {
+	fprintf(stderr, "=B %d\n", frame_get_u16(&reply[0]));
+}
+
+// Sends the newest flight state if a subscription update is due. Returns the ticks until the next one.
+static TickType_t bluetooth_stream(void) {
+	uint8_t* payload = frame_payload(&bt_link);
+	TickType_t now = xTaskGetTickCount();
+	uint32_t version;
+	if (stream_period == 0) return portMAX_DELAY;
+	if ((int32_t) (stream_next - now) > 0) return stream_next - now;
+
+	version = flight_encode(payload);
+	if (version != stream_version) {
+		stream_version = version;
+		frame_put_u32(&payload[RPC_FLIGHT_SIZE], version);
+		frame_put_u32(&payload[RPC_FLIGHT_SIZE + 4], now * portTICK_PERIOD_MS);
+		// Returns once the frame has left the UART, so nothing builds up behind it
+		frame_send(&bt_link, RPC_FLIGHT | RPC_PUSH, stream_count++, RPC_STREAM_SIZE);
+	}
+
+	// Updates that came due during the send are dropped, not sent late
+	stream_next += stream_period / portTICK_PERIOD_MS;
+	now = xTaskGetTickCount();
+	if ((int32_t) (stream_next - now) <= 0) {
+		stream_next = now + stream_period / portTICK_PERIOD_MS;
+	}
+	return stream_next - now;
+}
+
+static uint32_t command_storage(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	storage_stats_t stats;
+	size_t name_length;
+	if (!storage_get_stats(request->arg, &stats)) return RPC_ERROR_END;
+	frame_put_u32(&reply[0], stats.count);
+	frame_put_u32(&reply[4], stats.high_water);
+	frame_put_u32(&reply[8], stats.capacity);
+	frame_put_u32(&reply[12], stats.dropped);
+	frame_put_u32(&reply[16], stats.written);
+	name_length = strlen(stats.name);
+	memcpy(&reply[RPC_STORAGE_SIZE], stats.name, name_length);
+	*length = RPC_STORAGE_SIZE + name_length;
+	return 0;
+}
+
+static void text_storage(const char* command_line) {
+	bt_request_t request = { 0, "" };
+	uint16_t length;
+	uint8_t* reply = frame_payload(&bt_link);
+	// One line per storage queue: occupancy now, high-water mark, capacity, drops and rows written
+	for (; command_storage(&request, reply, &length) == 0; request.arg++) {
+		reply[length] = 0;
+		fprintf(stderr, "=Q %s %lu %lu %lu %lu %lu \n", &reply[RPC_STORAGE_SIZE], frame_get_u32(&reply[0]),
+				frame_get_u32(&reply[4]), frame_get_u32(&reply[8]), frame_get_u32(&reply[12]), frame_get_u32(&reply[16]));
+	}
+}
+
+static uint32_t command_perf(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	*length = perf_encode_report(reply, BT_REPLY_MAX);
+	return *length == 0 ? FRAME_ERROR_BAD_REQUEST : 0;
+}
+
+static void print_perf(const uint8_t* reply, uint16_t length) {
+	// Binary reply, layout in tasks/perf.h; the length line tells the reader how much follows
+	fprintf(stderr, "=R %d\n", length);
+	uart0_write(reply, length);
+}
+
+static uint32_t command_list(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	static FILINFO fno;
+	static DIR dir;
+	uint32_t index = 0;
+	size_t name_length;
+	FRESULT res = f_opendir(&dir, "/");
+	if (res != FR_OK) return res;
+	for (;;) {
+		res = f_readdir(&dir, &fno);
+		if (res != FR_OK) return res;
+		if (fno.fname[0] == 0) return RPC_ERROR_END;
+		if (fno.fname[0] == '.') continue;
+		if (index++ == request->arg) break;
+	}
+	frame_put_u32(&reply[0], fno.fsize);
+	reply[4] = fno.fattrib;
+	name_length = strlen(fno.fname);
+	memcpy(&reply[RPC_LIST_SIZE], fno.fname, name_length);
+	*length = RPC_LIST_SIZE + name_length;
+	return 0;
+}
+
+static void text_list(const char* command_line) {
+	static FILINFO fno;
+	static DIR dir;
+	FRESULT res;
+
+	res = f_opendir(&dir, "/");
+	if (res != FR_OK) {
+		fprintf(stderr, "root dir open failed with erro %d\n", res);
+		return;
+	}
+
+	for(;;) {
+		res = f_readdir(&dir, &fno);
+		if (res != FR_OK || fno.fname[0] == 0) break;
+		if (fno.fname[0] == '.') continue;
+		if (fno.fattrib & AM_DIR) {
+			fprintf(stderr, "D %d %s\n", fno.fsize, fno.fname);
+		} else {
+			fprintf(stderr, "F %d %s\n", fno.fsize, fno.fname);
 		}
-		res = f_open(&t_file, buff, FA_OPEN_ALWAYS | FA_WRITE);
+	}
+	fprintf(stderr, "END\n");
+	if (res != FR_OK) {
+		fprintf(stderr, "readdir failed with error %d\n", res);
+	}
+}
+
+static uint32_t command_remove(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	if (request->payload[0] == 0) return FRAME_ERROR_BAD_REQUEST;
+	return f_unlink(request->payload);
+}
+
+// Sends [offset, end) of the open t_file as windowed frames, then 'c' with the range's CRC-32 or 'x'
+static void xfer_send(const char* name, uint32_t offset, uint32_t end) {
+	uint32_t crc = 0, error;
+	bt_link.request_position = 0;
+	error = frame_send_file(&bt_link, t_file, offset, end, &crc);
+	if (error == 0) {
+		frame_send(&bt_link, 'c', crc, 0);
+	} else {
+		LOG_WARN("xfer of %s stopped with error 0x%x", name, error);
+		frame_send(&bt_link, 'x', error, 0);
+	}
+	t_file_close();
+}
+
+static uint32_t command_xfer(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	uint32_t size, offset = request->arg;
+	FRESULT res;
+	// The acks that follow reuse the request buffer
+	strncpy(buff, request->payload, sizeof(buff) - 1);
+	res = t_file_open(buff, FA_OPEN_EXISTING | FA_READ);
+	if (res != FR_OK) return res;
+	size = f_size(t_file);
+	if (offset > size) offset = size;
+	frame_put_u32(&reply[0], size);
+	frame_put_u32(&reply[4], offset);
+	frame_put_u32(&reply[8], size - offset);
+	frame_send(&bt_link, RPC_XFER | RPC_REPLY, 0, RPC_XFER_SIZE);
+	xfer_send(buff, offset, size);
+	return BT_REPLY_SENT;
+}
+
+static void text_xfer(const char* command_line) {
+	// xfer <filename> [offset [length]]; no length runs to the end of the file. The "=X size offset length"
+	// line is followed by frames, see frame_send_file. xfer_get.py is the host side.
+	unsigned long offset = 0, length = 0;
+	uint32_t size, end;
+	FRESULT res;
+	if (sscanf(command_line, "%5s %19s %lu %lu", command, buff, &offset, &length) < 2) {
+		fprintf(stderr, "Need <filename>\n");
+		return;
+	}
+	res = t_file_open(buff, FA_OPEN_EXISTING | FA_READ);
+	if (res != FR_OK) {
+		fprintf(stderr, "=X E %d\n", res);
+		return;
+	}
+	size = f_size(t_file);
+	if (offset > size) offset = size;
+	end = (length == 0 || length > size - offset) ? size : offset + length;
+	fprintf(stderr, "=X %lu %lu %lu\n", size, offset, end - offset);
+
+	xfer_send(buff, offset, end);
+	while (bt_read(bt_link.rx, bt_link.rx_size, BT_XFER_QUIET_MS / portTICK_PERIOD_MS) > 0);
+	bt_link.rx_count = bt_link.rx_position = 0;
+}
+
+static uint32_t command_usb(const bt_request_t* request, uint8_t* reply, uint16_t* length) {
+	// Resets into download mode (tasks/download.h); only returns when refused
+	download_mode_request();
+	return RPC_ERROR_REFUSED;
+}
+
+static void text_usb(const char* command_line) {
+	if (!download_mode_request()) {
+		fprintf(stderr, "=U refused in flight\n");
+	}
+}
+
+static void text_cat(const char* command_line) {
+	FRESULT res;
+	if (sscanf(command_line, "%5s %19s", command, buff) == 0) {
+		fprintf(stderr, "Need <filename>\n");
+		return;
+	}
+	res = t_file_open(buff, FA_OPEN_EXISTING | FA_READ);
+	if (res != FR_OK) {
+		fprintf(stderr, "open file %s failed with error %d\n", buff, res);
+		return;
+	}
+
+	for(;;) {
+		UINT read = 0;
+		res = f_read(t_file, command_block, 40, &read);
 		if (res != FR_OK) {
-			fprintf(stderr, "Failed to open file %s with error %d\n", buff, res);
-			return;
+			break;
 		}
+		if (read == 0) break;
+		uart0_write(command_block, read);
+		// vcom_write(command_block, read);
 
-		res = f_lseek(&t_file, f_size(&t_file));
-		if (res != FR_OK) {
-			fprintf(stderr, "Failed to seek to end with error %d\n", res);
-			goto fail;
+	}
+
+	fprintf(stderr, "END\n");
+	if (res != FR_OK) {
+		fprintf(stderr, "f_read failed with error %d\n", res);
+	}
+
+	t_file_close();
+}
+
+static void text_append(const char* command_line) {
+	FRESULT res;
+	if (sscanf(command_line, "%5s %19s", command, buff) == 0) {
+		fprintf(stderr, "Need <filename>\n");
+		return;
+	}
+	res = t_file_open(buff, FA_OPEN_ALWAYS | FA_WRITE);
+	if (res != FR_OK) {
+		fprintf(stderr, "Failed to open file %s with error %d\n", buff, res);
+		return;
+	}
+
+	res = f_lseek(t_file, f_size(t_file));
+	if (res != FR_OK) {
+		fprintf(stderr, "Failed to seek to end with error %d\n", res);
+		goto fail;
+	}
+
+	if (sscanf(command_line, "%5s %19s", command, buff) == 0) {
+		fprintf(stderr, "Need <string>\n");
+		goto fail;
+	}
+	res = f_write(t_file, buff, strlen(buff), NULL);
+	if (res != FR_OK) {
+		fprintf(stderr, "Failed to write with error %d\n", res);
+		goto fail;
+	}
+
+	fail:
+	t_file_close();
+}
+
+static void text_parameters(const char* command_line) {
+	fprintf(stderr, "=P Parameter Message\n");
+}
+
+static const bt_command_t bt_commands[] = {
+	{ RPC_STATUS,	"stat",	command_status,		print_status,	NULL },
+	{ RPC_FLIGHT,	"fld",	command_flight,		print_flight,	NULL },
+	{ RPC_ATTITUDE,	"att",	command_attitude,	print_attitude,	NULL },
+	{ RPC_STORAGE,	"stq",	command_storage,	NULL,			text_storage },
+	{ RPC_PERF,		"perf",	command_perf,		print_perf,		NULL },
+	{ RPC_SUBSCRIBE,	"sub",	command_subscribe,	print_subscribe,	NULL },
+	{ RPC_LIST,		"ls",	command_list,		NULL,			text_list },
+	{ RPC_REMOVE,	"rm",	command_remove,		NULL,			NULL },
+	{ RPC_XFER,		"xfer",	command_xfer,		NULL,			text_xfer },
+	{ RPC_USB,		"usb",	command_usb,		NULL,			text_usb },
+	{ 0,			"cat",	NULL,				NULL,			text_cat },
+	{ 0,			"appd",	NULL,				NULL,			text_append },
+	{ 0,			"par",	NULL,				NULL,			text_parameters },
+};
+#define BT_COMMAND_COUNT (sizeof(bt_commands) / sizeof(bt_commands[0]))
+
+static void bluetooth_handle_command(const char* command_line) {
+	const bt_command_t* entry;
+	bt_request_t request = { 0, buff };
+	uint16_t length = 0;
+	uint32_t status;
+
+	if (strlen(command_line) == 0) return;
+	if (sscanf(command_line, "%5s", command) == 0) return;
+
+	for (entry = bt_commands; entry < bt_commands + BT_COMMAND_COUNT; entry++) {
+		if (strcmp(command, entry->name) == 0) break;
+	}
+	if (entry == bt_commands + BT_COMMAND_COUNT) {
+		fprintf(stderr, "Invalid command %s\n", command);
+		return;
+	}
+	if (entry->text) {
+		entry->text(command_line);
+		return;
+	}
+
+	// The binary handler, with the first argument as its payload and, if it is a number, its arg
+	buff[0] = 0;
+	sscanf(command_line, "%5s %19s", command, buff);
+	request.arg = strtoul(buff, NULL, 0);
+	status = entry->handler(&request, frame_payload(&bt_link), &length);
+	if (status != 0) {
+		fprintf(stderr, "%s failed with error %lu\n", command, status);
+	} else if (entry->print) {
+		entry->print(frame_payload(&bt_link), length);
+	}
+}
+
+static void bluetooth_handle_request(void) {
+	const bt_command_t* entry;
+	uint8_t id = frame_request_type(&bt_link);
+	bt_request_t request = { frame_request_arg(&bt_link), frame_request_payload(&bt_link) };
+	uint16_t length = 0;
+	uint32_t status = RPC_ERROR_UNKNOWN;
+
+	// Late ack for a transfer that is already over
+	if (id == 'A') return;
+	for (entry = bt_commands; entry < bt_commands + BT_COMMAND_COUNT; entry++) {
+		if (entry->id == id && entry->id != 0) {
+			status = entry->handler(&request, frame_payload(&bt_link), &length);
+			break;
 		}
+	}
+	if (status == BT_REPLY_SENT) return;
+	frame_send(&bt_link, id | RPC_REPLY, status, status == 0 ? length : 0);
+}
 
-		if (sscanf(command_line, "%5s %19s", command, buff) == 0) {
-			fprintf(stderr, "Need <string>\n");
-			goto fail;
+// Reads until a whole line or request frame is in, or timeout ticks pass with nothing received.
+// A frame is only looked for at the start of a line.
+static bt_input_t bluetooth_read(TickType_t timeout) {
+	for (;;) {
+		uint8_t byte;
+		if (bt_link.rx_position == bt_link.rx_count) {
+			TickType_t wait = timeout;
+			if (frame_parsing(&bt_link) && wait > BT_REQUEST_TIMEOUT_MS / portTICK_PERIOD_MS) {
+				wait = BT_REQUEST_TIMEOUT_MS / portTICK_PERIOD_MS;
+			}
+			bt_link.rx_position = 0;
+			bt_link.rx_count = bt_read(bt_link.rx, bt_link.rx_size, wait);
+			if (bt_link.rx_count == 0) {
+				// A request frame that stops arriving partway is dropped, so text gets through again
+				if (frame_parsing(&bt_link) &&
+						xTaskGetTickCount() - last_input >= BT_REQUEST_TIMEOUT_MS / portTICK_PERIOD_MS) {
+					bt_link.request_position = 0;
+				}
+				return BT_INPUT_NONE;
+			}
+			last_input = xTaskGetTickCount();
 		}
-		res = f_write(&t_file, buff, strlen(buff), NULL);
-		if (res != FR_OK) {
-			fprintf(stderr, "Failed to write with error %d\n", res);
-			goto fail;
+		byte = bt_link.rx[bt_link.rx_position++];
+		if (frame_parsing(&bt_link) || (line_length == 0 && byte == FRAME_SYNC)) {
+			if (frame_parse(&bt_link, byte)) return BT_INPUT_REQUEST;
+			continue;
 		}
-
-		fail:
-		f_close(&t_file);
-	}  else if (strcmp(command, "fld") == 0) {
-		float cur_spd = 0;
-		double elapsed_time = time_arr[0] - time_arr[4];
-		double vertical_change = abs(alt_arr[0] - alt_arr[4]);
-		if( elapsed_time != 0 ) {
-			cur_spd = vertical_change / elapsed_time;
+		if (line_length < sizeof(line_buffer) - 1) {
+			line_buffer[line_length++] = byte;
 		}
-		if( cur_spd > max_spd ) {
-			max_spd = cur_spd;
+		if (byte == '\n') {
+			line_buffer[line_length] = 0;
+			line_length = 0;
+			return BT_INPUT_LINE;
 		}
-
-		fprintf(stderr, "=F %f %f %f %f %f %f %f \n", max_alt, max_acc, descent_rate, time_arr[0], max_spd, cur_spd, alt_arr[0], res);
-	} else if (strcmp(command, "stat") == 0) {
-		fprintf(stderr, "=S %d %d %d %d %d \n", gps_activated, volt_active, baro_running, imu_running, highg_running, res);
-	} else if (strcmp(command, "par") == 0) {
-		fprintf(stderr, "=P Parameter Message\n", res);
-	}  else {
-		fprintf(stderr, "Invalid command %s\n", command);
 	}
-
 }
 
 void task_bluetooth_commands(void* pvParameters) {
 	fprintf(stderr, "SB,1\n");
 	fprintf(stderr, "R,1\n");
 	vTaskDelay(1000);
-	Chip_UART0_SetBaud(LPC_USART0, 9600);
+	Chip_UART0_SetBaud(LPC_USART0, BT_BAUD);
 	fprintf(stderr, "\n");
 //	fprintf(stderr, "SN,ROCKET\n");
 	fprintf(stderr, "SN,RocketBrd\n");
@@ -172,8 +632,15 @@ void task_bluetooth_commands(void* pvParameters) {
 
 	for(;;) {
 		while (true) {
-			memset(line_buffer, 0, sizeof(line_buffer));
-			fgets(line_buffer, 79, stdin);
+			// Subscription updates go out between commands
+			bt_input_t input = bluetooth_read(bluetooth_stream());
+			if (input == BT_INPUT_NONE) continue;
+			if (input == BT_INPUT_REQUEST) {
+				if (bluetooth_mldp_active) {
+					bluetooth_handle_request();
+				}
+				continue;
+			}
 			LOG_INFO("received %s", line_buffer);
 			if (line_buffer[0] == 0 && line_buffer[1] != 0) {
 				LOG_INFO("extras %s", &line_buffer[1]);
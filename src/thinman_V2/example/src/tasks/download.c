@@ -0,0 +1,198 @@
+/*
+ * download.c
+ *
+ *  Frames go out through vcom_write_all and come in through vcom_bread_timeout;
+ *  the windowed send is frame_send_file.
+ */
+
+#include <string.h>
+#include <cr_section_macros.h>
+#include "chip.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "ff.h"
+#include "logging.h"
+#include "warm_restart.h"
+#include "drivers/cdc_vcom.h"
+#include "drivers/crc.h"
+#include "flight/flight_phase.h"
+#include "./frame.h"
+#include "./flash_log.h"
+#include "./download.h"
+
+#define DOWNLOAD_MODE_MAGIC		0x55534244	// "USBD"
+
+typedef struct {
+	uint8_t frame[FRAME_SIZE(DOWNLOAD_BLOCK_SIZE)];
+	uint8_t request[FRAME_SIZE(DOWNLOAD_MAX_REQUEST) + 1];
+	uint8_t rx[USB_FS_MAX_BULK_PACKET];
+	frame_link_t link;
+	FIL file;
+	DIR dir;
+	FILINFO info;
+} download_state_t;
+
+// Left alone by the startup code, so the request survives the reset
+__NOINIT_DEF static uint32_t download_mode_flag;
+static bool download_mode;
+// Taken from the heap when the task starts; nothing else runs on it in download mode
+static download_state_t* dl;
+
+void download_mode_init(void) {
+	download_mode = download_mode_flag == DOWNLOAD_MODE_MAGIC && !(warm_restart_reset_cause() & SYSCTL_RST_POR);
+	download_mode_flag = 0;
+}
+
+bool download_mode_active(void) {
+	return download_mode;
+}
+
+bool download_mode_request(void) {
+	if (flight_phase_is_full_rate(flight_phase_get())) return false;
+	download_mode_flag = DOWNLOAD_MODE_MAGIC;
+	NVIC_SystemReset();
+	return true;
+}
+
+static bool download_write(const uint8_t* data, uint32_t size) {
+	return vcom_write_all(data, size);
+}
+
+static uint32_t download_read(uint8_t* buffer, uint32_t size, TickType_t timeout) {
+	return vcom_bread_timeout(buffer, size, timeout);
+}
+
+static void download_list(uint32_t first) {
+	frame_link_t* link = &dl->link;
+	uint32_t count = 0;
+	FRESULT res = f_opendir(&dl->dir, "/");
+	if (res != FR_OK) {
+		frame_send(link, 'x', res, 0);
+		return;
+	}
+	for (;;) {
+		size_t name_length;
+		res = f_readdir(&dl->dir, &dl->info);
+		if (res != FR_OK || dl->info.fname[0] == 0) break;
+		if (dl->info.fname[0] == '.' || (dl->info.fattrib & AM_DIR)) continue;
+		if (count < first) {
+			count++;
+			continue;
+		}
+		name_length = strlen(dl->info.fname);
+		frame_put_u32(frame_payload(link), dl->info.fsize);
+		memcpy(frame_payload(link) + 4, dl->info.fname, name_length);
+		if (!frame_send(link, 'l', count++, 4 + name_length)) return;
+	}
+	if (res != FR_OK) {
+		frame_send(link, 'x', res, 0);
+	} else {
+		frame_send(link, 'e', count, 0);
+	}
+}
+
+// Answers a get of size bytes from start
+static void download_send(const char* name, frame_read_t read, void* context, uint32_t size, uint32_t start) {
+	frame_link_t* link = &dl->link;
+	uint32_t position, crc = 0, error;
+	if (start > size) {
+		frame_send(link, 'x', FRAME_ERROR_BAD_REQUEST, 0);
+		return;
+	}
+	LOG_INFO("Download %s, %u bytes from %u", name, size, start);
+	if (!frame_send(link, 'g', size, 0)) return;
+
+	// Catch the CRC up with the part the host already has
+	for (position = 0; position < start; ) {
+		uint16_t length = start - position < DOWNLOAD_BLOCK_SIZE ? start - position : DOWNLOAD_BLOCK_SIZE;
+		if (!read(context, position, frame_payload(link), length)) {
+			frame_send(link, 'x', FR_DISK_ERR, 0);
+			return;
+		}
+		crc = crc_crc32_update(crc, frame_payload(link), length);
+		position += length;
+	}
+
+	error = frame_send_range(link, read, context, start, size, &crc);
+	if (error == 0) {
+		frame_send(link, 'c', crc, 0);
+	} else {
+		LOG_WARN("Download of %s stopped with error 0x%x", name, error);
+		frame_send(link, 'x', error, 0);
+	}
+}
+
+static void download_get(const char* name, uint32_t start) {
+	FRESULT res = f_open(&dl->file, name, FA_OPEN_EXISTING | FA_READ);
+	if (res != FR_OK) {
+		frame_send(&dl->link, 'x', res, 0);
+		return;
+	}
+	download_send(name, frame_read_file, &dl->file, f_size(&dl->file), start);
+	f_close(&dl->file);
+}
+
+static bool download_read_mirror(void* context, uint32_t offset, uint8_t* buffer, uint16_t length) {
+	return flash_log_read(offset, buffer, length);
+}
+
+static void download_mirror(uint32_t start) {
+	if (!flash_log_ready()) {
+		frame_send(&dl->link, 'x', FR_NOT_READY, 0);
+		return;
+	}
+	download_send("flash mirror", download_read_mirror, NULL, flash_log_size(), start);
+}
+
+void task_download(void* pvParameters) {
+	frame_link_t* link;
+	dl = pvPortMalloc(sizeof(download_state_t));
+	if (dl == NULL) {
+		LOG_ERROR("No memory for download buffers");
+		vTaskDelete(NULL);
+	}
+	memset(dl, 0, sizeof(*dl));
+	link = &dl->link;
+	link->write = download_write;
+	link->read = download_read;
+	link->frame = dl->frame;
+	link->payload_max = DOWNLOAD_BLOCK_SIZE;
+	link->request = dl->request;
+	link->request_max = DOWNLOAD_MAX_REQUEST;
+	link->rx = dl->rx;
+	link->rx_size = sizeof(dl->rx);
+	link->window = DOWNLOAD_WINDOW_BLOCKS;
+	link->ack_timeout = DOWNLOAD_ACK_TIMEOUT_MS / portTICK_PERIOD_MS;
+	link->retry_limit = DOWNLOAD_RETRY_LIMIT;
+	flash_log_init();
+	LOG_INFO("Download mode, waiting for the host");
+
+	for (;;) {
+		char name[DOWNLOAD_MAX_REQUEST + 1];
+		if (!frame_receive(link, portMAX_DELAY)) continue;
+		switch (frame_request_type(link)) {
+		case 'L':
+			download_list(frame_request_arg(link));
+			break;
+		case 'G':
+			// The acks that follow reuse the request buffer
+			strcpy(name, frame_request_payload(link));
+			download_get(name, frame_request_arg(link));
+			break;
+		case 'M':
+			download_mirror(frame_request_arg(link));
+			break;
+		case 'A':
+			// Late ack for a transfer that is already over
+			break;
+		case 'Q':
+			LOG_INFO("Leaving download mode");
+			vTaskDelay(100);
+			NVIC_SystemReset();
+			break;
+		default:
+			frame_send(link, 'x', FRAME_ERROR_BAD_REQUEST, 0);
+			break;
+		}
+	}
+}
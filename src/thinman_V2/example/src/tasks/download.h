@@ -0,0 +1,52 @@
+/*
+ * download.h
+ *
+ *  Flight data download over the USB CDC port. The USB ROM stack works out of
+ *  the USB SRAM, which holds the high-g pretrigger and kernel trace rings in
+ *  flight, so USB only comes up in download mode. The "usb" command (refused
+ *  between launch and landing) sets a flag in no-init RAM and resets; that
+ *  boot mounts the card and runs task_download instead of the sensor and
+ *  storage tasks. A quit frame or any other reset goes back to flight mode.
+ *  download.py is the host side.
+ */
+
+#ifndef DOWNLOAD_H_
+#define DOWNLOAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Frames are laid out as in tasks/frame.h. Host to device:
+ *   'L'  List the root directory from file number arg, counting from 0
+ *   'G'  Get the file named by the payload, from byte offset arg
+ *   'M'  Get the flash mirror ring (tasks/flash_log.h) as for 'G'
+ *   'A'  Acknowledge, see frame_send_file
+ *   'Q'  Leave download mode
+ * Device to host:
+ *   'l'  One file: u32 size, then the name; arg is its place in the listing
+ *   'e'  End of the listing, arg is the number of files
+ *   'g'  Get accepted, arg is the file size
+ *   'd'  Data, arg is its file offset
+ *   'c'  File complete, arg is the CRC-32 (zlib.crc32) of the whole file
+ *   'x'  Request failed, arg is the FRESULT or a FRAME_ERROR_ code
+ *
+ * A get that starts part way through reads the part the host already has
+ * once, so the CRC still covers the whole file. A get from the end only sends
+ * the CRC, for a host that missed it.
+ */
+#define DOWNLOAD_BLOCK_SIZE			512		// Data frame payload
+#define DOWNLOAD_MAX_REQUEST		32		// Longest payload accepted from the host
+#define DOWNLOAD_WINDOW_BLOCKS		8
+#define DOWNLOAD_ACK_TIMEOUT_MS		200
+#define DOWNLOAD_RETRY_LIMIT		10
+
+// Reads and clears the download flag. Call in main after warm_restart_init.
+void download_mode_init(void);
+bool download_mode_active(void);
+// Resets into download mode. Returns false without resetting while in flight.
+bool download_mode_request(void);
+
+void task_download(void* pvParameters);
+
+#endif /* DOWNLOAD_H_ */
@@ -0,0 +1,225 @@
+/*
+ * flash_log.c
+ *
+ *  Two page buffers: one takes chunks while the other, once sealed, waits for
+ *  the flash. Sequence numbers are only ever compared between the first
+ *  pages of blocks, which the ring fills in order.
+ */
+
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging.h"
+#include "drivers/S25FL.h"
+#include "drivers/crc.h"
+#include "./frame.h"
+#include "./flash_log.h"
+
+#define PAGES_PER_BLOCK		(FLASH_LOG_BLOCK_SIZE / FLASH_LOG_PAGE_SIZE)
+#define FLASH_LOG_PAGES		(FLASH_LOG_BLOCKS * PAGES_PER_BLOCK)
+#define FLASH_LOG_DATA_END	(FLASH_LOG_PAGE_SIZE - 2)
+#define FLASH_LOG_ERASED	0xffffffff
+
+typedef struct {
+	uint8_t page[2][FLASH_LOG_PAGE_SIZE];
+	uint8_t filling;			// Index of the page taking chunks
+	bool sealed;				// The other page is waiting to be programmed
+	uint16_t fill;
+	uint16_t last_chunk;		// Offset of the filling page's last chunk, 0 before the first
+	TickType_t first_chunk_tick;
+	uint32_t sequence;			// Of the next page to seal
+	// Page counters; they run on past the end of the ring, which wraps them for addresses
+	uint32_t write_page;
+	uint32_t erased_page;		// Pages from write_page up to here are erased
+	uint32_t first_page;		// Oldest page that can hold data
+	bool ready;
+	flash_log_stats_t stats;
+} flash_log_state_t;
+
+static flash_log_state_t fl;
+
+#define FLASH_LOG_START		(FLASH_LOG_FIRST_BLOCK * FLASH_LOG_BLOCK_SIZE)
+#define FLASH_LOG_END_ADDRESS	(FLASH_LOG_START + FLASH_LOG_PAGES * FLASH_LOG_PAGE_SIZE)
+
+static uint32_t flash_log_address(uint32_t page) {
+	return FLASH_LOG_START + (page % FLASH_LOG_PAGES) * FLASH_LOG_PAGE_SIZE;
+}
+
+static uint32_t flash_log_read_sequence(uint32_t page) {
+	uint8_t buffer[4];
+	S25FL_read(flash_log_address(page), buffer, sizeof(buffer));
+	return frame_get_u32(buffer);
+}
+
+bool flash_log_init(void) {
+	uint32_t id = S25FL_read_id();
+	uint32_t block, head_block = 0, newest = FLASH_LOG_ERASED;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.fill = FLASH_LOG_HEADER_SIZE;
+	if ((id >> 16) != S25FL_MANUFACTURER_SPANSION) {
+		LOG_WARN("No SPI flash (id 0x%x), logging to the card only", id);
+		return false;
+	}
+
+	for (block = 0; block < FLASH_LOG_BLOCKS; block++) {
+		uint32_t sequence = flash_log_read_sequence(block * PAGES_PER_BLOCK);
+		if (sequence != FLASH_LOG_ERASED && (newest == FLASH_LOG_ERASED || sequence > newest)) {
+			newest = sequence;
+			head_block = block;
+		}
+	}
+	if (newest != FLASH_LOG_ERASED) {
+		uint32_t page = head_block * PAGES_PER_BLOCK;
+		while (page + 1 < (head_block + 1) * PAGES_PER_BLOCK && flash_log_read_sequence(page + 1) != FLASH_LOG_ERASED) {
+			page++;
+		}
+		fl.sequence = flash_log_read_sequence(page) + 1;
+		// The rest of the head block was erased with it. Skip one page in case power
+		// failed while it was being programmed.
+		fl.erased_page = (head_block + 1) * PAGES_PER_BLOCK;
+		fl.write_page = page + 2 < fl.erased_page ? page + 2 : fl.erased_page;
+		// The erase-ahead leaves the blocks after the head erased, so the oldest
+		// data starts at the first programmed block past them: block 0 until
+		// the ring wraps, and the head itself when it is the only one
+		for (block = 1; block < FLASH_LOG_BLOCKS; block++) {
+			if (flash_log_read_sequence(((head_block + block) % FLASH_LOG_BLOCKS) * PAGES_PER_BLOCK) != FLASH_LOG_ERASED) {
+				break;
+			}
+		}
+		fl.first_page = ((head_block + block) % FLASH_LOG_BLOCKS) * PAGES_PER_BLOCK;
+	}
+	fl.ready = true;
+	LOG_INFO("Flash mirror at page %u, sequence %u", fl.write_page % FLASH_LOG_PAGES, fl.sequence);
+	return true;
+}
+
+bool flash_log_ready(void) {
+	return fl.ready;
+}
+
+static void flash_log_seal(void) {
+	uint8_t* page = fl.page[fl.filling];
+	// Unprogrammed bytes read as FLASH_LOG_END
+	memset(page + fl.fill, 0xff, FLASH_LOG_DATA_END - fl.fill);
+	frame_put_u32(page, fl.sequence++);
+	frame_put_u16(page + FLASH_LOG_DATA_END, crc_crc16(page, FLASH_LOG_DATA_END));
+	fl.sealed = true;
+	fl.filling ^= 1;
+	fl.fill = FLASH_LOG_HEADER_SIZE;
+	fl.last_chunk = 0;
+}
+
+static void flash_log_program(void) {
+	S25FL_write(flash_log_address(fl.write_page), fl.page[fl.filling ^ 1], FLASH_LOG_PAGE_SIZE);
+	fl.write_page++;
+	fl.sealed = false;
+	fl.stats.pages++;
+}
+
+void flash_log_poll(void) {
+	if (!fl.ready) return;
+	if (!fl.sealed && fl.fill > FLASH_LOG_HEADER_SIZE &&
+			(xTaskGetTickCount() - fl.first_chunk_tick) >= FLASH_LOG_FLUSH_MS / portTICK_PERIOD_MS) {
+		flash_log_seal();
+	}
+	if (S25FL_busy()) {
+		// Programs wait for themselves, so this is an erase-ahead: step around it
+		// unless the page would land in the block being erased
+		if (fl.sealed && fl.write_page + PAGES_PER_BLOCK < fl.erased_page) {
+			S25FL_erase_suspend();
+			flash_log_program();
+			S25FL_erase_resume();
+			fl.stats.suspends++;
+		}
+		return;
+	}
+	if (fl.sealed && fl.write_page < fl.erased_page) {
+		flash_log_program();
+	}
+	if (fl.erased_page - fl.write_page < FLASH_LOG_ERASE_AHEAD_BLOCKS * PAGES_PER_BLOCK) {
+		S25FL_erase_sector_start(flash_log_address(fl.erased_page));
+		fl.erased_page += PAGES_PER_BLOCK;
+		fl.stats.erases++;
+	}
+}
+
+// Seals the filling page, once the other one is free
+static bool flash_log_next_page(void) {
+	if (fl.sealed) {
+		flash_log_poll();
+		if (fl.sealed) return false;
+	}
+	flash_log_seal();
+	return true;
+}
+
+void flash_log_append(uint8_t stream, uint16_t file_number, uint32_t offset, const void* data, uint16_t length) {
+	const uint8_t* p = (const uint8_t*) data;
+	if (!fl.ready) return;
+	while (length > 0) {
+		uint8_t* page = fl.page[fl.filling];
+		uint8_t* chunk = page + fl.last_chunk;
+		uint16_t n = FLASH_LOG_DATA_END - fl.fill;
+
+		if (fl.last_chunk == 0 || chunk[0] != stream || frame_get_u16(chunk + 2) != file_number ||
+				frame_get_u32(chunk + 4) + chunk[1] != offset || n == 0) {
+			if (n <= FLASH_LOG_CHUNK_HEADER) {
+				if (!flash_log_next_page()) {
+					fl.stats.dropped += length;
+					return;
+				}
+				continue;
+			}
+			if (fl.fill == FLASH_LOG_HEADER_SIZE) {
+				fl.first_chunk_tick = xTaskGetTickCount();
+			}
+			fl.last_chunk = fl.fill;
+			chunk = page + fl.fill;
+			chunk[0] = stream;
+			chunk[1] = 0;
+			frame_put_u16(chunk + 2, file_number);
+			frame_put_u32(chunk + 4, offset);
+			fl.fill += FLASH_LOG_CHUNK_HEADER;
+			n -= FLASH_LOG_CHUNK_HEADER;
+		}
+		if (n > length) {
+			n = length;
+		}
+		memcpy(page + fl.fill, p, n);
+		chunk[1] += n;
+		fl.fill += n;
+		p += n;
+		offset += n;
+		length -= n;
+	}
+}
+
+uint32_t flash_log_size(void) {
+	uint32_t pages = (fl.write_page + FLASH_LOG_PAGES - fl.first_page) % FLASH_LOG_PAGES;
+	if (pages == 0 && fl.sequence > 0) {
+		pages = FLASH_LOG_PAGES;
+	}
+	return pages * FLASH_LOG_PAGE_SIZE;
+}
+
+bool flash_log_read(uint32_t offset, uint8_t* buffer, uint16_t length) {
+	uint32_t address;
+	if (!fl.ready || offset + length > flash_log_size()) return false;
+	address = flash_log_address(fl.first_page) + offset;
+	if (address >= FLASH_LOG_END_ADDRESS) {
+		address -= FLASH_LOG_END_ADDRESS - FLASH_LOG_START;
+	}
+	if (address + length > FLASH_LOG_END_ADDRESS) {
+		uint16_t first = FLASH_LOG_END_ADDRESS - address;
+		S25FL_read(address, buffer, first);
+		S25FL_read(FLASH_LOG_START, buffer + first, length - first);
+	} else {
+		S25FL_read(address, buffer, length);
+	}
+	return true;
+}
+
+void flash_log_get_stats(flash_log_stats_t* stats) {
+	*stats = fl.stats;
+}
@@ -0,0 +1,81 @@
+/*
+ * flash_log.h
+ *
+ *  Mirror of the TAB streams on the S25FL SPI flash, for when the card drops
+ *  out under vibration. The storage writer formats each row once and hands
+ *  the same bytes to the card file and to flash_log_append, which packs them
+ *  into pages tagged with the file and offset they belong to. Full pages are
+ *  programmed in order around a ring of 64 kB blocks that is erased ahead of
+ *  the write position, oldest data first. download.py fetches the ring,
+ *  rebuilds the files from it and compares them with the card copies.
+ *
+ *  The ring has the flash above the FTL partition (drivers/ftl.h) that holds
+ *  FatFs drive 1. Rows are not written through that volume: each sync would
+ *  rewrite a FAT and a directory sector as well, and its RAM map limits it to
+ *  about a minute of flight.
+ */
+
+#ifndef FLASH_LOG_H_
+#define FLASH_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/S25FL.h"
+#include "drivers/ftl.h"
+
+/*
+ * Page, little-endian:
+ *   u32 sequence		Pages sealed before it; 0xffffffff when erased
+ *   chunks, each:
+ *     u8  stream		storage_stream_t, or FLASH_LOG_END after the last chunk
+ *     u8  length
+ *     u16 file_number	N of <name>N.TAB
+ *     u32 offset		In the file, of the first byte
+ *     length bytes of the file
+ *   u16 crc_crc16 of everything before it, in the last two bytes
+ *
+ * Rows run on from one page to the next in a new chunk. A chunk that starts
+ * before the end of what came earlier for its file follows a warm restart,
+ * which cut the file back there.
+ */
+#define FLASH_LOG_PAGE_SIZE		256
+#define FLASH_LOG_HEADER_SIZE	4
+#define FLASH_LOG_CHUNK_HEADER	8
+#define FLASH_LOG_END			0xff
+#define FLASH_LOG_BLOCK_SIZE	0x10000		// S25FL_erase_sector with S25FL_E_64
+// Above the FTL partition
+#define FLASH_LOG_FIRST_BLOCK	(FTL_BLOCKS * FTL_BLOCK_SIZE / FLASH_LOG_BLOCK_SIZE)
+#define FLASH_LOG_BLOCKS		((S25FL_SECTOR_COUNT * S25FL_SECTOR_SIZE) / FLASH_LOG_BLOCK_SIZE - FLASH_LOG_FIRST_BLOCK)
+
+// Kept erased ahead of the write position, about 45 s of flight-rate rows. A
+// block takes up to 650 ms to erase, which pages behind it wait out by
+// suspending the erase.
+#define FLASH_LOG_ERASE_AHEAD_BLOCKS	16
+// A part-filled page is programmed once its oldest row is this old
+#define FLASH_LOG_FLUSH_MS		500
+
+typedef struct {
+	uint32_t pages;			// Programmed since boot
+	uint32_t erases;
+	uint32_t suspends;		// Pages programmed with an erase suspended
+	uint32_t dropped;		// Bytes refused while both page buffers waited on an erase
+} flash_log_stats_t;
+
+// Finds the write position left by the last session. Returns false, and the mirror stays
+// off, when no S25FL answers. The other functions belong to the task that called it.
+bool flash_log_init(void);
+bool flash_log_ready(void);
+
+// Queues length bytes at offset in file_number of stream. Never waits on an erase.
+void flash_log_append(uint8_t stream, uint16_t file_number, uint32_t offset, const void* data, uint16_t length);
+
+// Programs sealed pages and erases ahead when the flash is free. Call often.
+void flash_log_poll(void);
+
+// The ring from its oldest page to the newest, as one range of bytes. Download mode only.
+uint32_t flash_log_size(void);
+bool flash_log_read(uint32_t offset, uint8_t* buffer, uint16_t length);
+
+void flash_log_get_stats(flash_log_stats_t* stats);
+
+#endif /* FLASH_LOG_H_ */
@@ -0,0 +1,37 @@
+/*
+ * flight_state.c
+ */
+
+#include <string.h>
+#include <chip.h>
+#include "./flight_state.h"
+
+static flight_state_t flight_state;
+// Odd while a publish is in progress
+static volatile uint32_t flight_state_sequence;
+
+void flight_state_init(void) {
+	flight_state_t state;
+	memset(&state, 0, sizeof(state));
+	flight_state_publish(&state);
+}
+
+void flight_state_publish(const flight_state_t* state) {
+	flight_state_sequence++;
+	// __DMB also stops the compiler moving the copy across the sequence updates
+	__DMB();
+	flight_state = *state;
+	__DMB();
+	flight_state_sequence++;
+}
+
+uint32_t flight_state_snapshot(flight_state_t* state) {
+	uint32_t sequence;
+	do {
+		sequence = flight_state_sequence;
+		__DMB();
+		*state = flight_state;
+		__DMB();
+	} while ((sequence & 1) || sequence != flight_state_sequence);
+	return sequence >> 1;
+}
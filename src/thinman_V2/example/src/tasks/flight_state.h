@@ -0,0 +1,44 @@
+/*
+ * flight_state.h
+ *
+ *  Versioned snapshot of the flight record. The acquisition task is the only
+ *  writer and publishes a whole struct through a seqlock; readers copy it out
+ *  without a mutex and retry if a publish overlapped the copy. Readers must
+ *  run at or below the writer's priority, or a retry could spin forever.
+ *  Kept in raw/integer units; convert with the sensor scale only for display.
+ */
+
+#ifndef FLIGHT_STATE_H_
+#define FLIGHT_STATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FLIGHT_STATE_ALT_HISTORY 5
+
+typedef struct {
+	int32_t alt_mm[FLIGHT_STATE_ALT_HISTORY];		// Baro altitude, newest first
+	uint32_t alt_tick[FLIGHT_STATE_ALT_HISTORY];	// ticks (ms) of each alt_mm sample
+	int32_t max_alt_mm;		// Highest average of alt_mm
+	int16_t max_acc_imu;	// raw LSM accel counts, +x
+	int16_t max_acc_highg;	// raw H3L accel counts, +x
+	int16_t imu_accel[3];	// Latest raw LSM accel, for telemetry
+} flight_state_t;
+
+// Zeroes and publishes the state. Call before the writer or any reader starts.
+void flight_state_init(void);
+
+// Writer only: replaces the published state with a copy of state
+void flight_state_publish(const flight_state_t* state);
+
+// Copies a consistent snapshot. Returns the version, which advances by one with each publish.
+uint32_t flight_state_snapshot(flight_state_t* state);
+
+// Device status, each flag written by a single task
+extern bool volt_active;
+extern bool gps_activated;
+extern bool baro_running;
+extern bool imu_running;
+extern bool highg_running;
+
+#endif /* FLIGHT_STATE_H_ */
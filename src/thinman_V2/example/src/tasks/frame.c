@@ -0,0 +1,133 @@
+/*
+ * frame.c
+ *
+ *  A frame that has to go out again is read from the card again rather than
+ *  kept in RAM, so the window costs card reads but no memory.
+ */
+
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging.h"
+#include "drivers/crc.h"
+#include "./frame.h"
+
+uint32_t frame_get_u32(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+void frame_put_u32(uint8_t* p, uint32_t value) {
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+uint16_t frame_get_u16(const uint8_t* p) {
+	return p[0] | (p[1] << 8);
+}
+
+void frame_put_u16(uint8_t* p, uint16_t value) {
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+bool frame_send(frame_link_t* link, uint8_t type, uint32_t arg, uint16_t length) {
+	uint8_t* frame = link->frame;
+	uint16_t crc;
+	frame[0] = FRAME_SYNC;
+	frame[1] = type;
+	frame[2] = length;
+	frame[3] = length >> 8;
+	frame_put_u32(&frame[4], arg);
+	crc = crc_crc16(&frame[1], FRAME_HEADER_SIZE - 1 + length);
+	frame[FRAME_HEADER_SIZE + length] = crc;
+	frame[FRAME_HEADER_SIZE + length + 1] = crc >> 8;
+	return link->write(frame, FRAME_SIZE(length));
+}
+
+// Anything that does not complete a good frame resyncs on the next sync byte
+bool frame_parse(frame_link_t* link, uint8_t byte) {
+	uint8_t* request = link->request;
+	size_t length;
+	if (link->request_position == 0 && byte != FRAME_SYNC) return false;
+	request[link->request_position++] = byte;
+	if (link->request_position < FRAME_HEADER_SIZE) return false;
+
+	length = frame_get_u16(&request[2]);
+	if (length > link->request_max) {
+		link->request_position = 0;
+		return false;
+	}
+	if (link->request_position < FRAME_SIZE(length)) return false;
+
+	link->request_position = 0;
+	if (crc_crc16(&request[1], FRAME_HEADER_SIZE - 1 + length) != frame_get_u16(&request[FRAME_HEADER_SIZE + length])) {
+		return false;
+	}
+	request[FRAME_HEADER_SIZE + length] = 0;
+	return true;
+}
+
+bool frame_receive(frame_link_t* link, TickType_t timeout) {
+	for (;;) {
+		while (link->rx_position < link->rx_count) {
+			if (frame_parse(link, link->rx[link->rx_position++])) return true;
+		}
+		link->rx_position = 0;
+		link->rx_count = link->read(link->rx, link->rx_size, timeout);
+		if (link->rx_count == 0) return false;
+	}
+}
+
+uint32_t frame_send_range(frame_link_t* link, frame_read_t read, void* context, uint32_t offset, uint32_t end, uint32_t* crc) {
+	uint32_t base = offset, next = offset;
+	uint32_t crc_offset = offset;			// Everything before it is in *crc
+	uint32_t rewound = end + 1;
+	int retries = 0;
+
+	while (base < end) {
+		// Fill the window
+		while (next < end && (next - base) / link->payload_max < link->window) {
+			uint16_t length = end - next < link->payload_max ? end - next : link->payload_max;
+			if (!read(context, next, frame_payload(link), length)) {
+				return FR_DISK_ERR;
+			}
+			if (next == crc_offset) {
+				*crc = crc_crc32_update(*crc, frame_payload(link), length);
+				crc_offset += length;
+			}
+			if (!frame_send(link, 'd', next, length)) return FRAME_ERROR_LINK;
+			next += length;
+		}
+
+		if (frame_receive(link, link->ack_timeout)) {
+			uint32_t arg = frame_request_arg(link);
+			if (frame_request_type(link) != 'A') {
+				// The host sends it again once this transfer has given up
+				return FRAME_ERROR_ABANDONED;
+			}
+			if (arg > base && arg <= next) {
+				base = arg;
+				retries = 0;
+			} else if (arg == base && next > base && rewound != base) {
+				// The host acked a frame after a gap; go back now rather than wait out the timeout
+				next = rewound = base;
+			}
+		} else {
+			if (++retries > link->retry_limit) return FRAME_ERROR_TIMEOUT;
+			next = base;
+		}
+	}
+	return 0;
+}
+
+bool frame_read_file(void* context, uint32_t offset, uint8_t* buffer, uint16_t length) {
+	FIL* file = (FIL*) context;
+	UINT read = 0;
+	return f_lseek(file, offset) == FR_OK && f_read(file, buffer, length, &read) == FR_OK && read == length;
+}
+
+uint32_t frame_send_file(frame_link_t* link, FIL* file, uint32_t offset, uint32_t end, uint32_t* crc) {
+	return frame_send_range(link, frame_read_file, file, offset, end, crc);
+}
@@ -0,0 +1,120 @@
+/*
+ * frame.h
+ *
+ *  Binary frames for file transfer off the board, shared by the USB download
+ *  (tasks/download.h) and the Bluetooth "xfer" command. Every frame checks
+ *  its own CRC, so a corrupted or dropped frame costs a resend rather than
+ *  the whole file. The binary ground commands (tasks/rpc.h) use the same frames.
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "FreeRTOS.h"
+#include "ff.h"
+
+/*
+ * Frame layout, little-endian:
+ *   u8  FRAME_SYNC
+ *   u8  type
+ *   u16 length			Payload bytes
+ *   u32 arg
+ *   length bytes of payload
+ *   u16 crc_crc16 of type through the payload
+ *
+ * A windowed file send answers a request for a byte range with:
+ *   'd'  Data, arg is the file offset of the payload
+ *   'c'  Range complete, arg is the CRC-32 (zlib.crc32) passed to frame_send_file
+ *   'x'  Failed, arg is the FRESULT or a FRAME_ERROR_ code
+ * and takes from the host:
+ *   'A'  Acknowledge every byte before offset arg
+ *
+ * Up to window frames are in flight unacknowledged. The host acks every data
+ * frame it receives with the next offset it wants, and drops frames that
+ * arrive out of order. The board sends again from the first unacknowledged
+ * offset (go-back-N) when an ack repeats it, or when the window has not moved
+ * for ack_timeout; it gives up after retry_limit timeouts in a row.
+ */
+#define FRAME_SYNC			0xd5
+#define FRAME_HEADER_SIZE	8
+#define FRAME_SIZE(length)	(FRAME_HEADER_SIZE + (length) + 2)
+
+#define FRAME_ERROR_TIMEOUT		0x100
+#define FRAME_ERROR_BAD_REQUEST	0x101
+#define FRAME_ERROR_ABANDONED	0x102	// Another request came in mid-transfer
+#define FRAME_ERROR_LINK		0x103	// Nothing more can be sent
+
+typedef struct {
+	// Transport. read returns 0 after timeout ticks with nothing received.
+	bool (*write)(const uint8_t* data, uint32_t size);
+	uint32_t (*read)(uint8_t* buffer, uint32_t size, TickType_t timeout);
+
+	uint8_t* frame;				// FRAME_SIZE(payload_max) bytes, the frame going out
+	uint16_t payload_max;
+	uint8_t* request;			// FRAME_SIZE(request_max) + 1 bytes, the frame coming in
+	uint16_t request_max;
+	uint8_t* rx;				// Bytes read from the transport but not parsed yet
+	uint16_t rx_size;
+
+	uint8_t window;				// Data frames in flight
+	TickType_t ack_timeout;
+	uint8_t retry_limit;
+
+	size_t request_position;
+	uint32_t rx_count;
+	uint32_t rx_position;
+} frame_link_t;
+
+uint16_t frame_get_u16(const uint8_t* p);
+void frame_put_u16(uint8_t* p, uint16_t value);
+uint32_t frame_get_u32(const uint8_t* p);
+void frame_put_u32(uint8_t* p, uint32_t value);
+
+// The payload of the outgoing frame, to fill in before frame_send
+static inline uint8_t* frame_payload(frame_link_t* link) {
+	return link->frame + FRAME_HEADER_SIZE;
+}
+
+// Sends the length payload bytes already in place
+bool frame_send(frame_link_t* link, uint8_t type, uint32_t arg, uint16_t length);
+
+// Feeds one byte to the incoming frame. True once it completes a frame with a good CRC,
+// which is then in link->request as for frame_receive.
+bool frame_parse(frame_link_t* link, uint8_t byte);
+
+// True while an incoming frame has started but not completed
+static inline bool frame_parsing(const frame_link_t* link) {
+	return link->request_position != 0;
+}
+
+// Waits up to timeout ticks for each read from the transport. Returns false on a timeout.
+// The frame is left in link->request, its payload NUL terminated.
+bool frame_receive(frame_link_t* link, TickType_t timeout);
+
+static inline uint8_t frame_request_type(const frame_link_t* link) {
+	return link->request[1];
+}
+
+static inline uint32_t frame_request_arg(const frame_link_t* link) {
+	return frame_get_u32(&link->request[4]);
+}
+
+static inline const char* frame_request_payload(const frame_link_t* link) {
+	return (const char*) &link->request[FRAME_HEADER_SIZE];
+}
+
+// Reads length bytes at offset of whatever frame_send_range is sending
+typedef bool (*frame_read_t)(void* context, uint32_t offset, uint8_t* buffer, uint16_t length);
+
+// Sends bytes [offset, end) as windowed data frames, folding each into *crc the first
+// time it goes out. Returns 0 once all of it is acknowledged, else the code for 'x'.
+uint32_t frame_send_range(frame_link_t* link, frame_read_t read, void* context, uint32_t offset, uint32_t end, uint32_t* crc);
+// frame_read_t for a FIL
+bool frame_read_file(void* context, uint32_t offset, uint8_t* buffer, uint16_t length);
+// frame_send_range from a file
+uint32_t frame_send_file(frame_link_t* link, FIL* file, uint32_t offset, uint32_t end, uint32_t* crc);
+
+#endif /* FRAME_H_ */
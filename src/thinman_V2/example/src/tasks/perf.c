@@ -0,0 +1,176 @@
+/*
+ * perf.c
+ *
+ *  The run time counters wrap with the timebase every ~71.6 minutes, so CPU
+ *  shares are taken from the difference between two samples rather than from
+ *  the totals.
+ */
+
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging.h"
+#include "boot_profile.h"
+#include "drivers/timebase.h"
+#include "./perf.h"
+#include "./storage.h"
+#include "./acquisition.h"
+
+typedef struct {
+	TaskHandle_t handle;
+	char name[PERF_NAME_LEN];
+	uint32_t run_time;			// ulRunTimeCounter at the last sample
+	uint16_t cpu_permille;		// Share of the last window
+	uint16_t stack_free_words;
+	uint8_t priority;
+	uint8_t state;
+} perf_task_t;
+
+static perf_task_t perf_tasks[PERF_MAX_TASKS];
+static int perf_task_count;
+static uint32_t perf_window_us;
+static uint32_t perf_last_total;
+static size_t perf_heap_free;
+static size_t perf_heap_min = (size_t) -1;
+static uint32_t perf_irq_latency_us;
+static uint32_t perf_irq_latency_max_us;
+
+uint32_t perf_run_time_counter(void) {
+	return timebase_us();
+}
+
+// Last-sample run time for handle, or the current count for a task seen for the first time
+static uint32_t perf_previous_run_time(const TaskStatus_t* status) {
+	int i;
+	for (i = 0; i < perf_task_count; i++) {
+		if (perf_tasks[i].handle == status->xHandle) return perf_tasks[i].run_time;
+	}
+	return status->ulRunTimeCounter;
+}
+
+static void perf_sample(void) {
+	// On the stack; perf_log, the other deep call, runs after this returns
+	TaskStatus_t perf_status[PERF_MAX_TASKS];
+	uint32_t used[PERF_MAX_TASKS];
+	int count, i;
+	uint32_t total;
+
+	count = uxTaskGetSystemState(perf_status, PERF_MAX_TASKS, &total);
+	// Only this task writes perf_tasks, so it can be read here before the update
+	for (i = 0; i < count; i++) {
+		used[i] = perf_status[i].ulRunTimeCounter - perf_previous_run_time(&perf_status[i]);
+	}
+
+	// Only tasks read perf_tasks, so the scheduler lock will do. Under the interrupt mask this
+	// loop, a strncpy and two library divides a task, held off every interrupt for ~50 us.
+	vTaskSuspendAll();
+	perf_window_us = total - perf_last_total;
+	perf_last_total = total;
+	for (i = 0; i < count; i++) {
+		const TaskStatus_t* status = &perf_status[i];
+		perf_task_t* task = &perf_tasks[i];
+		task->handle = status->xHandle;
+		strncpy(task->name, status->pcTaskName, PERF_NAME_LEN);
+		task->run_time = status->ulRunTimeCounter;
+		// Divide by the window in ms rather than multiply, so a late sample cannot overflow
+		task->cpu_permille = perf_window_us >= 1000 ? used[i] / (perf_window_us / 1000) : 0;
+		task->stack_free_words = status->usStackHighWaterMark;
+		task->priority = status->uxCurrentPriority;
+		task->state = status->eCurrentState;
+	}
+	perf_task_count = count;
+	perf_irq_latency_us = timebase_take_irq_latency_max();
+	if (perf_irq_latency_us > perf_irq_latency_max_us) {
+		perf_irq_latency_max_us = perf_irq_latency_us;
+	}
+	perf_heap_free = xPortGetFreeHeapSize();
+	if (perf_heap_free < perf_heap_min) {
+		perf_heap_min = perf_heap_free;
+	}
+	xTaskResumeAll();
+}
+
+static void perf_log(void) {
+	int i;
+	storage_stats_t queue;
+	acq_frame_stats_t frames;
+	LOG_INFO("Perf window %uus heap %u min %u", perf_window_us, perf_heap_free, perf_heap_min);
+	for (i = 0; i < perf_task_count; i++) {
+		const perf_task_t* task = &perf_tasks[i];
+		LOG_INFO("Perf %.8s cpu %u.%u%% stack free %u", task->name, task->cpu_permille / 10, task->cpu_permille % 10,
+				task->stack_free_words);
+	}
+	for (i = 0; storage_get_stats(i, &queue); i++) {
+		LOG_INFO("Perf queue %s %u/%u high water %u dropped %u", queue.name, queue.count, queue.capacity,
+				queue.high_water, queue.dropped);
+	}
+	acquisition_get_frame_stats(&frames);
+	LOG_INFO("Perf acq busy max %uus overruns %u", frames.busy_max_us, frames.overruns);
+	LOG_INFO("Perf irq latency %uus max %uus", perf_irq_latency_us, perf_irq_latency_max_us);
+}
+
+void task_perf(void* pvParameters) {
+	portTickType last_wake = xTaskGetTickCount();
+	uint32_t counter = 0;
+	perf_last_total = perf_run_time_counter();
+	for (;;) {
+		vTaskDelayUntil(&last_wake, PERF_SAMPLE_PERIOD_MS);
+		perf_sample();
+		boot_profile_poll();
+		counter++;
+		if ((counter % (PERF_LOG_PERIOD_MS / PERF_SAMPLE_PERIOD_MS)) == 0) {
+			perf_log();
+		}
+	}
+}
+
+static uint8_t* perf_put_u16(uint8_t* p, uint32_t value) {
+	if (value > 0xffff) value = 0xffff;
+	p[0] = value;
+	p[1] = value >> 8;
+	return p + 2;
+}
+
+static uint8_t* perf_put_u32(uint8_t* p, uint32_t value) {
+	p = perf_put_u16(p, value & 0xffff);
+	return perf_put_u16(p, value >> 16);
+}
+
+size_t perf_encode_report(uint8_t* buffer, size_t size) {
+	uint8_t* p = buffer;
+	storage_stats_t queue;
+	acq_frame_stats_t frames;
+	int i;
+	if (size < PERF_REPORT_MAX_SIZE) return 0;
+
+	vTaskSuspendAll();
+	*p++ = PERF_REPORT_VERSION;
+	*p++ = perf_task_count;
+	p = perf_put_u32(p, perf_window_us);
+	p = perf_put_u16(p, perf_heap_free);
+	p = perf_put_u16(p, perf_heap_min);
+	for (i = 0; i < perf_task_count; i++) {
+		const perf_task_t* task = &perf_tasks[i];
+		memcpy(p, task->name, PERF_NAME_LEN);
+		p += PERF_NAME_LEN;
+		p = perf_put_u16(p, task->cpu_permille);
+		p = perf_put_u16(p, task->stack_free_words);
+		*p++ = task->priority;
+		*p++ = task->state;
+	}
+	xTaskResumeAll();
+
+	*p++ = STORAGE_STREAM_COUNT;
+	for (i = 0; storage_get_stats(i, &queue); i++) {
+		p = perf_put_u16(p, queue.count);
+		p = perf_put_u16(p, queue.high_water);
+		p = perf_put_u16(p, queue.capacity);
+		p = perf_put_u16(p, queue.dropped);
+	}
+	acquisition_get_frame_stats(&frames);
+	p = perf_put_u16(p, frames.busy_max_us);
+	p = perf_put_u16(p, frames.overruns);
+	p = perf_put_u16(p, perf_irq_latency_us);
+	p = perf_put_u16(p, perf_irq_latency_max_us);
+	return p - buffer;
+}
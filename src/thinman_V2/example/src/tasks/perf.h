@@ -0,0 +1,48 @@
+/*
+ * perf.h
+ *
+ *  Runtime statistics: per-task CPU share from the FreeRTOS run time stats
+ *  (counted on the microsecond timebase), stack high-water marks, free heap
+ *  and storage queue depths. Sampled by task_perf every PERF_SAMPLE_PERIOD_MS
+ *  and mirrored into the persistent log every PERF_LOG_PERIOD_MS.
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "./storage.h"
+
+#define PERF_SAMPLE_PERIOD_MS	1000
+#define PERF_LOG_PERIOD_MS		10000
+
+/*
+ * Binary reply to the "perf" command, little-endian:
+ *   u8  PERF_REPORT_VERSION
+ *   u8  task count T
+ *   u32 window_us		Run time covered by the CPU shares
+ *   u16 heap_free		Bytes
+ *   u16 heap_min		Lowest heap_free sampled since boot
+ *   T x { char name[PERF_NAME_LEN] (NUL padded), u16 cpu_permille, u16 stack_free_words, u8 priority, u8 state }
+ *   u8  queue count Q
+ *   Q x { u16 count, u16 high_water, u16 capacity, u16 dropped }	Saturated at 0xffff
+ *   u16 acq_busy_max_us, u16 acq_overruns
+ *   u16 irq_latency_us		Worst timebase probe latency in the last window
+ *   u16 irq_latency_max_us	Since boot
+ */
+#define PERF_REPORT_VERSION	2
+#define PERF_NAME_LEN		8
+#define PERF_MAX_TASKS		12
+#define PERF_REPORT_MAX_SIZE (10 + PERF_MAX_TASKS * (PERF_NAME_LEN + 6) + 1 + STORAGE_STREAM_COUNT * 8 + 8)
+
+void task_perf(void* pvParameters);
+
+// Encodes the latest sample into buffer. Returns the size, or 0 if it does not fit. Tasks only;
+// it takes the scheduler lock.
+size_t perf_encode_report(uint8_t* buffer, size_t size);
+
+// Run time stats clock, see portGET_RUN_TIME_COUNTER_VALUE in FreeRTOSConfig.h
+uint32_t perf_run_time_counter(void);
+
+#endif /* PERF_H_ */
@@ -0,0 +1,68 @@
+/*
+ * pyro.c
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "chip.h"
+#include "logging.h"
+#include "drivers/timebase.h"
+#include "drivers/firing_board.h"
+#include "./pyro.h"
+
+static pyro_event_t pyro_last;
+static bool pyro_requested;
+
+bool pyro_fire(uint8_t channel, uint16_t delay_ms) {
+	pyro_event_t event = {0};
+	if (delay_ms > FIRING_BOARD_MAX_DELAY_MS) return false;
+	event.channel = channel;
+	event.delay_ms = delay_ms;
+	event.request_us = timebase_us();
+	if (!firing_board_fire_channel_after(channel, delay_ms)) return false;
+	event.ack_us = timebase_us();
+	event.pending = true;
+
+	taskENTER_CRITICAL();
+	pyro_last = event;
+	pyro_requested = true;
+	taskEXIT_CRITICAL();
+	return true;
+}
+
+void pyro_poll(void) {
+	firing_board_fire_status_t status;
+	pyro_event_t event;
+	if (!pyro_get_last(&event) || !event.pending) return;
+	if (!firing_board_read_fire_status(&status)) return;
+	if (status.channel != event.channel) return;
+	if (status.state == FIRING_BOARD_FIRE_ARMED || status.state == FIRING_BOARD_FIRE_PULSE) return;
+
+	event.pending = false;
+	event.fired = status.state == FIRING_BOARD_FIRE_DONE;
+	if (event.fired) {
+		event.board_delay_us = status.fire_us - status.request_us;
+		// The board handles the command in the read phase, just before ack_us
+		event.latency_us = (event.ack_us - event.request_us) + event.board_delay_us;
+		LOG_INFO("Pyro %d fired %uus after request, board %uus for a %ums delay", event.channel, event.latency_us,
+				event.board_delay_us, event.delay_ms);
+	} else {
+		LOG_ERROR("Pyro %d request dropped by the firing board", event.channel);
+	}
+
+	taskENTER_CRITICAL();
+	// A newer request may have come in while the status was read
+	if (pyro_last.request_us == event.request_us) {
+		pyro_last = event;
+	}
+	taskEXIT_CRITICAL();
+}
+
+bool pyro_get_last(pyro_event_t* event) {
+	bool requested;
+	taskENTER_CRITICAL();
+	*event = pyro_last;
+	requested = pyro_requested;
+	taskEXIT_CRITICAL();
+	return requested;
+}
@@ -0,0 +1,40 @@
+/*
+ * pyro.h
+ *
+ *  Timestamped fire requests to the firing board. The request is stamped on
+ *  timebase_us() around the I2C command; the board stamps when it handled the
+ *  command and when it asserted the channel, and the completion is read back
+ *  later so request-to-fire latency is measured rather than guessed.
+ */
+
+#ifndef PYRO_H_
+#define PYRO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	uint8_t channel;
+	uint16_t delay_ms;		// Requested arm-to-fire delay
+	bool pending;			// Sent; completion not read back yet
+	bool fired;
+	uint32_t request_us;	// timebase_us before the fire command went out
+	uint32_t ack_us;		// timebase_us once the board had replied
+	// Request to channel asserted. Upper bound: it counts the whole fire transaction
+	// on the bus, not just the part before the board handled the command.
+	uint32_t latency_us;
+	uint32_t board_delay_us;	// Board handling the command to channel asserted
+} pyro_event_t;
+
+// Ask the firing board to fire channel after delay_ms, at most FIRING_BOARD_MAX_DELAY_MS.
+// Returns false when the board rejected or did not acknowledge the request.
+bool pyro_fire(uint8_t channel, uint16_t delay_ms);
+
+// Reads back a pending completion and logs the latency. Called from the task that
+// polls the firing board, never from the acquisition frame.
+void pyro_poll(void);
+
+// Last request. Returns false when nothing was requested since boot.
+bool pyro_get_last(pyro_event_t* event);
+
+#endif /* PYRO_H_ */
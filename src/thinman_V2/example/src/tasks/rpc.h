@@ -0,0 +1,122 @@
+/*
+ * rpc.h
+ *
+ *  Binary ground commands on the Bluetooth link. A request is a frame
+ *  (tasks/frame.h) whose type is one of the command IDs below, with the
+ *  argument in arg and any name in the payload. The answer is a frame of
+ *  type id | RPC_REPLY whose arg is 0 or an error, and whose payload is the
+ *  packed reply laid out below. The text commands ("fld", "stat", ...) run
+ *  the same handlers and print the reply as a line; see the command table in
+ *  bluetooth_command.c. rpc.py is the host side.
+ */
+
+#ifndef RPC_H_
+#define RPC_H_
+
+// Command IDs stay below the frame letters ('A', 'c', 'd', 'x') used by transfers
+#define RPC_STATUS		0x01
+#define RPC_FLIGHT		0x02
+#define RPC_ATTITUDE	0x03
+#define RPC_STORAGE		0x04
+#define RPC_PERF		0x05
+#define RPC_SUBSCRIBE	0x06
+#define RPC_LIST		0x10
+#define RPC_REMOVE		0x11
+#define RPC_XFER		0x12
+#define RPC_USB			0x13
+
+#define RPC_REPLY		0x80
+#define RPC_PUSH		0xc0	// Unrequested update, see RPC_SUBSCRIBE
+
+#define RPC_VERSION		2
+#define RPC_MAX_REQUEST	16		// Payload bytes; an 8.3 name and its NUL
+
+// Reply arg: 0, a FRESULT, FRAME_ERROR_BAD_REQUEST, or
+#define RPC_ERROR_UNKNOWN	0x200	// No such command
+#define RPC_ERROR_END		0x201	// Index past the last entry
+#define RPC_ERROR_REFUSED	0x202	// Not allowed in this flight phase
+
+/*
+ * Replies, little-endian:
+ *
+ * RPC_STATUS
+ *   u8  RPC_VERSION
+ *   u8  flags			RPC_STATUS_ bits
+ *   u8  flight phase	flight_phase_t
+ *   u32 uptime_ms
+ */
+#define RPC_STATUS_SIZE		7
+#define RPC_STATUS_GPS		0x01
+#define RPC_STATUS_VOLT		0x02
+#define RPC_STATUS_BARO		0x04
+#define RPC_STATUS_IMU		0x08
+#define RPC_STATUS_HIGHG	0x10
+
+/*
+ * RPC_FLIGHT, from the flight_state snapshot
+ *   u32 tick			ms, of the newest altitude
+ *   i32 alt_mm
+ *   i32 max_alt_mm
+ *   i32 max_acc_mg		Larger of the IMU and high-g peaks along +x
+ *   i16 speed_dm_s		Vertical, up positive, over the altitude history
+ *   i16 max_speed_dm_s	Highest speed_dm_s reported
+ *   u16 descent_dm_s	Not estimated on board yet, 0
+ *   u8  flight phase
+ */
+#define RPC_FLIGHT_SIZE		23
+
+/*
+ * RPC_ATTITUDE
+ *   i32 q0, q1, q2, q3	Q30
+ *   i32 vertical_cos	Q30
+ *   u32 cycles_last, cycles_max, cycles_budget
+ */
+#define RPC_ATTITUDE_SIZE	32
+
+/*
+ * RPC_SUBSCRIBE, arg is the period in ms, 0 to stop
+ *   u16 period_ms		As granted, no shorter than the link can carry
+ *   then frames of type RPC_FLIGHT | RPC_PUSH, arg counting them from 0:
+ *   the RPC_FLIGHT reply
+ *   u32 version		flight_state version; a step of more than one means updates were coalesced
+ *   u32 sent_tick		ms, when the frame went out
+ *
+ * At most one update is ever waiting for the link, and it is the newest: an
+ * update that comes due while the last one is still going out is skipped
+ * rather than queued, and one is only sent when the flight state has changed.
+ * The subscription ends on disconnect. stream_client.py measures the rate and
+ * staleness of the updates.
+ */
+#define RPC_SUBSCRIBE_SIZE	2
+#define RPC_STREAM_SIZE		(RPC_FLIGHT_SIZE + 8)
+
+/*
+ * RPC_STORAGE, arg is the queue index
+ *   u32 count, high_water, capacity, dropped, written
+ *   name, not terminated
+ */
+#define RPC_STORAGE_SIZE	20
+
+/*
+ * RPC_PERF
+ *   the report in tasks/perf.h
+ *
+ * RPC_LIST, arg is the index of the root directory entry
+ *   u32 size
+ *   u8  attributes		FatFs AM_ bits
+ *   name, not terminated
+ *
+ * RPC_REMOVE, payload is the file name
+ *   nothing
+ *
+ * RPC_XFER, arg is the offset to start from, payload is the file name
+ *   u32 size, u32 offset, u32 length
+ *   then the windowed frames of frame_send_file, acked with 'A'
+ *
+ * RPC_USB
+ *   Only answers RPC_ERROR_REFUSED; otherwise the board resets into download mode
+ */
+#define RPC_LIST_SIZE		5
+#define RPC_XFER_SIZE		12
+
+#endif /* RPC_H_ */
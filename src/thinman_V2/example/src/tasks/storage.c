@@ -0,0 +1,599 @@
+/*
+ * storage.c
+ *
+ *  Producers never touch the card: they push into a queue per stream and
+ *  this task does every f_write and f_sync. An SD card can hold a write
+ *  for hundreds of ms while it collects garbage internally, so each queue
+ *  holds STORAGE_STALL_MS of its stream at the full rate. When one fills
+ *  anyway the producer drops the record and keeps sampling; the drop shows
+ *  up in the stream's stats, next to the card's write latency histogram
+ *  (drivers/sdcard.h), and the totals are logged once the flight lands.
+ *  stall_sim.py replays card latencies against these queue sizes.
+ *
+ *  Each row is formatted once into storage_row and the same bytes go to the
+ *  card file and, with STORAGE_MIRROR, to the flash mirror. A card write
+ *  that fails stops the stream's card file until it can be reopened; the
+ *  rows missed in between are covered by a comment line of the same length,
+ *  so offsets in the two copies keep matching.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <cr_section_macros.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "ff.h"
+#include "logging.h"
+#include "kernel_trace.h"
+#include "boot_profile.h"
+#include "warm_restart.h"
+#include "drivers/spsc_queue.h"
+#include "drivers/sdcard.h"
+#include "sensors/LSM.h"
+#include "sensors/H3L.h"
+#include "flight/flight_phase.h"
+#include "flight/pretrigger.h"
+#include "./flash_log.h"
+#include "./storage.h"
+
+// The writer sleeps this long when every queue is empty
+#define STORAGE_IDLE_PERIOD_MS	10
+// Longest write the queues ride out; cards are specified to finish a write
+// within 250 ms (SDHC) or 500 ms (SDXC), and the histogram shows the card fitted
+#define STORAGE_STALL_MS		500
+// Records a stream produces while the writer is stalled and then asleep
+#define STORAGE_STALL_RECORDS(rate_hz)	(((rate_hz) * (STORAGE_STALL_MS + STORAGE_IDLE_PERIOD_MS) + 999) / 1000)
+
+// Full rates, from the slots in tasks/acquisition.c, the volts poll and 9600 baud
+#define BARO_RATE_HZ			25
+#define IMU_RATE_HZ				200
+#define HIGHG_RATE_HZ			100
+#define VOLTS_RATE_HZ			50
+#define GPS_RATE_BYTES			960
+
+// Powers of two for spsc_queue. The IMU queue is the biggest buffer in RAM, at 3 kB.
+#define BARO_QUEUE_RECORDS		16
+#define IMU_QUEUE_RECORDS		128
+#define HIGHG_QUEUE_RECORDS		64
+#define VOLTS_QUEUE_RECORDS		32
+#define GPS_QUEUE_BYTES			1024
+
+#if BARO_QUEUE_RECORDS < STORAGE_STALL_RECORDS(BARO_RATE_HZ) || IMU_QUEUE_RECORDS < STORAGE_STALL_RECORDS(IMU_RATE_HZ) \
+		|| HIGHG_QUEUE_RECORDS < STORAGE_STALL_RECORDS(HIGHG_RATE_HZ) || VOLTS_QUEUE_RECORDS < STORAGE_STALL_RECORDS(VOLTS_RATE_HZ) \
+		|| GPS_QUEUE_BYTES < STORAGE_STALL_RECORDS(GPS_RATE_BYTES)
+#error "A storage queue cannot ride out STORAGE_STALL_MS"
+#endif
+// A pass of the writer takes at most this fraction of a queue before moving
+// on, so after a stall the streams catch up together rather than the last
+// one waiting for all the others to drain
+#define STORAGE_PASS_SHARE		8
+
+// The rings hold the last pre-trigger window at the full rate, which is not
+// the same length for every sensor: 1.28 s of baro, 0.85 s of high-g and only
+// about 0.3 s of IMU. Launch is confirmed 20 ms after +x passes 2.5 g
+// (flight/flight_phase.c), so this covers ignition but little of the pad before it.
+#define BARO_PRETRIGGER_RECORDS	32		// 1.28 s at 25 Hz
+// The IMU ring fills what the baro ring and queue leave of the otherwise unused
+// 2kB SRAM1 bank: 61 rows of 24 bytes, 0.305 s at 200 Hz
+#define IMU_PRETRIGGER_RECORDS	((0x800 - (BARO_PRETRIGGER_RECORDS + BARO_QUEUE_RECORDS) * sizeof(baro_record_t)) / sizeof(imu_record_t))
+// The high-g ring shares the 2kB USB SRAM bank with the kernel trace ring; only
+// download mode hands the bank to USB (tasks/download.h). 85 rows of 12 bytes,
+// 0.85 s at 100 Hz.
+#define HIGHG_PRETRIGGER_RECORDS ((0x800 - KERNEL_TRACE_RING_SIZE) / sizeof(highg_record_t))
+
+// Queue stats are logged this often
+#define STORAGE_REPORT_PERIOD_MS 10000
+// A stream whose card file failed tries to reopen it this often
+#define STORAGE_CARD_RETRY_MS	1000
+// Longest header or row; the IMU header
+#define STORAGE_ROW_SIZE		0xc0
+
+typedef union {
+	baro_record_t baro;
+	imu_record_t imu;
+	highg_record_t highg;
+	volts_record_t volts;
+	char gps;
+} storage_record_t;
+
+typedef struct {
+	const char* name;				// TAB file base name
+	uint16_t record_size;
+	uint16_t queue_capacity;
+	void* queue_buffer;
+	void* ring_buffer;				// NULL when the stream is not pre-triggered
+	uint16_t ring_capacity;
+	uint16_t logged_offset;			// Of the logged flag; t_us leads every pre-triggered record
+	uint16_t sync_every;			// Records between f_sync calls
+	// Format into row, returning the length
+	int (*header)(char* row);
+	int (*format)(char* row, const void* record);
+} storage_stream_desc_t;
+
+typedef struct {
+	spsc_queue_t queue;
+	pretrigger_ring_t ring;
+	FIL file;
+	volatile bool open_requested;
+	bool open;
+	uint16_t file_number;			// N of <name>N.TAB, kept in the warm restart block
+	uint32_t last_log_us;
+	uint32_t written;
+	uint32_t unsynced;
+	uint32_t offset;				// Bytes of the stream so far, whether or not the card took them
+	uint32_t card_rows_end;			// Offset just past the last row the card file took whole
+	uint32_t card_synced_end;		// card_rows_end at the last f_sync that went through
+	bool card_failed;				// The card file is closed until a retry reopens it
+	TickType_t card_retry_tick;
+	uint32_t card_errors;
+	uint32_t card_missed;			// Bytes formatted while the card file was closed
+} storage_stream_state_t;
+
+static volatile bool storage_volume_mounted;
+static bool storage_mirror;
+static char storage_row[STORAGE_ROW_SIZE];
+
+__BSS(RAM2) static baro_record_t baro_queue_buffer[BARO_QUEUE_RECORDS];
+static imu_record_t imu_queue_buffer[IMU_QUEUE_RECORDS];
+static highg_record_t highg_queue_buffer[HIGHG_QUEUE_RECORDS];
+static volts_record_t volts_queue_buffer[VOLTS_QUEUE_RECORDS];
+static char gps_queue_buffer[GPS_QUEUE_BYTES];
+
+__BSS(RAM2) static baro_record_t baro_ring_buffer[BARO_PRETRIGGER_RECORDS];
+__BSS(RAM2) static imu_record_t imu_ring_buffer[IMU_PRETRIGGER_RECORDS];
+__BSS(RAM3) static highg_record_t highg_ring_buffer[HIGHG_PRETRIGGER_RECORDS];
+
+static storage_stream_state_t storage_state[STORAGE_STREAM_COUNT];
+
+/*****************************************************************************
+ * Stream formats
+ ****************************************************************************/
+
+// Raw counts are logged; the headers carry the scale for post/load_tab.m
+static int baro_header(char* row) {
+	return sprintf(row, "%% t_us temp_raw pressure_raw kind=baro t_unit=us temp_offset_mdegc=42500 temp_counts_per_degc=480 pressure_counts_per_mbar=4096\n");
+}
+
+static int baro_format(char* row, const void* record) {
+	const baro_record_t* r = (const baro_record_t*) record;
+	return sprintf(row, "%lu\t%d\t%ld\n", r->t_us, r->temp_raw, r->pressure_raw);
+}
+
+static int imu_header(char* row) {
+	return sprintf(row, "%% t_us ax ay az gx gy gz mx my mz kind=imu t_unit=us full_scale_counts=%d a_fs_mg=%ld g_fs_mdps=%ld m_fs_mgauss=%ld\n",
+			LSM_FULL_SCALE_COUNTS, LSM_a_fs_mg, LSM_g_fs_mdps, LSM_m_fs_mgauss);
+}
+
+static int imu_format(char* row, const void* record) {
+	const imu_record_t* r = (const imu_record_t*) record;
+	return sprintf(row, "%lu\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", r->t_us,
+			r->accel[0], r->accel[1], r->accel[2],
+			r->gyro[0], r->gyro[1], r->gyro[2],
+			r->mag[0], r->mag[1], r->mag[2]);
+}
+
+static int highg_header(char* row) {
+	return sprintf(row, "%% t_us ax ay az kind=highg t_unit=us full_scale_counts=%d a_fs_mg=%ld\n", H3L_FULL_SCALE_COUNTS, H3L_a_fs_mg);
+}
+
+static int highg_format(char* row, const void* record) {
+	const highg_record_t* r = (const highg_record_t*) record;
+	return sprintf(row, "%lu\t%d\t%d\t%d\n", r->t_us, r->accel[0], r->accel[1], r->accel[2]);
+}
+
+static int volts_header(char* row) {
+	return sprintf(row, "%% tick vext vbus ch1 ch2 ch3 ch4 mode fires kind=volts t_unit=ms\n");
+}
+
+static int volts_format(char* row, const void* record) {
+	const volts_record_t* r = (const volts_record_t*) record;
+	return sprintf(row, "%u\t%f\t%f\t%u\t%u\t%u\t%u\t%u\t%u\n", r->tick, r->vext, r->vbus, r->channel_raw[0],
+			r->channel_raw[1], r->channel_raw[2], r->channel_raw[3], r->mode, r->fire_count);
+}
+
+static int gps_format(char* row, const void* record) {
+	row[0] = *(const char*) record;
+	return 1;
+}
+
+static const storage_stream_desc_t storage_streams[STORAGE_STREAM_COUNT] = {
+	[STORAGE_BARO] = {"BARO", sizeof(baro_record_t), BARO_QUEUE_RECORDS, baro_queue_buffer,
+			baro_ring_buffer, BARO_PRETRIGGER_RECORDS, offsetof(baro_record_t, logged), 50, baro_header, baro_format},
+	[STORAGE_IMU] = {"IMU", sizeof(imu_record_t), IMU_QUEUE_RECORDS, imu_queue_buffer,
+			imu_ring_buffer, IMU_PRETRIGGER_RECORDS, offsetof(imu_record_t, logged), 100, imu_header, imu_format},
+	[STORAGE_HIGHG] = {"HIGHG", sizeof(highg_record_t), HIGHG_QUEUE_RECORDS, highg_queue_buffer,
+			highg_ring_buffer, HIGHG_PRETRIGGER_RECORDS, offsetof(highg_record_t, logged), 50, highg_header, highg_format},
+	[STORAGE_VOLTS] = {"VOLTS", sizeof(volts_record_t), VOLTS_QUEUE_RECORDS, volts_queue_buffer,
+			NULL, 0, 0, 25, volts_header, volts_format},
+	// About 20 NMEA sentences between syncs
+	[STORAGE_GPS] = {"GPS", sizeof(char), GPS_QUEUE_BYTES, gps_queue_buffer,
+			NULL, 0, 0, 1024, NULL, gps_format},
+};
+
+/*****************************************************************************
+ * Writer
+ ****************************************************************************/
+
+static char storage_file_name[0x20];
+
+static void storage_format_name(const char* base, const char* extension, int number) {
+	if (number == 0) {
+		sprintf(storage_file_name, "%s.%s", base, extension);
+	} else {
+		sprintf(storage_file_name, "%s%d.%s", base, number, extension);
+	}
+}
+
+static FRESULT storage_create_next(FIL* f, const char* base, const char* extension, uint16_t* number) {
+	int rename_number = 0;
+	storage_format_name(base, extension, rename_number);
+	while (f_stat(storage_file_name, NULL) == FR_OK) {
+		rename_number ++;
+		storage_format_name(base, extension, rename_number);
+	}
+	LOG_INFO("%s output is %s", base, storage_file_name);
+	*number = rename_number;
+	return f_open(f, storage_file_name, FA_WRITE | FA_CREATE_ALWAYS);
+}
+
+FRESULT storage_open_next(FIL* f, const char* base, const char* extension) {
+	uint16_t number;
+	return storage_create_next(f, base, extension, &number);
+}
+
+// After a warm restart, reopens the stream's session file at its last synced offset.
+// Rows written after that sync may be torn, so they are cut off.
+static bool storage_resume(storage_stream_t stream) {
+	const storage_stream_desc_t* desc = &storage_streams[stream];
+	storage_stream_state_t* state = &storage_state[stream];
+	uint16_t number;
+	uint32_t offset;
+	FRESULT result;
+
+	if (!warm_restart_get_file(stream, &number, &offset)) return false;
+	storage_format_name(desc->name, "TAB", number);
+	result = f_open(&state->file, storage_file_name, FA_WRITE | FA_OPEN_EXISTING);
+	if (result == FR_OK) {
+		if (offset > f_size(&state->file)) {
+			offset = f_size(&state->file);
+		}
+		result = f_lseek(&state->file, offset);
+		if (result == FR_OK) {
+			result = f_truncate(&state->file);
+		}
+		if (result != FR_OK) {
+			f_close(&state->file);
+		}
+	}
+	if (result != FR_OK) {
+		LOG_ERROR("Could not resume %s: %d", storage_file_name, result);
+		return false;
+	}
+	LOG_INFO("%s output resumes %s at %u", desc->name, storage_file_name, offset);
+	state->file_number = number;
+	state->offset = offset;
+	state->card_rows_end = state->card_synced_end = offset;
+	return true;
+}
+
+// Hands one formatted row to the card file and the flash mirror
+static void storage_emit(storage_stream_t stream, storage_stream_state_t* state, const char* row, int length) {
+	if (length <= 0) return;
+#ifdef STORAGE_MIRROR
+	if (storage_mirror) {
+		flash_log_append(stream, state->file_number, state->offset, row, length);
+	}
+#endif
+	state->offset += length;
+	if (state->card_failed) {
+		state->card_missed += length;
+	} else {
+		UINT written = 0;
+		FRESULT result = f_write(&state->file, row, length, &written);
+		if (result != FR_OK || written != length) {
+			LOG_ERROR("%s log failed %d", storage_streams[stream].name, result);
+			state->card_failed = true;
+			state->card_retry_tick = xTaskGetTickCount();
+			state->card_errors++;
+			state->card_missed += length - written;
+		} else {
+			state->card_rows_end = state->offset;
+		}
+	}
+}
+
+static FRESULT storage_open_stream(storage_stream_t stream) {
+	const storage_stream_desc_t* desc = &storage_streams[stream];
+	storage_stream_state_t* state = &storage_state[stream];
+	FRESULT result;
+
+	if (storage_resume(stream)) return FR_OK;
+	result = storage_create_next(&state->file, desc->name, "TAB", &state->file_number);
+	if (result != FR_OK) return result;
+	state->offset = 0;
+	state->card_rows_end = state->card_synced_end = 0;
+	if (desc->header) {
+		storage_emit(stream, state, storage_row, desc->header(storage_row));
+	}
+	// Sync once so the file exists on the card before the warm restart block points at it
+	result = f_sync(&state->file);
+	if (result == FR_OK) {
+		state->card_synced_end = state->card_rows_end;
+		warm_restart_save_file(stream, state->file_number, f_tell(&state->file));
+	}
+	return result;
+}
+
+// True when a pad-rate row is due. On the pad every sample goes to the pre-trigger
+// ring but only one every FLIGHT_LOW_RATE_PERIOD_MS is written to the card.
+static bool pad_log_due(uint32_t t_us, uint32_t* last_log_us) {
+	if ((t_us - *last_log_us) < FLIGHT_LOW_RATE_PERIOD_MS * 1000UL) return false;
+	*last_log_us = t_us;
+	return true;
+}
+
+// Offset just past the last '\n' in [from, to) of file, or from if there is none
+static uint32_t storage_last_row_end(FIL* file, uint32_t from, uint32_t to) {
+	while (to > from) {
+		UINT length = to - from < sizeof(storage_row) ? to - from : sizeof(storage_row);
+		UINT got = 0;
+		if (f_lseek(file, to - length) != FR_OK || f_read(file, storage_row, length, &got) != FR_OK || got != length) {
+			break;
+		}
+		for (; got > 0; got--) {
+			if (storage_row[got - 1] == '\n') return to - length + got;
+		}
+		to -= length;
+	}
+	return from;
+}
+
+// Reopens a failed card file. Whatever the card is missing up to the stream's offset
+// becomes a '%' comment line, which post/load_tab.m skips and the mirror fills in. The
+// line starts at the end of the last whole row, so it overwrites any part of a row the
+// failed write left behind. A file shorter than that lost rows FatFs had taken and may
+// end inside one, so it is read back to the last newline after the last sync.
+static void storage_card_retry(storage_stream_t stream, storage_stream_state_t* state) {
+	const storage_stream_desc_t* desc = &storage_streams[stream];
+	uint32_t size, gap;
+	UINT written;
+	FRESULT result;
+
+	state->card_retry_tick = xTaskGetTickCount();
+	// Closing flushes what f_write still held; until that works the file stays open
+	if (state->file.fs != NULL && f_close(&state->file) != FR_OK) return;
+	storage_format_name(desc->name, "TAB", state->file_number);
+	result = f_open(&state->file, storage_file_name, FA_READ | FA_WRITE | FA_OPEN_EXISTING);
+	if (result != FR_OK) return;
+	size = f_size(&state->file);
+	if (size > state->card_rows_end) {
+		size = state->card_rows_end;
+	} else if (size < state->card_rows_end && size > state->card_synced_end) {
+		size = storage_last_row_end(&state->file, state->card_synced_end, size);
+	}
+	gap = state->offset - size;
+	result = f_lseek(&state->file, size);
+	if (result == FR_OK && gap > 0) {
+		memset(storage_row, ' ', sizeof(storage_row));
+		storage_row[0] = '\n';
+		if (gap > 2) {
+			storage_row[1] = '%';
+		}
+		while (result == FR_OK && gap > 0) {
+			UINT length = gap < sizeof(storage_row) ? gap : sizeof(storage_row);
+			if (length == gap) {
+				storage_row[length - 1] = '\n';
+			}
+			result = f_write(&state->file, storage_row, length, &written);
+			if (written != length) {
+				result = FR_DISK_ERR;
+			}
+			gap -= length;
+			memset(storage_row, ' ', 2);
+		}
+	}
+	if (result == FR_OK) {
+		result = f_sync(&state->file);
+	}
+	if (result != FR_OK) {
+		f_close(&state->file);
+		return;
+	}
+	LOG_WARN("%s card file reopened, %u bytes from %u filled", desc->name, state->offset - size, size);
+	state->card_failed = false;
+	state->card_rows_end = state->card_synced_end = state->offset;
+	warm_restart_save_file(stream, state->file_number, state->offset);
+}
+
+static void storage_write(const storage_stream_desc_t* desc, storage_stream_state_t* state, const void* record) {
+	storage_emit(state - storage_state, state, storage_row, desc->format(storage_row, record));
+	state->written++;
+	state->unsynced++;
+	boot_profile_mark(BOOT_STAGE_FIRST_WRITE);
+}
+
+static void storage_store(const storage_stream_desc_t* desc, storage_stream_state_t* state, storage_record_t* record, flight_phase_t phase) {
+	static storage_record_t old;
+	if (desc->ring_buffer == NULL) {
+		storage_write(desc, state, record);
+	} else if (phase == FLIGHT_PHASE_PAD) {
+		bool* logged = (bool*)((uint8_t*) record + desc->logged_offset);
+		uint32_t t_us;
+		memcpy(&t_us, record, sizeof(t_us));
+		*logged = pad_log_due(t_us, &state->last_log_us);
+		pretrigger_push(&state->ring, record);
+		if (*logged) {
+			storage_write(desc, state, record);
+		}
+	} else {
+		// Write out the pre-trigger window first, skipping rows already written at the pad rate.
+		// These rows land after the pad-rate rows they overlap; post/load_tab.m sorts by time.
+		while (pretrigger_pop(&state->ring, &old)) {
+			if (!*(bool*)((uint8_t*) &old + desc->logged_offset)) {
+				storage_write(desc, state, &old);
+			}
+		}
+		storage_write(desc, state, record);
+	}
+	if (state->unsynced >= desc->sync_every) {
+		int out;
+		if (state->card_failed) {
+			state->unsynced = 0;
+			return;
+		}
+		out = f_sync(&state->file);
+		if (out != FR_OK) {
+			LOG_ERROR("%s sync failed %d", desc->name, out);
+			state->card_failed = true;
+			state->card_retry_tick = xTaskGetTickCount();
+			state->card_errors++;
+		} else {
+			state->card_synced_end = state->card_rows_end;
+			warm_restart_save_file(state - storage_state, state->file_number, f_tell(&state->file));
+		}
+		state->unsynced = 0;
+	}
+}
+
+static void storage_report(void) {
+	int i;
+	storage_stats_t stats;
+	for (i = 0; i < STORAGE_STREAM_COUNT; i++) {
+		storage_get_stats(i, &stats);
+		LOG_INFO("Storage %s high water %u/%u dropped %u written %u", stats.name, stats.high_water, stats.capacity,
+				stats.dropped, stats.written);
+		if (stats.card_errors) {
+			LOG_WARN("Storage %s card errors %u, %u bytes not on the card", stats.name, stats.card_errors, stats.card_missed);
+		}
+	}
+#ifdef STORAGE_MIRROR
+	if (storage_mirror) {
+		flash_log_stats_t mirror;
+		flash_log_get_stats(&mirror);
+		LOG_INFO("Storage mirror %u pages %u erases %u suspends dropped %u", mirror.pages, mirror.erases, mirror.suspends, mirror.dropped);
+	}
+#endif
+#ifdef SDCARD_WRITE_TIMING
+	{
+		sdcard_write_stats_t card;
+		SDCardGetWriteStats(&card);
+		LOG_INFO("Storage card %u writes %u sectors, longest %u us", card.writes, card.sectors, card.max_us);
+		LOG_INFO("Storage card ms <1 %u <2 %u <4 %u <8 %u <16 %u <32 %u <64 %u <128 %u <256 %u <512 %u more %u",
+				card.histogram[0], card.histogram[1], card.histogram[2], card.histogram[3], card.histogram[4],
+				card.histogram[5], card.histogram[6], card.histogram[7], card.histogram[8], card.histogram[9],
+				card.histogram[10]);
+	}
+#endif
+}
+
+// Once per boot, when the flight lands, so the log has the session's losses in one place
+static void storage_report_session(void) {
+	int i;
+	uint32_t dropped = 0;
+	uint32_t missed = 0;
+	storage_report();
+	for (i = 0; i < STORAGE_STREAM_COUNT; i++) {
+		dropped += storage_state[i].queue.dropped;
+		missed += storage_state[i].card_missed;
+	}
+	if (dropped || missed) {
+		LOG_WARN("Storage session lost %u records in full queues, %u bytes not on the card", dropped, missed);
+	} else {
+		LOG_INFO("Storage session lost nothing");
+	}
+}
+
+void storage_init(void) {
+	int i;
+	for (i = 0; i < STORAGE_STREAM_COUNT; i++) {
+		const storage_stream_desc_t* desc = &storage_streams[i];
+		spsc_queue_init(&storage_state[i].queue, desc->queue_buffer, desc->record_size, desc->queue_capacity);
+		if (desc->ring_buffer != NULL) {
+			pretrigger_init(&storage_state[i].ring, desc->ring_buffer, desc->record_size, desc->ring_capacity);
+		}
+	}
+}
+
+void storage_volume_ready(void) {
+	storage_volume_mounted = true;
+}
+
+void storage_open(storage_stream_t stream) {
+	storage_state[stream].open_requested = true;
+}
+
+bool storage_push(storage_stream_t stream, const void* record) {
+	return spsc_queue_push(&storage_state[stream].queue, record);
+}
+
+void task_storage(void* pvParameters) {
+	static storage_record_t record;
+	portTickType last_report = xTaskGetTickCount();
+	bool session_reported = false;
+	int i, n;
+#ifdef STORAGE_MIRROR
+	storage_mirror = flash_log_init();
+#endif
+	for (;;) {
+		bool idle = true;
+		flight_phase_t phase = flight_phase_get();
+		if (!storage_volume_mounted) {
+			// Producers start during boot; their records wait in the queues until the card is up
+			vTaskDelay(STORAGE_IDLE_PERIOD_MS);
+			continue;
+		}
+		for (i = 0; i < STORAGE_STREAM_COUNT; i++) {
+			const storage_stream_desc_t* desc = &storage_streams[i];
+			storage_stream_state_t* state = &storage_state[i];
+			if (!state->open) {
+				if (!state->open_requested) continue;
+				state->open_requested = false;
+				int result = storage_open_stream(i);
+				if (result != FR_OK) {
+					LOG_ERROR("Failed to open %s log file with error code %d", desc->name, result);
+					continue;
+				}
+				state->open = true;
+			}
+			if (state->card_failed && (xTaskGetTickCount() - state->card_retry_tick) >= STORAGE_CARD_RETRY_MS) {
+				storage_card_retry(i, state);
+			}
+			for (n = desc->queue_capacity / STORAGE_PASS_SHARE; n > 0 && spsc_queue_pop(&state->queue, &record); n--) {
+				storage_store(desc, state, &record, phase);
+				idle = false;
+			}
+		}
+#ifdef STORAGE_MIRROR
+		flash_log_poll();
+#endif
+		kernel_trace_flush();
+		if ((xTaskGetTickCount() - last_report) >= STORAGE_REPORT_PERIOD_MS) {
+			last_report = xTaskGetTickCount();
+			storage_report();
+		}
+		if (phase == FLIGHT_PHASE_LANDED && !session_reported) {
+			session_reported = true;
+			storage_report_session();
+		}
+		if (idle) {
+			vTaskDelay(STORAGE_IDLE_PERIOD_MS);
+		}
+	}
+}
+
+bool storage_get_stats(int stream, storage_stats_t* stats) {
+	const storage_stream_state_t* state;
+	if (stream < 0 || stream >= STORAGE_STREAM_COUNT) return false;
+	state = &storage_state[stream];
+	stats->name = storage_streams[stream].name;
+	stats->capacity = spsc_queue_capacity(&state->queue);
+	stats->count = spsc_queue_count(&state->queue);
+	stats->high_water = state->queue.high_water;
+	stats->dropped = state->queue.dropped;
+	stats->written = state->written;
+	stats->card_errors = state->card_errors;
+	stats->card_missed = state->card_missed;
+	stats->open = state->open;
+	return true;
+}
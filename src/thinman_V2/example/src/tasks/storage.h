@@ -0,0 +1,99 @@
+/*
+ * storage.h
+ *
+ *  Storage writer. Producer tasks push records into per-stream SPSC queues
+ *  and never touch FatFs; a single low-priority task owns the TAB files and
+ *  the pre-trigger rings, so an SD stall in f_sync only backs up the queues.
+ */
+
+#ifndef STORAGE_H_
+#define STORAGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ff.h"
+
+// Mirror every TAB stream to the S25FL as well as the card (tasks/flash_log.h).
+// Without a flash fitted the mirror stays off on its own.
+#define STORAGE_MIRROR
+
+typedef enum {
+	STORAGE_BARO,
+	STORAGE_IMU,
+	STORAGE_HIGHG,
+	STORAGE_VOLTS,
+	STORAGE_GPS,		// Raw NMEA bytes, one char per record
+	STORAGE_STREAM_COUNT,
+} storage_stream_t;
+
+// Samples are stamped with timebase_us() when the sensor reports data ready, just before the burst read
+typedef struct {
+	uint32_t t_us;
+	int32_t pressure_raw;
+	int16_t temp_raw;
+	bool logged;	// Set by the writer for rows already written at the pad rate
+} baro_record_t;
+
+// Raw LSM counts; scale with LSM_*_fs_* only for display. In coast and descent
+// accel and gyro are filtered down to fewer rows (tasks/acquisition.c), in the same counts.
+// The attitude is left out to keep the queue and pretrigger ring small; it follows
+// from these rows by running them through flight/attitude.c on the ground.
+typedef struct {
+	uint32_t t_us;
+	int16_t accel[3];
+	int16_t gyro[3];
+	int16_t mag[3];		// Latest magnetometer sample; it updates at 80 Hz
+	bool logged;
+} imu_record_t;
+
+typedef struct {
+	uint32_t t_us;
+	int16_t accel[3];
+	bool logged;
+} highg_record_t;
+
+// Firing board status block
+typedef struct {
+	uint32_t tick;
+	float vext;
+	float vbus;
+	uint16_t channel_raw[4];	// 12-bit counts; the board compares them against vext
+	uint8_t mode;				// firing_board_mode_t
+	uint8_t fire_count;
+} volts_record_t;
+
+typedef struct {
+	const char* name;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t high_water;	// Largest queue occupancy seen
+	uint32_t dropped;		// Records refused because the queue was full
+	uint32_t written;
+	uint32_t card_errors;	// Failed card writes and syncs; each closes the file until a retry
+	uint32_t card_missed;	// Bytes written while the card file was closed
+	bool open;
+} storage_stats_t;
+
+// Set up the queues. Call before any producer task is created.
+void storage_init(void);
+
+// Called once the card is mounted. Until then the writer touches neither FatFs nor the queues.
+void storage_volume_ready(void);
+
+// Ask the writer to open the next free <name>.TAB for stream. Producers call this once
+// their device is initialized, so headers carry the configured scales. Records pushed
+// before the file is open wait in the queue.
+void storage_open(storage_stream_t stream);
+
+// Producer side; one producer task per stream. Returns false when the record was dropped.
+bool storage_push(storage_stream_t stream, const void* record);
+
+void task_storage(void* pvParameters);
+
+// Opens the first of <base>.<extension>, <base>1.<extension>, ... that does not exist yet.
+// Writer task only.
+FRESULT storage_open_next(FIL* f, const char* base, const char* extension);
+
+bool storage_get_stats(int stream, storage_stats_t* stats);
+
+#endif /* STORAGE_H_ */
@@ -0,0 +1,124 @@
+/*
+ * warm_restart.c
+ *
+ *  Every update rewrites the CRC inside a critical section. A reset in the
+ *  middle of an update leaves a bad CRC, which reads as a cold boot.
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <cr_section_macros.h>
+#include "chip.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "drivers/crc.h"
+#include "warm_restart.h"
+
+#define WARM_RESTART_MAGIC		0x574d5253	// "WMRS"
+#define WARM_RESTART_VERSION	1
+// A fault that keeps recurring halts in exit_error instead of reset-looping
+#define WARM_RESTART_LIMIT		5
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t phase;
+	uint8_t restarts;
+	int32_t last_error;
+	uint16_t file_number[STORAGE_STREAM_COUNT];
+	uint32_t file_offset[STORAGE_STREAM_COUNT];
+	uint16_t crc;					// crc_crc16 of everything above
+} warm_restart_block_t;
+
+// Left alone by the startup code, so it keeps its contents across a reset
+__NOINIT_DEF static warm_restart_block_t warm_block;
+
+static bool warm_restart;
+static uint32_t warm_reset_cause;
+static int warm_last_error;
+
+static uint16_t warm_restart_crc(void) {
+	return crc_crc16(&warm_block, offsetof(warm_restart_block_t, crc));
+}
+
+static void warm_restart_clear(void) {
+	int i;
+	memset(&warm_block, 0, sizeof(warm_block));
+	warm_block.magic = WARM_RESTART_MAGIC;
+	warm_block.version = WARM_RESTART_VERSION;
+	warm_block.phase = FLIGHT_PHASE_PAD;
+	for (i = 0; i < STORAGE_STREAM_COUNT; i++) {
+		warm_block.file_number[i] = WARM_RESTART_NO_FILE;
+	}
+	warm_block.crc = warm_restart_crc();
+}
+
+void warm_restart_init(void) {
+	bool valid;
+	warm_reset_cause = Chip_SYSCTL_GetSystemRSTStatus();
+	Chip_SYSCTL_ClearSystemRSTStatus(warm_reset_cause);
+
+	// RAM contents are undefined after power-on even if the CRC happens to match
+	valid = !(warm_reset_cause & SYSCTL_RST_POR) && warm_block.magic == WARM_RESTART_MAGIC &&
+			warm_block.version == WARM_RESTART_VERSION && warm_block.crc == warm_restart_crc();
+	warm_restart = valid && flight_phase_is_full_rate(warm_block.phase);
+	if (!warm_restart) {
+		warm_restart_clear();
+		return;
+	}
+	warm_last_error = warm_block.last_error;
+	warm_block.last_error = 0;
+	if (warm_block.restarts < 0xff) {
+		warm_block.restarts++;
+	}
+	warm_block.crc = warm_restart_crc();
+}
+
+bool warm_restart_is_warm(void) {
+	return warm_restart;
+}
+
+flight_phase_t warm_restart_phase(void) {
+	return warm_block.phase;
+}
+
+uint32_t warm_restart_reset_cause(void) {
+	return warm_reset_cause;
+}
+
+uint32_t warm_restart_count(void) {
+	return warm_block.restarts;
+}
+
+int warm_restart_last_error(void) {
+	return warm_last_error;
+}
+
+void warm_restart_save_phase(flight_phase_t phase) {
+	taskENTER_CRITICAL();
+	warm_block.phase = phase;
+	warm_block.crc = warm_restart_crc();
+	taskEXIT_CRITICAL();
+}
+
+void warm_restart_save_file(storage_stream_t stream, uint16_t number, uint32_t offset) {
+	taskENTER_CRITICAL();
+	warm_block.file_number[stream] = number;
+	warm_block.file_offset[stream] = offset;
+	warm_block.crc = warm_restart_crc();
+	taskEXIT_CRITICAL();
+}
+
+bool warm_restart_get_file(storage_stream_t stream, uint16_t* number, uint32_t* offset) {
+	if (!warm_restart || warm_block.file_number[stream] == WARM_RESTART_NO_FILE) return false;
+	*number = warm_block.file_number[stream];
+	*offset = warm_block.file_offset[stream];
+	return true;
+}
+
+void warm_restart_on_fatal(int error_code) {
+	if (!flight_phase_is_full_rate(warm_block.phase) || warm_block.restarts >= WARM_RESTART_LIMIT) return;
+	warm_block.last_error = error_code;
+	warm_block.crc = warm_restart_crc();
+	NVIC_SystemReset();
+}
@@ -9,7 +9,7 @@
 
 #include "diskio.h"		/* FatFs lower layer API */
 #include "drivers/sdcard.h"		/* Example: MMC/SDC control */
-#include "drivers/S25FL.h"
+#include "drivers/ftl.h"
 #include "logging.h"
 
 /* Definitions of physical drive number for each drive */
@@ -40,7 +40,7 @@ DSTATUS disk_status (
 		return STA_NOINIT;
 
 	case SPIFLASH :
-		if (S25FL_initialized()) {
+		if (ftl_ready()) {
 			return 0;
 		}
 		return STA_NOINIT;
@@ -75,7 +75,7 @@ DSTATUS disk_initialize (
 
 		return stat;
 	case SPIFLASH:
-		if (S25FL_initialized()) {
+		if (ftl_ready() || ftl_init()) {
 			return 0;
 		}
 		return STA_NOINIT;
@@ -109,9 +109,7 @@ DRESULT disk_read (
 
 		return res;
 	case SPIFLASH:
-		S25FL_read_sectors(buff, sector, count);
-//		LOG_DEBUG("read sect %d + %d", sector, count);
-		return 0;
+		return ftl_read(buff, sector, count) ? RES_OK : RES_ERROR;
 	}
 
 	LOG_ERROR("Read fall through for pdrv %d", pdrv);
@@ -149,9 +147,7 @@ DRESULT disk_write (
 
 		return res;
 	case SPIFLASH:
-		S25FL_write_sectors(buff, sector, count);
-//		LOG_DEBUG("wrote sect %d + %d", sector, count);
-		return 0;
+		return ftl_write(buff, sector, count) ? RES_OK : RES_ERROR;
 	}
 
 	LOG_ERROR("Write fall through with pdrv %d", pdrv);
@@ -191,17 +187,20 @@ DRESULT disk_ioctl (
 
 	case SPIFLASH :
 
-		// Process of the command for the MMC/SD card
+		// The FTL writes through, and remaps, so no alignment helps it
 		if (cmd == CTRL_SYNC) {
 			res = 0;
 		} else if (cmd == GET_SECTOR_COUNT) {
-			*((DWORD*)buff) = S25FL_SECTOR_COUNT;
+			*((DWORD*)buff) = FTL_SECTOR_COUNT;
 			res = 0;
 		} else if (cmd == GET_SECTOR_SIZE) {
-			*((DWORD*)buff) = S25FL_SECTOR_SIZE;
+			*((DWORD*)buff) = FTL_SECTOR_SIZE;
 			res = 0;
 		} else if (cmd == GET_BLOCK_SIZE) {
-			*((DWORD*) buff) = S25FL_BLOCK_SIZE / S25FL_SECTOR_SIZE;
+			*((DWORD*) buff) = 1;
+			res = 0;
+		} else if (cmd == CTRL_ERASE_SECTOR) {
+			ftl_trim(((DWORD*) buff)[0], ((DWORD*) buff)[1]);
 			res = 0;
 		}
 
@@ -39,6 +39,7 @@ int ff_cre_syncobj (	/* 1:Function succeeded, 0:Could not create due to any erro
 
   *sobj = xSemaphoreCreateMutex();	/* FreeRTOS */
 	ret = (int)(*sobj != NULL);
+	if (ret) vQueueAddToRegistry(*sobj, "FatFs");
 
 	return ret;
 }
@@ -0,0 +1,166 @@
+# Request-to-fire timing of the firing board (src/firing_board), from its own
+# code: firing_board.c is compiled for the host with FIRING_BOARD_HOST and
+# driven through ctypes. This script plays the flight computer's fire
+# command (drivers/firing_board.c) and steps the board clock, calling the
+# Timer0 tick at every millisecond as the interrupt would.
+#
+#   python fire_check.py [--requests N] [--seed N]
+#
+# For each arm-to-fire delay it sends FIRE at random points within a
+# millisecond and checks:
+#   - a zero delay asserts the channel before the command returns, so before
+#     the reply goes out
+#   - any other delay asserts it on the tick of the deadline, more than
+#     delay - 1 ms and at most delay after the request; a FIRE without a
+#     delay takes the 2 s default
+#   - the board's READ_FIRE_STATUS stamps agree with when the pin went high
+#   - the pulse lasts FIRE_PULSE_MS, give or take the tick
+#   - requests over 10 s, while armed, or without power are refused
+# Exits non-zero on any failure.
+#
+# Board time only: interrupts do not nest on the ATtiny, so on the board a
+# tick can also wait out a USI or ADC handler, and the I2C transfer itself
+# adds to what pyro.c measures on the flight computer. Those need hardware.
+import argparse
+import ctypes
+import os
+import random
+import struct
+import sys
+import host_build
+
+BOARD = os.path.join(host_build.HERE, '..', 'firing_board', 'firing_board', 'firing_board')
+
+FIRE = 3                # I2C_COMMAND_FIRE
+READ_FIRE_STATUS = 4
+SYSTEM_MODE_NO_POWER = 1
+SYSTEM_MODE_READY = 2
+FIRE_STATE_PULSE = 2
+FIRE_STATE_DONE = 3
+CHANNEL_PINS = [6, 4, 1, 3]
+MASTER_ARM = 1          # PORTB, active low
+DEFAULT_DELAY_MS = 2000
+MAX_DELAY_MS = 10000
+PULSE_MS = 10
+STEP_US = 8             # Timer0 count at clk/64, which board_host_wait steps by
+
+
+class Board(object):
+    def __init__(self):
+        self.lib = host_build.load([os.path.join(BOARD, 'firing_board.c'), 'host/firing_board/board_host.c'],
+                                   defines=['FIRING_BOARD_HOST'], includes=['host/firing_board', BOARD],
+                                   extra=['-fshort-enums', '-fgnu89-inline'])
+        self.porta = ctypes.c_uint8.in_dll(self.lib, 'PORTA')
+        self.portb = ctypes.c_uint8.in_dll(self.lib, 'PORTB')
+        self.mode = ctypes.c_uint8.in_dll(self.lib, 'system_mode')
+        self.lib.timebase_us.restype = ctypes.c_uint32
+        self.lib.board_host_wait.restype = ctypes.c_uint32
+        self.portb.value = 1 << MASTER_ARM
+        self.mode.value = SYSTEM_MODE_READY
+
+    def command(self, *data):
+        self.lib.board_host_request(struct.pack('%dB' % len(data), *data), len(data))
+        reply = ctypes.create_string_buffer(16)
+        length = self.lib.board_host_reply(reply)
+        return reply.raw[:length]
+
+    def fire(self, channel, delay_ms=None):
+        if delay_ms is None:
+            return self.command(FIRE, channel) == '\0'
+        return self.command(FIRE, channel, delay_ms & 0xff, delay_ms >> 8) == '\0'
+
+    def status(self):
+        """channel, fire state, request us, pin assert us, now us"""
+        return struct.unpack('<BBIII', self.command(READ_FIRE_STATUS)[1:])
+
+    def asserted(self, channel):
+        pin = self.porta.value & (1 << CHANNEL_PINS[channel - 1])
+        return bool(pin) and not self.portb.value & (1 << MASTER_ARM)
+
+    def wait(self, channel, level, limit_us):
+        """Steps the clock until the channel is asserted, or released; returns the us taken."""
+        return self.lib.board_host_wait(1 << CHANNEL_PINS[channel - 1], level, limit_us)
+
+    def now(self):
+        return self.lib.timebase_us()
+
+    def advance(self, us):
+        self.lib.board_host_advance(us)
+
+
+def check_delay(board, rng, delay_ms, requests):
+    """Latencies in ms and failures for one delay; None sends FIRE without one."""
+    expect = DEFAULT_DELAY_MS if delay_ms is None else delay_ms
+    latencies, pulses, failures = [], [], []
+    for n in range(requests):
+        channel = rng.randint(1, 4)
+        board.advance(rng.randrange(1000))
+        start = board.now()
+        if not board.fire(channel, delay_ms):
+            failures.append('refused at %d us' % start)
+            continue
+        if expect == 0 and not board.asserted(channel):
+            failures.append('zero delay not asserted when the reply went out')
+        limit = (expect + 2) * 1000
+        if board.wait(channel, True, limit) == limit:
+            failures.append('delay %d: never fired' % expect)
+            continue
+        seen = board.now()
+        pulses.append(board.wait(channel, False, (PULSE_MS + 2) * 1000) / 1000.0)
+        got_channel, state, request_us, done_us, now_us = board.status()
+        latency = (done_us - request_us) / 1000.0
+        latencies.append(latency)
+        if got_channel != channel or state != FIRE_STATE_DONE:
+            failures.append('status channel %d state %d after firing %d' % (got_channel, state, channel))
+        if request_us != start or abs(done_us - seen) >= STEP_US:
+            failures.append('stamps %d-%d, pin high from %d' % (request_us, done_us, seen))
+        if expect == 0 and latency != 0 or expect and not expect - 1 < latency <= expect:
+            failures.append('delay %d fired after %.3f ms' % (expect, latency))
+        if not PULSE_MS - 1 < pulses[-1] <= PULSE_MS + 1:
+            failures.append('pulse %.3f ms' % pulses[-1])
+        board.advance(5000)
+    return latencies, pulses, failures
+
+
+def check_refusals(board):
+    failures = []
+    if board.fire(1, MAX_DELAY_MS + 1):
+        failures.append('accepted a %d ms delay' % (MAX_DELAY_MS + 1))
+    if not board.fire(1, 100):
+        failures.append('refused a 100 ms delay')
+    elif board.fire(2, 0):
+        failures.append('accepted a request while armed')
+    board.advance(200 * 1000)
+    board.mode.value = SYSTEM_MODE_NO_POWER
+    if board.fire(1, 0):
+        failures.append('fired without power')
+    board.mode.value = SYSTEM_MODE_READY
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Firing board request-to-fire timing')
+    parser.add_argument('--requests', type=int, default=50, help='requests per delay')
+    parser.add_argument('--seed', type=int, default=1)
+    opts = parser.parse_args()
+    rng = random.Random(opts.seed)
+    board = Board()
+    ok = True
+    print '%-9s %9s %10s %10s %10s %s' % ('delay ms', 'requests', 'min ms', 'max ms', 'pulse ms', 'result')
+    for delay_ms in [0, 1, 100, DEFAULT_DELAY_MS, None, MAX_DELAY_MS]:
+        latencies, pulses, failures = check_delay(board, rng, delay_ms, opts.requests)
+        ok = ok and not failures
+        print '%-9s %9d %10.3f %10.3f %10.3f %s' % (
+            'default' if delay_ms is None else delay_ms, len(latencies), min(latencies or [0]),
+            max(latencies or [0]), max(pulses or [0]), 'ok' if not failures else 'BAD')
+        for failure in failures[:5]:
+            print '          ' + failure
+    failures = check_refusals(board)
+    ok = ok and not failures
+    print 'refusals: ' + ('ok' if not failures else ', '.join(failures))
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,95 @@
+# Host side of the frames in example/src/tasks/frame.h, shared by download.py
+# (USB) and xfer_get.py (Bluetooth).
+import binascii
+import struct
+import time
+
+SYNC = 0xd5
+HEADER = struct.Struct('<BBHI')
+MAX_PAYLOAD = 512
+ABANDONED = 0x102
+ERRORS = {
+    0x100: 'timed out waiting for acks',
+    0x101: 'bad request',
+    0x102: 'abandoned for another request',
+    0x103: 'link lost',
+}
+
+
+class FrameError(Exception):
+    pass
+
+
+def error_text(code):
+    return ERRORS.get(code, 'FatFs error %d' % code)
+
+
+class FrameLink(object):
+    def __init__(self, sp):
+        self.sp = sp
+        self.buf = ''
+
+    def send(self, kind, arg=0, payload=''):
+        body = struct.pack('<BHI', ord(kind), len(payload), arg) + payload
+        self.sp.write(chr(SYNC) + body + struct.pack('<H', binascii.crc_hqx(body, 0)))
+
+    def receive(self, timeout):
+        """Next good frame as (type, arg, payload), or None after timeout seconds."""
+        deadline = time.time() + timeout
+        while True:
+            frame = self._parse()
+            if frame:
+                return frame
+            if time.time() > deadline:
+                return None
+            data = self.sp.read(4096)
+            if not data and self.buf:
+                # A frame's bytes come together, so a start left waiting on a quiet link had its
+                # length damaged; look for the next sync rather than wait for bytes that are not coming
+                self.buf = self.buf[1:]
+            self.buf += data
+
+    def _parse(self):
+        while True:
+            start = self.buf.find(chr(SYNC))
+            if start < 0:
+                self.buf = ''
+                return None
+            self.buf = self.buf[start:]
+            if len(self.buf) < HEADER.size:
+                return None
+            _, kind, length, arg = HEADER.unpack_from(self.buf)
+            if length > MAX_PAYLOAD:
+                self.buf = self.buf[1:]
+                continue
+            end = HEADER.size + length
+            if len(self.buf) < end + 2:
+                return None
+            crc, = struct.unpack_from('<H', self.buf, end)
+            if binascii.crc_hqx(self.buf[1:end], 0) != crc:
+                self.buf = self.buf[1:]
+                continue
+            frame = (chr(kind), arg, self.buf[HEADER.size:end])
+            self.buf = self.buf[end + 2:]
+            return frame
+
+    def receive_range(self, out, offset, end, timeout):
+        """Writes data frames for [offset, end) to out, acking each one. Returns the 'c' CRC."""
+        expected = offset
+        while True:
+            frame = self.receive(timeout)
+            if frame is None:
+                raise FrameError('stalled at offset %d' % expected)
+            kind, arg, payload = frame
+            if kind == 'd':
+                # Out of order frames are dropped; the repeated ack sends the board back
+                if arg == expected:
+                    out.write(payload)
+                    expected += len(payload)
+                self.send('A', expected)
+            elif kind == 'c':
+                if expected != end:
+                    raise FrameError('complete at %d, expected %d' % (expected, end))
+                return arg
+            elif kind == 'x':
+                raise FrameError(error_text(arg))
@@ -75,7 +75,7 @@ void vApplicationMallocFailedHook(void)
 void vApplicationIdleHook(void)
 {
 	/* Best to sleep here until next systick */
-	neopixel_refresh_now();
+	neopixel_refresh_idle();
 	__WFI();
 }
 
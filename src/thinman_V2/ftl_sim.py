@@ -0,0 +1,430 @@
+# Write amplification and throughput of the flash translation layer
+# (example/src/drivers/ftl.c) under the storage writer's workload, on a model
+# of the S25FL. ftl.c is compiled for the host with host_build, with the
+# S25FL calls served by the model here. FatFs is modelled as far as
+# it decides which sectors are written: each file has its own sector buffer,
+# the FAT and directory share one window that is written back when it moves,
+# clusters are one sector, and f_sync writes the file's partial sector and
+# its directory sector. Each session logs the five TAB files at the pad and
+# flight rates of mirror_sim.py, deleting the oldest session when space
+# runs short. For comparison, it also gives the cost of the old in-place
+# mapping, which erased 4 kB for every write.
+#
+# --powercut N instead cuts power N times at a random flash operation of
+# random writes, remounts, and checks every sector reads back as written.
+#
+#   python ftl_sim.py [--blocks N] [--sessions N] [--pad S] [--seconds S] [--no-trim] [--powercut N] [--seed N]
+import argparse
+import ctypes
+import random
+import struct
+import sys
+import host_build
+import mirror_sim
+
+SECTOR = 512
+BLOCK = 0x10000
+TAG_SLOTS = 4
+SLOTS = BLOCK // SECTOR - TAG_SLOTS
+SPARE_BLOCKS = 2
+
+# S25FL128S typical times, with SPI1 at 12 MHz
+SPI_BYTES_PER_MS = 12e6 / 8 / 1000
+PROGRAM_MS = 0.25
+ERASE_MS = 130.0
+COMMAND = 4
+
+
+class PowerCut(Exception):
+    pass
+
+
+class Nor(object):
+    """The flash, as the host S25FL.c calls it. program and erase return True
+    once the power has failed."""
+    def __init__(self, size):
+        self.data = bytearray('\xff' * size)
+        self.ms = 0.0
+        self.erases = 0
+        self.programmed = 0
+        self.cut_at = None      # Operations left before the power fails
+        self.rng = random.Random(0)
+
+    def tick(self):
+        if self.cut_at is not None:
+            self.cut_at -= 1
+            return self.cut_at < 0
+        return False
+
+    def read(self, address, length):
+        self.ms += (COMMAND + length) / SPI_BYTES_PER_MS
+        return bytes(self.data[address:address + length])
+
+    def program(self, address, data):
+        assert address // 256 == (address + len(data) - 1) // 256, 'program crosses a page'
+        cut = self.tick()
+        if cut:
+            data = data[:self.rng.randint(0, len(data))]
+        for i, b in enumerate(bytearray(data)):
+            self.data[address + i] &= b
+        self.ms += (COMMAND + len(data)) / SPI_BYTES_PER_MS + PROGRAM_MS
+        self.programmed += len(data)
+        return cut
+
+    def erase(self, address):
+        if self.tick():
+            # Part of the block cleared
+            for i in range(self.rng.randint(0, BLOCK)):
+                self.data[address + self.rng.randrange(BLOCK)] = 0xff
+            return True
+        self.data[address:address + BLOCK] = '\xff' * BLOCK
+        self.ms += ERASE_MS
+        self.erases += 1
+        return False
+
+
+class Stats(ctypes.Structure):
+    """ftl_stats_t"""
+    _fields_ = [('writes', ctypes.c_uint32), ('copies', ctypes.c_uint32), ('erases', ctypes.c_uint32),
+                ('min_erases', ctypes.c_uint16), ('max_erases', ctypes.c_uint16)]
+
+
+READ = ctypes.CFUNCTYPE(None, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint8), ctypes.c_uint32)
+PROGRAM = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint8), ctypes.c_uint32)
+ERASE = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_uint32)
+
+
+def library(blocks):
+    return host_build.load(['drivers/ftl.c', 'drivers/crc.c', 'host/S25FL.c', 'host/ftl_host.c', 'host/host.c'],
+                           defines=['FTL_BLOCKS=%d' % blocks])
+
+
+class Ftl(object):
+    """drivers/ftl.c, compiled for the host, on a Nor"""
+    def __init__(self, nor, blocks):
+        self.nor = nor
+        self.lib = library(blocks)
+        self.sector_count = (blocks - SPARE_BLOCKS) * SLOTS
+        self.error = None
+
+        # Exceptions cannot pass back through the C, so they stop it like a power cut
+        def read(address, buffer, length):
+            try:
+                ctypes.memmove(buffer, nor.read(address, length), length)
+            except Exception as e:
+                self.error = self.error or e
+
+        def program(address, buffer, length):
+            try:
+                return nor.program(address, ctypes.string_at(buffer, length))
+            except Exception as e:
+                self.error = self.error or e
+                return 1
+
+        def erase(address):
+            try:
+                return nor.erase(address)
+            except Exception as e:
+                self.error = self.error or e
+                return 1
+        self.callbacks = (READ(read), PROGRAM(program), ERASE(erase))
+        self.lib.S25FL_host_connect(*self.callbacks)
+
+    def call(self, result, failure):
+        if self.error:
+            raise self.error
+        if result < 0:
+            raise PowerCut()
+        if not result:
+            raise RuntimeError(failure)
+
+    def init(self):
+        self.call(self.lib.ftl_host_init(), 'ftl_init failed')
+
+    def read(self, sector):
+        buffer = ctypes.create_string_buffer(SECTOR)
+        self.call(self.lib.ftl_host_read(buffer, sector, 1), 'ftl_read failed')
+        return buffer.raw
+
+    def write(self, sector, data):
+        self.call(self.lib.ftl_host_write(data, sector, 1), 'FTL has no block to collect')
+
+    def trim(self, first, last):
+        self.lib.ftl_trim(first, last)
+
+    def stats(self):
+        stats = Stats()
+        self.lib.ftl_get_stats(ctypes.byref(stats))
+        return stats
+
+
+class Disk(object):
+    """disk_write and friends, timing each call"""
+    def __init__(self, ftl):
+        self.ftl = ftl
+        self.slowest = 0.0
+        self.calls = 0
+
+    def write(self, sector, data):
+        start = self.ftl.nor.ms
+        self.ftl.write(sector, bytes(data))
+        self.slowest = max(self.slowest, self.ftl.nor.ms - start)
+        self.calls += 1
+
+    def read(self, sector):
+        return self.ftl.read(sector)
+
+
+class File(object):
+    def __init__(self, name, entry):
+        self.name = name
+        self.entry = entry
+        self.clusters = []
+        self.size = 0
+        self.buffer = bytearray(SECTOR)
+        self.dirty = False
+
+
+class Fat(object):
+    """The sector traffic of FatFs on a FAT12 volume of one sector clusters, after f_mkfs."""
+    def __init__(self, disk, sectors, trim):
+        self.disk = disk
+        self.trim = trim
+        self.root_sectors = 512 * 32 // SECTOR
+        clusters = sectors - 1 - self.root_sectors
+        self.fat_sectors = ((clusters + 2) * 3 // 2 + SECTOR - 1) // SECTOR
+        self.clusters = sectors - 1 - self.fat_sectors - self.root_sectors
+        self.data_start = 1 + self.fat_sectors + self.root_sectors
+        self.fat = [0] * (self.clusters + 2)
+        self.last = 1
+        self.window = None
+        self.window_dirty = False
+        self.entries = {}
+        for sector in range(self.data_start):
+            disk.write(sector, bytearray(SECTOR))
+        if trim:
+            disk.ftl.trim(self.data_start, sectors - 1)
+
+    def free(self):
+        return self.fat[2:].count(0)
+
+    def move_window(self, sector):
+        if sector == self.window:
+            return
+        if self.window_dirty:
+            self.disk.write(self.window, bytearray(SECTOR))
+            self.window_dirty = False
+        self.disk.read(sector)
+        self.window = sector
+
+    def touch(self, sector):
+        self.move_window(sector)
+        self.window_dirty = True
+
+    def fat_sector(self, cluster):
+        return 1 + cluster * 3 // 2 // SECTOR
+
+    def dir_sector(self, entry):
+        return 1 + self.fat_sectors + entry * 32 // SECTOR
+
+    def allocate(self, previous):
+        cluster = self.last
+        for i in range(self.clusters):
+            cluster = cluster + 1 if cluster + 1 < self.clusters + 2 else 2
+            if self.fat[cluster] == 0:
+                break
+        else:
+            raise RuntimeError('volume full')
+        self.touch(self.fat_sector(cluster))
+        self.fat[cluster] = 0xfff
+        if previous is not None:
+            self.touch(self.fat_sector(previous))
+            self.fat[previous] = cluster
+        self.last = cluster
+        return cluster
+
+    def create(self, name):
+        entry = min(set(range(512)) - set(f.entry for f in self.entries.values()))
+        f = File(name, entry)
+        self.entries[name] = f
+        self.touch(self.dir_sector(entry))
+        return f
+
+    def write(self, f, data):
+        while data:
+            offset = f.size % SECTOR
+            if offset == 0:
+                if f.dirty:
+                    self.disk.write(self.data_start + f.clusters[-1] - 2, f.buffer)
+                    f.dirty = False
+                f.clusters.append(self.allocate(f.clusters[-1] if f.clusters else None))
+            n = min(SECTOR - offset, len(data))
+            f.buffer[offset:offset + n] = data[:n]
+            f.dirty = True
+            f.size += n
+            data = data[n:]
+
+    def sync(self, f):
+        if f.dirty:
+            self.disk.write(self.data_start + f.clusters[-1] - 2, f.buffer)
+            f.dirty = False
+        self.touch(self.dir_sector(f.entry))
+        self.disk.write(self.window, bytearray(SECTOR))
+        self.window_dirty = False
+
+    def unlink(self, name):
+        f = self.entries.pop(name)
+        runs = []
+        for cluster in f.clusters:
+            self.touch(self.fat_sector(cluster))
+            self.fat[cluster] = 0
+            if runs and runs[-1][1] + 1 == cluster:
+                runs[-1][1] = cluster
+            else:
+                runs.append([cluster, cluster])
+        # _USE_ERASE: remove_chain hands each run to CTRL_ERASE_SECTOR
+        for first, last in runs if self.trim else []:
+            self.disk.ftl.trim(self.data_start + first - 2, self.data_start + last - 2)
+        self.touch(self.dir_sector(f.entry))
+        self.disk.write(self.window, bytearray(SECTOR))
+        self.window_dirty = False
+
+
+def session(fat, number, opts, rng):
+    files = []
+    for i, desc in enumerate(mirror_sim.STREAMS):
+        name, period, pretriggered, sync_every, header, row = desc
+        f = fat.create('%s%d.TAB' % (name, number))
+        files.append([f, desc, 0])
+        if header:
+            fat.write(f, header)
+    for t in range(0, int((opts.pad + opts.seconds) * 1000), mirror_sim.WRITER_PERIOD_MS):
+        flight = t >= opts.pad * 1000
+        for entry in files:
+            f, (name, period, pretriggered, sync_every, header, row), unsynced = entry
+            period = period if flight or not pretriggered else mirror_sim.PAD_PERIOD_MS
+            rows = 10 if period == 0 else len(range((t // period + (t % period != 0)) * period, t + mirror_sim.WRITER_PERIOD_MS, period))
+            for i in range(rows):
+                fat.write(f, row(rng, t))
+                entry[2] += 1
+                if entry[2] >= sync_every:
+                    entry[2] = 0
+                    fat.sync(f)
+    for f, desc, unsynced in files:
+        fat.sync(f)
+    return [f.name for f, desc, unsynced in files]
+
+
+def workload(opts):
+    rng = random.Random(opts.seed)
+    nor = Nor(opts.blocks * BLOCK)
+    ftl = Ftl(nor, opts.blocks)
+    ftl.init()
+    disk = Disk(ftl)
+    fat = Fat(disk, ftl.sector_count, not opts.no_trim)
+    setup_writes, setup_ms = ftl.stats().writes, nor.ms
+    history = []
+    logged = 0
+    print '%d kB volume, %d sectors' % (ftl.sector_count * SECTOR // 1024, ftl.sector_count)
+    print '%-8s %9s %9s %9s %7s %7s %9s' % ('session', 'kB', 'writes', 'copies', 'erases', 'WA', 'slowest')
+    for number in range(1, opts.sessions + 1):
+        # Make room the way a ground crew would, oldest session first
+        while history and fat.free() < fat.clusters * 6 // 10:
+            for name in history.pop(0):
+                fat.unlink(name)
+        before = ftl.stats()
+        disk.slowest = 0.0
+        size = sum(f.size for f in fat.entries.values())
+        try:
+            history.append(session(fat, number, opts, rng))
+        except RuntimeError as e:
+            print 'session %d: %s' % (number, e)
+            break
+        size = sum(f.size for f in fat.entries.values()) - size
+        logged += size
+        after = ftl.stats()
+        writes, copies, erases = after.writes - before.writes, after.copies - before.copies, after.erases - before.erases
+        print '%-8d %9d %9d %9d %7d %7.2f %7.0fms' % (number, size // 1024, writes, copies, erases,
+                                                     float(writes + copies) / writes, disk.slowest)
+    stats = ftl.stats()
+    writes = stats.writes - setup_writes
+    ms = nor.ms - setup_ms
+    if logged == 0:
+        return
+    print
+    print 'FatFs wrote %d sectors for %d kB of rows: %.2f sectors per sector of rows' % (
+        writes, logged // 1024, float(writes) * SECTOR / logged)
+    print 'FTL: write amplification %.2f (%.2f counting tags and headers), %d erases, erase counts %d-%d' % (
+        float(stats.writes + stats.copies) / stats.writes, float(nor.programmed) / (stats.writes * SECTOR),
+        stats.erases, stats.min_erases, stats.max_erases)
+    print '     %.0f kB/s of rows, %.0f kB/s of sectors, flash busy %.1f%% of the %.0f s logged' % (
+        logged / ms, writes * SECTOR / ms, 100 * ms / (opts.sessions * (opts.pad + opts.seconds) * 1000),
+        opts.sessions * (opts.pad + opts.seconds))
+    in_place = writes * (ERASE_MS + 16 * (PROGRAM_MS + (COMMAND + 256) / SPI_BYTES_PER_MS))
+    print 'In place, erasing 4 kB a write: %d erases, %.0f kB/s of rows' % (writes, logged / in_place)
+
+
+def powercut(opts):
+    rng = random.Random(opts.seed)
+    nor = Nor(opts.blocks * BLOCK)
+    nor.rng = rng
+    ftl = Ftl(nor, opts.blocks)
+    ftl.init()
+    # Hot sectors like a FAT, and a cold sequential run like file data
+    hot = range(0, 16)
+    written = {}
+    cuts = bad = 0
+    version = 0
+    while cuts < opts.powercut:
+        nor.cut_at = rng.randint(0, 3000)
+        pending = None
+        try:
+            while True:
+                if rng.random() < 0.5:
+                    sector = rng.choice(hot)
+                else:
+                    sector = rng.randrange(ftl.sector_count)
+                version += 1
+                data = struct.pack('<II', sector, version) * (SECTOR // 8)
+                pending = (sector, data)
+                ftl.write(sector, data)
+                written[sector] = data
+                pending = None
+        except PowerCut:
+            cuts += 1
+        nor.cut_at = None
+        ftl = Ftl(nor, opts.blocks)
+        ftl.init()
+        for sector in range(ftl.sector_count):
+            got = ftl.read(sector)
+            expect = [written.get(sector, '\0' * SECTOR)]
+            if pending and pending[0] == sector:
+                expect.append(pending[1])
+            if got not in expect:
+                bad += 1
+                print 'cut %d: sector %d reads wrong' % (cuts, sector)
+            elif pending and pending[0] == sector:
+                written[sector] = got
+    print '%d power cuts, %d sectors wrong, %d writes, %d erases' % (cuts, bad, version, nor.erases)
+    return bad == 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='FTL on a model of the S25FL')
+    parser.add_argument('--blocks', type=int, default=16, help='64 kB blocks in the partition, FTL_BLOCKS')
+    parser.add_argument('--sessions', type=int, default=4)
+    parser.add_argument('--pad', type=float, default=60, help='seconds at the pad rate per session')
+    parser.add_argument('--seconds', type=float, default=15, help='seconds at the flight rate per session')
+    parser.add_argument('--no-trim', action='store_true', help='as with _USE_ERASE 0')
+    parser.add_argument('--powercut', type=int, help='check recovery from this many power cuts instead')
+    parser.add_argument('--seed', type=int, default=1)
+    opts = parser.parse_args()
+    if opts.powercut:
+        if not powercut(opts):
+            sys.exit(1)
+    else:
+        workload(opts)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,38 @@
+/*
+ * FreeRTOS.h
+ *
+ *  Host stand-in for the parts of the kernel headers the modules built by
+ *  host_build.py use: the heap is malloc and there is one thread.
+ */
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint32_t portTickType;
+typedef portTickType TickType_t;
+typedef long portBASE_TYPE;
+typedef long BaseType_t;
+
+#define pdTRUE		1
+#define pdFALSE		0
+#define pdPASS		1
+#define pdFAIL		0
+#define portMAX_DELAY	0xffffffffUL
+#define portTICK_RATE_MS	1
+#define portTICK_PERIOD_MS	1
+
+// FreeRTOSConfig.h brings it in through board.h; host.c sets the LPC11U68's 48 MHz
+extern uint32_t SystemCoreClock;
+
+#define pvPortMalloc(size)	malloc(size)
+#define vPortFree(p)		free(p)
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
+
+#endif /* FREERTOS_H */
@@ -0,0 +1,32 @@
+/*
+ * chip.h
+ *
+ *  Host stand-in for the parts of the LPCOpen chip header that modules
+ *  built by host_build.py name. The I2C calls are in i2c_host.c and always
+ *  fail, as they would with nothing on the bus; the reset calls are in the
+ *  check's own stubs (warm_restart_host.c).
+ */
+
+#ifndef CHIP_H
+#define CHIP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef int I2C_ID_T;
+
+int Chip_I2C_MasterSend(I2C_ID_T id, uint8_t slave_address, const uint8_t* buffer, int length);
+int Chip_I2C_MasterCmdRead(I2C_ID_T id, uint8_t slave_address, uint8_t command, uint8_t* buffer, int length);
+
+// syscon_11u6x.h
+#define SYSCTL_RST_POR    (1 << 0)
+#define SYSCTL_RST_EXTRST (1 << 1)
+#define SYSCTL_RST_WDT    (1 << 2)
+#define SYSCTL_RST_BOD    (1 << 3)
+#define SYSCTL_RST_SYSRST (1 << 4)
+
+uint32_t Chip_SYSCTL_GetSystemRSTStatus(void);
+void Chip_SYSCTL_ClearSystemRSTStatus(uint32_t reset);
+void NVIC_SystemReset(void);
+
+#endif /* CHIP_H */
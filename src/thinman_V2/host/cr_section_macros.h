@@ -0,0 +1,15 @@
+/*
+ * cr_section_macros.h
+ *
+ *  Host stand-in for the LPCXpresso section macros: there is one RAM, and
+ *  a host process keeps no-init data only because nothing clears it.
+ */
+
+#ifndef CR_SECTION_MACROS_H
+#define CR_SECTION_MACROS_H
+
+#define __NOINIT_DEF
+#define __BSS(bank)
+#define __DATA(bank)
+
+#endif /* CR_SECTION_MACROS_H */
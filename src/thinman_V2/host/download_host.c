@@ -0,0 +1,270 @@
+/*
+ * download_host.c
+ *
+ *  Runs task_download (tasks/download.c) in a thread for download_check.py.
+ *  The VCOM endpoints are the master side of a pseudo terminal, so the
+ *  check talks to it through the same frame_link.py code download.py uses
+ *  on /dev/ttyACM0. The card is a directory on the host holding the files
+ *  the check registers, and the flash mirror a buffer it hands over.
+ *
+ *  Faults go in at the link, each at random with a chance of 1 in N: a
+ *  data frame from the board is dropped, a frame of any kind has a byte
+ *  flipped, or a read from the host has a byte flipped, which loses acks
+ *  and requests. A fixed period would line up with the window and drop the
+ *  same frame every time it is sent again.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "chip.h"
+#include "ff.h"
+#include "drivers/cdc_vcom.h"
+#include "flight/flight_phase.h"
+#include "tasks/frame.h"
+#include "tasks/flash_log.h"
+#include "tasks/download.h"
+
+#define HOST_MAX_FILES	32
+#define HOST_MAX_RUN	3			// Faults of a kind in a row, under download.py's REQUEST_RETRIES
+
+typedef struct {
+	uint32_t frames;			// Written by the board
+	uint32_t data_frames;
+	uint32_t dropped;
+	uint32_t corrupted;
+	uint32_t reads;				// From the host
+	uint32_t reads_corrupted;
+} download_host_stats_t;
+
+static int master = -1, slave = -1;
+static char root[256];
+static char files[HOST_MAX_FILES][13];
+static int file_count;
+static FILE* open_file;
+static const uint8_t* mirror;
+static uint32_t mirror_size;
+static uint32_t drop_every, corrupt_every, corrupt_read_every;
+static uint32_t fault_state = 1;
+static uint32_t drop_run, corrupt_run, corrupt_read_run;
+static download_host_stats_t stats;
+static pthread_t thread;
+static volatile bool running;
+
+// Opens the pseudo terminal and returns the path for the check to open, or NULL
+const char* download_host_open(const char* card) {
+	struct termios raw;
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) || unlockpt(master)) return NULL;
+	// Held open so the master never reads a hang-up between the check's opens
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if (slave < 0 || tcgetattr(slave, &raw)) return NULL;
+	cfmakeraw(&raw);
+	tcsetattr(slave, TCSANOW, &raw);
+	snprintf(root, sizeof(root), "%s", card);
+	return ptsname(master);
+}
+
+// Puts name, a file in the card directory, in the root listing
+void download_host_file(const char* name) {
+	if (file_count < HOST_MAX_FILES) {
+		snprintf(files[file_count++], sizeof(files[0]), "%s", name);
+	}
+}
+
+// The flash mirror ring; NULL leaves it not ready, as with no S25FL
+void download_host_mirror(const uint8_t* data, uint32_t size) {
+	mirror = data;
+	mirror_size = size;
+}
+
+// Chances of 1 in N; 0 turns a fault off
+void download_host_faults(uint32_t drop, uint32_t corrupt, uint32_t corrupt_read, uint32_t seed) {
+	drop_every = drop;
+	corrupt_every = corrupt;
+	corrupt_read_every = corrupt_read;
+	fault_state = seed | 1;
+	drop_run = corrupt_run = corrupt_read_run = 0;
+}
+
+// xorshift32, only called from the task's thread. At most HOST_MAX_RUN in a row, as more
+// would be a dead link, which download.py gives up on.
+static bool fault(uint32_t one_in, uint32_t* run) {
+	fault_state ^= fault_state << 13;
+	fault_state ^= fault_state >> 17;
+	fault_state ^= fault_state << 5;
+	if (one_in && fault_state % one_in == 0 && *run < HOST_MAX_RUN) {
+		(*run)++;
+		return true;
+	}
+	*run = 0;
+	return false;
+}
+
+void download_host_stats(download_host_stats_t* out) {
+	*out = stats;
+}
+
+static void* download_host_task(void* unused) {
+	task_download(NULL);
+	return NULL;
+}
+
+bool download_host_start(void) {
+	running = true;
+	return pthread_create(&thread, NULL, download_host_task, NULL) == 0;
+}
+
+// Waits up to timeout_ms for the task to leave download mode. Returns false, stopping it
+// anyway, if it did not.
+bool download_host_stop(uint32_t timeout_ms) {
+	uint32_t waited;
+	bool left;
+	for (waited = 0; running && waited < timeout_ms; waited += 10) {
+		usleep(10000);
+	}
+	left = !running;
+	if (!left) {
+		pthread_cancel(thread);
+	}
+	pthread_join(thread, NULL);
+	return left;
+}
+
+// Leaving download mode resets the board; here it ends the thread
+void NVIC_SystemReset(void) {
+	running = false;
+	pthread_exit(NULL);
+}
+
+uint32_t warm_restart_reset_cause(void) {
+	return SYSCTL_RST_POR;
+}
+
+// Download mode only starts on the pad
+flight_phase_t flight_phase_get(void) {
+	return FLIGHT_PHASE_PAD;
+}
+
+bool flight_phase_is_full_rate(flight_phase_t phase) {
+	return false;
+}
+
+uint32_t vcom_bread_timeout(uint8_t* pBuf, uint32_t buf_len, uint32_t timeout) {
+	struct pollfd fd = {master, POLLIN, 0};
+	ssize_t got;
+	if (poll(&fd, 1, timeout == portMAX_DELAY ? -1 : (int) (timeout * portTICK_PERIOD_MS)) <= 0) return 0;
+	got = read(master, pBuf, buf_len);
+	if (got <= 0) return 0;
+	stats.reads++;
+	if (fault(corrupt_read_every, &corrupt_read_run)) {
+		pBuf[got / 2] ^= 0x5a;
+		stats.reads_corrupted++;
+	}
+	return got;
+}
+
+bool vcom_write_all(const uint8_t* pBuf, uint32_t buf_len) {
+	uint8_t frame[FRAME_SIZE(DOWNLOAD_BLOCK_SIZE)];
+	uint32_t sent = 0;
+	stats.frames++;
+	// One frame a call, from frame_send
+	if (buf_len > 1 && pBuf[1] == 'd') {
+		stats.data_frames++;
+		if (fault(drop_every, &drop_run)) {
+			stats.dropped++;
+			return true;
+		}
+	}
+	if (fault(corrupt_every, &corrupt_run) && buf_len <= sizeof(frame)) {
+		memcpy(frame, pBuf, buf_len);
+		frame[buf_len / 2] ^= 0x5a;
+		pBuf = frame;
+		stats.corrupted++;
+	}
+	while (sent < buf_len) {
+		ssize_t n = write(master, pBuf + sent, buf_len - sent);
+		if (n < 0 && errno != EINTR) return false;
+		if (n > 0) sent += n;
+	}
+	return true;
+}
+
+FRESULT f_opendir(DIR* dp, const TCHAR* path) {
+	dp->index = 0;
+	return FR_OK;
+}
+
+FRESULT f_readdir(DIR* dp, FILINFO* fno) {
+	char path[512];
+	FILE* f;
+	memset(fno, 0, sizeof(*fno));
+	if (dp->index >= file_count) return FR_OK;
+	snprintf(fno->fname, sizeof(fno->fname), "%s", files[dp->index++]);
+	snprintf(path, sizeof(path), "%s/%s", root, fno->fname);
+	f = fopen(path, "rb");
+	if (f == NULL) return FR_DISK_ERR;
+	fseek(f, 0, SEEK_END);
+	fno->fsize = ftell(f);
+	fclose(f);
+	return FR_OK;
+}
+
+// download.c has one file open at a time
+FRESULT f_open(FIL* fp, const TCHAR* path, BYTE mode) {
+	char host_path[512];
+	int i;
+	for (i = 0; i < file_count && strcmp(files[i], path); i++);
+	if (i == file_count) return FR_NO_FILE;
+	snprintf(host_path, sizeof(host_path), "%s/%s", root, path);
+	open_file = fopen(host_path, "rb");
+	if (open_file == NULL) return FR_DISK_ERR;
+	memset(fp, 0, sizeof(*fp));
+	fseek(open_file, 0, SEEK_END);
+	fp->fsize = ftell(open_file);
+	return FR_OK;
+}
+
+FRESULT f_lseek(FIL* fp, DWORD ofs) {
+	if (ofs > fp->fsize || fseek(open_file, ofs, SEEK_SET)) return FR_DISK_ERR;
+	fp->fptr = ofs;
+	return FR_OK;
+}
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br) {
+	*br = fread(buff, 1, btr, open_file);
+	fp->fptr += *br;
+	return ferror(open_file) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_close(FIL* fp) {
+	fclose(open_file);
+	open_file = NULL;
+	return FR_OK;
+}
+
+bool flash_log_init(void) {
+	return mirror != NULL;
+}
+
+bool flash_log_ready(void) {
+	return mirror != NULL;
+}
+
+uint32_t flash_log_size(void) {
+	return mirror_size;
+}
+
+bool flash_log_read(uint32_t offset, uint8_t* buffer, uint16_t length) {
+	if (offset > mirror_size || length > mirror_size - offset) return false;
+	memcpy(buffer, mirror + offset, length);
+	return true;
+}
@@ -0,0 +1,36 @@
+/*
+ * S25FL.h
+ *
+ *  Host stand-in for the flash calls, served by S25FL.c here from the
+ *  Python model the check registers with S25FL_host_connect.
+ */
+
+#ifndef S25FL_H
+#define S25FL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+#define S25FL_MANUFACTURER_SPANSION	0x01
+
+uint32_t S25FL_read_id(void);
+bool S25FL_busy(void);
+void S25FL_read(uint32_t address, uint8_t* buffer, uint32_t length);
+void S25FL_write(uint32_t address, uint8_t* buffer, uint32_t length);
+void S25FL_erase_sector(uint32_t address);
+void S25FL_erase_sector_start(uint32_t address);
+void S25FL_erase_suspend(void);
+void S25FL_erase_resume(void);
+
+// The model's program and erase return non-zero once the power has failed,
+// and the call then jumps to S25FL_host_cut, which the wrapper around the
+// firmware call set, as if the core had stopped there
+typedef void (*S25FL_host_read_t)(uint32_t address, uint8_t* buffer, uint32_t length);
+typedef int (*S25FL_host_program_t)(uint32_t address, const uint8_t* buffer, uint32_t length);
+typedef int (*S25FL_host_erase_t)(uint32_t address);
+
+void S25FL_host_connect(S25FL_host_read_t read, S25FL_host_program_t program, S25FL_host_erase_t erase);
+extern jmp_buf S25FL_host_cut;
+
+#endif /* S25FL_H */
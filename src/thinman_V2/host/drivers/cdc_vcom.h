@@ -0,0 +1,20 @@
+/*
+ * cdc_vcom.h
+ *
+ *  Host stand-in for the VCOM calls download mode makes, served by
+ *  download_host.c from the master side of a pseudo terminal, which the
+ *  check opens as the board's serial port.
+ */
+
+#ifndef __CDC_VCOM_H_
+#define __CDC_VCOM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define USB_FS_MAX_BULK_PACKET	64
+
+uint32_t vcom_bread_timeout(uint8_t* pBuf, uint32_t buf_len, uint32_t timeout);
+bool vcom_write_all(const uint8_t* pBuf, uint32_t buf_len);
+
+#endif /* __CDC_VCOM_H_ */
@@ -0,0 +1,15 @@
+/*
+ * interrupt.h
+ *
+ *  Host stand-in. Handlers become plain functions the check calls; nothing
+ *  preempts them, so masking does nothing.
+ */
+
+#ifndef AVR_INTERRUPT_H
+#define AVR_INTERRUPT_H
+
+#define ISR(vector)	void vector(void)
+#define cli()
+#define sei()
+
+#endif /* AVR_INTERRUPT_H */
@@ -0,0 +1,30 @@
+/*
+ * io.h
+ *
+ *  Host stand-in: the ATtiny461 registers firing_board.c touches are plain
+ *  bytes in board_host.c.
+ */
+
+#ifndef AVR_IO_H
+#define AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit)	(1 << (bit))
+
+extern volatile uint8_t PORTA, PORTB, DDRA, DDRB;
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, CLKPR;
+extern volatile uint16_t ADC;
+
+#define MUX5	5
+#define REFS1	7
+#define REFS2	4
+#define ADPS0	0
+#define ADPS1	1
+#define ADPS2	2
+#define ADIE	3
+#define ADSC	6
+#define ADEN	7
+#define CLKPCE	7
+
+#endif /* AVR_IO_H */
@@ -0,0 +1,15 @@
+/*
+ * pgmspace.h
+ *
+ *  Host stand-in: flash constants are ordinary constants.
+ */
+
+#ifndef AVR_PGMSPACE_H
+#define AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(address)	(*(const uint8_t*) (address))
+
+#endif /* AVR_PGMSPACE_H */
@@ -0,0 +1,101 @@
+/*
+ * board_host.c
+ *
+ *  What firing_board.c expects from the drivers, for fire_check.py: the USI
+ *  buffers are byte queues the check fills and drains, and the timebase is a
+ *  counter it steps, calling timebase_tick as Timer0 would.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware_config.h"
+#include "drivers/neopixel.h"
+#include "drivers/timebase.h"
+
+volatile uint8_t PORTA, PORTB, DDRA, DDRB;
+volatile uint8_t ADMUX, ADCSRA, ADCSRB, CLKPR;
+volatile uint16_t ADC;
+
+rgb_color channel_colors[CHANNELS];
+
+// The USI driver's buffers hold one byte less than their size
+#define HOST_TWI_BUFFER	15
+
+static uint8_t rx[HOST_TWI_BUFFER], tx[HOST_TWI_BUFFER];
+static uint8_t rx_head, rx_tail, tx_count;
+static uint32_t host_us;
+
+void neopixel_init(void) {
+}
+
+void neopixel_update(void) {
+}
+
+void blink_error_code(int code) {
+}
+
+int16_t usi_twi_receive_byte_non_blocking(void) {
+	if (rx_tail == rx_head) return -1;
+	return rx[rx_tail++];
+}
+
+bool usi_twi_tranmit_byte_non_blocking(uint8_t b) {
+	if (tx_count == HOST_TWI_BUFFER) return false;
+	tx[tx_count++] = b;
+	return true;
+}
+
+uint32_t timebase_ms(void) {
+	return host_us / 1000;
+}
+
+uint32_t timebase_us(void) {
+	return host_us;
+}
+
+// A write from the master, which the USI handler then hands to the command code
+void board_host_request(const uint8_t* bytes, uint8_t length) {
+	void handle_i2c_command_non_blocking(void);
+	rx_head = rx_tail = tx_count = 0;
+	while (rx_head < length && rx_head < HOST_TWI_BUFFER) {
+		rx[rx_head] = bytes[rx_head];
+		rx_head++;
+	}
+	handle_i2c_command_non_blocking();
+}
+
+// The reply the master reads back; returns its length
+uint8_t board_host_reply(uint8_t* bytes) {
+	uint8_t i;
+	for (i = 0; i < tx_count; i++) {
+		bytes[i] = tx[i];
+	}
+	return tx_count;
+}
+
+// Moves the clock on by us, with a tick interrupt at each millisecond crossed
+void board_host_advance(uint32_t us) {
+	while (us > 0) {
+		uint32_t step = 1000 - host_us % 1000;
+		if (step > us) {
+			host_us += us;
+			return;
+		}
+		host_us += step;
+		us -= step;
+		timebase_tick(host_us / 1000);
+	}
+}
+
+// Steps the clock a Timer0 count at a time, for at most limit_us, until the
+// channel pin in mask reads level with the master arm asserted. Returns the
+// time taken, or limit_us when it never did.
+uint32_t board_host_wait(uint8_t mask, bool level, uint32_t limit_us) {
+	uint32_t start = host_us;
+	while (host_us - start < limit_us) {
+		bool on = (PORTA & mask) && !(PORTB & (1 << 1));
+		if (on == level) return host_us - start;
+		board_host_advance(8);
+	}
+	return limit_us;
+}
@@ -0,0 +1,25 @@
+/*
+ * crc16.h
+ *
+ *  Host stand-in, the avr-libc reference code for _crc_xmodem_update.
+ */
+
+#ifndef UTIL_CRC16_H
+#define UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data) {
+	int i;
+	crc = crc ^ ((uint16_t) data << 8);
+	for (i = 0; i < 8; i++) {
+		if (crc & 0x8000) {
+			crc = (crc << 1) ^ 0x1021;
+		} else {
+			crc <<= 1;
+		}
+	}
+	return crc;
+}
+
+#endif /* UTIL_CRC16_H */
@@ -0,0 +1,13 @@
+/*
+ * delay.h
+ *
+ *  Host stand-in. Only the main loop delays, and the check never runs it.
+ */
+
+#ifndef UTIL_DELAY_H
+#define UTIL_DELAY_H
+
+#define _delay_ms(ms)	((void) (ms))
+#define _delay_us(us)	((void) (us))
+
+#endif /* UTIL_DELAY_H */
@@ -0,0 +1,24 @@
+/*
+ * ftl_host.c
+ *
+ *  The FTL calls that touch the flash, returning -1 when the power failed
+ *  part way through.
+ */
+
+#include "drivers/S25FL.h"
+#include "drivers/ftl.h"
+
+int ftl_host_init(void) {
+	if (setjmp(S25FL_host_cut)) return -1;
+	return ftl_init();
+}
+
+int ftl_host_read(uint8_t* buffer, uint32_t sector, uint32_t count) {
+	if (setjmp(S25FL_host_cut)) return -1;
+	return ftl_read(buffer, sector, count);
+}
+
+int ftl_host_write(const uint8_t* buffer, uint32_t sector, uint32_t count) {
+	if (setjmp(S25FL_host_cut)) return -1;
+	return ftl_write(buffer, sector, count);
+}
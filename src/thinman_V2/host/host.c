@@ -0,0 +1,14 @@
+/*
+ * host.c
+ *
+ *  Kernel and clock state the stand-in headers here refer to.
+ */
+
+#include "task.h"
+
+TickType_t host_ticks;
+uint32_t SystemCoreClock = 48000000;
+
+void host_set_ticks(TickType_t ticks) {
+	host_ticks = ticks;
+}
@@ -0,0 +1,42 @@
+/*
+ * i2c_host.c
+ *
+ *  The I2C bus of the chip.h stand-in, with nothing on it, and the timing
+ *  of the LPS altitude conversions for lps_check.py.
+ */
+
+#include "chip.h"
+#include "drivers/cycles.h"
+#include "sensors/LPS.h"
+
+int Chip_I2C_MasterSend(I2C_ID_T id, uint8_t slave_address, const uint8_t* buffer, int length) {
+	return 0;
+}
+
+int Chip_I2C_MasterCmdRead(I2C_ID_T id, uint8_t slave_address, uint8_t command, uint8_t* buffer, int length) {
+	return 0;
+}
+
+volatile int32_t lps_host_sink;
+volatile float lps_host_sink_m;
+
+// Fewest time stamp counter ticks, over rounds runs, for one call of each
+// conversion at every reading in raw[]
+void lps_host_cycles(const int32_t* raw, uint32_t count, uint32_t rounds, uint32_t* table, uint32_t* formula) {
+	uint32_t round, i, start, spent;
+	*table = *formula = 0xffffffff;
+	for (round = 0; round < rounds; round++) {
+		start = cycles_now();
+		for (i = 0; i < count; i++) {
+			lps_host_sink = LPS_pressure_raw_to_altitude_mm(raw[i]);
+		}
+		spent = cycles_since(start);
+		if (spent < *table) *table = spent;
+		start = cycles_now();
+		for (i = 0; i < count; i++) {
+			lps_host_sink_m = LPS_pressure_to_altitude_m(raw[i] / 4096.0f, 1013.25f);
+		}
+		spent = cycles_since(start);
+		if (spent < *formula) *formula = spent;
+	}
+}
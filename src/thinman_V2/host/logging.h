@@ -0,0 +1,19 @@
+/*
+ * logging.h
+ *
+ *  Host stand-in: errors and warnings go to stderr, the rest is dropped so
+ *  the checks print only their own results.
+ */
+
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define LOG_NORMAL(type, msg, ...) { fprintf(stderr, "%s " msg "\n", type, ##__VA_ARGS__); }
+#define LOG_CRITICAL(msg, ...) { LOG_NORMAL("CRITICAL", msg, ##__VA_ARGS__); }
+#define LOG_ERROR(msg, ...) { LOG_NORMAL("ERROR", msg, ##__VA_ARGS__); }
+#define LOG_WARN(msg, ...) { LOG_NORMAL("WARN ", msg, ##__VA_ARGS__); }
+#define LOG_INFO(msg, ...) { }
+#define LOG_DEBUG(msg, ...) { }
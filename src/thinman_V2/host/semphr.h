@@ -0,0 +1,16 @@
+/*
+ * semphr.h
+ *
+ *  Host stand-in for the semaphore type ffconf.h names; nothing built for
+ *  the host takes one.
+ */
+
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "FreeRTOS.h"
+
+typedef void* xSemaphoreHandle;
+typedef xSemaphoreHandle SemaphoreHandle_t;
+
+#endif /* SEMAPHORE_H */
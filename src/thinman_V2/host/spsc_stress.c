@@ -0,0 +1,181 @@
+/*
+ * spsc_stress.c
+ *
+ *  One side of an spsc_queue in a timer signal and the other in the main
+ *  loop, for spsc_check.py. On the single-core M0+ the queue's hazard is
+ *  not two cores at once but an interrupt landing between any two
+ *  instructions of the side it preempts; a fast interval timer lands the
+ *  signal at such arbitrary points, on any number of host cores.
+ *
+ *  Each record carries its sequence number and a payload derived from it,
+ *  so the consumer can tell a record that was torn, repeated, reordered or
+ *  lost from one that came through. Records too small for the sequence, as
+ *  the GPS bytes are, carry its low bytes and are retried when refused, so
+ *  every byte must come out in turn. Larger records are dropped when the
+ *  queue is full, as a sensor sample is, except from the main loop, which
+ *  retries so the handler sees it mid-push rather than only refused.
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "drivers/spsc_queue.h"
+
+#define STRESS_MAX_RECORD	64
+#define STRESS_TICK_US		20
+
+typedef struct {
+	uint32_t pushed;		// Records the producer got in
+	uint32_t dropped;		// Pushes refused as full, by the producer's count
+	uint32_t popped;
+	uint32_t torn;			// Payload not matching its sequence
+	uint32_t out_of_order;	// Sequence not after the last one seen
+	uint32_t high_water;
+	uint32_t queue_dropped;	// spsc_queue_t.dropped at the end
+	uint32_t ticks;			// Signals taken
+} spsc_stress_result_t;
+
+typedef struct {
+	spsc_queue_t queue;
+	uint16_t record_size;
+	bool isr_producer;		// The signal pushes; otherwise it pops
+	uint32_t records;
+	uint32_t sequence;		// Next to push
+	uint32_t burst;			// Most records one signal pushes
+	uint32_t last;			// Last sequence popped
+	bool first;
+	volatile bool done;		// Every record pushed or dropped
+	spsc_stress_result_t* result;
+} stress_t;
+
+static stress_t stress;
+
+static bool small(uint16_t size) {
+	return size < sizeof(uint32_t);
+}
+
+static void fill(uint8_t* record, uint16_t size, uint32_t sequence) {
+	uint16_t i;
+	memcpy(record, &sequence, small(size) ? size : sizeof(sequence));
+	for (i = sizeof(sequence); i < size; i++) {
+		record[i] = (uint8_t)(sequence * 31 + i);
+	}
+}
+
+static bool intact(const uint8_t* record, uint16_t size, uint32_t sequence) {
+	uint16_t i;
+	for (i = sizeof(sequence); i < size; i++) {
+		if (record[i] != (uint8_t)(sequence * 31 + i)) return false;
+	}
+	return true;
+}
+
+// Pushes up to count records, stopping at the first refusal when retry is
+// set so the same record goes again next time
+static void produce(stress_t* s, uint32_t count, bool retry) {
+	uint8_t record[STRESS_MAX_RECORD];
+	while (count-- && s->sequence < s->records) {
+		fill(record, s->record_size, s->sequence);
+		if (spsc_queue_push(&s->queue, record)) {
+			s->result->pushed++;
+		} else {
+			s->result->dropped++;
+			if (retry) return;
+		}
+		s->sequence++;
+	}
+	if (s->sequence == s->records) {
+		s->done = true;
+	}
+}
+
+// Pops until the queue is empty
+static void consume(stress_t* s) {
+	uint8_t record[STRESS_MAX_RECORD];
+	uint32_t mask = small(s->record_size) ? (1UL << (8 * s->record_size)) - 1 : 0xffffffff;
+	while (spsc_queue_pop(&s->queue, record)) {
+		uint32_t sequence = 0;
+		memcpy(&sequence, record, small(s->record_size) ? s->record_size : sizeof(sequence));
+		if (small(s->record_size)) {
+			if (sequence != (s->result->popped & mask)) {
+				s->result->out_of_order++;
+			}
+		} else if (!s->first && sequence <= s->last) {
+			s->result->out_of_order++;
+		}
+		s->result->popped++;
+		if (!intact(record, s->record_size, sequence)) {
+			s->result->torn++;
+		}
+		s->first = false;
+		s->last = sequence;
+	}
+}
+
+static void tick(int signal) {
+	stress.result->ticks++;
+	if (stress.isr_producer) {
+		produce(&stress, stress.burst, small(stress.record_size));
+	} else {
+		consume(&stress);
+	}
+}
+
+// Runs records records of record_size bytes through a queue of capacity,
+// starting both indices at start so they can wrap past 2^32. The signal
+// pushes bursts of up to burst records when isr_producer is set, and
+// otherwise pops everything queued. Returns false if the timer could not
+// be set up.
+bool spsc_stress(uint16_t record_size, uint32_t capacity, uint32_t records, uint32_t start,
+		bool isr_producer, uint32_t burst, spsc_stress_result_t* result) {
+	struct sigaction action, old_action;
+	struct itimerval timer = {{0, STRESS_TICK_US}, {0, STRESS_TICK_US}}, off = {{0, 0}, {0, 0}};
+	void* buffer;
+	if (record_size == 0 || record_size > STRESS_MAX_RECORD) return false;
+	buffer = malloc((size_t)record_size * capacity);
+	if (buffer == NULL) return false;
+	memset(result, 0, sizeof(*result));
+	memset(&stress, 0, sizeof(stress));
+	spsc_queue_init(&stress.queue, buffer, record_size, capacity);
+	stress.queue.head = stress.queue.tail = start;
+	stress.record_size = record_size;
+	stress.isr_producer = isr_producer;
+	stress.records = records;
+	stress.burst = burst;
+	stress.first = true;
+	stress.result = result;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = tick;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGALRM, &action, &old_action)) {
+		free(buffer);
+		return false;
+	}
+	if (setitimer(ITIMER_REAL, &timer, NULL)) {
+		sigaction(SIGALRM, &old_action, NULL);
+		free(buffer);
+		return false;
+	}
+	if (isr_producer) {
+		// Spin on the queue as task_storage does, only without the idle delay
+		while (!stress.done) {
+			consume(&stress);
+		}
+	} else {
+		while (!stress.done) {
+			produce(&stress, 1, true);
+		}
+	}
+	setitimer(ITIMER_REAL, &off, NULL);
+	sigaction(SIGALRM, &old_action, NULL);
+	consume(&stress);
+	result->high_water = stress.queue.high_water;
+	result->queue_dropped = stress.queue.dropped;
+	free(buffer);
+	return true;
+}
@@ -0,0 +1,21 @@
+/*
+ * task.h
+ *
+ *  Host stand-in. Delays return at once; the tick count is the one the
+ *  test last set with host_set_ticks (host.c).
+ */
+
+#ifndef TASK_H
+#define TASK_H
+
+#include "FreeRTOS.h"
+
+extern TickType_t host_ticks;
+
+#define vTaskDelay(ticks)		((void)(ticks))
+#define vTaskDelete(task)		((void)(task))
+#define xTaskGetTickCount()		host_ticks
+#define vTaskSuspendAll()
+#define xTaskResumeAll()		pdFALSE
+
+#endif /* TASK_H */
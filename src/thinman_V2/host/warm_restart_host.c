@@ -0,0 +1,56 @@
+/*
+ * warm_restart_host.c
+ *
+ *  warm_restart.c with the reset hardware stubbed out, for
+ *  warm_restart_check.py. It is included rather than linked so the check
+ *  can read and tear the no-init block the way a reset part way through
+ *  an update would leave it. NVIC_SystemReset jumps back to the check.
+ */
+
+#include <setjmp.h>
+#include "warm_restart.c"
+
+static uint32_t host_reset_status;
+static jmp_buf host_reset;
+
+uint32_t Chip_SYSCTL_GetSystemRSTStatus(void) {
+	return host_reset_status;
+}
+
+void Chip_SYSCTL_ClearSystemRSTStatus(uint32_t reset) {
+	host_reset_status &= ~reset;
+}
+
+void NVIC_SystemReset(void) {
+	longjmp(host_reset, 1);
+}
+
+// Boots with the reset status bits cause; returns whether it resumed a flight
+bool warm_host_boot(uint32_t cause) {
+	// The startup code clears .bss; only the block is left alone
+	warm_restart = false;
+	warm_reset_cause = 0;
+	warm_last_error = 0;
+	host_reset_status = cause;
+	warm_restart_init();
+	return warm_restart_is_warm();
+}
+
+// exit_error in flight: true when it reset the chip, false when it returned to halt
+bool warm_host_fatal(int error_code) {
+	if (setjmp(host_reset)) return true;
+	warm_restart_on_fatal(error_code);
+	return false;
+}
+
+uint32_t warm_host_block_size(void) {
+	return sizeof(warm_block);
+}
+
+void warm_host_read_block(uint8_t* bytes) {
+	memcpy(bytes, &warm_block, sizeof(warm_block));
+}
+
+void warm_host_write_block(const uint8_t* bytes) {
+	memcpy(&warm_block, bytes, sizeof(warm_block));
+}
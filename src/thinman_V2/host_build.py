@@ -0,0 +1,65 @@
+# Compiles firmware sources from example/src into a host shared library and
+# loads it with ctypes, so the host checks run the code that flies rather
+# than a port of it.
+#
+#   lib = host_build.load(['flight/decimate.c'], defines=['CYCLES_HOST'])
+#
+# Sources and include paths are relative to example/src, or to this
+# directory when they start with host/. Modules that touch hardware build
+# with their <MODULE>_HOST define, as spsc_queue.c and timebase.c do; the
+# rest find the stand-ins in host/ for the chip, kernel, logging and
+# flash headers ahead of the real ones, and the caller's includes ahead of
+# example/src, so another board's sources see their own headers. The
+# library is rebuilt when any source, or any .c or .h file under
+# example/src or host/, is newer, since a stub may include the module it
+# wraps; it goes in build/host next to this file. CC picks the compiler;
+# gcc by default.
+import ctypes
+import hashlib
+import os
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC = os.path.join(HERE, 'example', 'src')
+HOST = os.path.join(HERE, 'host')
+OUT = os.path.join(HERE, 'build', 'host')
+CFLAGS = ['-std=gnu99', '-O2', '-g', '-fPIC', '-shared', '-Wall', '-Wno-unused-function']
+
+
+def newest(paths):
+    latest = 0
+    for source in paths:
+        latest = max(latest, os.path.getmtime(source))
+    for top in (SRC, HOST):
+        for root, dirs, files in os.walk(top):
+            for name in files:
+                if name.endswith(('.h', '.c')):
+                    latest = max(latest, os.path.getmtime(os.path.join(root, name)))
+    return latest
+
+
+def path(name):
+    if os.path.isabs(name):
+        return name
+    if name.startswith('host/'):
+        return os.path.join(HERE, name)
+    return os.path.join(SRC, name)
+
+
+def load(sources, defines=(), includes=(), extra=()):
+    """Builds sources into one library if needed and returns its ctypes.CDLL."""
+    paths = [path(s) for s in sources]
+    flags = CFLAGS + ['-D' + d for d in defines] + ['-I' + HOST]
+    flags += ['-I' + path(i) for i in includes] + ['-I' + SRC]
+    flags += list(extra)
+    key = hashlib.md5(' '.join(paths + flags).encode()).hexdigest()[:8]
+    name = os.path.splitext(os.path.basename(paths[0]))[0]
+    lib = os.path.join(OUT, 'lib%s-%s.so' % (name, key))
+    if not os.path.exists(lib) or os.path.getmtime(lib) < newest(paths):
+        if not os.path.isdir(OUT):
+            os.makedirs(OUT)
+        cmd = [os.environ.get('CC', 'gcc')] + flags + ['-o', lib] + paths
+        if subprocess.call(cmd):
+            sys.exit('host build failed: ' + ' '.join(cmd))
+    return ctypes.CDLL(lib)
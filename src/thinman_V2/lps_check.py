@@ -0,0 +1,110 @@
+# Checks the LPS altitude lookup (example/src/sensors/LPS.c) against the
+# pow() formula it replaced. LPS.c is compiled for the host with host_build,
+# against the chip.h and I2C stand-ins in host/, and driven through ctypes.
+#
+#   python lps_check.py [--step COUNTS] [--rounds N]
+#
+# It checks:
+#   - across the table, 256 to 1088 mbar, LPS_pressure_raw_to_altitude_mm
+#     is within the error LPS.h states against LPS_pressure_to_altitude_m,
+#     band by band, at every step raw counts
+#   - altitude never rises with pressure, and readings past either end of
+#     the table clamp to it
+# and prints the host time stamp counter ticks per call of both. Host
+# ticks only rank the two; the M0+ has no FPU, so there the formula is a
+# soft-float divide and a double pow(), and the gap is far wider.
+# Exits non-zero on any failure.
+import argparse
+import ctypes
+import sys
+import host_build
+
+COUNTS_PER_MBAR = 4096
+TABLE_FIRST_MBAR = 256
+TABLE_LAST_MBAR = 1088
+# Highest altitude of each band in m, and the error LPS.h allows in it in mm
+BANDS = [(1000, 25), (5000, 55), (10000, 170)]
+
+lib = host_build.load(['sensors/LPS.c', 'host/i2c_host.c'], defines=['CYCLES_HOST'], extra=['-fcommon', '-lm'])
+lib.LPS_pressure_raw_to_altitude_mm.restype = ctypes.c_int32
+lib.LPS_pressure_raw_to_altitude_mm.argtypes = [ctypes.c_int32]
+lib.LPS_pressure_to_altitude_m.restype = ctypes.c_float
+lib.LPS_pressure_to_altitude_m.argtypes = [ctypes.c_float, ctypes.c_float]
+
+
+def table_mm(raw):
+    return lib.LPS_pressure_raw_to_altitude_mm(raw)
+
+
+def formula_mm(raw):
+    return lib.LPS_pressure_to_altitude_m(raw / float(COUNTS_PER_MBAR), 1013.25) * 1000
+
+
+def check_accuracy(step):
+    """Worst error in mm per band, and failures."""
+    worst = [0.0] * len(BANDS)
+    where = [0] * len(BANDS)
+    failures = []
+    last = None
+    for raw in range(TABLE_FIRST_MBAR * COUNTS_PER_MBAR, TABLE_LAST_MBAR * COUNTS_PER_MBAR + 1, step):
+        got = table_mm(raw)
+        want = formula_mm(raw)
+        if last is not None and got > last:
+            failures.append('altitude rises from %d to %d mm at %.4f mbar' % (last, got, raw / 4096.0))
+        last = got
+        for band, (top_m, limit_mm) in enumerate(BANDS):
+            if want <= top_m * 1000:
+                error = abs(got - want)
+                if error > worst[band]:
+                    worst[band], where[band] = error, raw
+                break
+    for band, (top_m, limit_mm) in enumerate(BANDS):
+        if worst[band] >= limit_mm:
+            failures.append('%.1f mm off below %d m, at %.4f mbar; LPS.h says < %d' %
+                            (worst[band], top_m, where[band] / 4096.0, limit_mm))
+    return worst, failures
+
+
+def check_clamp():
+    failures = []
+    low = table_mm(TABLE_FIRST_MBAR * COUNTS_PER_MBAR)
+    high = table_mm(TABLE_LAST_MBAR * COUNTS_PER_MBAR)
+    for raw in (0, -1, 100 * COUNTS_PER_MBAR, TABLE_FIRST_MBAR * COUNTS_PER_MBAR - 1):
+        if table_mm(raw) != low:
+            failures.append('%d counts gave %d mm, not the %d mm top of the table' % (raw, table_mm(raw), low))
+    for raw in (TABLE_LAST_MBAR * COUNTS_PER_MBAR + 1, 1200 * COUNTS_PER_MBAR, 0x7fffff):
+        if table_mm(raw) != high:
+            failures.append('%d counts gave %d mm, not the %d mm bottom of the table' % (raw, table_mm(raw), high))
+    return failures
+
+
+def host_ticks(rounds):
+    """Ticks per call of the table and of the formula, over flight pressures."""
+    count = 1000
+    raw = (ctypes.c_int32 * count)(*[int((300 + i * 0.7) * COUNTS_PER_MBAR) for i in range(count)])
+    table, formula = ctypes.c_uint32(), ctypes.c_uint32()
+    lib.lps_host_cycles(raw, count, rounds, ctypes.byref(table), ctypes.byref(formula))
+    return table.value / float(count), formula.value / float(count)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='LPS altitude lookup against the pow() formula')
+    parser.add_argument('--step', type=int, default=16, help='raw counts between checked readings')
+    parser.add_argument('--rounds', type=int, default=50, help='timing runs to take the fastest of')
+    opts = parser.parse_args()
+    worst, failures = check_accuracy(opts.step)
+    failures += check_clamp()
+    print '%-10s %9s %9s' % ('below m', 'worst mm', 'limit mm')
+    for (top_m, limit_mm), error in zip(BANDS, worst):
+        print '%-10d %9.1f %9d' % (top_m, error, limit_mm)
+    table, formula = host_ticks(opts.rounds)
+    print 'host ticks per call: table %.1f, pow() formula %.1f' % (table, formula)
+    print 'result: ' + ('ok' if not failures else 'BAD')
+    for failure in failures[:5]:
+        print '        ' + failure
+    if failures:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,147 @@
+# Link-time memory budget from the GNU ld map file that the MCUXpresso build writes
+# next to the .axf (Debug/thinman_V2.map).
+#
+#   python memory_report.py Debug/thinman_V2.map [count]
+#
+# Prints the fill of every memory region, splits main RAM into task stacks, the
+# FreeRTOS heap (ucHeap), other .bss and .data, and lists the largest RAM objects.
+# Exits non-zero when a region overflows, or when main RAM leaves less than
+# MSP_RESERVE above .bss for the main stack.
+from __future__ import print_function
+import re
+import sys
+
+HEX = r'0x[0-9a-fA-F]+'
+REGION = re.compile(r'^(\S+)\s+(%s)\s+(%s)' % (HEX, HEX))
+OUTPUT_SECTION = re.compile(r'^(\.\S+)(?:\s+(%s)\s+(%s)(?:\s+load address (%s))?)?\s*$' % (HEX, HEX, HEX))
+INPUT_SECTION = re.compile(r'^ (\.\S+|COMMON)(?:\s+(%s)\s+(%s)\s+(\S+))?\s*$' % (HEX, HEX))
+ADDRESS_SIZE_FILE = re.compile(r'^\s+(%s)\s+(%s)\s+(\S+)\s*$' % (HEX, HEX))
+SYMBOL = re.compile(r'^\s+(%s)\s+([A-Za-z_]\w*)\s*$' % HEX)
+
+RAM_PREFIXES = ('.bss', '.data', '.noinit', '.heap')
+
+# The main stack grows down from the top of main RAM into whatever .bss leaves.
+# main() runs hardware_init and its logging on it before the scheduler starts;
+# after that only interrupt handlers use it, nested at most a few deep.
+MSP_RESERVE = 0x400
+
+
+def parse(lines):
+    regions = []
+    outputs = []
+    objects = []
+    loads = []
+    state = None
+    pending = None      # wrapped section name waiting for its address line
+    for line in lines:
+        line = line.rstrip('\r\n')
+        if line.startswith('Memory Configuration'):
+            state = 'memory'
+            continue
+        if line.startswith('Linker script and memory map'):
+            state = 'map'
+            continue
+        if state == 'memory':
+            m = REGION.match(line)
+            if m and m.group(1) != '*default*':
+                regions.append((m.group(1), int(m.group(2), 16), int(m.group(3), 16)))
+            continue
+        if state != 'map':
+            continue
+
+        if pending:
+            m = ADDRESS_SIZE_FILE.match(line) if pending[0] == 'input' else re.match(r'^\s+(%s)\s+(%s)' % (HEX, HEX), line)
+            if m:
+                line = (' ' if pending[0] == 'input' else '') + pending[1] + line
+            pending = None
+
+        m = OUTPUT_SECTION.match(line)
+        if m:
+            if m.group(2) is None:
+                pending = ('output', m.group(1))
+            else:
+                outputs.append((m.group(1), int(m.group(2), 16), int(m.group(3), 16)))
+                if m.group(4):
+                    # Initialized data also takes its load image in flash
+                    loads.append((int(m.group(4), 16), int(m.group(3), 16)))
+            continue
+        m = INPUT_SECTION.match(line)
+        if m:
+            if m.group(2) is None:
+                pending = ('input', m.group(1))
+                continue
+            name, address, size, source = m.group(1), int(m.group(2), 16), int(m.group(3), 16), m.group(4)
+            if size and outputs and outputs[-1][0].startswith(RAM_PREFIXES):
+                source = re.sub(r'.*[/\\]', '', source)
+                # -fdata-sections puts each object in .bss.<symbol>; otherwise name it by its file
+                symbol = name.split('.', 2)[2] if name.count('.') >= 2 else None
+                objects.append([symbol, address, size, source])
+            continue
+        m = SYMBOL.match(line)
+        if m and objects and objects[-1][0] is None and int(m.group(1), 16) == objects[-1][1]:
+            objects[-1][0] = m.group(2)
+    return regions, outputs, loads, objects
+
+
+def region_of(regions, address):
+    for name, origin, length in regions:
+        if origin <= address < origin + length:
+            return name
+    return None
+
+
+def report(regions, outputs, loads, objects, count):
+    """Prints the report and returns the problems found."""
+    problems = []
+    used = dict((name, 0) for name, _, _ in regions)
+    for address, size in [o[1:] for o in outputs] + loads:
+        region = region_of(regions, address)
+        if region and size:
+            used[region] += size
+
+    print('%-14s %8s %8s %6s' % ('Region', 'Used', 'Size', ''))
+    for name, origin, length in regions:
+        print('%-14s %8d %8d %5.1f%%' % (name, used[name], length, 100.0 * used[name] / length))
+        if used[name] > length:
+            problems.append('%s overflows by %d bytes' % (name, used[name] - length))
+
+    # Main RAM is the region holding .bss; the RAM2/RAM3 banks get their own sections
+    main = [o for o in outputs if o[0] == '.bss']
+    if main:
+        main_region = region_of(regions, main[0][1])
+        length = [r[2] for r in regions if r[0] == main_region][0]
+        in_main = [o for o in objects if region_of(regions, o[1]) == main_region]
+        stacks = sum(o[2] for o in in_main if o[0] and o[0].endswith('_stack'))
+        heap = sum(o[2] for o in in_main if o[0] == 'ucHeap')
+        data = sum(o[2] for o in outputs if o[0].startswith('.data') and region_of(regions, o[1]) == main_region)
+        bss = sum(o[2] for o in outputs if o[0].startswith('.bss') and region_of(regions, o[1]) == main_region)
+        print()
+        print('%s budget' % main_region)
+        print('  task stacks     %6d' % stacks)
+        print('  FreeRTOS heap   %6d' % heap)
+        print('  other .bss      %6d' % (bss - stacks - heap))
+        print('  .data           %6d' % data)
+        free = length - used[main_region]
+        print('  main stack      %6d  (MSP_RESERVE)' % MSP_RESERVE)
+        print('  headroom        %6d' % (free - MSP_RESERVE))
+        if free < MSP_RESERVE:
+            problems.append('%s leaves %d bytes for the main stack, under %d' % (main_region, free, MSP_RESERVE))
+
+    print()
+    print('Largest RAM objects')
+    for symbol, address, size, source in sorted(objects, key=lambda o: -o[2])[:count]:
+        print('  %6d  %-10s %-28s %s' % (size, region_of(regions, address) or '?', symbol or '?', source))
+    return problems
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.exit('usage: memory_report.py thinman_V2.map [count]')
+    with open(sys.argv[1]) as f:
+        parsed = parse(f)
+    problems = report(*parsed, count=int(sys.argv[2]) if len(sys.argv) > 2 else 20)
+    if problems:
+        print()
+        for problem in problems:
+            print('FAIL: ' + problem)
+        sys.exit(1)
@@ -0,0 +1,121 @@
+# Host side of the flash mirror in example/src/tasks/flash_log.h: rebuilds
+# the TAB files from the ring download.py fetched, and checks the card copies
+# against them. Shared by download.py and mirror_sim.py.
+import binascii
+import struct
+
+PAGE_SIZE = 256
+HEADER_SIZE = 4
+CHUNK = struct.Struct('<BBHI')
+END = 0xff
+ERASED = 0xffffffff
+# storage_stream_t order
+STREAMS = ['BARO', 'IMU', 'HIGHG', 'VOLTS', 'GPS']
+
+
+def file_name(stream, number):
+    base = STREAMS[stream] if stream < len(STREAMS) else 'STREAM%d' % stream
+    return '%s%s.TAB' % (base, number if number else '')
+
+
+def pages(ring):
+    """Pages with a good CRC as (sequence, page), oldest first, and the count of torn ones."""
+    good, torn = [], 0
+    for start in range(0, len(ring) - PAGE_SIZE + 1, PAGE_SIZE):
+        page = ring[start:start + PAGE_SIZE]
+        sequence, = struct.unpack_from('<I', page)
+        if sequence == ERASED:
+            continue
+        crc, = struct.unpack_from('<H', page, PAGE_SIZE - 2)
+        if binascii.crc_hqx(page[:PAGE_SIZE - 2], 0) != crc:
+            torn += 1
+            continue
+        good.append((sequence, page))
+    good.sort()
+    return good, torn
+
+
+def chunks(page):
+    """(stream, file number, offset, bytes) for each chunk in a page."""
+    position = HEADER_SIZE
+    while position + CHUNK.size <= PAGE_SIZE - 2:
+        stream, length, number, offset = CHUNK.unpack_from(page, position)
+        if stream == END:
+            return
+        position += CHUNK.size
+        yield stream, number, offset, page[position:position + length]
+        position += length
+
+
+class MirrorFile(object):
+    def __init__(self):
+        self.data = bytearray()
+        self.holes = []         # [start, end) the mirror never got
+
+    def put(self, offset, data):
+        if offset < len(self.data):
+            # A warm restart cut the card file back here, or a new session reused the name
+            del self.data[offset:]
+            self.holes = [(a, min(b, offset)) for a, b in self.holes if a < offset]
+        elif offset > len(self.data):
+            self.holes.append((len(self.data), offset))
+            self.data.extend('\0' * (offset - len(self.data)))
+        self.data.extend(data)
+
+
+def rebuild(ring):
+    """{file name: MirrorFile} from the raw ring, and the count of torn pages."""
+    files = {}
+    good, torn = pages(ring)
+    for sequence, page in good:
+        for stream, number, offset, data in chunks(page):
+            files.setdefault(file_name(stream, number), MirrorFile()).put(offset, data)
+    return files, torn
+
+
+def differences(a, b, block=512):
+    """[start, end) ranges where a and b differ, over the length of the longer one."""
+    found = []
+    length = max(len(a), len(b))
+    start = None
+    for base in range(0, length, block):
+        if a[base:base + block] == b[base:base + block]:
+            if start is not None:
+                found.append((start, base))
+                start = None
+            continue
+        for i in range(base, min(base + block, length)):
+            same = i < len(a) and i < len(b) and a[i] == b[i]
+            if same and start is not None:
+                found.append((start, i))
+                start = None
+            elif not same and start is None:
+                start = i
+    if start is not None:
+        found.append((start, length))
+    return found
+
+
+def subtract(ranges, holes):
+    """The parts of ranges outside every hole."""
+    for a, b in holes:
+        ranges = [r for x, y in ranges for r in ((x, min(y, a)), (max(x, b), y)) if r[0] < r[1]]
+    return ranges
+
+
+def merge(card, mirror):
+    """The card copy checked against the mirror. Returns the merged file, the ranges
+    the card got wrong or missed that the mirror fills, and the ranges neither has."""
+    card = bytearray(card)
+    merged = bytearray(mirror.data)
+    if len(card) > len(merged):
+        # The mirror lags the card by up to a page and FLASH_LOG_FLUSH_MS
+        merged.extend(card[len(merged):])
+    lost = []
+    for a, b in mirror.holes:
+        have = card[a:b]
+        merged[a:a + len(have)] = have
+        if a + len(have) < b:
+            lost.append((a + len(have), b))
+    repaired = subtract(differences(card, merged), lost)
+    return merged, repaired, lost
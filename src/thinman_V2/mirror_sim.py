@@ -0,0 +1,411 @@
+# Replays a logging session through models of the storage writer
+# (example/src/tasks/storage.c) and the flash mirror (tasks/flash_log.c) with
+# card failures injected part way through, then checks that mirror_log.py
+# rebuilds every TAB file from the card and mirror copies.
+#
+#   python mirror_sim.py [--pad S] [--seconds S] [--fail AT:FOR ...] [--restart AT] [--blocks N] [--seed N]
+#
+# The card model fails every write, sync, close and open while a failure is
+# on; the write that meets a failure still takes a random part of its row.
+# When the close that ends it goes through, the card keeps a random part
+# of what was written since the last sync, which may end mid-row, as FatFs
+# does when the sector holding the rest never reached the card. Erasing a
+# 64 kB block takes 130-650 ms (S25FL128S), and pages outside it are
+# programmed with the erase suspended; a page program is taken as instant.
+# The mirror is read back the way download mode finds it, from the flash
+# alone; --blocks shrinks the ring so a short session wraps it. Exits
+# non-zero if a byte that reached either copy is missing or wrong in the
+# merged file, or if the card copy on its own has a row with the wrong
+# number of columns, which post/load_tab.m cannot load.
+import argparse
+import binascii
+import random
+import struct
+import sys
+import mirror_log
+
+WRITER_PERIOD_MS = 10       # STORAGE_IDLE_PERIOD_MS
+CARD_RETRY_MS = 1000        # STORAGE_CARD_RETRY_MS
+PAD_PERIOD_MS = 500         # FLIGHT_LOW_RATE_PERIOD_MS
+ROW_SIZE = 0xc0             # STORAGE_ROW_SIZE
+
+PAGE = mirror_log.PAGE_SIZE
+DATA_END = PAGE - 2
+BLOCK_PAGES = 0x10000 // PAGE
+BLOCKS = 16000000 // 4096 * 4096 // 0x10000 - 16     # Above the FTL partition (drivers/ftl.h)
+ERASE_AHEAD_PAGES = 16 * BLOCK_PAGES
+FLUSH_MS = 500
+
+
+def baro_row(rng, t):
+    return '%d\t%d\t%d\n' % (t * 1000, rng.randint(2000, 9000), rng.randint(3000000, 4200000))
+
+
+def imu_row(rng, t):
+    values = [rng.randint(-32768, 32767) for i in range(9)]
+    return '%d\t' % (t * 1000) + '\t'.join(str(v) for v in values) + '\n'
+
+
+def highg_row(rng, t):
+    return '%d\t%d\t%d\t%d\n' % (t * 1000, rng.randint(-2048, 2047), rng.randint(-2048, 2047), rng.randint(-2048, 2047))
+
+
+def volts_row(rng, t):
+    return '%d\t%f\t%f\t%d\t%d\t%d\t%d\t%d\t%d\n' % (t, rng.uniform(7, 8.4), rng.uniform(4.8, 5.2),
+                                                     rng.randint(0, 4095), rng.randint(0, 4095), rng.randint(0, 4095),
+                                                     rng.randint(0, 4095), 0, 0)
+
+
+def gps_row(rng, t):
+    return rng.choice('$GPGGA,0123456789.,*\r\n')
+
+
+# name, flight period ms (0 for every writer pass), pre-triggered, sync_every, header, row
+STREAMS = [
+    ('BARO', 20, True, 50, '% t_us temp_raw pressure_raw kind=baro\n', baro_row),
+    ('IMU', 5, True, 100, '% t_us ax ay az gx gy gz mx my mz kind=imu\n', imu_row),
+    ('HIGHG', 10, True, 50, '% t_us ax ay az kind=highg\n', highg_row),
+    ('VOLTS', 100, False, 25, '% tick vext vbus ch1 ch2 ch3 ch4 mode fires kind=volts\n', volts_row),
+    ('GPS', 0, False, 1024, None, gps_row),
+]
+
+
+class Card(object):
+    def __init__(self, failures, rng):
+        self.failures = failures
+        self.rng = rng
+        self.files = {}
+
+    def failing(self, t):
+        return any(at <= t < at + length for at, length in self.failures)
+
+
+class CardFile(object):
+    """A TAB file open on the card: synced holds what survives, pending what f_write took since."""
+    def __init__(self, card, name):
+        self.card = card
+        self.name = name
+        card.files.setdefault(name, bytearray())
+        self.pending = bytearray()
+        self.open = True
+
+    def write(self, t, data):
+        if self.card.failing(t):
+            self.pending.extend(data[:self.card.rng.randint(0, len(data) - 1)])
+            return False
+        self.pending.extend(data)
+        return True
+
+    def sync(self, t):
+        if self.card.failing(t):
+            return False
+        self.card.files[self.name].extend(self.pending)
+        self.pending = bytearray()
+        return True
+
+    def close(self, t, rng):
+        if self.card.failing(t):
+            return False
+        self.card.files[self.name].extend(self.pending[:rng.randint(0, len(self.pending))])
+        self.pending = bytearray()
+        self.open = False
+        return True
+
+    def size(self):
+        return len(self.card.files[self.name]) + len(self.pending)
+
+
+class Flash(object):
+    """flash_log.c with the S25FL reduced to a dict of programmed pages and an erase timer."""
+    def __init__(self, rng, blocks=BLOCKS):
+        self.rng = rng
+        self.blocks = blocks
+        self.ring_pages = blocks * BLOCK_PAGES
+        self.programmed = {}
+        self.busy_until = 0.0
+        self.page = [bytearray(PAGE), bytearray(PAGE)]
+        self.filling = 0
+        self.sealed = False
+        self.fill = mirror_log.HEADER_SIZE
+        self.last_chunk = 0
+        self.first_chunk_ms = 0
+        self.sequence = 0
+        self.write_page = 0
+        self.erased_page = 0
+        self.dropped = 0
+        self.suspends = 0
+        self.now = 0
+
+    def reboot(self):
+        """Warm restart: RAM is lost, and flash_log_init skips a page past the newest."""
+        self.page = [bytearray(PAGE), bytearray(PAGE)]
+        self.sealed = False
+        self.fill = mirror_log.HEADER_SIZE
+        self.last_chunk = 0
+        self.busy_until = 0.0
+        if self.write_page == 0:
+            return
+        self.erased_page = ((self.write_page - 1) // BLOCK_PAGES + 1) * BLOCK_PAGES
+        self.write_page = min(self.write_page + 1, self.erased_page)
+
+    def seal(self):
+        page = self.page[self.filling]
+        page[self.fill:DATA_END] = '\xff' * (DATA_END - self.fill)
+        page[0:4] = struct.pack('<I', self.sequence)
+        page[DATA_END:] = struct.pack('<H', binascii.crc_hqx(bytes(page[:DATA_END]), 0))
+        self.sequence += 1
+        self.sealed = True
+        self.filling ^= 1
+        self.fill = mirror_log.HEADER_SIZE
+        self.last_chunk = 0
+
+    def program(self):
+        self.programmed[self.write_page % self.ring_pages] = bytes(self.page[self.filling ^ 1])
+        self.write_page += 1
+        self.sealed = False
+
+    def poll(self):
+        if not self.sealed and self.fill > mirror_log.HEADER_SIZE and self.now - self.first_chunk_ms >= FLUSH_MS:
+            self.seal()
+        if self.now < self.busy_until:
+            if self.sealed and self.write_page + BLOCK_PAGES < self.erased_page:
+                self.program()
+                self.suspends += 1
+            return
+        if self.sealed and self.write_page < self.erased_page:
+            self.program()
+        if self.erased_page - self.write_page < ERASE_AHEAD_PAGES:
+            for page in range(self.erased_page, self.erased_page + BLOCK_PAGES):
+                self.programmed.pop(page % self.ring_pages, None)
+            self.erased_page += BLOCK_PAGES
+            self.busy_until = self.now + self.rng.uniform(130, 650)
+
+    def append(self, stream, number, offset, data):
+        while data:
+            page = self.page[self.filling]
+            room = DATA_END - self.fill
+            chunk = self.last_chunk
+            if chunk == 0 or room == 0 or (page[chunk], struct.unpack_from('<H', page, chunk + 2)[0]) != (stream, number) or \
+                    struct.unpack_from('<I', page, chunk + 4)[0] + page[chunk + 1] != offset:
+                if room <= mirror_log.CHUNK.size:
+                    if self.sealed:
+                        self.poll()
+                    if self.sealed:
+                        self.dropped += len(data)
+                        return
+                    self.seal()
+                    continue
+                if self.fill == mirror_log.HEADER_SIZE:
+                    self.first_chunk_ms = self.now
+                chunk = self.last_chunk = self.fill
+                mirror_log.CHUNK.pack_into(page, chunk, stream, 0, number, offset)
+                self.fill += mirror_log.CHUNK.size
+                room -= mirror_log.CHUNK.size
+            n = min(room, len(data))
+            page[self.fill:self.fill + n] = data[:n]
+            page[chunk + 1] += n
+            self.fill += n
+            offset += n
+            data = data[n:]
+
+    def first_sequence(self, block):
+        page = self.programmed.get(block * BLOCK_PAGES)
+        return None if page is None else struct.unpack_from('<I', page)[0]
+
+    def ring(self):
+        """What download mode reads: flash_log_init's scan from the flash alone, then flash_log_read."""
+        firsts = [(self.first_sequence(b), b) for b in range(self.blocks) if self.first_sequence(b) is not None]
+        if not firsts:
+            return ''
+        newest, head = max(firsts)
+        page = head * BLOCK_PAGES
+        while page + 1 < (head + 1) * BLOCK_PAGES and page + 1 in self.programmed:
+            page += 1
+        write = min(page + 2, (head + 1) * BLOCK_PAGES)
+        for step in range(1, self.blocks + 1):
+            first = (head + step) % self.blocks
+            if self.first_sequence(first) is not None:
+                break
+        first *= BLOCK_PAGES
+        pages = (write - first) % self.ring_pages or self.ring_pages
+        blank = '\xff' * PAGE
+        return ''.join(self.programmed.get((first + p) % self.ring_pages, blank) for p in range(pages))
+
+
+class Stream(object):
+    def __init__(self, index, desc, card, flash):
+        self.index = index
+        self.name, self.period, self.pretriggered, self.sync_every, self.header, self.row = desc
+        self.card = card
+        self.flash = flash
+        self.file_name = mirror_log.file_name(index, 1)
+        self.file = CardFile(card, self.file_name)
+        self.truth = bytearray()
+        self.offset = 0
+        self.rows_end = 0       # card_rows_end
+        self.synced = 0         # card_synced_end
+        self.unsynced = 0
+        self.failed = False
+        self.retry_ms = 0
+        self.missed = 0
+        if self.header:
+            self.emit(0, self.header)
+
+    def emit(self, t, row):
+        self.flash.append(self.index, 1, self.offset, row)
+        self.truth.extend(row)
+        self.offset += len(row)
+        if self.failed:
+            self.missed += len(row)
+        elif not self.file.write(t, row):
+            self.failed, self.retry_ms = True, t
+            self.missed += len(row)
+        else:
+            self.rows_end = self.offset
+
+    def store(self, t, row):
+        self.emit(t, row)
+        self.unsynced += 1
+        if self.unsynced >= self.sync_every:
+            self.unsynced = 0
+            if self.failed:
+                return
+            if self.file.sync(t):
+                self.synced = self.offset
+            else:
+                self.failed, self.retry_ms = True, t
+
+    def retry(self, t, rng):
+        """storage_card_retry"""
+        self.retry_ms = t
+        if self.file.open and not self.file.close(t, rng):
+            return
+        if self.card.failing(t):
+            return
+        self.file = CardFile(self.card, self.file_name)
+        size = self.file.size()
+        if size > self.rows_end:
+            size = self.rows_end
+        elif self.synced < size < self.rows_end:
+            # storage_last_row_end
+            size = max(self.card.files[self.file_name].rfind('\n', self.synced, size) + 1, self.synced)
+        del self.card.files[self.file_name][size:]
+        gap = self.offset - size
+        filler = bytearray(' ' * gap)
+        if gap:
+            filler[0] = '\n'
+            filler[-1] = '\n'
+            if gap > 2:
+                filler[1] = '%'
+        self.file.write(t, filler)
+        self.file.sync(t)
+        self.rows_end = self.synced = self.offset
+        self.failed = False
+
+    def warm_restart(self, t, rng):
+        """storage_resume: the card file is cut back to the last sync, and the stream goes on from there."""
+        if self.file.open:
+            self.file.pending = bytearray()
+        else:
+            self.file = CardFile(self.card, self.file_name)
+        resume = min(self.synced, len(self.card.files[self.file_name]))
+        del self.card.files[self.file_name][resume:]
+        del self.truth[resume:]
+        self.offset = self.rows_end = resume
+        self.failed = False
+        self.unsynced = 0
+
+
+def simulate(opts, rng):
+    card = Card(opts.fail, rng)
+    flash = Flash(rng, opts.blocks)
+    streams = [Stream(i, desc, card, flash) for i, desc in enumerate(STREAMS)]
+    end_ms = int((opts.pad + opts.seconds) * 1000)
+    restarted = opts.restart is None
+    for t in range(0, end_ms, WRITER_PERIOD_MS):
+        flash.now = t
+        if not restarted and t >= opts.restart * 1000:
+            restarted = True
+            flash.reboot()
+            for s in streams:
+                s.warm_restart(t, rng)
+        flight = t >= opts.pad * 1000
+        for s in streams:
+            if s.failed and t - s.retry_ms >= CARD_RETRY_MS:
+                s.retry(t, rng)
+            period = s.period if flight or not s.pretriggered else PAD_PERIOD_MS
+            if period == 0:
+                rows = 10
+            else:
+                rows = len(range((t // period + (t % period != 0)) * period, t + WRITER_PERIOD_MS, period))
+            for i in range(rows):
+                s.store(t, s.row(rng, t))
+        flash.poll()
+    # Close the card files the way a landing does: a last sync, if the card lets it
+    for s in streams:
+        if not s.failed and s.file.sync(end_ms):
+            s.synced = s.offset
+    # Let the mirror drain
+    for t in range(end_ms, end_ms + 2000, WRITER_PERIOD_MS):
+        flash.now = t
+        flash.poll()
+    return streams, card, flash
+
+
+def unloadable(on_card, header):
+    """Lines of a TAB file's card copy that load_tab.m's load() would reject: not a comment,
+    and not as many columns as the header names."""
+    columns = len([token for token in header.split()[1:] if '=' not in token])
+    return [line for line in on_card.split('\n')
+            if line.strip() and not line.lstrip().startswith('%') and len(line.split()) != columns]
+
+
+def check(streams, card, flash):
+    mirrored, torn = mirror_log.rebuild(flash.ring())
+    ok = True
+    print '%-10s %9s %9s %9s %9s %9s' % ('file', 'bytes', 'card miss', 'repaired', 'lost', 'result')
+    for s in streams:
+        on_card = str(card.files[s.file_name])
+        mirror = mirrored.get(s.file_name, mirror_log.MirrorFile())
+        merged, repaired, lost = mirror_log.merge(on_card, mirror)
+        truth = str(s.truth)
+        bad = [r for r in mirror_log.subtract(mirror_log.differences(truth, merged), lost)]
+        # Bytes neither copy has are only allowed where the mirror dropped them and the card missed them
+        unexplained = [(a, b) for a, b in lost if on_card[a:b] == truth[a:b] and b <= len(on_card)]
+        broken = unloadable(on_card, s.header) if s.header else []
+        good = not bad and not unexplained and not broken
+        ok = ok and good
+        print '%-10s %9d %9d %9d %9d %9s' % (s.file_name, len(truth), len(truth) - len(on_card) + sum(
+            b - a for a, b in mirror_log.differences(truth[:len(on_card)], on_card)), sum(b - a for a, b in repaired),
+            sum(b - a for a, b in lost), 'ok' if good else 'BAD %s' % (bad or unexplained or broken)[:3])
+    print 'mirror: %d pages, %d programmed with an erase suspended, %d torn, %d bytes dropped' % (
+        flash.write_page, flash.suspends, torn, flash.dropped)
+    return ok
+
+
+def failure(text):
+    at, length = text.split(':')
+    return float(at), float(length)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Card failure injection against the flash mirror')
+    parser.add_argument('--pad', type=float, default=30, help='seconds at the pad rate first')
+    parser.add_argument('--seconds', type=float, default=60, help='seconds at the flight rate')
+    parser.add_argument('--fail', type=failure, action='append', help='card fails at AT s for FOR s')
+    parser.add_argument('--restart', type=float, help='warm restart at this many seconds')
+    parser.add_argument('--blocks', type=int, default=BLOCKS, help='64 kB blocks in the ring; fewer to wrap it')
+    parser.add_argument('--seed', type=int, default=1)
+    opts = parser.parse_args()
+    if opts.fail is None:
+        opts.fail = [(opts.pad + 5, 0.3), (opts.pad + 20, 2.5)]
+    opts.fail = [(at * 1000, length * 1000) for at, length in opts.fail]
+
+    rng = random.Random(opts.seed)
+    streams, card, flash = simulate(opts, rng)
+    if not check(streams, card, flash):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
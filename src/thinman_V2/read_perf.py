@@ -0,0 +1,46 @@
+# Requests the binary "perf" report over the command link and prints it.
+# Layout is documented in example/src/tasks/perf.h.
+import serial
+import struct
+import sys
+
+PORT = sys.argv[1] if len(sys.argv) > 1 else 'COM8'
+NAME_LEN = 8
+STATES = ['run', 'ready', 'blocked', 'susp', 'deleted']
+QUEUES = ['BARO', 'IMU', 'HIGHG', 'VOLTS', 'GPS']
+
+def decode(data):
+    version, task_count, window_us, heap_free, heap_min = struct.unpack_from('<BBIHH', data, 0)
+    if version not in (1, 2):
+        raise ValueError('unknown report version %d' % version)
+    offset = 10
+    print 'window %d us, heap free %d, min %d' % (window_us, heap_free, heap_min)
+    for i in range(task_count):
+        name = data[offset:offset + NAME_LEN].rstrip('\x00')
+        cpu, stack, prio, state = struct.unpack_from('<HHBB', data, offset + NAME_LEN)
+        offset += NAME_LEN + 6
+        print '  %-8s %5.1f%%  stack free %4d words  prio %d  %s' % (name, cpu / 10.0, stack, prio,
+                                                                    STATES[state] if state < len(STATES) else state)
+    queue_count, = struct.unpack_from('<B', data, offset)
+    offset += 1
+    for i in range(queue_count):
+        count, high_water, capacity, dropped = struct.unpack_from('<HHHH', data, offset)
+        offset += 8
+        name = QUEUES[i] if i < len(QUEUES) else str(i)
+        print '  queue %-6s %4d/%-4d high water %4d dropped %d' % (name, count, capacity, high_water, dropped)
+    busy_max_us, overruns = struct.unpack_from('<HH', data, offset)
+    print 'acquisition busy max %d us, overruns %d' % (busy_max_us, overruns)
+    if version >= 2:
+        latency_us, latency_max_us = struct.unpack_from('<HH', data, offset + 4)
+        print 'interrupt latency %d us, max %d us since boot' % (latency_us, latency_max_us)
+
+sp = serial.Serial(PORT, 9600, timeout=2)
+sp.write('perf\r\n')
+while True:
+    line = sp.readline()
+    if not line:
+        sys.exit('no reply')
+    if line.startswith('=R '):
+        break
+size = int(line.split()[1])
+decode(sp.read(size))
@@ -0,0 +1,185 @@
+# Binary ground commands over the Bluetooth link. Request IDs and reply
+# layouts are documented in example/src/tasks/rpc.h.
+#
+#   python rpc.py [-p COM8] status
+#   python rpc.py fld [-n COUNT] [-i SECONDS]
+#   python rpc.py att | stq | ls
+#   python rpc.py rm NAME
+#   python rpc.py get NAME...         Resumes a file already in the output directory
+#   python rpc.py usb                 Reset into USB download mode (download.py)
+import argparse
+import binascii
+import os
+import serial
+import struct
+import sys
+import time
+from frame_link import FrameLink, FrameError, error_text
+
+STATUS, FLIGHT, ATTITUDE, STORAGE, PERF, SUBSCRIBE = 0x01, 0x02, 0x03, 0x04, 0x05, 0x06
+LIST, REMOVE, XFER, USB = 0x10, 0x11, 0x12, 0x13
+REPLY = 0x80
+PUSH = 0xc0
+ERROR_END = 0x201
+RPC_ERRORS = {
+    0x200: 'unknown command',
+    ERROR_END: 'past the last entry',
+    0x202: 'refused in this flight phase',
+}
+PHASES = ['pad', 'boost', 'coast', 'descent', 'landed']
+FLAGS = ['gps', 'volt', 'baro', 'imu', 'highg']
+
+REPLY_TIMEOUT = 2.0
+RETRIES = 3
+# Longer than the board's whole retry budget (6 x 1 s), so it has given up first
+FRAME_TIMEOUT = 8.0
+
+
+class RpcError(FrameError):
+    def __init__(self, code):
+        FrameError.__init__(self, RPC_ERRORS.get(code) or error_text(code))
+        self.code = code
+
+
+def request(link, command, arg=0, payload=''):
+    """Sends a request until it is answered. Returns the reply payload, or raises RpcError."""
+    for attempt in range(RETRIES):
+        link.send(chr(command), arg, payload)
+        deadline = time.time() + REPLY_TIMEOUT
+        while time.time() < deadline:
+            frame = link.receive(deadline - time.time())
+            if frame is None:
+                break
+            kind, status, data = frame
+            if ord(kind) == command | REPLY:
+                if status:
+                    raise RpcError(status)
+                return data
+    raise FrameError('no answer to command 0x%02x' % command)
+
+
+def phase_name(phase):
+    return PHASES[phase] if phase < len(PHASES) else str(phase)
+
+
+def show_status(link):
+    version, flags, phase, uptime_ms = struct.unpack('<BBBI', request(link, STATUS))
+    up = [name for i, name in enumerate(FLAGS) if flags & (1 << i)]
+    print 'protocol %d, %s, up %.1f s, running: %s' % (version, phase_name(phase), uptime_ms / 1000.0,
+                                                         ' '.join(up) or 'nothing')
+
+
+def show_flight(link, count, interval):
+    for i in range(count):
+        if i:
+            time.sleep(interval)
+        tick, alt, max_alt, max_acc, speed, max_speed, descent, phase = struct.unpack(
+            '<IiiihhHB', request(link, FLIGHT))
+        print '%9.3f s  %-7s alt %8.2f m  max %8.2f m  speed %+7.1f m/s  max %6.1f m/s  max acc %6.2f g' % (
+            tick / 1000.0, phase_name(phase), alt / 1000.0, max_alt / 1000.0, speed / 10.0, max_speed / 10.0,
+            max_acc / 1000.0)
+
+
+def show_attitude(link):
+    values = struct.unpack('<iiiiiIII', request(link, ATTITUDE))
+    q = [x / float(1 << 30) for x in values[:4]]
+    print 'q %+.4f %+.4f %+.4f %+.4f  vertical cos %+.4f' % (q[0], q[1], q[2], q[3], values[4] / float(1 << 30))
+    print 'update %d cycles, max %d, budget %d' % values[5:]
+
+
+def show_storage(link):
+    index = 0
+    while True:
+        try:
+            data = request(link, STORAGE, index)
+        except RpcError as e:
+            if e.code == ERROR_END:
+                return
+            raise
+        count, high_water, capacity, dropped, written = struct.unpack_from('<IIIII', data)
+        print '%-6s %4d/%-4d high water %4d dropped %d written %d' % (data[20:], count, capacity, high_water,
+                                                                      dropped, written)
+        index += 1
+
+
+def list_files(link):
+    files = []
+    while True:
+        try:
+            data = request(link, LIST, len(files))
+        except RpcError as e:
+            if e.code == ERROR_END:
+                return files
+            raise
+        size, attributes = struct.unpack_from('<IB', data)
+        files.append((data[5:], size, attributes))
+
+
+def get_file(link, name, out_dir):
+    path = os.path.join(out_dir, name)
+    offset = os.path.getsize(path) if os.path.exists(path) else 0
+    size, start, length = struct.unpack('<III', request(link, XFER, offset, name))
+    if start < offset:
+        # Local copy is longer than the file on the card; the transfer already running ends it
+        link.receive_range(open(os.devnull, 'wb'), start, start + length, FRAME_TIMEOUT)
+        os.remove(path)
+        return get_file(link, name, out_dir)
+    began = time.time()
+    f = open(path, 'ab')
+    crc = link.receive_range(f, start, start + length, FRAME_TIMEOUT)
+    f.close()
+    f = open(path, 'rb')
+    f.seek(start)
+    if binascii.crc32(f.read()) & 0xffffffff != crc:
+        f.close()
+        raise FrameError('%s CRC mismatch' % name)
+    f.close()
+    print '%-12s %8d bytes  %6.2f kB/s' % (name, size, length / 1024.0 / max(time.time() - began, 1e-3))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Binary ground commands over the Bluetooth link')
+    parser.add_argument('-p', '--port', default='COM8')
+    parser.add_argument('-b', '--baud', type=int, default=9600)
+    parser.add_argument('-o', '--out', default='.', help='output directory for get')
+    parser.add_argument('-n', '--count', type=int, default=1, help='fld replies to print')
+    parser.add_argument('-i', '--interval', type=float, default=1.0, help='seconds between fld requests')
+    parser.add_argument('command', choices=['status', 'fld', 'att', 'stq', 'ls', 'rm', 'get', 'usb'])
+    parser.add_argument('args', nargs='*')
+    opts = parser.parse_args()
+
+    link = FrameLink(serial.Serial(opts.port, opts.baud, timeout=0.05))
+    if opts.command == 'status':
+        show_status(link)
+    elif opts.command == 'fld':
+        show_flight(link, opts.count, opts.interval)
+    elif opts.command == 'att':
+        show_attitude(link)
+    elif opts.command == 'stq':
+        show_storage(link)
+    elif opts.command == 'ls':
+        for name, size, attributes in list_files(link):
+            print '%s %8d %s' % ('D' if attributes & 0x10 else 'F', size, name)
+    elif opts.command == 'rm':
+        for name in opts.args:
+            request(link, REMOVE, 0, name)
+    elif opts.command == 'get':
+        if not os.path.isdir(opts.out):
+            os.makedirs(opts.out)
+        for name in opts.args:
+            get_file(link, name, opts.out)
+    elif opts.command == 'usb':
+        # A reset drops the link, so silence means it worked
+        try:
+            request(link, USB)
+        except RpcError:
+            raise
+        except FrameError:
+            print 'resetting into download mode'
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except FrameError as e:
+        sys.exit(str(e))
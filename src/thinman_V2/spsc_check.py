@@ -0,0 +1,159 @@
+# Checks the storage queues (example/src/drivers/spsc_queue.c), built for
+# the host with SPSC_HOST.
+#
+#   python spsc_check.py [--ticks N] [--seed N]
+#
+# With one thread it checks, through ctypes:
+#   - records come out in order and intact, across the ends of the buffer
+#   - a full queue refuses the push and counts a drop, and pop on an empty
+#     queue fails
+#   - high_water and spsc_queue_count stay right as the 32-bit indices wrap
+# Then host/spsc_stress.c runs each side in a 20 us timer signal, standing
+# in for an interrupt, against the other in the main loop, for every record
+# size the storage streams use, at capacities from 2 up, from indices that
+# wrap during the run. It fails on any torn, repeated, reordered or lost
+# record, and when the drop counts disagree. Exits non-zero on any failure.
+#
+# The signal preempts the other side at arbitrary instructions, as an
+# interrupt does on the single-core M0+, so an index published before its
+# record is copied, or a slot handed back before it is read, shows up as
+# torn records. Memory ordering between cores is not exercised; the M0+
+# has one.
+import argparse
+import ctypes
+import random
+import struct
+import sys
+import host_build
+
+# storage.c record sizes: baro and high-g, IMU and volts, and the GPS bytes
+RECORD_SIZES = [12, 24, 1]
+CAPACITIES = [2, 4, 16, 128]
+
+
+class Queue(ctypes.Structure):
+    _fields_ = [('buffer', ctypes.c_void_p), ('record_size', ctypes.c_uint16), ('mask', ctypes.c_uint16),
+                ('head', ctypes.c_uint32), ('tail', ctypes.c_uint32),
+                ('high_water', ctypes.c_uint32), ('dropped', ctypes.c_uint32)]
+
+
+class StressResult(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint32) for name in
+                ('pushed', 'dropped', 'popped', 'torn', 'out_of_order', 'high_water', 'queue_dropped', 'ticks')]
+
+
+lib = host_build.load(['drivers/spsc_queue.c', 'host/spsc_stress.c'], defines=['SPSC_HOST'])
+lib.spsc_queue_push.restype = ctypes.c_bool
+lib.spsc_queue_pop.restype = ctypes.c_bool
+lib.spsc_stress.restype = ctypes.c_bool
+
+
+class Spsc(object):
+    """spsc_queue_t and its functions, for records of up to 8 bytes."""
+    def __init__(self, capacity, start=0):
+        self.q = Queue()
+        self.buffer = ctypes.create_string_buffer(8 * capacity)
+        lib.spsc_queue_init(ctypes.byref(self.q), self.buffer, 8, capacity)
+        self.q.head = self.q.tail = start
+
+    def push(self, value):
+        return lib.spsc_queue_push(ctypes.byref(self.q), struct.pack('<Q', value))
+
+    def pop(self):
+        out = ctypes.create_string_buffer(8)
+        if not lib.spsc_queue_pop(ctypes.byref(self.q), out):
+            return None
+        return struct.unpack('<Q', out.raw)[0]
+
+    def count(self):
+        return (self.q.head - self.q.tail) & 0xffffffff
+
+
+def check_single(rng):
+    failures = []
+    for capacity in CAPACITIES:
+        for start in (0, 0xffffffff - capacity // 2):
+            q = Spsc(capacity, start)
+            if q.pop() is not None:
+                failures.append('capacity %d: popped from an empty queue' % capacity)
+            for n in range(capacity):
+                if not q.push(n):
+                    failures.append('capacity %d: refused push %d' % (capacity, n))
+            if q.push(capacity) or q.q.dropped != 1:
+                failures.append('capacity %d: full push not refused and counted' % capacity)
+            if q.q.high_water != capacity or q.count() != capacity:
+                failures.append('capacity %d from %#x: high water %d, count %d' %
+                                (capacity, start, q.q.high_water, q.count()))
+            # Random interleaving, checked against a Python list
+            model = list(range(capacity))
+            value = capacity + 1
+            for step in range(capacity * 50):
+                if rng.random() < 0.5:
+                    ok = q.push(value)
+                    if ok != (len(model) < capacity):
+                        failures.append('capacity %d: push %s with %d queued' % (capacity, ok, len(model)))
+                    if ok:
+                        model.append(value)
+                    value += 1
+                else:
+                    got = q.pop()
+                    want = model.pop(0) if model else None
+                    if got != want:
+                        failures.append('capacity %d: popped %s, expected %s' % (capacity, got, want))
+                if q.count() != len(model):
+                    failures.append('capacity %d: count %d, expected %d' % (capacity, q.count(), len(model)))
+                if failures:
+                    return failures
+    return failures
+
+
+def check_preempted(ticks, rng):
+    print '%-8s %6s %9s %9s %9s %9s %6s %7s %s' % ('signal', 'bytes', 'capacity', 'pushed', 'dropped', 'popped',
+                                                 'high', 'ticks', 'result')
+    ok = True
+    for isr_producer in (True, False):
+        for size in RECORD_SIZES:
+            for capacity in CAPACITIES:
+                r = StressResult()
+                # About ticks signals' worth, each moving up to a queue's worth
+                records = ticks * capacity
+                start = 0xffffffff - rng.randrange(records)
+                # Bursts past the capacity so the producer also finds the queue full
+                burst = rng.randint(1, 2 * capacity)
+                if not lib.spsc_stress(size, capacity, records, start, isr_producer, burst, ctypes.byref(r)):
+                    sys.exit('could not set up the timer signal')
+                failures = []
+                if r.torn or r.out_of_order:
+                    failures.append('%d torn, %d out of order' % (r.torn, r.out_of_order))
+                # Only an interrupt producing full-size records drops them; the rest retry
+                lost = r.dropped if isr_producer and size >= 4 else 0
+                if r.popped != r.pushed or r.pushed + lost != records:
+                    failures.append('pushed %d, dropped %d, popped %d of %d' % (r.pushed, r.dropped, r.popped, records))
+                if r.queue_dropped != r.dropped or r.high_water > capacity:
+                    failures.append('queue counted %d drops, high water %d' % (r.queue_dropped, r.high_water))
+                ok = ok and not failures
+                print '%-8s %6d %9d %9d %9d %9d %6d %7d %s' % (
+                    'producer' if isr_producer else 'consumer', size, capacity, r.pushed, r.dropped, r.popped,
+                    r.high_water, r.ticks, 'ok' if not failures else 'BAD')
+                for failure in failures:
+                    print '         ' + failure
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SPSC queue checks, single-threaded and preempted')
+    parser.add_argument('--ticks', type=int, default=5000, help='timer signals per preempted run, roughly')
+    parser.add_argument('--seed', type=int, default=1)
+    opts = parser.parse_args()
+    rng = random.Random(opts.seed)
+    failures = check_single(rng)
+    print 'single thread: ' + ('ok' if not failures else 'BAD')
+    for failure in failures[:5]:
+        print '       ' + failure
+    ok = check_preempted(opts.ticks, rng) and not failures
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
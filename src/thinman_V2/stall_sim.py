@@ -0,0 +1,216 @@
+# Replays SD card write latencies against the storage queues
+# (example/src/tasks/storage.c) at the flight rate, and checks that no
+# producer finds its queue full.
+#
+#   python stall_sim.py [--profile typical|worst|burst] [--replay LOG] [--seconds S] [--load F]
+#                       [--queue NAME=N ...] [--seed N]
+#
+# Producers push at their full rates into queues of the sizes in storage.c.
+# The writer model pops them stream by stream the way task_storage does,
+# spends the formatting time of each row, and stalls on the card whenever
+# FatFs would write a sector: when a file's sector buffer fills, and on
+# f_sync for the partial sector, the directory entry and, once a cluster
+# has been allocated since the last sync, the FAT. It starts with the
+# pre-trigger rings to write out, as at launch. Each sector write takes a
+# latency drawn from the profile:
+#
+#   typical  1-3 ms, and every 500-1500 writes a stall of 100-250 ms
+#   worst    1-3 ms, and every 500-1500 writes a stall of 250-500 ms, the
+#            SDXC limit
+#   burst    worst, with each stall followed by a second one
+#
+# Stalls are spaced because a card that has just collected garbage has
+# erased blocks to write into for a while.
+#
+# --replay instead draws from the histogram in the last "Storage card ms"
+# line of a board log, uniformly within each bucket, and --queue tries
+# another capacity for a stream. burst goes past STORAGE_STALL_MS on
+# purpose, to show what the drops look like. Exits non-zero if any record
+# was dropped.
+import argparse
+import random
+import re
+import sys
+import mirror_sim
+
+IDLE_MS = 10                # STORAGE_IDLE_PERIOD_MS
+SECTOR = 512
+CLUSTER_SECTORS = 64        # 32 kB clusters, as a 4-32 GB card is formatted
+BUCKETS = 11                # SDCARD_WRITE_BUCKETS
+PASS_SHARE = 8              # STORAGE_PASS_SHARE
+
+# name, period ms, queue capacity, pre-trigger ring records, sync_every, M0+ formatting us per row
+STREAMS = [
+    ('BARO', 40.0, 16, 32, 50, 150),
+    ('IMU', 5.0, 128, (0x800 - 48 * 12) // 24, 100, 450),
+    ('HIGHG', 10.0, 64, 0x400 // 12, 50, 120),
+    ('VOLTS', 20.0, 32, 0, 25, 600),       # Two floats through soft-float %f
+    ('GPS', 1000.0 / 960, 1024, 0, 1024, 5),
+]
+ROWS = dict((desc[0], desc[5]) for desc in mirror_sim.STREAMS)
+
+PROFILES = {
+    'typical': (1000, (100, 250), False),
+    'worst': (1000, (250, 500), False),
+    'burst': (1000, (250, 500), True),
+}
+
+
+class Card(object):
+    """Latency of one SDCardDiskWrite of one sector, in ms."""
+    def __init__(self, rng, profile, replay):
+        self.rng = rng
+        self.profile = profile
+        self.replay = replay
+        self.repeat = False
+        self.next_stall = self.spacing()
+        self.histogram = [0] * BUCKETS
+        self.writes = 0
+        self.longest = 0.0
+
+    def spacing(self):
+        every = PROFILES[self.profile][0]
+        return self.rng.randint(every // 2, every * 3 // 2)
+
+    def sample(self):
+        if self.replay:
+            pick = self.rng.uniform(0, sum(self.replay))
+            for bucket, count in enumerate(self.replay):
+                pick -= count
+                if pick <= 0 and count:
+                    break
+            low = 0 if bucket == 0 else 1 << (bucket - 1)
+            return self.rng.uniform(low, 1 << bucket)
+        (low, high), burst = PROFILES[self.profile][1:]
+        if self.repeat or self.writes >= self.next_stall:
+            self.repeat = burst and not self.repeat
+            self.next_stall = self.writes + self.spacing()
+            return self.rng.uniform(low, high)
+        return self.rng.uniform(1, 3)
+
+    def write(self):
+        ms = self.sample()
+        bucket = 0
+        while bucket < BUCKETS - 1 and ms >= 1 << bucket:
+            bucket += 1
+        self.histogram[bucket] += 1
+        self.writes += 1
+        self.longest = max(self.longest, ms)
+        return ms
+
+
+class Stream(object):
+    def __init__(self, desc, rng, card):
+        self.name, self.period, self.capacity, ring, self.sync_every, self.format_us = desc
+        self.rng = rng
+        self.card = card
+        self.next_ms = 0.0
+        self.queue = 0
+        self.high_water = 0
+        self.dropped = 0
+        self.backlog = ring
+        self.unsynced = 0
+        self.buffered = 0
+        self.sectors = 0
+        self.synced_sectors = 0
+
+    def produce(self, now):
+        while self.next_ms <= now:
+            if self.queue == self.capacity:
+                self.dropped += 1
+            else:
+                self.queue += 1
+                self.high_water = max(self.high_water, self.queue)
+            self.next_ms += self.period
+
+    def store(self, load):
+        """storage_store for one row, returning the writer's time in ms."""
+        ms = self.format_us / 1000.0 / (1 - load)
+        self.buffered += len(ROWS[self.name](self.rng, 0))
+        while self.buffered >= SECTOR:
+            self.buffered -= SECTOR
+            self.sectors += 1
+            ms += self.card.write()
+        self.unsynced += 1
+        if self.unsynced >= self.sync_every:
+            self.unsynced = 0
+            writes = 1 + (self.buffered > 0)
+            if self.sectors // CLUSTER_SECTORS != self.synced_sectors // CLUSTER_SECTORS:
+                writes += 1
+            self.synced_sectors = self.sectors
+            for i in range(writes):
+                ms += self.card.write()
+        return ms
+
+
+def simulate(opts, rng):
+    card = Card(rng, opts.profile, opts.replay)
+    streams = [Stream(desc, rng, card) for desc in STREAMS]
+    for s in streams:
+        s.capacity = opts.queue.get(s.name, s.capacity)
+    end_ms = opts.seconds * 1000
+    now = 0.0
+    while now < end_ms:
+        idle = True
+        for s in streams:
+            # The pre-trigger window goes out before the first live record
+            while s.backlog:
+                s.backlog -= 1
+                now += s.store(opts.load)
+                for p in streams:
+                    p.produce(now)
+            for p in streams:
+                p.produce(now)
+            for i in range(min(s.queue, s.capacity // PASS_SHARE)):
+                s.queue -= 1
+                now += s.store(opts.load)
+                for p in streams:
+                    p.produce(now)
+                idle = False
+        if idle:
+            now += IDLE_MS
+    return streams, card
+
+
+def read_replay(path):
+    counts = None
+    with open(path) as log:
+        for line in log:
+            if 'Storage card ms' in line:
+                counts = [int(n) for n in re.findall(r'(?:<\d+|more) (\d+)', line)]
+    if counts is None or len(counts) != BUCKETS or not sum(counts):
+        sys.exit('%s: no "Storage card ms" line with %d counts' % (path, BUCKETS))
+    return counts
+
+
+def queue_size(text):
+    name, capacity = text.split('=')
+    return name.upper(), int(capacity)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SD card stalls against the storage queues')
+    parser.add_argument('--profile', choices=sorted(PROFILES), default='worst')
+    parser.add_argument('--replay', metavar='LOG', help='board log to take the latency histogram from')
+    parser.add_argument('--seconds', type=float, default=600, help='seconds at the flight rate')
+    parser.add_argument('--load', type=float, default=0.3, help='CPU fraction the sensor tasks take from the writer')
+    parser.add_argument('--queue', type=queue_size, action='append', default=[], help='NAME=N capacity to try')
+    parser.add_argument('--seed', type=int, default=1)
+    opts = parser.parse_args()
+    opts.queue = dict(opts.queue)
+    if opts.replay:
+        opts.replay = read_replay(opts.replay)
+
+    streams, card = simulate(opts, random.Random(opts.seed))
+    print '%-6s %9s %11s %9s' % ('stream', 'capacity', 'high water', 'dropped')
+    for s in streams:
+        print '%-6s %9d %11d %9d' % (s.name, s.capacity, s.high_water, s.dropped)
+    labels = ['<%d' % (1 << b) for b in range(BUCKETS - 1)] + ['more']
+    print 'card: %d writes, longest %.0f ms' % (card.writes, card.longest)
+    print 'card ms ' + ' '.join('%s %d' % pair for pair in zip(labels, card.histogram))
+    if any(s.dropped for s in streams):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,102 @@
+# Stand-in for the app's flight data screen: subscribes to flight state
+# updates over the Bluetooth link (RPC_SUBSCRIBE in
+# example/src/tasks/rpc.h) and reports how many arrive and how old they are.
+#
+#   python stream_client.py [-p COM8] [--period MS] [--seconds S] [--status-every S]
+#
+# Staleness is measured against the board clock: the offset between the two
+# clocks is taken from the update that arrived fastest, so the figures are
+# relative to that update's link delay. "age" is from the newest altitude
+# sample to arrival, "link" from the board sending the update to arrival.
+import argparse
+import serial
+import struct
+import sys
+import time
+import rpc
+from frame_link import FrameLink, FrameError
+
+UPDATE = struct.Struct('<IiiihhHBII')
+
+
+def percentiles(values):
+    values = sorted(values)
+    if not values:
+        return 'none'
+    pick = lambda p: values[min(len(values) - 1, int(p * len(values)))]
+    return 'p50 %6.1f  p90 %6.1f  max %6.1f ms' % (pick(0.5) * 1000, pick(0.9) * 1000, values[-1] * 1000)
+
+
+def stream(link, period, seconds, status_every):
+    granted, = struct.unpack('<H', rpc.request(link, rpc.SUBSCRIBE, period))
+    print 'asked for an update every %d ms, granted %d ms' % (period, granted)
+    updates = []            # (arrival, count, version, data tick, sent tick)
+    round_trips = []
+    status_sent = None
+    next_status = time.time() + status_every if status_every else None
+    end = time.time() + seconds
+    while time.time() < end:
+        if status_sent is not None and time.time() > status_sent + rpc.REPLY_TIMEOUT:
+            status_sent = None
+        if next_status and time.time() >= next_status and status_sent is None:
+            link.send(chr(rpc.STATUS))
+            status_sent = time.time()
+            next_status += status_every
+        frame = link.receive(0.05)
+        if frame is None:
+            continue
+        arrival = time.time()
+        kind, arg, payload = frame
+        if ord(kind) == rpc.FLIGHT | rpc.PUSH and len(payload) == UPDATE.size:
+            fields = UPDATE.unpack(payload)
+            updates.append((arrival, arg, fields[8], fields[0], fields[9]))
+        elif ord(kind) == rpc.STATUS | rpc.REPLY and status_sent is not None:
+            round_trips.append(arrival - status_sent)
+            status_sent = None
+    rpc.request(link, rpc.SUBSCRIBE, 0)
+    report(updates, granted, round_trips, status_every)
+
+
+def report(updates, granted, round_trips, status_every):
+    if len(updates) < 2:
+        print 'only %d updates arrived' % len(updates)
+        return
+    span = updates[-1][0] - updates[0][0]
+    counts = [u[1] for u in updates]
+    lost = counts[-1] - counts[0] + 1 - len(updates)
+    coalesced = sum(max(0, b[2] - a[2] - 1) for a, b in zip(updates, updates[1:]))
+    offset = min(u[0] - u[4] / 1000.0 for u in updates)
+    ages = [u[0] - offset - u[3] / 1000.0 for u in updates]
+    links = [u[0] - offset - u[4] / 1000.0 for u in updates]
+    gaps = [b[0] - a[0] for a, b in zip(updates, updates[1:])]
+    print '%d updates in %.1f s: %.2f per second (granted %.2f), %d lost on the link' % (
+        len(updates), span, (len(updates) - 1) / span, 1000.0 / granted, lost)
+    print 'flight state versions skipped between updates: %d' % coalesced
+    print 'interval  ' + percentiles(gaps)
+    print 'age       ' + percentiles(ages)
+    print 'link      ' + percentiles(links)
+    if status_every:
+        print 'status round trip while streaming  ' + percentiles(round_trips)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Flight state subscription client')
+    parser.add_argument('-p', '--port', default='COM8')
+    parser.add_argument('-b', '--baud', type=int, default=9600)
+    parser.add_argument('--period', type=int, default=100, help='requested update period, ms')
+    parser.add_argument('--seconds', type=float, default=10)
+    parser.add_argument('--status-every', type=float, default=0, help='also request status this often, s')
+    opts = parser.parse_args()
+
+    link = FrameLink(serial.Serial(opts.port, opts.baud, timeout=0.01))
+    try:
+        stream(link, opts.period, opts.seconds, opts.status_every)
+    except KeyboardInterrupt:
+        rpc.request(link, rpc.SUBSCRIBE, 0)
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except FrameError as e:
+        sys.exit(str(e))
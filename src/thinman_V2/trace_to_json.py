@@ -0,0 +1,133 @@
+# Converts a TRACE.BIN kernel trace from the flight computer into Chrome trace
+# JSON, viewable in chrome://tracing or ui.perfetto.dev.
+# Block and event layout is documented in example/src/kernel_trace.c.
+#
+#   python trace_to_json.py TRACE.BIN trace.json
+from __future__ import print_function
+import json
+import struct
+import sys
+
+NAME_LEN = 10   # configMAX_TASK_NAME_LEN
+
+(SWITCH_IN, TASK_CREATE, TASK_DELETE, QUEUE_BLOCK, QUEUE_RECEIVE, QUEUE_TIMEOUT, QUEUE_SEND,
+ QUEUE_SEND_ISR, PRIORITY_INHERIT, PRIORITY_DISINHERIT, ISR_ENTER, ISR_EXIT) = range(1, 13)
+MUTEX_TYPES = (1, 4)    # queueQUEUE_TYPE_MUTEX, queueQUEUE_TYPE_RECURSIVE_MUTEX
+
+PID_CPU, PID_WAITS, PID_LOCKS, PID_ISR = 1, 2, 3, 4
+
+
+def cstr(raw):
+    return raw.split(b'\x00')[0].decode('ascii', 'replace')
+
+
+def read_blocks(data):
+    offset = 0
+    while offset + 8 <= len(data):
+        magic, kind, count, dropped = struct.unpack_from('<2sBxHH', data, offset)
+        if magic != b'KT':
+            raise ValueError('bad block at offset %d' % offset)
+        offset += 8
+        size = {1: 1 + NAME_LEN, 2: 2 + NAME_LEN, 3: 8}[kind] * count
+        yield kind, count, dropped, data[offset:offset + size]
+        offset += size
+
+
+def convert(data):
+    tasks = {}
+    queues = {}
+    out = []
+    last_t = None
+    wrap = 0
+    current = None          # (task, start_us)
+    waits = {}              # task -> (queue, start_us)
+    holds = {}              # (queue, task) -> start_us
+    isrs = {}               # irq -> start_us
+
+    def task_name(number):
+        return tasks.get(number, 'task%d' % number)
+
+    def queue_name(obj):
+        return queues.get(obj, '0x%04x' % obj)
+
+    def slice_(pid, tid, name, start, end, args=None):
+        event = {'ph': 'X', 'pid': pid, 'tid': tid, 'name': name, 'ts': start, 'dur': max(end - start, 0)}
+        if args:
+            event['args'] = args
+        out.append(event)
+
+    def instant(name, ts, args=None):
+        event = {'ph': 'i', 's': 'g', 'pid': PID_CPU, 'tid': 0, 'name': name, 'ts': ts}
+        if args:
+            event['args'] = args
+        out.append(event)
+
+    for kind, count, dropped, payload in read_blocks(data):
+        if kind == 1:
+            for i in range(count):
+                number, = struct.unpack_from('<B', payload, i * (1 + NAME_LEN))
+                tasks[number] = cstr(payload[i * (1 + NAME_LEN) + 1:(i + 1) * (1 + NAME_LEN)])
+            continue
+        if kind == 2:
+            for i in range(count):
+                obj, = struct.unpack_from('<H', payload, i * (2 + NAME_LEN))
+                queues[obj] = cstr(payload[i * (2 + NAME_LEN) + 2:(i + 1) * (2 + NAME_LEN)])
+            continue
+        for i in range(count):
+            t_us, etype, arg, obj = struct.unpack_from('<IBBH', payload, i * 8)
+            # Microsecond timebase wraps every ~71.6 minutes; only a large backward step is a wrap
+            if last_t is not None and t_us + (1 << 31) < last_t:
+                wrap += 1 << 32
+            last_t = t_us
+            t = t_us + wrap
+            if dropped and i == 0:
+                instant('dropped %d events' % dropped, t)
+            task = current[0] if current else None
+
+            if etype == SWITCH_IN:
+                if current:
+                    slice_(PID_CPU, current[0], task_name(current[0]), current[1], t)
+                current = (arg, t)
+            elif etype == QUEUE_BLOCK and task is not None:
+                waits[task] = (obj, t)
+            elif etype in (QUEUE_RECEIVE, QUEUE_TIMEOUT) and task is not None:
+                wait = waits.pop(task, None)
+                if wait and wait[0] == obj:
+                    slice_(PID_WAITS, task, 'wait ' + queue_name(obj), wait[1], t,
+                           {'result': 'timeout' if etype == QUEUE_TIMEOUT else 'ok'})
+                if etype == QUEUE_RECEIVE and arg in MUTEX_TYPES:
+                    holds[(obj, task)] = t
+            elif etype == QUEUE_SEND and task is not None and arg in MUTEX_TYPES:
+                start = holds.pop((obj, task), None)
+                if start is not None:
+                    slice_(PID_LOCKS, obj, task_name(task), start, t)
+            elif etype == QUEUE_SEND_ISR:
+                out.append({'ph': 'i', 's': 't', 'pid': PID_ISR, 'tid': 0, 'name': 'give ' + queue_name(obj), 'ts': t})
+            elif etype == PRIORITY_INHERIT:
+                instant('priority inversion: %s raised to %d' % (task_name(arg), obj), t,
+                        {'waiting': task_name(task) if task is not None else None})
+            elif etype == PRIORITY_DISINHERIT:
+                instant('%s back to priority %d' % (task_name(arg), obj), t)
+            elif etype == ISR_ENTER:
+                isrs[arg] = t
+            elif etype == ISR_EXIT and arg in isrs:
+                slice_(PID_ISR, arg, 'IRQ %d' % arg, isrs.pop(arg), t)
+
+    for pid, name in ((PID_CPU, 'CPU'), (PID_WAITS, 'Queue waits'), (PID_LOCKS, 'Mutex holders'), (PID_ISR, 'Interrupts')):
+        out.append({'ph': 'M', 'pid': pid, 'name': 'process_name', 'args': {'name': name}})
+    for number in tasks:
+        for pid in (PID_CPU, PID_WAITS):
+            out.append({'ph': 'M', 'pid': pid, 'tid': number, 'name': 'thread_name', 'args': {'name': tasks[number]}})
+    for obj in queues:
+        out.append({'ph': 'M', 'pid': PID_LOCKS, 'tid': obj, 'name': 'thread_name', 'args': {'name': queues[obj]}})
+    return {'traceEvents': out, 'displayTimeUnit': 'ms'}
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.exit('usage: trace_to_json.py TRACE.BIN out.json')
+    with open(sys.argv[1], 'rb') as f:
+        trace = convert(f.read())
+    with open(sys.argv[2], 'w') as f:
+        json.dump(trace, f)
+    print('%d events' % len(trace['traceEvents']))
@@ -0,0 +1,244 @@
+# Resets the warm restart block (example/src/warm_restart.c) at random
+# points of a flight and checks what the next boot resumes. warm_restart.c
+# is compiled for the host through host/warm_restart_host.c, which stubs
+# the reset status and NVIC_SystemReset, and driven through ctypes.
+#
+#   python warm_restart_check.py [--flights N] [--tears N] [--seed N]
+#
+# It checks:
+#   - a power-on reset boots cold whatever RAM holds, including a valid
+#     block from a flight
+#   - across flights of phase and file updates, a reset of any other cause
+#     resumes exactly the last saved phase and files while the phase is
+#     between launch and landing, and boots cold otherwise; exit_error
+#     resets in flight, carries its code to the next boot only, and stops
+#     resetting after WARM_RESTART_LIMIT restarts
+#   - a reset part way through an update, leaving any mix of the old and
+#     new bytes, either resumes the state before or after the update or
+#     boots cold; never a mix of the two
+# Exits non-zero on any failure.
+import argparse
+import ctypes
+import os
+import random
+import sys
+import host_build
+
+PAD, BOOST, COAST, DESCENT, LANDED = range(5)
+FULL_RATE = (BOOST, COAST, DESCENT)
+STREAMS = 5                 # STORAGE_STREAM_COUNT
+NO_FILE = 0xffff
+RESTART_LIMIT = 5           # WARM_RESTART_LIMIT
+POR, EXTRST, WDT, BOD, SYSRST = [1 << n for n in range(5)]
+CAUSES = [('ext', EXTRST), ('wdt', WDT), ('bod', BOD), ('sys', SYSRST), ('por', POR), ('bod+por', BOD | POR)]
+
+lib = host_build.load(['host/warm_restart_host.c', 'flight/flight_phase.c', 'drivers/crc.c', 'host/host.c'],
+                      includes=[os.path.join(host_build.HERE, 'example', 'inc'),
+                                os.path.join(host_build.HERE, 'fatfs')])
+lib.warm_host_boot.restype = ctypes.c_bool
+lib.warm_host_fatal.restype = ctypes.c_bool
+lib.warm_restart_get_file.restype = ctypes.c_bool
+lib.warm_restart_count.restype = ctypes.c_uint32
+lib.warm_restart_phase.restype = ctypes.c_int
+BLOCK = lib.warm_host_block_size()
+
+
+def block():
+    data = ctypes.create_string_buffer(BLOCK)
+    lib.warm_host_read_block(data)
+    return bytearray(data.raw)
+
+
+def set_block(data):
+    lib.warm_host_write_block(ctypes.create_string_buffer(bytes(data), BLOCK))
+
+
+def files():
+    """What warm_restart_get_file gives for each stream, None for no file."""
+    found = []
+    for stream in range(STREAMS):
+        number, offset = ctypes.c_uint16(), ctypes.c_uint32()
+        if lib.warm_restart_get_file(stream, ctypes.byref(number), ctypes.byref(offset)):
+            found.append((number.value, offset.value))
+        else:
+            found.append(None)
+    return found
+
+
+class Flight(object):
+    """The state the firmware saved, as the next warm boot must see it."""
+    def __init__(self):
+        self.phase = PAD
+        self.files = [None] * STREAMS
+        self.restarts = 0
+        self.last_error = 0
+
+    def cold(self):
+        self.__init__()
+
+    def save_phase(self, phase):
+        self.phase = phase
+        lib.warm_restart_save_phase(phase)
+
+    def save_file(self, stream, number, offset):
+        self.files[stream] = (number, offset)
+        lib.warm_restart_save_file(stream, number, offset)
+
+    def check(self, what):
+        """Failures comparing the booted state with the saved one."""
+        failures = []
+        got = (lib.warm_restart_phase(), files(),
+               lib.warm_restart_count(), lib.warm_restart_last_error())
+        want = (self.phase, self.files, self.restarts, self.last_error)
+        if got != want:
+            failures.append('%s: booted to phase %d, files %s, %d restarts, error %d; expected %s' %
+                            ((what,) + got + (want,)))
+        return failures
+
+
+def boot(flight, cause, what):
+    """Boots after a reset of cause and checks it against flight."""
+    warm = lib.warm_host_boot(cause)
+    expect_warm = not cause & POR and flight.phase in FULL_RATE
+    if warm != expect_warm:
+        return ['%s: %s boot, expected %s' % (what, 'warm' if warm else 'cold', 'warm' if expect_warm else 'cold')]
+    if warm:
+        flight.restarts = min(flight.restarts + 1, 0xff)
+    else:
+        flight.cold()
+    failures = flight.check(what)
+    flight.last_error = 0
+    return failures
+
+
+def check_power_on(rng):
+    failures = []
+    flight = Flight()
+    for n in range(50):
+        set_block(bytearray(rng.getrandbits(8) for i in range(BLOCK)))
+        failures += boot(flight, POR, 'power-on over noise')
+    # A block left from a flight is still refused after a power-on
+    failures += boot(flight, WDT, 'reset on the pad')
+    flight.save_phase(COAST)
+    flight.save_file(0, 3, 4096)
+    failures += boot(flight, WDT, 'reset in coast')
+    failures += boot(flight, POR | BOD, 'power-on in coast')
+    return failures
+
+
+def check_flights(rng, flights):
+    """Random updates and resets across whole flights; failures and reset counts."""
+    failures = []
+    counts = dict((name, 0) for name, cause in CAUSES)
+    counts.update(fatal=0, halted=0)
+    for n in range(flights):
+        flight = Flight()
+        failures += boot(flight, POR, 'power-on')
+        number = rng.randrange(100)
+        phases = [PAD, BOOST, COAST, DESCENT, LANDED]
+        while phases:
+            action = rng.random()
+            if action < 0.1:
+                flight.save_phase(phases.pop(0))
+            elif action < 0.7:
+                stream = rng.randrange(STREAMS)
+                offset = (flight.files[stream] or (0, 0))[1] + rng.randrange(1, 20000)
+                flight.save_file(stream, number + stream, offset)
+            elif action < 0.85:
+                name, cause = rng.choice(CAUSES)
+                counts[name] += 1
+                failures += boot(flight, cause, '%s reset in phase %d' % (name, flight.phase))
+                if not lib.warm_restart_is_warm():
+                    # The session starts over on the pad
+                    phases = [BOOST, COAST, DESCENT, LANDED]
+            else:
+                code = rng.randrange(1, 100)
+                reset = lib.warm_host_fatal(code)
+                expect = flight.phase in FULL_RATE and flight.restarts < RESTART_LIMIT
+                if reset != expect:
+                    failures.append('exit_error %s in phase %d after %d restarts' %
+                                    ('reset' if reset else 'halted', flight.phase, flight.restarts))
+                if reset:
+                    counts['fatal'] += 1
+                    flight.last_error = code
+                    failures += boot(flight, SYSRST, 'exit_error %d in phase %d' % (code, flight.phase))
+                else:
+                    counts['halted'] += 1
+                    failures += boot(flight, EXTRST, 'reset after a halt in phase %d' % flight.phase)
+                    if not lib.warm_restart_is_warm():
+                        phases = [BOOST, COAST, DESCENT, LANDED]
+            if failures:
+                return failures, counts
+    return failures, counts
+
+
+def check_tears(rng, tears):
+    """Resets part way through updates in flight; failures and outcome counts."""
+    failures = []
+    outcomes = {'before': 0, 'after': 0, 'cold': 0}
+    flight = Flight()
+    boot(flight, POR, 'power-on')
+    flight.save_phase(BOOST)
+    for stream in range(STREAMS):
+        flight.save_file(stream, stream, 0)
+    for n in range(tears):
+        before_block = block()
+        before = (flight.phase, list(flight.files))
+        if rng.random() < 0.1 and flight.phase != DESCENT:
+            flight.save_phase(flight.phase + 1)
+        else:
+            stream = rng.randrange(STREAMS)
+            flight.save_file(stream, stream, flight.files[stream][1] + rng.randrange(1, 1 << rng.randrange(1, 24)))
+        after_block = block()
+        after = (flight.phase, list(flight.files))
+        changed = [i for i in range(BLOCK) if before_block[i] != after_block[i]]
+        # The stores may land in any order, so any subset of the changed bytes
+        for mask in range(1, (1 << len(changed)) - 1):
+            torn = bytearray(before_block)
+            for bit, i in enumerate(changed):
+                if mask >> bit & 1:
+                    torn[i] = after_block[i]
+            set_block(torn)
+            if not lib.warm_host_boot(WDT):
+                outcomes['cold'] += 1
+                continue
+            got = (lib.warm_restart_phase(), files())
+            if got == before:
+                outcomes['before'] += 1
+            elif got == after:
+                outcomes['after'] += 1
+            else:
+                failures.append('torn update resumed phase %d, files %s; before %s, after %s' % (got + (before, after)))
+                return failures, outcomes
+        # Carry on from the finished update
+        set_block(after_block)
+        if not lib.warm_host_boot(WDT):
+            failures.append('the finished update did not boot warm')
+            return failures, outcomes
+    return failures, outcomes
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Warm restart block against injected resets')
+    parser.add_argument('--flights', type=int, default=200)
+    parser.add_argument('--tears', type=int, default=200, help='updates to tear every way')
+    parser.add_argument('--seed', type=int, default=1)
+    opts = parser.parse_args()
+    rng = random.Random(opts.seed)
+    failures = check_power_on(rng)
+    print 'power-on: ' + ('ok' if not failures else 'BAD')
+    flight_failures, counts = check_flights(rng, opts.flights)
+    print 'flights: %d, resets %s: %s' % (opts.flights, ', '.join('%s %d' % item for item in sorted(counts.items())),
+                                          'ok' if not flight_failures else 'BAD')
+    tear_failures, outcomes = check_tears(rng, opts.tears)
+    print 'torn updates: resumed before %(before)d, after %(after)d, cold %(cold)d: ' % outcomes + \
+        ('ok' if not tear_failures else 'BAD')
+    failures += flight_failures + tear_failures
+    for failure in failures[:5]:
+        print '    ' + failure
+    if failures:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,100 @@
+# Throughput of the windowed frame transfer (example/src/tasks/frame.c) over a
+# simulated serial link, for picking frame size and window. The model follows
+# frame_send_file: uart0_write returns once a frame has left the UART, the
+# board fills its window and then waits for one ack at a time, and goes back
+# to the first unacknowledged offset on a repeated ack or a timeout. Card reads
+# are not modelled. A frame or ack is lost when any of its bytes is.
+#
+#   python xfer_bench.py [--size BYTES] [--latency MS] [--ber P] [--seed N]
+import argparse
+import heapq
+import random
+
+OVERHEAD = 10           # Frame header and CRC
+ACK_BYTES = OVERHEAD
+# As in bluetooth_command.c
+ACK_TIMEOUT = 1.0
+RETRY_LIMIT = 5
+
+
+def survives(rng, length, ber):
+    return rng.random() >= 1 - (1 - ber) ** length
+
+
+def simulate(size, frame, window, baud, latency, ber, rng):
+    """Seconds to move size bytes, or None if the board gives up."""
+    rate = baud / 10.0
+    t = 0.0
+    base = sent = 0
+    expected = 0            # Host side
+    host_free = 0.0         # When the host's transmit line is next idle
+    acks = []               # (arrival at the board, offset)
+    rewound = None
+    retries = 0
+    while base < size:
+        while sent < size and (sent - base) // frame < window:
+            n = min(frame, size - sent)
+            t += (n + OVERHEAD) / rate
+            if survives(rng, n + OVERHEAD, ber):
+                arrive = t + latency
+                if sent == expected:
+                    expected += n
+                host_free = max(host_free, arrive) + ACK_BYTES / rate
+                if survives(rng, ACK_BYTES, ber):
+                    heapq.heappush(acks, (host_free + latency, expected))
+            sent += n
+        if acks and acks[0][0] <= t + ACK_TIMEOUT:
+            at, offset = heapq.heappop(acks)
+            t = max(t, at)
+            if base < offset <= sent:
+                base = offset
+                retries = 0
+            elif offset == base and sent > base and rewound != base:
+                sent = rewound = base
+        else:
+            t += ACK_TIMEOUT
+            retries += 1
+            if retries > RETRY_LIMIT:
+                return None
+            sent = base
+    return t
+
+
+def cat_survival(size, ber):
+    """The old cat command: no overhead, but a single bad byte spoils the file."""
+    return (1 - ber) ** size
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Simulated xfer throughput')
+    parser.add_argument('--size', type=int, default=64 * 1024)
+    parser.add_argument('--latency', type=float, default=30, help='one-way link latency, ms')
+    parser.add_argument('--ber', type=float, default=1e-5, help='byte error rate')
+    parser.add_argument('--runs', type=int, default=5)
+    parser.add_argument('--seed', type=int, default=1)
+    opts = parser.parse_args()
+    latency = opts.latency / 1000.0
+
+    for baud in (9600, 115200):
+        line_rate = baud / 10.0 / 1024
+        print '%d baud, line rate %.2f kB/s, %d byte file, %.0f ms latency, byte error rate %g' % (
+            baud, line_rate, opts.size, opts.latency, opts.ber)
+        print '  cat: %.2f kB/s if the file survives, which it does %.0f%% of the time' % (
+            line_rate, 100 * cat_survival(opts.size, opts.ber))
+        print '  frame  ' + ''.join('  window %-2d' % w for w in (1, 2, 4, 8))
+        for frame in (64, 128, 256, 512):
+            row = '  %5d  ' % frame
+            for window in (1, 2, 4, 8):
+                rng = random.Random(opts.seed)
+                times = [simulate(opts.size, frame, window, baud, latency, opts.ber, rng) for i in range(opts.runs)]
+                done = [x for x in times if x is not None]
+                if len(done) < len(times):
+                    row += '%11s' % ('%d failed' % (len(times) - len(done)))
+                else:
+                    row += '%6.2f kB/s' % (opts.size / 1024.0 / (sum(done) / len(done)))
+            print row
+        print
+
+
+if __name__ == '__main__':
+    main()
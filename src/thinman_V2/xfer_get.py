@@ -0,0 +1,97 @@
+# Pulls files over the Bluetooth command link with the framed "xfer" command
+# (example/src/tasks/bluetooth_command.c, frames in tasks/frame.h).
+#
+#   python xfer_get.py [-p COM8] [-o DIR] BARO1.TAB IMU1.TAB
+#
+# A file that already exists in the output directory is resumed from where it
+# ends, and an interrupted transfer is requested again from the last byte
+# received.
+import argparse
+import binascii
+import os
+import serial
+import sys
+import time
+from frame_link import FrameLink, FrameError
+
+REPLY_TIMEOUT = 5.0
+# Longer than the board's whole retry budget (6 x 1 s), so it has given up first
+FRAME_TIMEOUT = 8.0
+ATTEMPTS = 5
+# After a transfer the board drops input until the link has been quiet for 200 ms
+SETTLE = 0.3
+
+
+def xfer(sp, name, offset):
+    """Requests name from offset. Returns the size, start and length from the =X reply line."""
+    sp.write('xfer %s %d\r\n' % (name, offset))
+    deadline = time.time() + REPLY_TIMEOUT
+    line = ''
+    while not (line.startswith('=X ') and line.endswith('\n')):
+        if line.endswith('\n'):
+            line = ''
+        c = sp.read(1)
+        if not c and time.time() > deadline:
+            raise FrameError('no reply to xfer')
+        line += c
+    fields = line.split()
+    if fields[1] == 'E':
+        raise FrameError('open %s failed with error %s' % (name, fields[2]))
+    return [int(x) for x in fields[1:4]]
+
+
+def get_file(sp, link, name, out_dir):
+    path = os.path.join(out_dir, name)
+    began = time.time()
+    first = None
+    for attempt in range(ATTEMPTS):
+        offset = os.path.getsize(path) if os.path.exists(path) else 0
+        size, start, length = xfer(sp, name, offset)
+        if first is None:
+            first = start
+        if start < offset:
+            # Local copy is longer than the file on the card
+            os.remove(path)
+            continue
+        f = open(path, 'ab')
+        try:
+            crc = link.receive_range(f, start, start + length, FRAME_TIMEOUT)
+        except FrameError as e:
+            f.close()
+            print '%s: %s, resuming' % (name, e)
+            continue
+        f.close()
+        f = open(path, 'rb')
+        f.seek(start)
+        if binascii.crc32(f.read()) & 0xffffffff != crc:
+            f.close()
+            raise FrameError('%s CRC mismatch' % name)
+        f.close()
+        elapsed = time.time() - began
+        print '%-12s %8d bytes  %6.2f kB/s' % (name, size, (size - first) / 1024.0 / max(elapsed, 1e-3))
+        time.sleep(SETTLE)
+        return
+    raise FrameError('%s: giving up after %d attempts' % (name, ATTEMPTS))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Framed file transfer over the Bluetooth link')
+    parser.add_argument('-p', '--port', default='COM8')
+    parser.add_argument('-b', '--baud', type=int, default=9600)
+    parser.add_argument('-o', '--out', default='.', help='output directory')
+    parser.add_argument('names', nargs='+')
+    opts = parser.parse_args()
+
+    sp = serial.Serial(opts.port, opts.baud, timeout=0.05)
+    link = FrameLink(sp)
+    if not os.path.isdir(opts.out):
+        os.makedirs(opts.out)
+    for name in opts.names:
+        get_file(sp, link, name, opts.out)
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except FrameError as e:
+        sys.exit(str(e))